@@ -0,0 +1,163 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "generic_btle.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A benchmark runs its operation b->n times; the runner grows n until a run
+// takes long enough to time reliably and reports ns/op and bytes/op.
+struct bench {
+    uint64_t n;
+    intptr_t arg;
+
+    // Bytes produced or consumed over all n operations.
+    uint64_t bytes;
+
+    int64_t start_ns;
+    int64_t elapsed_ns;
+    bool stopped;
+
+    // Set by a case that cannot run in this configuration.
+    bool skip;
+
+    size_t metric_count;
+    struct {
+        const char* name;
+        double value;
+    } metrics[8];
+};
+
+typedef void bench_fn(struct bench* b);
+
+struct bench_case {
+    const char* name;
+    bench_fn* fn;
+    intptr_t arg;
+};
+
+// Excludes setup done so far from the measurement.
+void bench_reset_timer(struct bench* b);
+
+// Excludes the rest of the case (result checks, teardown) from the
+// measurement.
+void bench_stop_timer(struct bench* b);
+
+// Reports an extra metric for the current case, compared against the
+// baseline like ns/op.
+void bench_report(struct bench* b, const char* metric, double value);
+
+// Fixture: a gble server wired to the GATT layer the way main.c does it,
+// with `connections` simulated centrals subscribed to RX.
+struct bench_env {
+    gble_server server;
+    gble_actuator_feature actuators[32];
+    gble_sensor_feature sensors[32];
+    uint16_t conn_handles[8];
+    size_t conn_count;
+
+    // Actuator callbacks fired since setup.
+    uint64_t actuator_calls;
+};
+
+extern struct bench_env bench_env;
+
+bool bench_env_setup(size_t actuator_count, size_t sensor_count, size_t connections);
+
+// Connects and subscribes `connections` more centrals to an existing fixture.
+bool bench_env_connect(size_t connections);
+
+void bench_env_teardown(void);
+
+// Cases, registered in bench_main.c
+
+// bench_codec.c
+bench_fn bench_gble_init;
+bench_fn bench_actuators_changed;
+bench_fn bench_actuators_frame;
+bench_fn bench_set_sensor_value;
+
+// bench_actuator.c
+bench_fn bench_actuator_task_push;
+bench_fn bench_actuator_task_slow_driver;
+
+// bench_ramp.c
+bench_fn bench_ramp_jitter_trace;
+
+// bench_motion.c
+bench_fn bench_motion_linear_strokes;
+bench_fn bench_motion_rotate_reversals;
+
+// bench_pattern.c
+bench_fn bench_pattern_stream_vs_play;
+bench_fn bench_pattern_tick;
+bench_fn bench_pattern_pool_churn;
+
+// bench_jitter.c
+bench_fn bench_jitter_trace;
+
+// bench_timesync.c
+bench_fn bench_time_sync;
+
+// bench_stream.c
+bench_fn bench_stream_pressure;
+
+// bench_coalesce.c
+bench_fn bench_sensor_coalesce;
+
+// bench_notify.c
+bench_fn bench_notify_overload;
+bench_fn bench_notify_copies;
+
+// bench_static.cpp
+bench_fn bench_gble_init_static;
+
+// bench_conn.c
+bench_fn bench_conn_profile;
+bench_fn bench_conn_adaptive;
+bench_fn bench_gap_multi_central;
+
+// bench_adv.c
+bench_fn bench_gap_reconnect;
+
+// bench_broadcast.c
+bench_fn bench_sensor_broadcast;
+
+// bench_arbiter.c
+bench_fn bench_arbiter_session;
+
+// bench_gatt.c
+bench_fn bench_set_read_value;
+bench_fn bench_chr_write;
+bench_fn bench_chr_write_batch;
+bench_fn bench_chr_write_long;
+bench_fn bench_chr_read;
+bench_fn bench_set_read_value_host_busy;
+
+#ifdef __cplusplus
+}
+#endif
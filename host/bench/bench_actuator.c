@@ -0,0 +1,171 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdio.h>
+
+#include "gble_actuator_task.h"
+#include "host_sim.h"
+
+#include "bench.h"
+
+static gble_actuator_task actuator_task;
+
+// Host task cost of a write when callbacks are deferred to the actuator
+// task: decode, slot update and ring push. The task is drained outside the
+// timed loop every so often so the ring keeps cycling.
+void bench_actuator_task_push(struct bench* b)
+{
+    if (!bench_env_setup(2, 0, 0) ||
+        !gble_actuator_task_start(&actuator_task, &bench_env.server, 5))
+    {
+        b->skip = true;
+        return;
+    }
+
+    uint8_t msgs[4][3] = {
+        { 0x82, 0x00, 0x01 },
+        { 0x82, 0x01, 0x01 },
+        { 0x82, 0x00, 0x00 },
+        { 0x82, 0x01, 0x00 },
+    };
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        gble_handle_actuators_changed(&bench_env.server, msgs[idx % 4], sizeof(msgs[0]));
+        b->bytes += sizeof(msgs[0]);
+
+        if ((idx & 0xff) == 0xff)
+        {
+            gble_actuator_task_drain(&actuator_task);
+        }
+    }
+
+    bench_stop_timer(b);
+
+    gble_actuator_task_drain(&actuator_task);
+
+    if (bench_env.actuator_calls + actuator_task.stats.coalesced != b->n)
+    {
+        fprintf(stderr, "actuator_task/push: %llu callbacks, %lu coalesced for %llu writes\n",
+                (unsigned long long)bench_env.actuator_calls,
+                (unsigned long)actuator_task.stats.coalesced,
+                (unsigned long long)b->n);
+    }
+
+    bench_env_teardown();
+}
+
+// Slow motor driver simulation on the virtual clock. A central writes a
+// four-actuator batch every 7.5 ms connection interval; each callback keeps
+// the actuator task busy for `arg` microseconds, during which the
+// higher-priority host task keeps receiving writes. One op is one frame.
+#define SLOW_DRIVER_ACTUATORS   4
+#define SLOW_DRIVER_INTERVAL_US 7500
+
+static struct {
+    int64_t next_write_us;
+    uint64_t frames_written;
+    uint64_t frames;
+} slow_driver;
+
+static void slow_driver_write_due(int64_t until_us)
+{
+    while (slow_driver.frames_written < slow_driver.frames && slow_driver.next_write_us <= until_us)
+    {
+        if (host_sim_now_us() < slow_driver.next_write_us)
+        {
+            host_sim_advance_us(slow_driver.next_write_us - host_sim_now_us());
+        }
+
+        // [[0, v], [1, v], [2, v], [3, v]] with v changing every frame
+        const uint8_t value = (uint8_t)(slow_driver.frames_written % 20) + 1;
+        uint8_t frame[1 + SLOW_DRIVER_ACTUATORS * 3] = { 0x80 | SLOW_DRIVER_ACTUATORS };
+        for (size_t idx = 0; idx < SLOW_DRIVER_ACTUATORS; ++idx)
+        {
+            frame[1 + idx * 3] = 0x82;
+            frame[2 + idx * 3] = (uint8_t)idx;
+            frame[3 + idx * 3] = value;
+        }
+
+        gble_handle_actuators_changed(&bench_env.server, frame, sizeof(frame));
+
+        ++slow_driver.frames_written;
+        slow_driver.next_write_us += SLOW_DRIVER_INTERVAL_US;
+    }
+}
+
+static void slow_driver_cb(gble_actuator_id actuator_id, uint32_t value, void* context)
+{
+    const int64_t cost_us = *(const int64_t*)context;
+    const int64_t done_us = host_sim_now_us() + cost_us;
+
+    // Writes arriving while the driver is busy preempt it
+    slow_driver_write_due(done_us);
+
+    host_sim_advance_us(done_us - host_sim_now_us());
+}
+
+void bench_actuator_task_slow_driver(struct bench* b)
+{
+    int64_t cost_us = b->arg;
+
+    if (!bench_env_setup(SLOW_DRIVER_ACTUATORS, 0, 0) ||
+        !gble_actuator_task_start(&actuator_task, &bench_env.server, 5))
+    {
+        b->skip = true;
+        return;
+    }
+
+    for (size_t idx = 0; idx < SLOW_DRIVER_ACTUATORS; ++idx)
+    {
+        bench_env.actuators[idx].cb = slow_driver_cb;
+        bench_env.actuators[idx].cb_context = &cost_us;
+    }
+
+    slow_driver.next_write_us = host_sim_now_us();
+    slow_driver.frames_written = 0;
+    slow_driver.frames = b->n;
+
+    bench_reset_timer(b);
+
+    while (slow_driver.frames_written < slow_driver.frames)
+    {
+        slow_driver_write_due(slow_driver.next_write_us);
+
+        while (host_sim_task_take_notify(actuator_task.handle))
+        {
+            gble_actuator_task_drain(&actuator_task);
+        }
+    }
+
+    bench_stop_timer(b);
+
+    const gble_actuator_task_stats* stats = &actuator_task.stats;
+
+    bench_report(b, "latency_avg_us", stats->dispatched ?
+                 (double)stats->latency_us_total / stats->dispatched : 0);
+    bench_report(b, "latency_max_us", stats->latency_us_max);
+    bench_report(b, "queue_high_water", stats->queue_high_water);
+    bench_report(b, "coalesced_ratio", stats->commands ?
+                 (double)stats->coalesced / stats->commands : 0);
+
+    bench_env_teardown();
+}
@@ -0,0 +1,158 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+
+#include "host/ble_hs.h"
+
+#include "ble_func.h"
+#include "host_sim.h"
+
+#include "bench.h"
+
+// Time a central gets to find the device again before it counts as failed
+#define RECONNECT_LIMIT_US 60000000
+
+struct reconnect_case {
+    // Advertising phases; zero keeps the CONFIG_GBLE_ADV_* defaults
+    bool legacy;
+    bool bonded;
+    // Scanner of the returning central
+    uint32_t scan_interval_us;
+    uint32_t scan_window_us;
+    // How long the central stays out of range before it scans again
+    int64_t away_us;
+};
+
+static const struct reconnect_case Reconnect_cases[] = {
+    // Phone in the background, ~1% duty cycle
+    { true,  true,  1280000, 11250, 0 },
+    { false, true,  1280000, 11250, 0 },
+    // App in the foreground, 50% duty cycle
+    { true,  true,  60000,   30000, 0 },
+    { false, true,  60000,   30000, 0 },
+    // Never bonded, so nothing to direct to
+    { false, false, 1280000, 11250, 0 },
+    // Back after the fast phase ran out
+    { true,  true,  1280000, 11250, 40000000 },
+    { false, true,  1280000, 11250, 40000000 },
+};
+
+// A bonded central drops its link and scans for the device again, as a
+// phone does in the background or foreground. One op is one drop and
+// reconnect. Reports the time from when the central scans again to the
+// connection, the share of reconnects that ran out of time or came from
+// directed advertising, the advertising events sent per second from drop
+// to reconnect and the advertisement data encodes over the run.
+void bench_gap_reconnect(struct bench* b)
+{
+    const struct reconnect_case* rc = &Reconnect_cases[b->arg];
+    const uint8_t peer[6] = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x00 };
+
+    if (!bench_env_setup(1, 0, 0))
+    {
+        b->skip = true;
+        return;
+    }
+
+    if (rc->legacy)
+    {
+        // Fast undirected advertising forever, as before the phases
+        const ble_func_adv_config config = {
+            .fast_itvl_ms = CONFIG_GBLE_ADV_FAST_ITVL_MS,
+            .slow_itvl_ms = CONFIG_GBLE_ADV_SLOW_ITVL_MS,
+        };
+
+        ble_func_set_adv_config(&config);
+    }
+
+    uint16_t conn_handle;
+
+    if (host_sim_connect(peer, &conn_handle) != 0 ||
+        (rc->bonded && host_sim_bond(conn_handle) != 0))
+    {
+        b->skip = true;
+        return;
+    }
+
+    ble_func_adv_stats adv_before;
+    struct host_sim_adv_stats sim_before;
+
+    ble_func_get_adv_stats(&adv_before);
+    host_sim_adv_stats(&sim_before);
+
+    uint32_t seed = 1;
+    int64_t reconnect_us = 0;
+    int64_t reconnect_max_us = 0;
+    int64_t waited_us = 0;
+    uint64_t failed = 0;
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        host_sim_disconnect(conn_handle, BLE_ERR_CONN_SPVN_TMO);
+
+        const int64_t drop_us = host_sim_now_us();
+        host_sim_advance_us(rc->away_us);
+
+        // The scanner runs on its own schedule
+        seed = seed * 1103515245 + 12345;
+
+        const int64_t scan_us = host_sim_now_us();
+        const struct host_sim_scan scan = {
+            .start_us = scan_us - (seed >> 8) % rc->scan_interval_us,
+            .interval_us = rc->scan_interval_us,
+            .window_us = rc->scan_window_us,
+        };
+
+        if (host_sim_scan_connect(peer, &scan, scan_us + RECONNECT_LIMIT_US, &conn_handle) != 0)
+        {
+            ++failed;
+
+            // Bring it back for the next round
+            host_sim_restart_advertising();
+            host_sim_connect(peer, &conn_handle);
+        }
+
+        const int64_t elapsed_us = host_sim_now_us() - scan_us;
+
+        reconnect_us += elapsed_us;
+        reconnect_max_us = elapsed_us > reconnect_max_us ? elapsed_us : reconnect_max_us;
+        waited_us += host_sim_now_us() - drop_us;
+    }
+
+    bench_stop_timer(b);
+
+    ble_func_adv_stats adv_after;
+    struct host_sim_adv_stats sim_after;
+
+    ble_func_get_adv_stats(&adv_after);
+    host_sim_adv_stats(&sim_after);
+
+    host_sim_disconnect(conn_handle, BLE_ERR_REM_USER_CONN_TERM);
+
+    bench_report(b, "reconnect_ms_avg", reconnect_us / 1000.0 / b->n);
+    bench_report(b, "reconnect_ms_max", reconnect_max_us / 1000.0);
+    bench_report(b, "failed_ratio", (double)failed / b->n);
+    bench_report(b, "directed_ratio",
+                 (double)(adv_after.connects[BLE_FUNC_ADV_DIRECTED] - adv_before.connects[BLE_FUNC_ADV_DIRECTED]) / b->n);
+    bench_report(b, "adv_events_per_s", (sim_after.events - sim_before.events) * 1e6 / waited_us);
+    bench_report(b, "data_encodes", adv_after.data_encodes);
+}
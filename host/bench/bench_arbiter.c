@@ -0,0 +1,136 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "gatt_svr.h"
+#include "gatt_svr_priv.h"
+#include "gble_arbiter.h"
+#include "host_sim.h"
+
+#include "bench.h"
+
+// A main controller and a safety monitor on one actuator, under each
+// arbitration policy (`arg`). One op is a 4 s session: the controller
+// holds 12 with writes at 50 Hz throughout; from 1 s to 3 s the monitor,
+// ranked above it, asks for 0 at 10 Hz. Reports how much of the stop window the
+// actuator really stopped, how long after the monitor's last command the
+// controller got it back, and what the contention cost in callbacks.
+#define ARBITER_SESSION_MS 4000
+#define ARBITER_STOP_START_MS 1000
+#define ARBITER_STOP_END_MS 3000
+#define ARBITER_CONTROL_MS 20
+#define ARBITER_MONITOR_MS 100
+#define ARBITER_LEASE_MS 200
+
+static gble_arbiter arbiter;
+
+void bench_arbiter_session(struct bench* b)
+{
+    if (!bench_env_setup(1, 0, 0) ||
+        !gble_arbiter_start(&arbiter, &bench_env.server, (gble_arbiter_policy)b->arg, ARBITER_LEASE_MS))
+    {
+        b->skip = true;
+        return;
+    }
+
+    const uint16_t tx_handle = Svc_char_handles[HANDLE_MAIN_TX];
+    const uint8_t stop_msg[3] = { 0x82, 0x00, 0x00 };
+    const uint8_t control_msg[3] = { 0x82, 0x00, 0x0c };
+    const gble_actuator_feature* actuator = &bench_env.server.actuators[0];
+
+    uint64_t stop_samples = 0;
+    uint64_t stopped = 0;
+    double recovered_ms_sum = 0;
+    uint64_t unrecovered = 0;
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        if (!bench_env_connect(2))
+        {
+            b->skip = true;
+            break;
+        }
+
+        const uint16_t controller = bench_env.conn_handles[0];
+        const uint16_t monitor = bench_env.conn_handles[1];
+        const int64_t start_us = host_sim_now_us();
+        int64_t recovered_us = 0;
+
+        gble_arbiter_set_priority(&arbiter, monitor, 1);
+
+        for (uint32_t ms = 0; ms < ARBITER_SESSION_MS; ms += ARBITER_CONTROL_MS / 2)
+        {
+            host_sim_advance_us(start_us + ms * 1000LL - host_sim_now_us());
+
+            const bool stop_window = ms >= ARBITER_STOP_START_MS && ms < ARBITER_STOP_END_MS;
+
+            if (stop_window && ms % ARBITER_MONITOR_MS == ARBITER_CONTROL_MS / 2)
+            {
+                host_sim_write(monitor, tx_handle, stop_msg, sizeof(stop_msg));
+            }
+
+            if (ms % ARBITER_CONTROL_MS == 0)
+            {
+                host_sim_write(controller, tx_handle, control_msg, sizeof(control_msg));
+
+                if (stop_window && ms >= ARBITER_STOP_START_MS + ARBITER_MONITOR_MS)
+                {
+                    ++stop_samples;
+                    stopped += actuator->last_value == 0;
+                }
+                else if (ms >= ARBITER_STOP_END_MS && !recovered_us && actuator->last_value == control_msg[2])
+                {
+                    recovered_us = host_sim_now_us();
+                }
+            }
+        }
+
+        if (recovered_us)
+        {
+            const int64_t last_stop_us = start_us +
+                (ARBITER_STOP_END_MS - ARBITER_MONITOR_MS + ARBITER_CONTROL_MS / 2) * 1000LL;
+            recovered_ms_sum += (recovered_us - last_stop_us) / 1000.0;
+        }
+        else
+        {
+            ++unrecovered;
+        }
+
+        bench_env_teardown();
+    }
+
+    bench_stop_timer(b);
+
+    if (!b->skip)
+    {
+        gble_arbiter_stats stats;
+        gble_arbiter_get_stats(&arbiter, &stats);
+
+        const double session_s = b->n * ARBITER_SESSION_MS / 1000.0;
+
+        bench_report(b, "stopped_ratio", stop_samples ? (double)stopped / stop_samples : 0);
+        bench_report(b, "recovered_ms", b->n > unrecovered ? recovered_ms_sum / (b->n - unrecovered) : 0);
+        bench_report(b, "callbacks_per_s", bench_env.actuator_calls / session_s);
+        bench_report(b, "contended_per_s", stats.contended / session_s);
+        bench_report(b, "overridden_per_s", stats.overridden / session_s);
+        bench_report(b, "rejected_per_s", stats.rejected / session_s);
+        bench_report(b, "takeovers_per_op", (double)stats.takeovers / b->n);
+    }
+}
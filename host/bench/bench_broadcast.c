@@ -0,0 +1,208 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+
+#include "ble_func.h"
+#include "gble_broadcast.h"
+#include "host_sim.h"
+
+#include "bench.h"
+
+// Four sensors sampled every 10 ms for observers that only watch them,
+// either each connected and subscribed, as before, or passively reading the
+// periodic advertising of the broadcast set. One op is one sample. Reports
+// what the device sends per second and how many advertising or connection
+// PDUs that takes, and for the broadcast how far behind the latest sample
+// the observers are and whether they decoded every value.
+#define BROADCAST_SENSORS   4
+#define BROADCAST_PERIOD_US 10000
+#define BROADCAST_INSTANCE  1
+
+static gble_broadcast broadcast;
+
+static int32_t broadcast_sample(uint64_t sample, size_t sensor)
+{
+    // Sensor 0 is the sample number; the others take 1 to 3 byte varints
+    const int32_t value = (int32_t)(sample % 1000);
+    return sensor == 0 ? value : sensor & 1 ? -value * (int32_t)(sensor + 1) : value * (int32_t)sensor * 100;
+}
+
+// Decodes the broadcast the way an observer would, returning the sample it
+// carries or -1 if the data or any value is off
+static int64_t broadcast_decode(const uint8_t* data, size_t size)
+{
+    if (size < GBLE_BROADCAST_HEADER_SIZE || data[0] != size - 1 || data[1] != 0xff ||
+        data[2] != (uint8_t)CONFIG_GBLE_BROADCAST_COMPANY_ID ||
+        data[3] != (uint8_t)(CONFIG_GBLE_BROADCAST_COMPANY_ID >> 8) ||
+        data[4] != GBLE_BROADCAST_VERSION)
+    {
+        return -1;
+    }
+
+    int32_t values[BROADCAST_SENSORS];
+    size_t count = 0;
+    size_t pos = GBLE_BROADCAST_HEADER_SIZE;
+
+    while (pos < size && count < BROADCAST_SENSORS)
+    {
+        uint32_t zigzag = 0;
+        unsigned shift = 0;
+
+        do
+        {
+            zigzag |= (uint32_t)(data[pos] & 0x7f) << shift;
+            shift += 7;
+        }
+        while (data[pos++] & 0x80 && pos < size);
+
+        values[count++] = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+    }
+
+    if (count != BROADCAST_SENSORS || pos != size)
+    {
+        return -1;
+    }
+
+    for (size_t sensor = 0; sensor < BROADCAST_SENSORS; ++sensor)
+    {
+        if (values[sensor] != broadcast_sample(values[0], sensor))
+        {
+            return -1;
+        }
+    }
+
+    return values[0];
+}
+
+void bench_sensor_broadcast(struct bench* b)
+{
+    const bool periodic = b->arg < 0;
+    const size_t observers = (size_t)(periodic ? -b->arg : b->arg);
+
+    if (!bench_env_setup(1, BROADCAST_SENSORS, periodic ? 0 : observers))
+    {
+        b->skip = true;
+        return;
+    }
+
+    if (periodic)
+    {
+        if (!ble_func_get_broadcast_size_max() ||
+            !gble_broadcast_start(&broadcast, &bench_env.server, CONFIG_GBLE_BROADCAST_INTERVAL_MS,
+                                  ble_func_get_broadcast_size_max()))
+        {
+            b->skip = true;
+            return;
+        }
+
+        gble_broadcast_set_data_fn(&broadcast, ble_func_set_broadcast_data_ctx, NULL);
+    }
+
+    uint64_t notify_count = 0;
+    uint64_t notify_bytes = 0;
+    for (size_t idx = 0; idx < bench_env.conn_count; ++idx)
+    {
+        notify_count -= host_sim_conn_stats(bench_env.conn_handles[idx])->notify_count;
+        notify_bytes -= host_sim_conn_stats(bench_env.conn_handles[idx])->notify_bytes;
+    }
+
+    struct host_sim_ext_adv_stats ext_before;
+    host_sim_ext_adv_stats(BROADCAST_INSTANCE, &ext_before);
+
+    const int64_t start_us = host_sim_now_us();
+    uint64_t observed = 0;
+    uint64_t behind = 0;
+    uint64_t decode_errors = 0;
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        for (size_t sensor = 0; sensor < BROADCAST_SENSORS; ++sensor)
+        {
+            gble_set_sensor_value(&bench_env.server, bench_env.sensors[sensor].id,
+                                  broadcast_sample(idx, sensor));
+        }
+
+        host_sim_advance_us(BROADCAST_PERIOD_US);
+
+        for (size_t observer = 0; periodic && observer < observers; ++observer)
+        {
+            uint8_t data[GBLE_BROADCAST_MAX_DATA_SIZE];
+            size_t size;
+
+            // Nothing to read before the first update
+            if (host_sim_observe(BROADCAST_INSTANCE, data, sizeof(data), &size) != 0 || !size)
+            {
+                continue;
+            }
+
+            const int64_t sample = broadcast_decode(data, size);
+            if (sample < 0)
+            {
+                ++decode_errors;
+                continue;
+            }
+
+            behind += (idx % 1000 + 1000 - (uint64_t)sample) % 1000;
+            ++observed;
+        }
+    }
+
+    bench_stop_timer(b);
+
+    const double seconds = (host_sim_now_us() - start_us) / 1e6;
+
+    bench_report(b, "observers", (double)observers);
+
+    if (periodic)
+    {
+        struct host_sim_ext_adv_stats ext_after;
+        host_sim_ext_adv_stats(BROADCAST_INSTANCE, &ext_after);
+
+        gble_broadcast_stats stats;
+        gble_broadcast_get_stats(&broadcast, &stats);
+        gble_broadcast_stop(&broadcast);
+
+        bench_report(b, "sends_per_s", (ext_after.periodic_data_sets - ext_before.periodic_data_sets) / seconds);
+        bench_report(b, "sent_bytes_per_s", (ext_after.data_bytes - ext_before.data_bytes) / seconds);
+        bench_report(b, "pdus_per_s",
+                     (ext_after.events - ext_before.events +
+                      ext_after.periodic_events - ext_before.periodic_events) / seconds);
+        bench_report(b, "data_size", stats.updates ? (double)stats.bytes / stats.updates : 0);
+        bench_report(b, "stale_ms_avg", observed ? behind * (BROADCAST_PERIOD_US / 1000.0) / observed : 0);
+        bench_report(b, "decode_errors", (double)decode_errors);
+    }
+    else
+    {
+        for (size_t idx = 0; idx < bench_env.conn_count; ++idx)
+        {
+            notify_count += host_sim_conn_stats(bench_env.conn_handles[idx])->notify_count;
+            notify_bytes += host_sim_conn_stats(bench_env.conn_handles[idx])->notify_bytes;
+        }
+
+        // One notification is one PDU on its connection
+        bench_report(b, "sends_per_s", notify_count / seconds);
+        bench_report(b, "sent_bytes_per_s", notify_bytes / seconds);
+        bench_report(b, "pdus_per_s", notify_count / seconds);
+    }
+
+    bench_env_teardown();
+}
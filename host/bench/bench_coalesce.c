@@ -0,0 +1,152 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+
+#include "cbor.h"
+
+#include "gatt_svr.h"
+#include "host_sim.h"
+
+#include "bench.h"
+
+// Four sensors updated back to back every 20 ms, as main.c does with two,
+// on the virtual clock to one central with a 247 byte ATT MTU. The case
+// argument is the coalescing window in ms, 0 for off; negative marks sensor
+// 0 urgent with a window of -arg. One op is one simulated second. Reports
+// notifications per second, the share of updates that did not need their
+// own notification, and the latency from update to notification.
+#define COALESCE_SENSORS   4
+#define COALESCE_PERIOD_US 20000
+
+static struct {
+    int64_t updated_us[COALESCE_SENSORS];
+    uint64_t values;
+    double latency_us;
+    double latency_max_us;
+} coalesce_trace;
+
+static void coalesce_record_value(CborValue* pair)
+{
+    CborValue element;
+    uint64_t id = 0;
+
+    if (cbor_value_enter_container(pair, &element) != CborNoError ||
+        cbor_value_get_uint64(&element, &id) != CborNoError || id >= COALESCE_SENSORS)
+    {
+        return;
+    }
+
+    const double latency_us = (double)(host_sim_now_us() - coalesce_trace.updated_us[id]);
+
+    coalesce_trace.latency_us += latency_us;
+    coalesce_trace.latency_max_us = latency_us > coalesce_trace.latency_max_us ? latency_us : coalesce_trace.latency_max_us;
+    ++coalesce_trace.values;
+}
+
+static void coalesce_record(uint8_t* buf, size_t buf_size, gble_sensor_priority priority, void* context)
+{
+    CborParser parser;
+    CborValue value;
+    CborValue element;
+
+    if (cbor_parser_init(buf, buf_size, 0, &parser, &value) == CborNoError &&
+        cbor_value_enter_container(&value, &element) == CborNoError)
+    {
+        if (cbor_value_is_array(&element))
+        {
+            while (!cbor_value_at_end(&element))
+            {
+                coalesce_record_value(&element);
+                cbor_value_advance(&element);
+            }
+        }
+        else
+        {
+            cbor_parser_init(buf, buf_size, 0, &parser, &value);
+            coalesce_record_value(&value);
+        }
+    }
+
+    gatt_svr_notify_read_value(buf, buf_size, priority);
+}
+
+void bench_sensor_coalesce(struct bench* b)
+{
+    const uint32_t window_ms = (uint32_t)(b->arg < 0 ? -b->arg : b->arg);
+
+    if (!bench_env_setup(0, COALESCE_SENSORS, 1))
+    {
+        b->skip = true;
+        return;
+    }
+
+    bench_env.sensors[0].urgent = b->arg < 0;
+    gble_set_sensor_callback_fn(&bench_env.server, coalesce_record, NULL);
+    gble_set_sensor_frame_size_fn(&bench_env.server, gatt_svr_get_notify_size_max_ctx, NULL);
+    host_sim_exchange_mtu(bench_env.conn_handles[0], 247);
+
+    if (window_ms > 0 && !gble_set_sensor_coalescing(&bench_env.server, window_ms))
+    {
+        b->skip = true;
+        return;
+    }
+
+    memset(&coalesce_trace, 0, sizeof(coalesce_trace));
+
+    const struct host_sim_conn_stats* link = host_sim_conn_stats(bench_env.conn_handles[0]);
+    const uint32_t notify_count = link->notify_count;
+    const uint64_t notify_bytes = link->notify_bytes;
+
+    const int64_t start_us = host_sim_now_us();
+    const int64_t end_us = start_us + (int64_t)b->n * 1000000;
+    int32_t value = 0;
+    uint64_t updates = 0;
+
+    bench_reset_timer(b);
+
+    for (int64_t now_us = start_us; now_us < end_us; now_us += COALESCE_PERIOD_US)
+    {
+        value = (value + 1) % 1000;
+
+        // Sensor 0, the urgent one, changes last so it carries the others
+        for (size_t idx = COALESCE_SENSORS; idx-- > 0;)
+        {
+            coalesce_trace.updated_us[idx] = now_us;
+            gble_set_sensor_value(&bench_env.server, bench_env.sensors[idx].id, value);
+            ++updates;
+        }
+
+        host_sim_advance_us(COALESCE_PERIOD_US);
+    }
+
+    bench_stop_timer(b);
+
+    const uint32_t notifies = link->notify_count - notify_count;
+    b->bytes = link->notify_bytes - notify_bytes;
+
+    bench_report(b, "notifies_per_s", (double)notifies / b->n);
+    bench_report(b, "saved_ratio", 1.0 - (double)notifies / updates);
+    bench_report(b, "latency_ms_avg", coalesce_trace.latency_us / coalesce_trace.values / 1000.0);
+    bench_report(b, "latency_ms_max", coalesce_trace.latency_max_us / 1000.0);
+    bench_report(b, "delivered_ratio", (double)coalesce_trace.values / updates);
+
+    gble_set_sensor_coalescing(&bench_env.server, 0);
+    bench_env_teardown();
+}
@@ -0,0 +1,231 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+
+// gble_init with `arg` actuators and `arg` sensors; bytes/op is the size of
+// the descriptor it encodes.
+void bench_gble_init(struct bench* b)
+{
+    static char names[64][16];
+    gble_actuator_feature actuators[32];
+    gble_sensor_feature sensors[32];
+    const size_t count = (size_t)b->arg;
+
+    if (count > COUNT_OF(actuators))
+    {
+        b->skip = true;
+        return;
+    }
+
+    for (size_t idx = 0; idx < count; ++idx)
+    {
+        snprintf(names[idx], sizeof(names[idx]), "Actuator %zu", idx + 1);
+        snprintf(names[32 + idx], sizeof(names[32 + idx]), "Sensor %zu", idx + 1);
+
+        actuators[idx] = (gble_actuator_feature) {
+            .description = names[idx],
+            .feature_type = GBLE_ACTUATOR_TYPE_VIBRATE,
+            .step_range_low = 0,
+            .step_range_high = 20,
+            .message_type = GBLE_ACTUATOR_MSG_SCALAR,
+        };
+
+        sensors[idx] = (gble_sensor_feature) {
+            .description = names[32 + idx],
+            .feature_type = GBLE_SENSOR_TYPE_PRESSURE,
+            .value_range_low = 0,
+            .value_range_high = 1000,
+            .message_type = GBLE_SENSOR_MSG_SUBSCRIBE,
+        };
+    }
+
+    static gble_server server;
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        if (!gble_init(&server, "Bench Device", actuators, count, sensors, count))
+        {
+            // The descriptor outgrew its buffer at this feature count.
+            b->skip = true;
+            return;
+        }
+
+        b->bytes += server.descriptor_size;
+    }
+
+    bench_report(b, "descriptor_size", server.descriptor_size);
+}
+
+// Actuator message encodings, selected by the case argument
+#define ACTUATOR_MSG_SMALL  0   // [id, 0..23], the common case
+#define ACTUATOR_MSG_UINT32 1   // [id, 0xffffffff], still canonical
+#define ACTUATOR_MSG_UINT64 2   // values in 8-byte form, only tinycbor takes these
+
+// Decodes alternating [id, value] writes for two actuators; every write
+// changes the value so each one reaches the actuator callback.
+void bench_actuators_changed(struct bench* b)
+{
+    if (!bench_env_setup(2, 0, 0))
+    {
+        b->skip = true;
+        return;
+    }
+
+    uint8_t msgs[4][11];
+    size_t msg_size;
+
+    for (size_t idx = 0; idx < COUNT_OF(msgs); ++idx)
+    {
+        const uint8_t id = idx & 1;
+        const uint8_t value = (idx >> 1) ^ 1;
+
+        msgs[idx][0] = 0x82;
+        msgs[idx][1] = id;
+
+        switch (b->arg)
+        {
+            case ACTUATOR_MSG_UINT32:
+                msgs[idx][2] = 0x1a;
+                memset(&msgs[idx][3], value ? 0xff : 0x00, 4);
+                msg_size = 7;
+                break;
+
+            case ACTUATOR_MSG_UINT64:
+                msgs[idx][2] = 0x1b;
+                memset(&msgs[idx][3], 0, 7);
+                msgs[idx][10] = value;
+                msg_size = 11;
+                break;
+
+            default:
+                msgs[idx][2] = value;
+                msg_size = 3;
+                break;
+        }
+    }
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        uint8_t* msg = msgs[idx % COUNT_OF(msgs)];
+        gble_handle_actuators_changed(&bench_env.server, msg, msg_size);
+        b->bytes += msg_size;
+    }
+
+    bench_stop_timer(b);
+
+    if (bench_env.actuator_calls != b->n)
+    {
+        fprintf(stderr, "actuators_changed: %llu callbacks for %llu writes\n",
+                (unsigned long long)bench_env.actuator_calls, (unsigned long long)b->n);
+    }
+
+    bench_env_teardown();
+}
+
+static void count_applied(size_t changed_count, void* context)
+{
+    ++*(uint64_t*)context;
+}
+
+// Four actuators per frame, either as one [[id, value], ...] batch (arg 1)
+// or as four separate [id, value] writes (arg 0); one op is one frame.
+void bench_actuators_frame(struct bench* b)
+{
+    const bool batched = b->arg != 0;
+
+    if (!bench_env_setup(4, 0, 0))
+    {
+        b->skip = true;
+        return;
+    }
+
+    uint64_t applied_calls = 0;
+    gble_set_actuators_applied_callback_fn(&bench_env.server, count_applied, &applied_calls);
+
+    uint8_t batch[2][13] = {
+        { 0x84, 0x82, 0x00, 0x01, 0x82, 0x01, 0x02, 0x82, 0x02, 0x03, 0x82, 0x03, 0x04 },
+        { 0x84, 0x82, 0x00, 0x05, 0x82, 0x01, 0x06, 0x82, 0x02, 0x07, 0x82, 0x03, 0x08 },
+    };
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        uint8_t* frame = batch[idx & 1];
+
+        if (batched)
+        {
+            gble_handle_actuators_changed(&bench_env.server, frame, sizeof(batch[0]));
+            b->bytes += sizeof(batch[0]);
+        }
+        else
+        {
+            for (size_t pair = 0; pair < 4; ++pair)
+            {
+                gble_handle_actuators_changed(&bench_env.server, &frame[1 + pair * 3], 3);
+                b->bytes += 3;
+            }
+        }
+    }
+
+    bench_stop_timer(b);
+
+    bench_report(b, "writes_per_op", batched ? 1 : 4);
+    bench_report(b, "group_updates_per_op", (double)applied_calls / b->n);
+
+    bench_env_teardown();
+}
+
+static void count_sensor_bytes(uint8_t* buf, size_t buf_size, gble_sensor_priority priority, void* context)
+{
+    struct bench* b = context;
+    b->bytes += buf_size;
+}
+
+// Encodes [id, value] sensor frames into a callback that only counts them,
+// so the GATT layer is not part of the measurement.
+void bench_set_sensor_value(struct bench* b)
+{
+    if (!bench_env_setup(0, 2, 0))
+    {
+        b->skip = true;
+        return;
+    }
+
+    gble_set_sensor_callback_fn(&bench_env.server, count_sensor_bytes, b);
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        gble_set_sensor_value(&bench_env.server, idx & 1, (int32_t)(idx & 0x3ff));
+    }
+
+    bench_stop_timer(b);
+
+    bench_env_teardown();
+}
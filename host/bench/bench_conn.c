@@ -0,0 +1,381 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+
+#include "ble_conn_profile.h"
+#include "ble_func.h"
+#include "gatt_svr.h"
+#include "gatt_svr_priv.h"
+#include "host/ble_hs.h"
+#include "host_sim.h"
+
+#include "bench.h"
+
+// Connection profiles against simulated centrals. One op is one connection:
+// connect, run the virtual clock until every request of the profile is
+// answered (retries included), disconnect. Reports what was granted, how
+// many parameter requests it took and how long after connecting the link
+// settled.
+#define CONN_SETTLE_LIMIT_US 30000000
+
+struct conn_case {
+    ble_conn_profile_id profile;
+    struct host_sim_central central;
+};
+
+static const struct conn_case conn_cases[] = {
+    // Grants everything
+    [0] = { BLE_CONN_PROFILE_LOW_LATENCY, { 6, 0, true, 251, 517 } },
+    // No faster than 15 ms, 185 byte MTU
+    [1] = { BLE_CONN_PROFILE_LOW_LATENCY, { 12, 0, true, 251, 185 } },
+    // No faster than 30 ms: 7.5-15 ms is refused, 7.5-30 ms granted
+    [2] = { BLE_CONN_PROFILE_LOW_LATENCY, { 24, 0, true, 251, 517 } },
+    // Refuses every parameter update
+    [3] = { BLE_CONN_PROFILE_LOW_LATENCY, { 6, 255, true, 251, 517 } },
+    // Bluetooth 4.1: 1M only, 27 byte PDUs, no MTU exchange, 30 ms floor
+    [4] = { BLE_CONN_PROFILE_LOW_LATENCY, { 24, 0, false, 27, 23 } },
+    [5] = { BLE_CONN_PROFILE_THROUGHPUT, { 6, 0, true, 251, 517 } },
+    [6] = { BLE_CONN_PROFILE_LOW_POWER, { 6, 0, true, 251, 517 } },
+    [7] = { BLE_CONN_PROFILE_NONE, { 6, 0, true, 251, 517 } },
+};
+
+void bench_conn_profile(struct bench* b)
+{
+    const struct conn_case* conn_case = &conn_cases[b->arg];
+
+    if (!bench_env_setup(0, 0, 0))
+    {
+        b->skip = true;
+        return;
+    }
+
+    ble_conn_profile_set_default(conn_case->profile);
+    host_sim_set_central(&conn_case->central);
+
+    const uint8_t peer[6] = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 };
+
+    ble_conn_profile_status status = { 0 };
+    double settle_ms_sum = 0;
+    uint64_t unsettled = 0;
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        if (!host_sim_advertising())
+        {
+            host_sim_restart_advertising();
+        }
+
+        uint16_t conn_handle;
+        if (host_sim_connect(peer, &conn_handle) != 0)
+        {
+            b->skip = true;
+            break;
+        }
+
+        host_sim_advance_us(CONN_SETTLE_LIMIT_US);
+
+        ble_conn_profile_get_status(conn_handle, &status);
+        if (status.settled_us)
+        {
+            settle_ms_sum += (status.settled_us - status.connected_us) / 1000.0;
+        }
+        else
+        {
+            ++unsettled;
+        }
+
+        host_sim_disconnect(conn_handle, BLE_ERR_REM_USER_CONN_TERM);
+    }
+
+    bench_stop_timer(b);
+
+    if (!b->skip)
+    {
+        bench_report(b, "settle_ms", b->n > unsettled ? settle_ms_sum / (b->n - unsettled) : 0);
+        bench_report(b, "unsettled_ratio", (double)unsettled / b->n);
+        bench_report(b, "mtu", status.mtu);
+        bench_report(b, "tx_octets", status.tx_octets);
+        bench_report(b, "phy", status.tx_phy);
+        bench_report(b, "itvl_ms", status.itvl * 1.25);
+        bench_report(b, "param_requests", status.param_requests);
+        bench_report(b, "params_granted", status.params_granted);
+    }
+
+    bench_env_teardown();
+}
+
+// Adaptive parameters over an actuator session. One op is one connection
+// running the same trace: CONN_SESSION_CYCLES times an idle stretch
+// followed by a burst of commands at 50 Hz. A command the central writes
+// goes out at the next connection event the peripheral listens to, every
+// (1 + latency) intervals, so its latency is the wait for that event. The
+// events listened to per second stand in for radio energy. Idle stretches
+// vary by up to CONN_SESSION_JITTER_US so bursts don't line up with the
+// connection events.
+#define CONN_SESSION_CYCLES 3
+#define CONN_SESSION_IDLE_US 8000000
+#define CONN_SESSION_JITTER_US 1000000
+#define CONN_SESSION_BURST_US 2000000
+#define CONN_SESSION_CMD_US 20000
+#define CONN_SESSION_STEP_US 10000
+
+struct conn_session {
+    uint16_t conn_handle;
+    int64_t anchor_us;
+    double listen_events;
+};
+
+static int64_t conn_session_listen_us(const struct conn_session* session)
+{
+    struct ble_gap_conn_desc desc;
+    if (ble_gap_conn_find(session->conn_handle, &desc) != 0)
+    {
+        return CONN_SESSION_STEP_US;
+    }
+
+    return (int64_t)(1 + desc.conn_latency) * desc.conn_itvl * 1250;
+}
+
+static void conn_session_advance_to(struct conn_session* session, int64_t target_us)
+{
+    while (host_sim_now_us() < target_us)
+    {
+        const int64_t remaining_us = target_us - host_sim_now_us();
+        const int64_t step_us = remaining_us < CONN_SESSION_STEP_US ? remaining_us : CONN_SESSION_STEP_US;
+
+        session->listen_events += (double)step_us / conn_session_listen_us(session);
+        host_sim_advance_us(step_us);
+    }
+}
+
+void bench_conn_adaptive(struct bench* b)
+{
+    if (!bench_env_setup(2, 0, 0))
+    {
+        b->skip = true;
+        return;
+    }
+
+    switch (b->arg)
+    {
+        case 0:
+            ble_conn_profile_set_default(BLE_CONN_PROFILE_LOW_LATENCY);
+            break;
+
+        case 1:
+            ble_conn_profile_set_default(BLE_CONN_PROFILE_LOW_POWER);
+            break;
+
+        default:
+            ble_conn_profile_set_adaptive(BLE_CONN_PROFILE_LOW_LATENCY, BLE_CONN_PROFILE_LOW_POWER,
+                                          CONFIG_GBLE_CONN_IDLE_MS);
+            break;
+    }
+
+    const struct host_sim_central central = { 6, 0, true, 251, 517 };
+    host_sim_set_central(&central);
+
+    const uint16_t tx_handle = Svc_char_handles[HANDLE_MAIN_TX];
+    const uint8_t msgs[2][3] = {
+        { 0x82, 0x00, 0x01 },
+        { 0x82, 0x00, 0x00 },
+    };
+
+    ble_conn_profile_status status = { 0 };
+    double latency_ms_sum = 0;
+    double first_ms_sum = 0;
+    double listen_events = 0;
+    double low_power_us = 0;
+    double session_us = 0;
+    uint64_t commands = 0;
+    uint64_t wakes = 0;
+    int64_t wake_us_max = 0;
+    uint32_t seed = 1;
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        if (!bench_env_connect(1))
+        {
+            b->skip = true;
+            break;
+        }
+
+        struct conn_session session = {
+            .conn_handle = bench_env.conn_handles[bench_env.conn_count - 1],
+            .anchor_us = host_sim_now_us(),
+        };
+
+        int64_t delivered_us = session.anchor_us;
+        int64_t burst_end_us = session.anchor_us;
+
+        for (int cycle = 0; cycle < CONN_SESSION_CYCLES; ++cycle)
+        {
+            seed = seed * 1103515245 + 12345;
+
+            const int64_t burst_us = burst_end_us + CONN_SESSION_IDLE_US + (seed >> 8) % CONN_SESSION_JITTER_US;
+            burst_end_us = burst_us + CONN_SESSION_BURST_US;
+
+            for (int64_t cmd_us = burst_us; cmd_us < burst_end_us; cmd_us += CONN_SESSION_CMD_US)
+            {
+                conn_session_advance_to(&session, cmd_us);
+
+                // Commands written while the peripheral sleeps go out
+                // together at the event it next listens to
+                if (cmd_us > delivered_us)
+                {
+                    const int64_t listen_us = conn_session_listen_us(&session);
+                    delivered_us = cmd_us + (listen_us - (cmd_us - session.anchor_us) % listen_us) % listen_us;
+                    conn_session_advance_to(&session, delivered_us);
+                }
+
+                host_sim_write(session.conn_handle, tx_handle, msgs[commands & 1], sizeof(msgs[0]));
+
+                const double latency_ms = (delivered_us - cmd_us) / 1000.0;
+                latency_ms_sum += latency_ms;
+                first_ms_sum += cmd_us == burst_us ? latency_ms : 0;
+                ++commands;
+            }
+        }
+
+        conn_session_advance_to(&session, burst_end_us + CONN_SESSION_IDLE_US);
+
+        ble_conn_profile_get_status(session.conn_handle, &status);
+        listen_events += session.listen_events;
+        low_power_us += status.profile_us[BLE_CONN_PROFILE_LOW_POWER];
+        session_us += host_sim_now_us() - session.anchor_us;
+        wakes += status.wakes;
+        wake_us_max = status.wake_us_max > wake_us_max ? status.wake_us_max : wake_us_max;
+
+        bench_env_teardown();
+    }
+
+    bench_stop_timer(b);
+
+    if (!b->skip && commands)
+    {
+        bench_report(b, "cmd_latency_ms_avg", latency_ms_sum / commands);
+        bench_report(b, "first_cmd_ms", first_ms_sum / ((double)b->n * CONN_SESSION_CYCLES));
+        bench_report(b, "listen_events_per_s", listen_events * 1e6 / session_us);
+        bench_report(b, "low_power_ratio", low_power_us / session_us);
+        bench_report(b, "wakes_per_session", (double)wakes / b->n);
+        bench_report(b, "wake_ms_max", wake_us_max / 1000.0);
+        bench_report(b, "param_requests", status.param_requests);
+    }
+
+    bench_env_teardown();
+}
+
+// `arg` centrals connecting one after the other, each only while the
+// application advertises: no restart from the driver. Each exchanges its own
+// MTU, subscribes and writes a command; then a sensor frame goes out and
+// the first central drops. One op is one such round. Reports connections
+// made, whether advertising stopped at the limit and came back after the
+// drop, and whether each central kept its own state.
+void bench_gap_multi_central(struct bench* b)
+{
+    const size_t centrals = (size_t)b->arg;
+
+    if (!bench_env_setup(1, 0, 0) || centrals > CONFIG_BT_NIMBLE_MAX_CONNECTIONS)
+    {
+        b->skip = true;
+        return;
+    }
+
+    const uint16_t tx_handle = Svc_char_handles[HANDLE_MAIN_TX];
+    const uint16_t rx_handle = Svc_char_handles[HANDLE_MAIN_RX];
+    const uint8_t msgs[2][3] = {
+        { 0x82, 0x00, 0x01 },
+        { 0x82, 0x00, 0x00 },
+    };
+    const uint8_t frame[4] = { 0x82, 0x00, 0x18, 0x2a };
+
+    uint16_t conn_handles[CONFIG_BT_NIMBLE_MAX_CONNECTIONS];
+    uint32_t notify_counts[CONFIG_BT_NIMBLE_MAX_CONNECTIONS];
+    uint64_t connected = 0;
+    uint64_t adv_at_limit = 0;
+    uint64_t readvertised = 0;
+    uint64_t mismatches = 0;
+    uint64_t notified = 0;
+    uint64_t writes = 0;
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        size_t count = 0;
+
+        for (; count < centrals && host_sim_advertising(); ++count)
+        {
+            const uint8_t peer[6] = { 0x10, 0x20, 0x30, 0x40, 0x50, (uint8_t)count };
+
+            if (host_sim_connect(peer, &conn_handles[count]) != 0)
+            {
+                break;
+            }
+
+            host_sim_exchange_mtu(conn_handles[count], 64 + 32 * count);
+            host_sim_subscribe(conn_handles[count], rx_handle, true, false);
+            host_sim_write(conn_handles[count], tx_handle, msgs[writes & 1], sizeof(msgs[0]));
+            notify_counts[count] = host_sim_conn_stats(conn_handles[count])->notify_count;
+            ++writes;
+        }
+
+        connected += count;
+        adv_at_limit += count == CONFIG_BT_NIMBLE_MAX_CONNECTIONS && host_sim_advertising();
+
+        gatt_svr_set_read_value(frame, sizeof(frame));
+
+        ble_func_conn_info infos[CONFIG_BT_NIMBLE_MAX_CONNECTIONS];
+        mismatches += ble_func_get_conns(infos, COUNT_OF(infos)) != count;
+
+        for (size_t conn = 0; conn < count; ++conn)
+        {
+            ble_func_conn_info info;
+            if (!ble_func_get_conn(conn_handles[conn], &info) ||
+                info.mtu != 64 + 32 * conn || info.subscriptions != 1 || info.peer_addr[5] != conn)
+            {
+                ++mismatches;
+            }
+
+            notified += host_sim_conn_stats(conn_handles[conn])->notify_count > notify_counts[conn];
+        }
+
+        for (size_t conn = 0; conn < count; ++conn)
+        {
+            host_sim_disconnect(conn_handles[conn], BLE_ERR_REM_USER_CONN_TERM);
+            readvertised += conn == 0 && host_sim_advertising();
+        }
+    }
+
+    bench_stop_timer(b);
+
+    bench_report(b, "connected_per_op", (double)connected / b->n);
+    bench_report(b, "adv_at_limit_ratio", (double)adv_at_limit / b->n);
+    bench_report(b, "readvertised_ratio", (double)readvertised / b->n);
+    bench_report(b, "state_mismatches", mismatches);
+    bench_report(b, "notified_ratio", connected ? (double)notified / connected : 0);
+    bench_report(b, "actuator_calls_per_write", writes ? (double)bench_env.actuator_calls / writes : 0);
+
+    bench_env_teardown();
+}
@@ -0,0 +1,157 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "ble_conn_profile.h"
+#include "ble_func.h"
+#include "gatt_svr.h"
+#include "gatt_svr_priv.h"
+#include "host_sim.h"
+
+#include "bench.h"
+
+struct bench_env bench_env;
+
+static char names[64][16];
+
+static void handle_client_disconnected(uint16_t conn_handle, void* context)
+{
+    gatt_svr_client_disconnected_ctx(conn_handle, NULL);
+    gble_client_disconnected(&bench_env.server, conn_handle);
+}
+
+static void count_actuator_change(gble_actuator_id actuator_id, uint32_t value, void* context)
+{
+    ++bench_env.actuator_calls;
+}
+
+bool bench_env_setup(size_t actuator_count, size_t sensor_count, size_t connections)
+{
+    if (actuator_count > COUNT_OF(bench_env.actuators) ||
+        sensor_count > COUNT_OF(bench_env.sensors) ||
+        connections > COUNT_OF(bench_env.conn_handles) ||
+        connections > HOST_SIM_MAX_CONNECTIONS)
+    {
+        return false;
+    }
+
+    memset(&bench_env, 0, sizeof(bench_env));
+
+    for (size_t idx = 0; idx < actuator_count; ++idx)
+    {
+        snprintf(names[idx], sizeof(names[idx]), "Actuator %zu", idx + 1);
+
+        bench_env.actuators[idx] = (gble_actuator_feature) {
+            .description = names[idx],
+            .feature_type = GBLE_ACTUATOR_TYPE_VIBRATE,
+            .step_range_low = 0,
+            .step_range_high = 20,
+            .message_type = GBLE_ACTUATOR_MSG_SCALAR,
+            .cb = count_actuator_change,
+        };
+    }
+
+    for (size_t idx = 0; idx < sensor_count; ++idx)
+    {
+        snprintf(names[32 + idx], sizeof(names[32 + idx]), "Sensor %zu", idx + 1);
+
+        bench_env.sensors[idx] = (gble_sensor_feature) {
+            .description = names[32 + idx],
+            .feature_type = GBLE_SENSOR_TYPE_PRESSURE,
+            .value_range_low = 0,
+            .value_range_high = 1000,
+            .message_type = GBLE_SENSOR_MSG_SUBSCRIBE,
+        };
+    }
+
+    if (!gble_init(&bench_env.server, "Bench Device",
+                   bench_env.actuators, actuator_count,
+                   bench_env.sensors, sensor_count))
+    {
+        return false;
+    }
+
+    if (!ble_init(gatt_svr_init))
+    {
+        return false;
+    }
+
+    // Centrals keep the link they connect with unless a case asks for a
+    // profile; see bench_conn.c
+    ble_conn_profile_set_default(BLE_CONN_PROFILE_NONE);
+    ble_conn_profile_set_adaptive(BLE_CONN_PROFILE_NONE, BLE_CONN_PROFILE_NONE, 0);
+
+    ble_func_register_disconnect_cb(handle_client_disconnected, NULL);
+    ble_func_register_subscribe_cb(gatt_svr_handle_subscribe_ctx, NULL);
+    ble_func_register_notify_tx_cb(gatt_svr_handle_notify_tx_ctx, NULL);
+
+    gatt_svr_register_descriptor_cb(gble_get_descriptor_ctx, &bench_env.server);
+    gatt_svr_register_write_cb(gble_handle_actuators_changed_ctx, &bench_env.server);
+    gatt_svr_register_write_reader_cb(gble_handle_actuators_changed_reader_ctx, &bench_env.server);
+    gatt_svr_register_write_activity_cb(ble_conn_profile_note_command_ctx, NULL);
+
+    gble_set_sensor_callback_fn(&bench_env.server, gatt_svr_set_read_value_ctx, NULL);
+    gatt_svr_register_notify_key_cb(gble_get_sensor_frame_key_ctx, NULL);
+
+    return bench_env_connect(connections);
+}
+
+bool bench_env_connect(size_t connections)
+{
+    if (bench_env.conn_count + connections > COUNT_OF(bench_env.conn_handles) ||
+        bench_env.conn_count + connections > HOST_SIM_MAX_CONNECTIONS)
+    {
+        return false;
+    }
+
+    for (size_t count = 0; count < connections; ++count)
+    {
+        const size_t idx = bench_env.conn_count;
+        const uint8_t peer[6] = { 0x10, 0x20, 0x30, 0x40, 0x50, (uint8_t)idx };
+
+        if (!host_sim_advertising())
+        {
+            host_sim_restart_advertising();
+        }
+
+        if (host_sim_connect(peer, &bench_env.conn_handles[idx]) != 0)
+        {
+            return false;
+        }
+
+        host_sim_subscribe(bench_env.conn_handles[idx], Svc_char_handles[HANDLE_MAIN_RX], true, false);
+        ++bench_env.conn_count;
+    }
+
+    return true;
+}
+
+void bench_env_teardown(void)
+{
+    for (size_t idx = 0; idx < bench_env.conn_count; ++idx)
+    {
+        host_sim_disconnect(bench_env.conn_handles[idx], BLE_ERR_REM_USER_CONN_TERM);
+    }
+
+    bench_env.conn_count = 0;
+}
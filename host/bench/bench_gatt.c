@@ -0,0 +1,289 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gatt_svr.h"
+#include "gatt_svr_priv.h"
+#include "host_sim.h"
+
+#include "bench.h"
+
+// Sensor value fan-out to `arg` subscribed centrals, through the notify
+// access callback into the simulated link; bytes/op counts what reached the
+// links. A negative `arg` hands out sparse connection handles (0x40, 0x80,
+// ...) the way some controllers do.
+void bench_set_read_value(struct bench* b)
+{
+    const bool sparse = b->arg < 0;
+    const size_t connections = (size_t)(sparse ? -b->arg : b->arg);
+
+    if (!bench_env_setup(0, 1, 0))
+    {
+        b->skip = true;
+        return;
+    }
+
+    if (sparse)
+    {
+        host_sim_set_conn_handles(0x40, 0x40);
+    }
+
+    if (!bench_env_connect(connections))
+    {
+        bench_env_teardown();
+        b->skip = true;
+        return;
+    }
+
+    uint8_t frames[2][4] = {
+        { 0x82, 0x00, 0x18, 0x2a },
+        { 0x82, 0x00, 0x18, 0x2b },
+    };
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        gatt_svr_set_read_value(frames[idx & 1], sizeof(frames[0]));
+    }
+
+    bench_stop_timer(b);
+
+    uint64_t notifies = 0;
+    for (size_t idx = 0; idx < bench_env.conn_count; ++idx)
+    {
+        const struct host_sim_conn_stats* stats = host_sim_conn_stats(bench_env.conn_handles[idx]);
+        notifies += stats->notify_count;
+        b->bytes += stats->notify_bytes;
+    }
+
+    bench_report(b, "notifies_per_op", (double)notifies / b->n);
+
+    struct host_sim_mbuf_stats mbuf_stats;
+    host_sim_mbuf_stats(&mbuf_stats);
+    bench_report(b, "mbuf_high_water", mbuf_stats.blocks_high_water);
+
+    bench_env_teardown();
+}
+
+// A central writing [id, value] to TX: ATT access callback, mbuf flattening
+// and the decode in gble.
+void bench_chr_write(struct bench* b)
+{
+    if (!bench_env_setup(2, 0, 1))
+    {
+        b->skip = true;
+        return;
+    }
+
+    const uint16_t tx_handle = Svc_char_handles[HANDLE_MAIN_TX];
+    const uint16_t conn_handle = bench_env.conn_handles[0];
+
+    uint8_t msgs[4][3] = {
+        { 0x82, 0x00, 0x01 },
+        { 0x82, 0x01, 0x01 },
+        { 0x82, 0x00, 0x00 },
+        { 0x82, 0x01, 0x00 },
+    };
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        host_sim_write(conn_handle, tx_handle, msgs[idx % 4], sizeof(msgs[0]));
+        b->bytes += sizeof(msgs[0]);
+    }
+
+    bench_stop_timer(b);
+    bench_env_teardown();
+}
+
+// Writes a 16 command batch, alternating values so every command lands.
+// The stub builds the write from blocks of arg bytes (0 for the default
+// size), so small ones leave it in pieces as a long write or short ACL
+// packets do; those are parsed through the mbuf chain reader.
+void bench_chr_write_batch(struct bench* b)
+{
+    const uint16_t block_size = b->arg ? (uint16_t)b->arg : CONFIG_BT_NIMBLE_MSYS_1_BLOCK_SIZE;
+
+    host_sim_mbuf_configure(block_size, CONFIG_BT_NIMBLE_MSYS_1_BLOCK_COUNT);
+
+    if (!bench_env_setup(GBLE_MAX_ACTUATOR_BATCH, 0, 1))
+    {
+        host_sim_mbuf_configure(CONFIG_BT_NIMBLE_MSYS_1_BLOCK_SIZE, CONFIG_BT_NIMBLE_MSYS_1_BLOCK_COUNT);
+        b->skip = true;
+        return;
+    }
+
+    const uint16_t tx_handle = Svc_char_handles[HANDLE_MAIN_TX];
+    const uint16_t conn_handle = bench_env.conn_handles[0];
+
+    uint8_t msgs[2][1 + GBLE_MAX_ACTUATOR_BATCH * 3];
+    for (size_t msg = 0; msg < 2; ++msg)
+    {
+        msgs[msg][0] = 0x80 | GBLE_MAX_ACTUATOR_BATCH;
+        for (size_t idx = 0; idx < GBLE_MAX_ACTUATOR_BATCH; ++idx)
+        {
+            msgs[msg][1 + idx * 3] = 0x82;
+            msgs[msg][2 + idx * 3] = (uint8_t)idx;
+            msgs[msg][3 + idx * 3] = (uint8_t)(msg + 1);
+        }
+    }
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        host_sim_write(conn_handle, tx_handle, msgs[idx & 1], sizeof(msgs[0]));
+        b->bytes += sizeof(msgs[0]);
+    }
+
+    bench_stop_timer(b);
+
+    bench_report(b, "actuator_calls_per_op", (double)bench_env.actuator_calls / b->n);
+    bench_report(b, "pieces_per_write", (double)((sizeof(msgs[0]) + block_size - 1) / block_size));
+
+    bench_env_teardown();
+    host_sim_mbuf_configure(CONFIG_BT_NIMBLE_MSYS_1_BLOCK_SIZE, CONFIG_BT_NIMBLE_MSYS_1_BLOCK_COUNT);
+}
+
+// A batch past the old 256 byte limit on writes: every id and value as a
+// full 64 bit CBOR integer makes 16 commands 305 bytes.
+void bench_chr_write_long(struct bench* b)
+{
+    if (!bench_env_setup(GBLE_MAX_ACTUATOR_BATCH, 0, 1))
+    {
+        b->skip = true;
+        return;
+    }
+
+    const uint16_t tx_handle = Svc_char_handles[HANDLE_MAIN_TX];
+    const uint16_t conn_handle = bench_env.conn_handles[0];
+
+    uint8_t msgs[2][1 + GBLE_MAX_ACTUATOR_BATCH * 19] = { 0 };
+    for (size_t msg = 0; msg < 2; ++msg)
+    {
+        msgs[msg][0] = 0x80 | GBLE_MAX_ACTUATOR_BATCH;
+        for (size_t idx = 0; idx < GBLE_MAX_ACTUATOR_BATCH; ++idx)
+        {
+            uint8_t* command = &msgs[msg][1 + idx * 19];
+            command[0] = 0x82;
+            command[1] = 0x1b;
+            command[9] = (uint8_t)idx;
+            command[10] = 0x1b;
+            command[18] = (uint8_t)(msg + 1);
+        }
+    }
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        host_sim_write(conn_handle, tx_handle, msgs[idx & 1], sizeof(msgs[0]));
+        b->bytes += sizeof(msgs[0]);
+    }
+
+    bench_stop_timer(b);
+
+    bench_report(b, "actuator_calls_per_op", (double)bench_env.actuator_calls / b->n);
+
+    bench_env_teardown();
+}
+
+// A central reading RX while the value changes between reads: the read
+// copies the published buffer without the notify lock.
+void bench_chr_read(struct bench* b)
+{
+    if (!bench_env_setup(0, 1, 1))
+    {
+        b->skip = true;
+        return;
+    }
+
+    const uint16_t rx_handle = Svc_char_handles[HANDLE_MAIN_RX];
+    const uint16_t conn_handle = bench_env.conn_handles[0];
+
+    uint8_t frame[16] = { 0x82, 0x00, 0x18, 0x2a };
+    gatt_svr_set_read_value(frame, sizeof(frame));
+
+    uint8_t buf[GATT_SVR_NOTIFY_VALUE_MAX];
+    uint16_t len = 0;
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        host_sim_read(conn_handle, rx_handle, buf, sizeof(buf), &len);
+        b->bytes += len;
+    }
+
+    bench_stop_timer(b);
+    bench_env_teardown();
+}
+
+// The application task sets `arg` values while the host task is busy; the
+// values are queued there and sent in one pump when it gets to the event.
+void bench_set_read_value_host_busy(struct bench* b)
+{
+    const size_t burst = (size_t)b->arg;
+
+    if (!bench_env_setup(0, 1, 1))
+    {
+        b->skip = true;
+        return;
+    }
+
+    uint8_t frame[4] = { 0x82, 0x00, 0x18, 0x00 };
+    uint64_t latest_ok = 0;
+    uint64_t bursts = 0;
+
+    const uint32_t events_start = host_sim_host_events();
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; idx += burst)
+    {
+        host_sim_hold_host_task();
+
+        for (size_t value = 0; value < burst; ++value)
+        {
+            frame[3] = (uint8_t)(idx + value);
+            gatt_svr_set_read_value(frame, sizeof(frame));
+        }
+
+        host_sim_release_host_task();
+
+        const struct host_sim_conn_stats* stats = host_sim_conn_stats(bench_env.conn_handles[0]);
+        latest_ok += stats->last_len == sizeof(frame) && memcmp(stats->last, frame, sizeof(frame)) == 0;
+        ++bursts;
+    }
+
+    bench_stop_timer(b);
+
+    const struct host_sim_conn_stats* stats = host_sim_conn_stats(bench_env.conn_handles[0]);
+    b->bytes = stats->notify_bytes;
+
+    bench_report(b, "host_events_per_op", (double)(host_sim_host_events() - events_start) / b->n);
+    bench_report(b, "notifies_per_op", (double)stats->notify_count / b->n);
+    bench_report(b, "latest_sent_ratio", (double)latest_ok / bursts);
+
+    bench_env_teardown();
+}
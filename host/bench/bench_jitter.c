@@ -0,0 +1,182 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gble_jitter.h"
+#include "host_sim.h"
+
+#include "bench.h"
+
+// Jittered stream on the virtual clock, as in ramp/jitter_trace: a value
+// every 20 ms, each delivered on a 7.5 ms connection event delayed by zero
+// to three extra events, in order. The case argument is the playout delay
+// in ms, or -1 to apply writes on arrival as untimed messages. One op is one
+// simulated second. Reports how far the intervals between actuator
+// callbacks stray from the 20 ms the client sent at, the latency from send
+// to callback, and the share of commands that arrived late or to an empty
+// queue.
+#define JITTER_SEND_PERIOD_US 20000
+#define JITTER_CONN_ITVL_US   7500
+
+static gble_jitter_buffer jitter;
+
+static struct {
+    int64_t last_us;
+    uint64_t intervals;
+    double interval_error_us;
+    double latency_us;
+    uint64_t callbacks;
+    int64_t sent_us[256];
+} jitter_trace;
+
+static uint32_t jitter_rand(uint32_t* state)
+{
+    // xorshift32, so every run sees the same trace
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static void jitter_record(gble_actuator_id actuator_id, uint32_t value, void* context)
+{
+    const int64_t now_us = host_sim_now_us();
+
+    if (jitter_trace.last_us >= 0)
+    {
+        jitter_trace.interval_error_us += fabs((double)(now_us - jitter_trace.last_us - JITTER_SEND_PERIOD_US));
+        ++jitter_trace.intervals;
+    }
+
+    jitter_trace.last_us = now_us;
+    jitter_trace.latency_us += now_us - jitter_trace.sent_us[value];
+    ++jitter_trace.callbacks;
+}
+
+void bench_jitter_trace(struct bench* b)
+{
+    const bool timed = b->arg >= 0;
+
+    if (!bench_env_setup(1, 0, 0))
+    {
+        b->skip = true;
+        return;
+    }
+
+    // Values are a sequence number, so every message is a change
+    bench_env.actuators[0].step_range_high = 255;
+    bench_env.actuators[0].cb = jitter_record;
+
+    memset(&jitter_trace, 0, sizeof(jitter_trace));
+    jitter_trace.last_us = -1;
+
+    if (timed && !gble_jitter_start(&jitter, &bench_env.server, CONFIG_GBLE_JITTER_TICK_HZ, b->arg))
+    {
+        b->skip = true;
+        return;
+    }
+
+    uint32_t rng = 0x2545f491;
+    const int64_t start_us = host_sim_now_us();
+    const int64_t end_us = start_us + (int64_t)b->n * 1000000;
+
+    int64_t next_send_us = start_us;
+    int64_t last_delivery_us = start_us;
+
+    // Sent but not yet delivered, in order
+    struct {
+        int64_t delivery_us;
+        uint32_t timestamp_ms;
+        uint8_t value;
+    } in_flight[8];
+    size_t in_flight_count = 0;
+    uint8_t sequence = 1;
+
+    bench_reset_timer(b);
+
+    for (int64_t now_us = start_us; now_us < end_us; now_us += 250)
+    {
+        if (now_us >= next_send_us && in_flight_count < COUNT_OF(in_flight))
+        {
+            int64_t delivery_us = (now_us / JITTER_CONN_ITVL_US + 1 + jitter_rand(&rng) % 4) * JITTER_CONN_ITVL_US;
+            if (delivery_us < last_delivery_us)
+            {
+                delivery_us = last_delivery_us;
+            }
+            last_delivery_us = delivery_us;
+
+            in_flight[in_flight_count].delivery_us = delivery_us;
+            in_flight[in_flight_count].timestamp_ms = (uint32_t)(now_us / 1000);
+            in_flight[in_flight_count].value = sequence;
+            ++in_flight_count;
+
+            jitter_trace.sent_us[sequence] = now_us;
+            ++sequence;
+            next_send_us += JITTER_SEND_PERIOD_US;
+        }
+
+        while (in_flight_count > 0 && now_us >= in_flight[0].delivery_us)
+        {
+            const uint32_t ts = in_flight[0].timestamp_ms;
+            uint8_t timed_msg[] = {
+                0x83, 0x27, 0x1a, ts >> 24, ts >> 16, ts >> 8, ts,
+                0x82, 0x00, 0x18, in_flight[0].value,
+            };
+            uint8_t msg[] = { 0x82, 0x00, 0x18, in_flight[0].value };
+
+            if (timed)
+            {
+                gble_handle_actuators_changed(&bench_env.server, timed_msg, sizeof(timed_msg));
+                b->bytes += sizeof(timed_msg);
+            }
+            else
+            {
+                gble_handle_actuators_changed(&bench_env.server, msg, sizeof(msg));
+                b->bytes += sizeof(msg);
+            }
+
+            --in_flight_count;
+            memmove(&in_flight[0], &in_flight[1], in_flight_count * sizeof(in_flight[0]));
+        }
+
+        host_sim_advance_us(250);
+    }
+
+    bench_stop_timer(b);
+
+    bench_report(b, "interval_err_us_avg", jitter_trace.interval_error_us / jitter_trace.intervals);
+    bench_report(b, "latency_ms_avg", jitter_trace.latency_us / jitter_trace.callbacks / 1000.0);
+
+    if (timed)
+    {
+        gble_jitter_stats stats;
+        gble_jitter_get_stats(&jitter, &stats);
+
+        bench_report(b, "late_ratio", (double)stats.late / stats.queued);
+        bench_report(b, "underrun_ratio", (double)stats.underruns / stats.queued);
+
+        gble_jitter_stop(&jitter);
+    }
+
+    bench_env_teardown();
+}
@@ -0,0 +1,428 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Benchmark runner. Results are written as a JSON array with one
+// {"case", "metric", "value"} record per line, which is also the baseline
+// format, so a results file can be promoted to a baseline as-is:
+//
+//   gble_bench --out results.json --baseline baseline.json
+//
+// Every metric is lower-is-better. The exit status is 2 when any metric
+// regressed by more than --tolerance against the baseline.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "gatt_svr.h"
+
+#include "bench.h"
+
+static const struct bench_case cases[] = {
+    { "gble_init/1",                    bench_gble_init,            1 },
+    { "gble_init/4",                    bench_gble_init,            4 },
+    { "gble_init/8",                    bench_gble_init,            8 },
+    { "gble_init/16",                   bench_gble_init,            16 },
+    { "gble_init_static/4",             bench_gble_init_static,     4 },
+    { "gble_handle_actuators_changed",  bench_actuators_changed,    0 },
+    { "gble_handle_actuators_changed/uint32", bench_actuators_changed, 1 },
+    { "gble_handle_actuators_changed/tinycbor", bench_actuators_changed, 2 },
+    { "actuator_frame/4x_single",       bench_actuators_frame,      0 },
+    { "actuator_frame/4x_batch",        bench_actuators_frame,      1 },
+    { "actuator_task/push",             bench_actuator_task_push,   0 },
+    { "actuator_task/driver_500us",     bench_actuator_task_slow_driver, 500 },
+    { "actuator_task/driver_2500us",    bench_actuator_task_slow_driver, 2500 },
+    { "ramp/jitter_trace/step",         bench_ramp_jitter_trace,    0 },
+    { "ramp/jitter_trace/linear",       bench_ramp_jitter_trace,    1 },
+    { "ramp/jitter_trace/exponential",  bench_ramp_jitter_trace,    2 },
+    { "ramp/jitter_trace/s_curve",      bench_ramp_jitter_trace,    3 },
+    { "motion/linear_strokes",          bench_motion_linear_strokes, 0 },
+    { "motion/rotate_reversals",        bench_motion_rotate_reversals, 0 },
+    { "pattern/stream_vs_play",         bench_pattern_stream_vs_play, 0 },
+    { "pattern/tick/2",                 bench_pattern_tick, 2 },
+    { "pattern/tick/16",                bench_pattern_tick, 16 },
+    { "pattern/pool_churn",             bench_pattern_pool_churn, 0 },
+    { "jitter/trace/immediate",         bench_jitter_trace,         -1 },
+    { "jitter/trace/0ms",               bench_jitter_trace,         0 },
+    { "jitter/trace/30ms",              bench_jitter_trace,         30 },
+    { "jitter/trace/60ms",              bench_jitter_trace,         60 },
+    { "time_sync/7.5ms",                bench_time_sync,            7500 },
+    { "time_sync/30ms",                 bench_time_sync,            30000 },
+    { "stream/1khz/single",             bench_stream_pressure,      0 },
+    { "stream/1khz/5ms",                bench_stream_pressure,      5 },
+    { "stream/1khz/20ms",               bench_stream_pressure,      20 },
+    { "stream/1khz/1000ms",             bench_stream_pressure,      1000 },
+    { "sensor_coalesce/4x/off",         bench_sensor_coalesce,      0 },
+    { "sensor_coalesce/4x/10ms",        bench_sensor_coalesce,      10 },
+    { "sensor_coalesce/4x/10ms_urgent", bench_sensor_coalesce,      -10 },
+    { "notify_queue/overload/drop_oldest", bench_notify_overload, GATT_SVR_NOTIFY_DROP_OLDEST },
+    { "notify_queue/overload/merge_latest", bench_notify_overload, GATT_SVR_NOTIFY_MERGE_LATEST },
+    { "notify_copy/1",                  bench_notify_copies,        1 },
+    { "notify_copy/3",                  bench_notify_copies,        3 },
+    { "conn_profile/low_latency/accepting",  bench_conn_profile, 0 },
+    { "conn_profile/low_latency/15ms_floor", bench_conn_profile, 1 },
+    { "conn_profile/low_latency/30ms_floor", bench_conn_profile, 2 },
+    { "conn_profile/low_latency/refusing",   bench_conn_profile, 3 },
+    { "conn_profile/low_latency/bt41",       bench_conn_profile, 4 },
+    { "conn_profile/throughput/accepting",   bench_conn_profile, 5 },
+    { "conn_profile/low_power/accepting",    bench_conn_profile, 6 },
+    { "conn_profile/none/accepting",         bench_conn_profile, 7 },
+    { "conn_adaptive/fixed_low_latency",     bench_conn_adaptive, 0 },
+    { "conn_adaptive/fixed_low_power",       bench_conn_adaptive, 1 },
+    { "conn_adaptive/adaptive",              bench_conn_adaptive, 2 },
+    { "gap/multi_central/1",                 bench_gap_multi_central, 1 },
+    { "gap/multi_central/2",                 bench_gap_multi_central, 2 },
+    { "gap/multi_central/3",                 bench_gap_multi_central, 3 },
+    { "gap/reconnect/legacy/background",     bench_gap_reconnect, 0 },
+    { "gap/reconnect/phased/background",     bench_gap_reconnect, 1 },
+    { "gap/reconnect/legacy/foreground",     bench_gap_reconnect, 2 },
+    { "gap/reconnect/phased/foreground",     bench_gap_reconnect, 3 },
+    { "gap/reconnect/phased/unbonded",       bench_gap_reconnect, 4 },
+    { "gap/reconnect/legacy/late",           bench_gap_reconnect, 5 },
+    { "gap/reconnect/phased/late",           bench_gap_reconnect, 6 },
+    { "broadcast/notify/1",                  bench_sensor_broadcast, 1 },
+    { "broadcast/notify/3",                  bench_sensor_broadcast, 3 },
+    { "broadcast/periodic/1",                bench_sensor_broadcast, -1 },
+    { "broadcast/periodic/3",                bench_sensor_broadcast, -3 },
+    { "broadcast/periodic/32",               bench_sensor_broadcast, -32 },
+    { "arbiter/last_write",                  bench_arbiter_session, 0 },
+    { "arbiter/exclusive",                   bench_arbiter_session, 1 },
+    { "arbiter/priority",                    bench_arbiter_session, 2 },
+    { "arbiter/max",                         bench_arbiter_session, 3 },
+    { "arbiter/sum",                         bench_arbiter_session, 4 },
+    { "gble_set_sensor_value",          bench_set_sensor_value,     0 },
+    { "gatt_svr_chr_access/tx_write",   bench_chr_write,            0 },
+    { "gatt_svr_chr_access/tx_batch",   bench_chr_write_batch,      0 },
+    { "gatt_svr_chr_access/tx_batch/27B_pieces", bench_chr_write_batch, 27 },
+    { "gatt_svr_chr_access/tx_write_long", bench_chr_write_long,    0 },
+    { "gatt_svr_chr_access/rx_read",    bench_chr_read,             0 },
+    { "gatt_svr_set_read_value/1",      bench_set_read_value,       1 },
+    { "gatt_svr_set_read_value/2",      bench_set_read_value,       2 },
+    { "gatt_svr_set_read_value/3",      bench_set_read_value,       3 },
+    { "gatt_svr_set_read_value/4",      bench_set_read_value,       4 },
+    { "gatt_svr_set_read_value/8",      bench_set_read_value,       8 },
+    { "gatt_svr_set_read_value/3/sparse_handles", bench_set_read_value, -3 },
+    { "gatt_svr_set_read_value/host_busy/1", bench_set_read_value_host_busy, 1 },
+    { "gatt_svr_set_read_value/host_busy/8", bench_set_read_value_host_busy, 8 },
+};
+
+#define MAX_RESULTS 256
+
+struct result {
+    char name[96];
+    char metric[48];
+    double value;
+};
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void bench_reset_timer(struct bench* b)
+{
+    b->start_ns = now_ns();
+}
+
+void bench_stop_timer(struct bench* b)
+{
+    if (!b->stopped)
+    {
+        b->elapsed_ns = now_ns() - b->start_ns;
+        b->stopped = true;
+    }
+}
+
+void bench_report(struct bench* b, const char* metric, double value)
+{
+    for (size_t idx = 0; idx < b->metric_count; ++idx)
+    {
+        if (strcmp(b->metrics[idx].name, metric) == 0)
+        {
+            b->metrics[idx].value = value;
+            return;
+        }
+    }
+
+    if (b->metric_count < sizeof(b->metrics) / sizeof(b->metrics[0]))
+    {
+        b->metrics[b->metric_count].name = metric;
+        b->metrics[b->metric_count].value = value;
+        ++b->metric_count;
+    }
+}
+
+static void run_once(const struct bench_case* bc, struct bench* b, uint64_t n)
+{
+    memset(b, 0, sizeof(*b));
+    b->n = n;
+    b->arg = bc->arg;
+
+    b->start_ns = now_ns();
+    bc->fn(b);
+    bench_stop_timer(b);
+}
+
+static void run_case(const struct bench_case* bc, struct bench* b, int64_t min_time_ns)
+{
+    uint64_t n = 1;
+
+    for (;;)
+    {
+        run_once(bc, b, n);
+
+        if (b->skip || b->elapsed_ns >= min_time_ns || n >= 1000000000)
+        {
+            return;
+        }
+
+        // Aim 20% past the target, growing at most 100x per round.
+        uint64_t next = b->elapsed_ns > 0 ?
+                        (uint64_t)((double)n * min_time_ns * 1.2 / b->elapsed_ns) :
+                        n * 100;
+
+        if (next > n * 100)
+        {
+            next = n * 100;
+        }
+
+        n = next > n ? next : n + 1;
+    }
+}
+
+static size_t add_result(struct result* results, size_t count,
+                         const char* name, const char* metric, double value)
+{
+    if (count == MAX_RESULTS)
+    {
+        return count;
+    }
+
+    snprintf(results[count].name, sizeof(results[count].name), "%s", name);
+    snprintf(results[count].metric, sizeof(results[count].metric), "%s", metric);
+    results[count].value = value;
+    return count + 1;
+}
+
+static size_t load_results(const char* path, struct result* results)
+{
+    FILE* f = fopen(path, "r");
+    if (!f)
+    {
+        return 0;
+    }
+
+    size_t count = 0;
+    char line[256];
+
+    while (count < MAX_RESULTS && fgets(line, sizeof(line), f))
+    {
+        struct result* r = &results[count];
+        if (sscanf(line, " {\"case\": \"%95[^\"]\", \"metric\": \"%47[^\"]\", \"value\": %lf}",
+                   r->name, r->metric, &r->value) == 3)
+        {
+            ++count;
+        }
+    }
+
+    fclose(f);
+    return count;
+}
+
+static bool write_results(const char* path, const struct result* results, size_t count)
+{
+    FILE* f = fopen(path, "w");
+    if (!f)
+    {
+        return false;
+    }
+
+    fprintf(f, "[\n");
+    for (size_t idx = 0; idx < count; ++idx)
+    {
+        fprintf(f, "{\"case\": \"%s\", \"metric\": \"%s\", \"value\": %.3f}%s\n",
+                results[idx].name, results[idx].metric, results[idx].value,
+                idx + 1 < count ? "," : "");
+    }
+    fprintf(f, "]\n");
+
+    return fclose(f) == 0;
+}
+
+static const struct result* find_result(const struct result* results, size_t count,
+                                        const char* name, const char* metric)
+{
+    for (size_t idx = 0; idx < count; ++idx)
+    {
+        if (strcmp(results[idx].name, name) == 0 && strcmp(results[idx].metric, metric) == 0)
+        {
+            return &results[idx];
+        }
+    }
+
+    return NULL;
+}
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr,
+            "usage: %s [--filter SUBSTR] [--out FILE] [--baseline FILE]\n"
+            "          [--tolerance FRACTION] [--min-time-ms MS]\n",
+            argv0);
+}
+
+int main(int argc, char** argv)
+{
+    const char* filter = NULL;
+    const char* out_path = "bench_results.json";
+    const char* baseline_path = NULL;
+    double tolerance = 0.15;
+    int64_t min_time_ns = 200 * 1000000LL;
+
+    for (int idx = 1; idx < argc; ++idx)
+    {
+        const char* arg = argv[idx];
+        const char* value = idx + 1 < argc ? argv[idx + 1] : NULL;
+
+        if (!value)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+
+        if (strcmp(arg, "--filter") == 0)
+        {
+            filter = value;
+        }
+        else if (strcmp(arg, "--out") == 0)
+        {
+            out_path = value;
+        }
+        else if (strcmp(arg, "--baseline") == 0)
+        {
+            baseline_path = value;
+        }
+        else if (strcmp(arg, "--tolerance") == 0)
+        {
+            tolerance = strtod(value, NULL);
+        }
+        else if (strcmp(arg, "--min-time-ms") == 0)
+        {
+            min_time_ns = strtoll(value, NULL, 0) * 1000000LL;
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+
+        ++idx;
+    }
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    static struct result results[MAX_RESULTS];
+    size_t result_count = 0;
+
+    printf("%-40s %12s %12s %12s\n", "case", "iterations", "ns/op", "bytes/op");
+
+    for (size_t idx = 0; idx < sizeof(cases) / sizeof(cases[0]); ++idx)
+    {
+        const struct bench_case* bc = &cases[idx];
+        if (filter && !strstr(bc->name, filter))
+        {
+            continue;
+        }
+
+        struct bench b;
+        run_case(bc, &b, min_time_ns);
+
+        if (b.skip)
+        {
+            printf("%-40s %12s\n", bc->name, "skipped");
+            continue;
+        }
+
+        double ns_per_op = (double)b.elapsed_ns / b.n;
+        double bytes_per_op = (double)b.bytes / b.n;
+
+        printf("%-40s %12llu %12.1f %12.1f", bc->name, (unsigned long long)b.n,
+               ns_per_op, bytes_per_op);
+        for (size_t m = 0; m < b.metric_count; ++m)
+        {
+            printf("  %s=%.3f", b.metrics[m].name, b.metrics[m].value);
+        }
+        printf("\n");
+
+        result_count = add_result(results, result_count, bc->name, "ns_per_op", ns_per_op);
+        result_count = add_result(results, result_count, bc->name, "bytes_per_op", bytes_per_op);
+        for (size_t m = 0; m < b.metric_count; ++m)
+        {
+            result_count = add_result(results, result_count, bc->name,
+                                      b.metrics[m].name, b.metrics[m].value);
+        }
+    }
+
+    if (!write_results(out_path, results, result_count))
+    {
+        fprintf(stderr, "failed to write %s\n", out_path);
+        return 1;
+    }
+
+    if (!baseline_path)
+    {
+        return 0;
+    }
+
+    static struct result baseline[MAX_RESULTS];
+    size_t baseline_count = load_results(baseline_path, baseline);
+    if (baseline_count == 0)
+    {
+        fprintf(stderr, "no baseline results in %s\n", baseline_path);
+        return 1;
+    }
+
+    int regressions = 0;
+
+    printf("\n%-40s %-14s %12s %12s %9s\n", "case", "metric", "baseline", "current", "delta");
+
+    for (size_t idx = 0; idx < result_count; ++idx)
+    {
+        const struct result* cur = &results[idx];
+        const struct result* base = find_result(baseline, baseline_count, cur->name, cur->metric);
+        if (!base)
+        {
+            continue;
+        }
+
+        double delta = base->value != 0 ? (cur->value - base->value) / base->value :
+                       (cur->value != 0 ? 1.0 : 0.0);
+        bool regressed = delta > tolerance;
+        regressions += regressed;
+
+        printf("%-40s %-14s %12.1f %12.1f %+8.1f%%%s\n", cur->name, cur->metric,
+               base->value, cur->value, delta * 100, regressed ? "  REGRESSED" : "");
+    }
+
+    return regressions ? 2 : 0;
+}
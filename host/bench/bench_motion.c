@@ -0,0 +1,187 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include "gble_motion.h"
+#include "host_sim.h"
+
+#include "bench.h"
+
+// Motion planner simulations on the virtual clock, ticking at 1 kHz with
+// 1000 steps/s and 4000 steps/s^2 limits. One op is one command.
+#define MOTION_TICK_HZ      1000
+#define MOTION_MAX_VELOCITY 1000.0f
+#define MOTION_MAX_ACCEL    4000.0f
+
+static gble_motion_engine motion;
+
+static struct {
+    float last_velocity;
+    float max_accel;
+    float max_speed;
+} motion_trace;
+
+static void motion_output(gble_actuator_id actuator_id, float position, float velocity, void* context)
+{
+    const float accel = fabsf(velocity - motion_trace.last_velocity) * MOTION_TICK_HZ;
+
+    motion_trace.max_accel = fmaxf(motion_trace.max_accel, accel);
+    motion_trace.max_speed = fmaxf(motion_trace.max_speed, fabsf(velocity));
+    motion_trace.last_velocity = velocity;
+}
+
+static bool motion_setup(gble_actuator_msg message_type, uint32_t range_high)
+{
+    if (!bench_env_setup(1, 0, 0))
+    {
+        return false;
+    }
+
+    bench_env.actuators[0].message_type = message_type;
+    bench_env.actuators[0].feature_type = message_type == GBLE_ACTUATOR_MSG_ROTATE ?
+                                          GBLE_ACTUATOR_TYPE_ROTATE : GBLE_ACTUATOR_TYPE_POSITION;
+    bench_env.actuators[0].step_range_high = range_high;
+    bench_env.actuators[0].command_cb = gble_motion_command_cb;
+    bench_env.actuators[0].cb_context = &motion;
+
+    motion_trace.last_velocity = 0;
+    motion_trace.max_accel = 0;
+    motion_trace.max_speed = 0;
+
+    return gble_motion_start(&motion, &bench_env.server, MOTION_TICK_HZ) &&
+           gble_motion_configure(&motion, 0, MOTION_MAX_VELOCITY, MOTION_MAX_ACCEL) &&
+           gble_motion_set_output_fn(&motion, 0, motion_output, NULL);
+}
+
+// Full strokes between 0 and 100 as [0, position, 400], one every 400 ms.
+// Reports how late each stroke arrives against its requested duration and
+// the peak acceleration against the limit. Streaming the same stroke as
+// position updates at 50 Hz would take 20 writes.
+#define STROKE_DURATION_MS 400
+
+void bench_motion_linear_strokes(struct bench* b)
+{
+    if (!motion_setup(GBLE_ACTUATOR_MSG_LINEAR, 100))
+    {
+        b->skip = true;
+        return;
+    }
+
+    double late_ms_total = 0;
+    double late_ms_max = 0;
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        const uint8_t position = (idx & 1) ? 0 : 100;
+        uint8_t msg[] = { 0x83, 0x00, 0x18, position, 0x19, STROKE_DURATION_MS >> 8, STROKE_DURATION_MS & 0xff };
+
+        gble_handle_actuators_changed(&bench_env.server, msg, sizeof(msg));
+        b->bytes += sizeof(msg);
+
+        const int64_t sent_us = host_sim_now_us();
+
+        // Run until arrival, or until the next stroke is due
+        int64_t arrived_us = -1;
+        while (host_sim_now_us() - sent_us < 2 * STROKE_DURATION_MS * 1000)
+        {
+            host_sim_advance_us(1000000 / MOTION_TICK_HZ);
+
+            if (motion.channels[0].position == position && motion.channels[0].velocity == 0)
+            {
+                arrived_us = host_sim_now_us();
+                break;
+            }
+        }
+
+        const double late_ms = arrived_us < 0 ? STROKE_DURATION_MS :
+                               (arrived_us - sent_us) / 1000.0 - STROKE_DURATION_MS;
+        late_ms_total += late_ms;
+        late_ms_max = fmax(late_ms_max, late_ms);
+
+        // Wait out the rest of the stroke period, at rest
+        const int64_t next_us = sent_us + STROKE_DURATION_MS * 1000;
+        if (host_sim_now_us() < next_us)
+        {
+            host_sim_advance_us(next_us - host_sim_now_us());
+        }
+    }
+
+    bench_stop_timer(b);
+
+    bench_report(b, "late_ms_avg", late_ms_total / b->n);
+    bench_report(b, "late_ms_max", late_ms_max);
+    bench_report(b, "accel_over_limit", motion_trace.max_accel / MOTION_MAX_ACCEL);
+    bench_report(b, "stretched_ratio", (double)motion.stats.stretched / b->n);
+
+    gble_motion_stop(&motion);
+    bench_env_teardown();
+}
+
+// Direction reversals at 500 steps/s as [0, 500, clockwise], one every
+// 400 ms. Reports the peak acceleration against the limit and the time to
+// settle at the new speed.
+void bench_motion_rotate_reversals(struct bench* b)
+{
+    if (!motion_setup(GBLE_ACTUATOR_MSG_ROTATE, 1000))
+    {
+        b->skip = true;
+        return;
+    }
+
+    double settle_ms_total = 0;
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        const bool clockwise = !(idx & 1);
+        uint8_t msg[] = { 0x83, 0x00, 0x19, 0x01, 0xf4, clockwise ? 0xf5 : 0xf4 };
+
+        gble_handle_actuators_changed(&bench_env.server, msg, sizeof(msg));
+        b->bytes += sizeof(msg);
+
+        const float wanted = clockwise ? 500.0f : -500.0f;
+        const int64_t sent_us = host_sim_now_us();
+        int64_t settled_us = -1;
+
+        while (host_sim_now_us() - sent_us < 400000)
+        {
+            host_sim_advance_us(1000000 / MOTION_TICK_HZ);
+
+            if (settled_us < 0 && motion.channels[0].velocity == wanted)
+            {
+                settled_us = host_sim_now_us();
+            }
+        }
+
+        settle_ms_total += settled_us < 0 ? 400 : (settled_us - sent_us) / 1000.0;
+    }
+
+    bench_stop_timer(b);
+
+    bench_report(b, "settle_ms_avg", settle_ms_total / b->n);
+    bench_report(b, "accel_over_limit", motion_trace.max_accel / MOTION_MAX_ACCEL);
+
+    gble_motion_stop(&motion);
+    bench_env_teardown();
+}
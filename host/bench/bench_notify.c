@@ -0,0 +1,205 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#include "gatt_svr.h"
+#include "host_sim.h"
+
+#include "bench.h"
+
+// An overloaded link on the virtual clock: 100 byte bulk frames every 2 ms
+// and a 4 byte urgent event every 50 ms to one central whose 7.5 ms
+// connection events carry two packets each, about half the bulk rate.
+// Notifications wait in the stub's link queue holding their mbufs, from a
+// pool of the device's msys_1 size as everywhere in the benches. The case
+// argument is the bulk class policy. One op is one simulated second. Reports how many of each
+// class reach the link and the urgent latency.
+#define NOTIFY_BULK_PERIOD_US   2000
+#define NOTIFY_URGENT_PERIOD_US 50000
+#define NOTIFY_CONN_ITVL_US     7500
+
+static struct {
+    uint64_t sent[GATT_SVR_NOTIFY_CLASS_COUNT];
+    uint64_t delivered[GATT_SVR_NOTIFY_CLASS_COUNT];
+    double urgent_latency_us;
+    double urgent_latency_max_us;
+} notify_trace;
+
+static void notify_record(uint16_t conn_handle, uint16_t attr_handle,
+                          const uint8_t* data, uint16_t len, void* context)
+{
+    int64_t sent_us;
+
+    if (len < 1 + sizeof(sent_us) || data[0] >= GATT_SVR_NOTIFY_CLASS_COUNT)
+    {
+        return;
+    }
+
+    ++notify_trace.delivered[data[0]];
+
+    if (data[0] == GATT_SVR_NOTIFY_URGENT)
+    {
+        memcpy(&sent_us, &data[1], sizeof(sent_us));
+
+        const double latency_us = (double)(host_sim_now_us() - sent_us);
+        notify_trace.urgent_latency_us += latency_us;
+        notify_trace.urgent_latency_max_us = latency_us > notify_trace.urgent_latency_max_us ?
+                                             latency_us : notify_trace.urgent_latency_max_us;
+    }
+}
+
+// Each class is one value updated over and over
+static uint64_t notify_key(const uint8_t* buf, size_t buf_size, void* context)
+{
+    return 1;
+}
+
+static void notify_send(gatt_svr_notify_class cls, size_t len)
+{
+    uint8_t buf[128] = { cls };
+    const int64_t now_us = host_sim_now_us();
+
+    memcpy(&buf[1], &now_us, sizeof(now_us));
+    gatt_svr_notify_read_value(buf, len, cls);
+    ++notify_trace.sent[cls];
+}
+
+void bench_notify_overload(struct bench* b)
+{
+    if (!bench_env_setup(0, 0, 1))
+    {
+        b->skip = true;
+        return;
+    }
+
+    const uint16_t conn_handle = bench_env.conn_handles[0];
+
+    host_sim_exchange_mtu(conn_handle, 247);
+    host_sim_set_link_capacity(conn_handle, 2);
+    host_sim_set_notify_hook(notify_record, NULL);
+    gatt_svr_register_notify_key_cb(notify_key, NULL);
+    gatt_svr_set_notify_policy(GATT_SVR_NOTIFY_BULK, (gatt_svr_notify_policy)b->arg);
+
+    memset(&notify_trace, 0, sizeof(notify_trace));
+
+    const int64_t start_us = host_sim_now_us();
+    const int64_t end_us = start_us + (int64_t)b->n * 1000000;
+
+    bench_reset_timer(b);
+
+    for (int64_t now_us = start_us; now_us < end_us; now_us += 500)
+    {
+        const int64_t elapsed_us = now_us - start_us;
+
+        if (elapsed_us % NOTIFY_URGENT_PERIOD_US == 0)
+        {
+            notify_send(GATT_SVR_NOTIFY_URGENT, 4 + 8);
+        }
+
+        if (elapsed_us % NOTIFY_BULK_PERIOD_US == 0)
+        {
+            notify_send(GATT_SVR_NOTIFY_BULK, 100);
+        }
+
+        if (elapsed_us % NOTIFY_CONN_ITVL_US == 0)
+        {
+            host_sim_conn_event(conn_handle);
+        }
+
+        host_sim_advance_us(500);
+    }
+
+    bench_stop_timer(b);
+
+    gatt_svr_notify_stats stats;
+    gatt_svr_get_notify_stats(conn_handle, &stats);
+
+    b->bytes = host_sim_conn_stats(conn_handle)->notify_bytes;
+
+    const uint64_t urgent = notify_trace.delivered[GATT_SVR_NOTIFY_URGENT];
+
+    bench_report(b, "urgent_delivered_ratio", (double)urgent / notify_trace.sent[GATT_SVR_NOTIFY_URGENT]);
+    bench_report(b, "urgent_latency_ms_avg", urgent ? notify_trace.urgent_latency_us / urgent / 1000.0 : 0);
+    bench_report(b, "urgent_latency_ms_max", notify_trace.urgent_latency_max_us / 1000.0);
+    bench_report(b, "bulk_delivered_ratio",
+                 (double)notify_trace.delivered[GATT_SVR_NOTIFY_BULK] / notify_trace.sent[GATT_SVR_NOTIFY_BULK]);
+    bench_report(b, "dropped_per_s", (double)(stats.dropped + stats.merged) / b->n);
+    bench_report(b, "retries_per_s", (double)stats.retries / b->n);
+    bench_report(b, "depth_max", stats.depth_max);
+
+    host_sim_set_notify_hook(NULL, NULL);
+    bench_env_teardown();
+}
+
+static uint64_t notify_link_bytes(void)
+{
+    uint64_t bytes = 0;
+    for (size_t idx = 0; idx < bench_env.conn_count; ++idx)
+    {
+        bytes += host_sim_conn_stats(bench_env.conn_handles[idx])->notify_bytes;
+    }
+
+    return bytes;
+}
+
+// Sensor values through the GATT server to arg subscribers, counting what
+// the server copies per byte that reaches the link: one into the read value,
+// and per subscriber one into its queue and one into the mbuf sent.
+void bench_notify_copies(struct bench* b)
+{
+    if (!bench_env_setup(0, 1, (size_t)b->arg))
+    {
+        b->skip = true;
+        return;
+    }
+
+    gatt_svr_copy_stats before;
+    gatt_svr_get_copy_stats(&before);
+    const uint64_t link_bytes = notify_link_bytes();
+
+    bench_reset_timer(b);
+
+    for (int64_t op = 0; op < b->n; ++op)
+    {
+        gble_set_sensor_value(&bench_env.server, bench_env.sensors[0].id, (int32_t)(op % 1000));
+    }
+
+    bench_stop_timer(b);
+
+    gatt_svr_copy_stats after;
+    gatt_svr_get_copy_stats(&after);
+
+    const uint64_t notify_bytes = notify_link_bytes() - link_bytes;
+    const uint64_t value_bytes = after.value_bytes - before.value_bytes;
+    const uint64_t queue_bytes = after.queue_bytes - before.queue_bytes;
+    const uint64_t mbuf_bytes = after.notify_bytes - before.notify_bytes;
+
+    b->bytes = notify_bytes;
+
+    bench_report(b, "copied_per_sent_byte",
+                 notify_bytes ? (double)(value_bytes + queue_bytes + mbuf_bytes) / notify_bytes : 0);
+    bench_report(b, "value_copy_bytes_per_op", (double)value_bytes / b->n);
+    bench_report(b, "queue_copy_bytes_per_op", (double)queue_bytes / b->n);
+    bench_report(b, "mbuf_copy_bytes_per_op", (double)mbuf_bytes / b->n);
+
+    bench_env_teardown();
+}
@@ -0,0 +1,284 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gble_pattern.h"
+#include "host_sim.h"
+
+#include "bench.h"
+
+static gble_pattern_engine patterns;
+
+static uint32_t pattern_rand(uint32_t* state)
+{
+    // xorshift32, so every run sees the same sequence
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// One period of a 1 Hz triangle over the full level range, as keyframes
+#define TRIANGLE_KEYFRAMES 11
+
+static size_t pattern_triangle(uint8_t* keyframes)
+{
+    for (size_t idx = 0; idx < TRIANGLE_KEYFRAMES; ++idx)
+    {
+        const uint32_t delta_ms = idx == 0 ? 0 : 1000 / (TRIANGLE_KEYFRAMES - 1);
+        const uint32_t half = (TRIANGLE_KEYFRAMES - 1) / 2;
+        const uint32_t level = idx <= half ? idx * 255 / half : (TRIANGLE_KEYFRAMES - 1 - idx) * 255 / half;
+
+        keyframes[idx * 3] = (uint8_t)(delta_ms >> 8);
+        keyframes[idx * 3 + 1] = (uint8_t)delta_ms;
+        keyframes[idx * 3 + 2] = (uint8_t)level;
+    }
+
+    return TRIANGLE_KEYFRAMES * 3;
+}
+
+// [-1, pattern_id, h'keyframes'] with a small id
+static size_t pattern_upload_frame(uint8_t* buf, uint8_t pattern_id, const uint8_t* keyframes, size_t size)
+{
+    buf[0] = 0x83;
+    buf[1] = 0x20;
+    buf[2] = pattern_id;
+    buf[3] = 0x58;
+    buf[4] = (uint8_t)size;
+    memcpy(&buf[5], keyframes, size);
+
+    return 5 + size;
+}
+
+static uint32_t sampled_value[2];
+
+static void pattern_sample_actuator(gble_actuator_id actuator_id, uint32_t value, void* context)
+{
+    sampled_value[actuator_id] = value;
+}
+
+// Same waveform driven two ways over one simulated second per op.
+// Actuator 0 gets it streamed as [0, value] at 50 Hz, each write delayed by
+// zero to three extra 7.5 ms connection events as in ramp/jitter_trace.
+// Actuator 1 plays it as an uploaded pattern at the 100 Hz default tick.
+// Reports bytes on the air per second and the mean output error against
+// the ideal triangle, in steps of the 0..20 range.
+#define STREAM_SEND_PERIOD_US 20000
+#define STREAM_CONN_ITVL_US   7500
+
+static float pattern_ideal(int64_t t_us)
+{
+    const float phase = (float)(t_us % 1000000) / 1e6f;
+    return 20.0f * (phase < 0.5f ? 2.0f * phase : 2.0f - 2.0f * phase);
+}
+
+void bench_pattern_stream_vs_play(struct bench* b)
+{
+    if (!bench_env_setup(2, 0, 0))
+    {
+        b->skip = true;
+        return;
+    }
+
+    for (size_t idx = 0; idx < 2; ++idx)
+    {
+        bench_env.actuators[idx].cb = pattern_sample_actuator;
+    }
+    sampled_value[0] = sampled_value[1] = 0;
+
+    if (!gble_pattern_start(&patterns, &bench_env.server, CONFIG_GBLE_PATTERN_TICK_HZ))
+    {
+        b->skip = true;
+        return;
+    }
+
+    uint8_t keyframes[TRIANGLE_KEYFRAMES * 3];
+    uint8_t frame[8 + sizeof(keyframes)];
+    uint64_t pattern_bytes = 0;
+    uint64_t stream_bytes = 0;
+
+    bench_reset_timer(b);
+
+    const size_t upload_size = pattern_upload_frame(frame, 1, keyframes, pattern_triangle(keyframes));
+    gble_handle_actuators_changed(&bench_env.server, frame, upload_size);
+
+    // Aligned to the stream's first sample
+    uint8_t play[] = { 0x84, 0x21, 0x01, 0x01, 0x00 };
+    gble_handle_actuators_changed(&bench_env.server, play, sizeof(play));
+    pattern_bytes += upload_size + sizeof(play);
+
+    uint32_t rng = 0x2545f491;
+    const int64_t start_us = host_sim_now_us();
+    const int64_t end_us = start_us + (int64_t)b->n * 1000000;
+
+    int64_t next_send_us = start_us;
+    int64_t last_delivery_us = start_us;
+    int64_t pending_us = -1;
+    uint8_t pending_value = 0;
+
+    double stream_error = 0;
+    double pattern_error = 0;
+    uint64_t samples = 0;
+
+    for (int64_t now_us = start_us; now_us < end_us; now_us += 1000)
+    {
+        if (pending_us < 0 && now_us >= next_send_us)
+        {
+            // Next sample goes out on a later connection event, in order
+            int64_t delivery_us = (now_us / STREAM_CONN_ITVL_US + 1 + pattern_rand(&rng) % 4) * STREAM_CONN_ITVL_US;
+            if (delivery_us < last_delivery_us)
+            {
+                delivery_us = last_delivery_us;
+            }
+
+            pending_us = delivery_us;
+            pending_value = (uint8_t)lroundf(pattern_ideal(now_us - start_us));
+            next_send_us += STREAM_SEND_PERIOD_US;
+        }
+
+        if (pending_us >= 0 && now_us >= pending_us)
+        {
+            uint8_t msg[] = { 0x82, 0x00, pending_value };
+            gble_handle_actuators_changed(&bench_env.server, msg, sizeof(msg));
+            stream_bytes += sizeof(msg);
+
+            last_delivery_us = pending_us;
+            pending_us = -1;
+        }
+
+        const float ideal = pattern_ideal(now_us - start_us);
+        stream_error += fabsf((float)sampled_value[0] - ideal);
+        pattern_error += fabsf((float)sampled_value[1] - ideal);
+        ++samples;
+
+        host_sim_advance_us(1000);
+    }
+
+    bench_stop_timer(b);
+
+    b->bytes += stream_bytes + pattern_bytes;
+
+    bench_report(b, "stream_bytes_per_s", (double)stream_bytes / b->n);
+    bench_report(b, "pattern_bytes_per_s", (double)pattern_bytes / b->n);
+    bench_report(b, "stream_err_avg", stream_error / samples);
+    bench_report(b, "pattern_err_avg", pattern_error / samples);
+
+    gble_pattern_stop(&patterns);
+    bench_env_teardown();
+}
+
+// Cost of one tick with every actuator playing an 11 keyframe pattern at a
+// different phase. Reports actuator callbacks per tick.
+void bench_pattern_tick(struct bench* b)
+{
+    const size_t actuator_count = b->arg;
+
+    if (!bench_env_setup(actuator_count, 0, 0) ||
+        !gble_pattern_start(&patterns, &bench_env.server, CONFIG_GBLE_PATTERN_TICK_HZ))
+    {
+        b->skip = true;
+        return;
+    }
+
+    uint8_t keyframes[TRIANGLE_KEYFRAMES * 3];
+    const size_t size = pattern_triangle(keyframes);
+
+    gble_pattern_upload(&patterns, 1, keyframes, size);
+
+    for (size_t idx = 0; idx < actuator_count; ++idx)
+    {
+        gble_pattern_play(&patterns, idx, 1, 0);
+        gble_pattern_set_speed(&patterns, idx, 100 + idx * 7);
+    }
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        gble_pattern_tick(&patterns);
+    }
+
+    bench_stop_timer(b);
+
+    gble_pattern_stats stats;
+    gble_pattern_get_stats(&patterns, &stats);
+
+    bench_report(b, "outputs_per_tick", (double)stats.outputs / stats.ticks);
+
+    gble_pattern_stop(&patterns);
+    bench_env_teardown();
+}
+
+// A library of 24 saved patterns played through the RAM pool, one play
+// command per op. Four of them get 80% of the plays. Reports how often a
+// play had to load from NVS, and evictions per play.
+#define LIBRARY_SIZE 24
+#define LIBRARY_HOT  4
+
+void bench_pattern_pool_churn(struct bench* b)
+{
+    if (!bench_env_setup(1, 0, 0) ||
+        !gble_pattern_start(&patterns, &bench_env.server, CONFIG_GBLE_PATTERN_TICK_HZ))
+    {
+        b->skip = true;
+        return;
+    }
+
+    uint8_t keyframes[TRIANGLE_KEYFRAMES * 3];
+    const size_t size = pattern_triangle(keyframes);
+
+    for (uint32_t id = 0; id < LIBRARY_SIZE; ++id)
+    {
+        gble_pattern_upload(&patterns, id, keyframes, size);
+        gble_pattern_save(&patterns, id);
+    }
+
+    gble_pattern_stats before;
+    gble_pattern_get_stats(&patterns, &before);
+
+    uint32_t rng = 0x2545f491;
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        const uint32_t pick = pattern_rand(&rng);
+        const uint8_t id = (pick % 10) < 8 ? pick / 10 % LIBRARY_HOT :
+                           LIBRARY_HOT + pick / 10 % (LIBRARY_SIZE - LIBRARY_HOT);
+
+        uint8_t play[] = { 0x84, 0x21, 0x00, id, 0x01 };
+        gble_handle_actuators_changed(&bench_env.server, play, sizeof(play));
+        b->bytes += sizeof(play);
+    }
+
+    bench_stop_timer(b);
+
+    gble_pattern_stats after;
+    gble_pattern_get_stats(&patterns, &after);
+
+    bench_report(b, "nvs_load_ratio", (double)(after.nvs_loads - before.nvs_loads) / b->n);
+    bench_report(b, "evictions_per_play", (double)(after.evictions - before.evictions) / b->n);
+
+    gble_pattern_stop(&patterns);
+    bench_env_teardown();
+}
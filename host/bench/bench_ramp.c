@@ -0,0 +1,150 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include "gble_ramp.h"
+#include "host_sim.h"
+
+#include "bench.h"
+
+// Jittered input trace on the virtual clock. The client samples a 1 Hz sine
+// over the 0..20 step range every 20 ms; each value goes out on a 7.5 ms
+// connection event, delayed by zero to three extra events at random, in
+// order. The ramp engine ticks at 1 kHz with the profile given by the case
+// argument. One op is one simulated second.
+#define TRACE_SEND_PERIOD_US 20000
+#define TRACE_CONN_ITVL_US   7500
+#define TRACE_TICK_HZ        1000
+
+static gble_ramp_engine ramp;
+
+static uint32_t trace_rand(uint32_t* state)
+{
+    // xorshift32, so every run sees the same trace
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static float trace_ideal(int64_t t_us)
+{
+    return 10.0f + 10.0f * sinf(2.0f * (float)M_PI * (float)t_us / 1e6f);
+}
+
+void bench_ramp_jitter_trace(struct bench* b)
+{
+    const gble_ramp_profile profile = (gble_ramp_profile)b->arg;
+    const uint32_t params[] = { 0, 120, 25, 40 };
+
+    if (!bench_env_setup(1, 0, 0))
+    {
+        b->skip = true;
+        return;
+    }
+
+    bench_env.actuators[0].cb = gble_ramp_actuator_cb;
+    bench_env.actuators[0].cb_context = &ramp;
+
+    if (!gble_ramp_start(&ramp, &bench_env.server, TRACE_TICK_HZ) ||
+        !gble_ramp_configure(&ramp, 0, profile, params[profile]))
+    {
+        b->skip = true;
+        return;
+    }
+
+    uint32_t rng = 0x2545f491;
+    const int64_t start_us = host_sim_now_us();
+    const int64_t end_us = start_us + (int64_t)b->n * 1000000;
+    const int64_t tick_us = 1000000 / TRACE_TICK_HZ;
+
+    int64_t next_send_us = start_us;
+    int64_t last_delivery_us = start_us;
+
+    // Sent values waiting for their connection event
+    struct { int64_t deliver_us; uint8_t value; } in_flight[16];
+    size_t in_flight_head = 0, in_flight_count = 0;
+
+    float prev = ramp.channels[0].value;
+    float prev_delta = 0;
+    double max_step = 0, jerk_sum = 0, error_sum = 0;
+    uint64_t samples = 0;
+
+    bench_reset_timer(b);
+
+    while (host_sim_now_us() < end_us)
+    {
+        const int64_t now_us = host_sim_now_us();
+
+        if (now_us >= next_send_us && in_flight_count < COUNT_OF(in_flight))
+        {
+            const int64_t event_us = ((now_us - start_us) / TRACE_CONN_ITVL_US + 1) * TRACE_CONN_ITVL_US + start_us;
+            int64_t deliver_us = event_us + (int64_t)(trace_rand(&rng) % 4) * TRACE_CONN_ITVL_US;
+            if (deliver_us < last_delivery_us)
+            {
+                deliver_us = last_delivery_us;
+            }
+            last_delivery_us = deliver_us;
+
+            size_t slot = (in_flight_head + in_flight_count) % COUNT_OF(in_flight);
+            in_flight[slot].deliver_us = deliver_us;
+            in_flight[slot].value = (uint8_t)lroundf(trace_ideal(now_us - start_us));
+            ++in_flight_count;
+
+            next_send_us += TRACE_SEND_PERIOD_US;
+        }
+
+        while (in_flight_count && in_flight[in_flight_head].deliver_us <= now_us)
+        {
+            uint8_t msg[] = { 0x82, 0x00, in_flight[in_flight_head].value };
+            gble_handle_actuators_changed(&bench_env.server, msg, sizeof(msg));
+            b->bytes += sizeof(msg);
+
+            in_flight_head = (in_flight_head + 1) % COUNT_OF(in_flight);
+            --in_flight_count;
+        }
+
+        host_sim_advance_us(tick_us);
+
+        const float value = ramp.channels[0].value;
+        const float delta = value - prev;
+
+        if (fabsf(delta) > max_step)
+        {
+            max_step = fabsf(delta);
+        }
+        jerk_sum += fabsf(delta - prev_delta);
+        error_sum += fabsf(value - trace_ideal(host_sim_now_us() - start_us));
+        ++samples;
+
+        prev = value;
+        prev_delta = delta;
+    }
+
+    bench_stop_timer(b);
+
+    bench_report(b, "max_step_per_tick", max_step);
+    bench_report(b, "mean_jerk", jerk_sum / samples);
+    bench_report(b, "mean_abs_error", error_sum / samples);
+
+    gble_ramp_stop(&ramp);
+    bench_env_teardown();
+}
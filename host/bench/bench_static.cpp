@@ -0,0 +1,94 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#include "gble_descriptor.hpp"
+
+#include "bench.h"
+
+namespace
+{
+
+// Same features as gble_init/4, so the descriptors can be compared
+constexpr gble::feature_table<4, 4> Table = {
+    "Bench Device",
+    {{
+        { "Actuator 1", GBLE_ACTUATOR_TYPE_VIBRATE, 0, 20, GBLE_ACTUATOR_MSG_SCALAR },
+        { "Actuator 2", GBLE_ACTUATOR_TYPE_VIBRATE, 0, 20, GBLE_ACTUATOR_MSG_SCALAR },
+        { "Actuator 3", GBLE_ACTUATOR_TYPE_VIBRATE, 0, 20, GBLE_ACTUATOR_MSG_SCALAR },
+        { "Actuator 4", GBLE_ACTUATOR_TYPE_VIBRATE, 0, 20, GBLE_ACTUATOR_MSG_SCALAR },
+    }},
+    {{
+        { "Sensor 1", GBLE_SENSOR_TYPE_PRESSURE, 0, 1000, GBLE_SENSOR_MSG_SUBSCRIBE },
+        { "Sensor 2", GBLE_SENSOR_TYPE_PRESSURE, 0, 1000, GBLE_SENSOR_MSG_SUBSCRIBE },
+        { "Sensor 3", GBLE_SENSOR_TYPE_PRESSURE, 0, 1000, GBLE_SENSOR_MSG_SUBSCRIBE },
+        { "Sensor 4", GBLE_SENSOR_TYPE_PRESSURE, 0, 1000, GBLE_SENSOR_MSG_SUBSCRIBE },
+    }},
+};
+
+static_assert(Table.actuator_index("Actuator 3") == 2, "Unexpected actuator id");
+static_assert(Table.sensor_index("Sensor 5") == 4, "Unexpected sensor id");
+
+} // namespace
+
+// gble_init_static over the compile-time descriptor of the gble_init/4
+// features. Skips, with a message, if the two encoders disagree.
+void bench_gble_init_static(struct bench* b)
+{
+    auto actuators = gble::make_actuator_features(Table);
+    auto sensors = gble::make_sensor_features(Table);
+
+    static gble_server runtime_server;
+    auto runtime_actuators = gble::make_actuator_features(Table);
+    auto runtime_sensors = gble::make_sensor_features(Table);
+
+    if (!gble_init(&runtime_server, Table.name,
+                   runtime_actuators.data(), runtime_actuators.size(),
+                   runtime_sensors.data(), runtime_sensors.size()))
+    {
+        b->skip = true;
+        return;
+    }
+
+    using desc = gble::descriptor<Table>;
+
+    if (runtime_server.descriptor_size != desc::size ||
+        memcmp(runtime_server.descriptor, desc::bytes.data(), desc::size) != 0)
+    {
+        fprintf(stderr, "gble_init_static: compile-time descriptor differs from gble_init\n");
+        b->skip = true;
+        return;
+    }
+
+    static gble_server server;
+
+    bench_reset_timer(b);
+
+    for (uint64_t idx = 0; idx < b->n; ++idx)
+    {
+        gble::init_static<Table>(&server, actuators, sensors);
+        b->bytes += server.descriptor_size;
+    }
+
+    bench_stop_timer(b);
+
+    bench_report(b, "descriptor_size", desc::size);
+}
@@ -0,0 +1,166 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+
+#include "cbor.h"
+
+#include "gatt_svr.h"
+#include "gble_stream.h"
+#include "host_sim.h"
+
+#include "bench.h"
+
+// A pressure sensor sampled at 1 kHz on the virtual clock, to one central
+// with a 247 byte ATT MTU. The case argument is the frame deadline in ms, or
+// 0 to send every sample with gble_set_sensor_value as before. One op is one
+// simulated second. Reports notifications and link bytes per second, and
+// the latency from each sample to the notification that carries it.
+#define STREAM_PERIOD_US 1000
+
+static gble_stream stream;
+
+static struct {
+    uint64_t samples;
+    double latency_us;
+    double latency_max_us;
+} stream_trace;
+
+static void stream_record_latency(int64_t sample_us)
+{
+    const double latency_us = (double)(host_sim_now_us() - sample_us);
+
+    stream_trace.latency_us += latency_us;
+    stream_trace.latency_max_us = latency_us > stream_trace.latency_max_us ? latency_us : stream_trace.latency_max_us;
+    ++stream_trace.samples;
+}
+
+static void stream_record(uint8_t* buf, size_t buf_size, gble_sensor_priority priority, void* context)
+{
+    CborParser parser;
+    CborValue value;
+    CborValue element;
+    size_t length = 0;
+
+    if (cbor_parser_init(buf, buf_size, 0, &parser, &value) == CborNoError &&
+        cbor_value_get_array_length(&value, &length) == CborNoError && length == 4 &&
+        cbor_value_enter_container(&value, &element) == CborNoError)
+    {
+        uint64_t base_us = 0;
+        uint64_t period_us = 0;
+        size_t samples_size = 0;
+
+        cbor_value_advance_fixed(&element);
+        cbor_value_get_uint64(&element, &base_us);
+        cbor_value_advance_fixed(&element);
+        cbor_value_get_uint64(&element, &period_us);
+        cbor_value_advance_fixed(&element);
+        cbor_value_get_string_length(&element, &samples_size);
+
+        // 0..4095 packs into two bytes a sample
+        for (size_t idx = 0; idx < samples_size / 2; ++idx)
+        {
+            stream_record_latency((int64_t)(base_us + idx * period_us));
+        }
+    }
+    else
+    {
+        stream_record_latency(host_sim_now_us());
+    }
+
+    gatt_svr_notify_read_value(buf, buf_size, priority);
+}
+
+void bench_stream_pressure(struct bench* b)
+{
+    const uint32_t max_latency_ms = (uint32_t)b->arg;
+
+    if (!bench_env_setup(0, 1, 1))
+    {
+        b->skip = true;
+        return;
+    }
+
+    bench_env.sensors[0].value_range_high = 4095;
+    gble_set_sensor_callback_fn(&bench_env.server, stream_record, NULL);
+    host_sim_exchange_mtu(bench_env.conn_handles[0], 247);
+
+    if (max_latency_ms > 0)
+    {
+        if (!gble_stream_start(&stream, &bench_env.server))
+        {
+            b->skip = true;
+            return;
+        }
+
+        gble_stream_set_frame_size_fn(&stream, gatt_svr_get_notify_size_max_ctx, NULL);
+        gble_stream_enable(&stream, bench_env.sensors[0].id, STREAM_PERIOD_US, max_latency_ms);
+    }
+
+    memset(&stream_trace, 0, sizeof(stream_trace));
+
+    const struct host_sim_conn_stats* link = host_sim_conn_stats(bench_env.conn_handles[0]);
+    const uint32_t notify_count = link->notify_count;
+    const uint64_t notify_bytes = link->notify_bytes;
+
+    const int64_t start_us = host_sim_now_us();
+    const int64_t end_us = start_us + (int64_t)b->n * 1000000;
+    uint32_t phase = 0;
+
+    bench_reset_timer(b);
+
+    for (int64_t now_us = start_us; now_us < end_us; now_us += STREAM_PERIOD_US)
+    {
+        // Sawtooth, so every sample is a change
+        const int32_t value = (int32_t)(phase++ % 4096);
+
+        if (max_latency_ms > 0)
+        {
+            gble_stream_push(&stream, bench_env.sensors[0].id, value, now_us);
+        }
+        else
+        {
+            gble_set_sensor_value(&bench_env.server, bench_env.sensors[0].id, value);
+        }
+
+        host_sim_advance_us(STREAM_PERIOD_US);
+    }
+
+    if (max_latency_ms > 0)
+    {
+        gble_stream_flush(&stream, bench_env.sensors[0].id);
+    }
+
+    bench_stop_timer(b);
+
+    b->bytes = link->notify_bytes - notify_bytes;
+
+    bench_report(b, "notifies_per_s", (double)(link->notify_count - notify_count) / b->n);
+    bench_report(b, "bytes_per_sample", (double)(link->notify_bytes - notify_bytes) / stream_trace.samples);
+    bench_report(b, "latency_ms_avg", stream_trace.latency_us / stream_trace.samples / 1000.0);
+    bench_report(b, "latency_ms_max", stream_trace.latency_max_us / 1000.0);
+    bench_report(b, "delivered_ratio", (double)stream_trace.samples / (b->n * (1000000 / STREAM_PERIOD_US)));
+
+    if (max_latency_ms > 0)
+    {
+        gble_stream_stop(&stream);
+    }
+
+    bench_env_teardown();
+}
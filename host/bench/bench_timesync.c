@@ -0,0 +1,170 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gatt_svr.h"
+#include "gatt_svr_priv.h"
+#include "gble_time_sync.h"
+#include "host_sim.h"
+
+#include "bench.h"
+
+// Time sync against a simulated client on the virtual clock. The client
+// clock runs TIMESYNC_DRIFT_PPM slower than the device and starts
+// TIMESYNC_OFFSET_US behind. Every 250 ms the client writes right after the
+// next connection event it sees, plus up to 500 us of its own latency; the
+// write is delivered on a connection event of `arg` us delayed by zero to
+// three extra events, and the notification comes back the same way.
+// One op is one simulated second. After the first window of rounds, reports
+// how far the device's view of the client clock is off, the drift error and
+// the shortest round trip.
+#define TIMESYNC_ROUND_US   250000
+#define TIMESYNC_OFFSET_US  123456789
+#define TIMESYNC_DRIFT_PPM  50
+
+static gble_time_sync time_sync;
+
+static uint32_t timesync_rand(uint32_t* state)
+{
+    // xorshift32, so every run sees the same trace
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static int64_t timesync_client_us(int64_t device_us)
+{
+    return device_us - TIMESYNC_OFFSET_US - device_us * TIMESYNC_DRIFT_PPM / 1000000;
+}
+
+static void timesync_put(uint8_t* buf, uint64_t value, size_t size)
+{
+    for (size_t idx = 0; idx < size; ++idx)
+    {
+        buf[idx] = (uint8_t)(value >> (8 * idx));
+    }
+}
+
+static void timesync_advance_to(int64_t device_us)
+{
+    const int64_t now_us = host_sim_now_us();
+    if (device_us > now_us)
+    {
+        host_sim_advance_us(device_us - now_us);
+    }
+}
+
+static int64_t timesync_next_event_us(int64_t now_us, int64_t conn_itvl_us, uint32_t* rng)
+{
+    return (now_us / conn_itvl_us + 1 + timesync_rand(rng) % 4) * conn_itvl_us;
+}
+
+void bench_time_sync(struct bench* b)
+{
+    const int64_t conn_itvl_us = b->arg;
+
+    if (!bench_env_setup(0, 0, 1))
+    {
+        b->skip = true;
+        return;
+    }
+
+    const uint16_t conn_handle = bench_env.conn_handles[0];
+    const uint16_t time_handle = Svc_char_handles[HANDLE_MAIN_TIME];
+
+    gble_time_sync_init(&time_sync);
+    gatt_svr_register_time_sync_cb(gble_time_sync_handle_request_ctx, gble_time_sync_get_status_ctx, &time_sync);
+    host_sim_subscribe(conn_handle, time_handle, true, false);
+
+    const struct host_sim_conn_stats* link = host_sim_conn_stats(conn_handle);
+
+    uint32_t rng = 0x2545f491;
+    const int64_t start_us = host_sim_now_us();
+    const int64_t end_us = start_us + (int64_t)b->n * 1000000;
+
+    uint32_t seq = 1;
+    int64_t prev_t3_us = 0;
+    double error_sum_us = 0;
+    double error_max_us = 0;
+    uint64_t error_count = 0;
+
+    bench_reset_timer(b);
+
+    for (int64_t round_us = start_us; round_us < end_us; round_us += TIMESYNC_ROUND_US)
+    {
+        const int64_t send_us = (round_us / conn_itvl_us + 1) * conn_itvl_us + timesync_rand(&rng) % 500;
+        timesync_advance_to(send_us);
+
+        uint8_t req[GBLE_TIME_SYNC_REQUEST_SIZE];
+        timesync_put(&req[0], seq, 4);
+        timesync_put(&req[4], (uint64_t)timesync_client_us(send_us), 8);
+        timesync_put(&req[12], (uint64_t)prev_t3_us, 8);
+
+        timesync_advance_to(timesync_next_event_us(send_us, conn_itvl_us, &rng));
+
+        const uint32_t notify_count = link->notify_count;
+        host_sim_write(conn_handle, time_handle, req, sizeof(req));
+        b->bytes += sizeof(req);
+
+        if (link->notify_count == notify_count || link->last_attr_handle != time_handle)
+        {
+            prev_t3_us = 0;
+            ++seq;
+            continue;
+        }
+
+        timesync_advance_to(timesync_next_event_us(host_sim_now_us(), conn_itvl_us, &rng));
+        prev_t3_us = timesync_client_us(host_sim_now_us());
+        b->bytes += link->last_len;
+        ++seq;
+
+        gble_time_sync_estimate estimate;
+        gble_time_sync_get_estimate(&time_sync, &estimate);
+        if (estimate.valid && estimate.rounds >= CONFIG_GBLE_TIME_SYNC_WINDOW)
+        {
+            const int64_t now_us = host_sim_now_us();
+            const double error_us = fabs((double)(gble_time_sync_to_device_us(&time_sync, timesync_client_us(now_us)) - now_us));
+
+            error_sum_us += error_us;
+            error_max_us = error_us > error_max_us ? error_us : error_max_us;
+            ++error_count;
+        }
+    }
+
+    bench_stop_timer(b);
+
+    gble_time_sync_estimate estimate;
+    gble_time_sync_get_estimate(&time_sync, &estimate);
+
+    if (error_count > 0)
+    {
+        bench_report(b, "offset_err_us_avg", error_sum_us / error_count);
+        bench_report(b, "offset_err_us_max", error_max_us);
+    }
+
+    bench_report(b, "drift_err_ppm", fabs(estimate.drift_ppb / 1000.0 - TIMESYNC_DRIFT_PPM));
+    bench_report(b, "rtt_ms", estimate.rtt_us / 1000.0);
+
+    gatt_svr_register_time_sync_cb(NULL, NULL, NULL);
+    bench_env_teardown();
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE  ((BaseType_t)1)
+#define pdPASS  pdTRUE
+#define pdFAIL  pdFALSE
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+
+typedef void (*TaskFunction_t)(void* param);
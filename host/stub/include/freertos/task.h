@@ -0,0 +1,26 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct tskTaskControlBlock* TaskHandle_t;
+
+// Both run off the virtual clock; vTaskDelay advances it.
+TickType_t xTaskGetTickCount(void);
+
+void vTaskDelay(TickType_t ticks);
+
+// Tasks are recorded but never scheduled: the host build has no scheduler,
+// so a driver runs a task's work itself, using host_sim_task_take_notify to
+// see whether it was woken.
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stack_depth,
+                       void* param, UBaseType_t priority, TaskHandle_t* out_handle);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack_depth,
+                                   void* param, UBaseType_t priority, TaskHandle_t* out_handle,
+                                   BaseType_t core_id);
+
+void vTaskDelete(TaskHandle_t task);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "host/ble_uuid.h"
+
+#define BLE_HS_ADV_MAX_SZ                   31
+
+#define BLE_HS_ADV_F_DISC_LTD               0x01
+#define BLE_HS_ADV_F_DISC_GEN               0x02
+#define BLE_HS_ADV_F_BREDR_UNSUP            0x04
+
+#define BLE_HS_ADV_TX_PWR_LVL_AUTO          (-128)
+
+#define BLE_HS_ADV_TYPE_FLAGS               0x01
+#define BLE_HS_ADV_TYPE_INCOMP_NAME         0x08
+#define BLE_HS_ADV_TYPE_COMP_NAME           0x09
+#define BLE_HS_ADV_TYPE_TX_PWR_LVL          0x0a
+#define BLE_HS_ADV_TYPE_ADV_ITVL            0x1a
+#define BLE_HS_ADV_TYPE_MFG_DATA            0xff
+
+struct ble_hs_adv_fields {
+    uint8_t flags;
+
+    const ble_uuid16_t* uuids16;
+    uint8_t num_uuids16;
+    unsigned uuids16_is_complete:1;
+
+    const uint8_t* name;
+    uint8_t name_len;
+    unsigned name_is_complete:1;
+
+    int8_t tx_pwr_lvl;
+    unsigned tx_pwr_lvl_is_present:1;
+
+    uint16_t appearance;
+    unsigned appearance_is_present:1;
+
+    uint16_t adv_itvl;
+    unsigned adv_itvl_is_present:1;
+
+    const uint8_t* mfg_data;
+    uint8_t mfg_data_len;
+};
+
+struct ble_hs_adv_field {
+    uint8_t length;
+    uint8_t type;
+    uint8_t value[0];
+};
+
+typedef int (*ble_hs_adv_parse_func_t)(const struct ble_hs_adv_field* field, void* arg);
+
+int ble_hs_adv_set_fields(const struct ble_hs_adv_fields* adv_fields,
+                          uint8_t* dst, uint8_t* dst_len, uint8_t max_len);
+
+int ble_hs_adv_parse(const uint8_t* data, uint8_t length,
+                     ble_hs_adv_parse_func_t func, void* user_data);
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "os/os_mbuf.h"
+
+struct os_mbuf* ble_hs_mbuf_from_flat(const void* buf, uint16_t len);
+
+int ble_hs_mbuf_to_flat(const struct os_mbuf* om, void* flat, uint16_t max_len,
+                        uint16_t* out_copy_len);
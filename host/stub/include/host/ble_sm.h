@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+
+#define BLE_SM_IO_CAP_DISP_ONLY         0x00
+#define BLE_SM_IO_CAP_DISP_YES_NO       0x01
+#define BLE_SM_IO_CAP_KEYBOARD_ONLY     0x02
+#define BLE_SM_IO_CAP_NO_IO             0x03
+#define BLE_SM_IO_CAP_KEYBOARD_DISP     0x04
+
+#define BLE_SM_PAIR_KEY_DIST_ENC        0x01
+#define BLE_SM_PAIR_KEY_DIST_ID         0x02
+#define BLE_SM_PAIR_KEY_DIST_SIGN       0x04
+#define BLE_SM_PAIR_KEY_DIST_LINK       0x08
+
+#define BLE_SM_IOACT_NONE               0
+#define BLE_SM_IOACT_OOB                1
+#define BLE_SM_IOACT_INPUT              2
+#define BLE_SM_IOACT_DISP               3
+#define BLE_SM_IOACT_NUMCMP             4
+#define BLE_SM_IOACT_OOB_SC             5
+
+struct ble_sm_io {
+    uint8_t action;
+    union {
+        uint32_t passkey;
+        uint8_t oob[16];
+        uint8_t numcmp_accept;
+    };
+};
+
+int ble_sm_inject_io(uint16_t conn_handle, struct ble_sm_io* pkey);
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "nimble/ble.h"
+
+struct ble_store_status_event;
+
+typedef int ble_store_status_fn(struct ble_store_status_event* event, void* arg);
+
+int ble_store_util_status_rr(struct ble_store_status_event* event, void* arg);
+
+int ble_store_util_delete_peer(const ble_addr_t* peer_id_addr);
+
+int ble_store_util_bonded_peers(ble_addr_t* out_peer_id_addrs, int* out_num_peers,
+                                int max_peers);
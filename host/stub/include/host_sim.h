@@ -0,0 +1,215 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+// Control surface of the host stand-in for ESP-IDF and NimBLE. The stubs
+// under host/stub implement just enough of both for generic_btle.c,
+// gatt_svr.c, gatt_vars.c and ble_func.c to build unchanged on Linux; this
+// header lets a driver play the part of the controller and the centrals.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+#define HOST_SIM_MAX_CONNECTIONS CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+
+// Resets the clock, timers, mbuf pool, GATT registry, GAP state and NVS.
+void host_sim_reset(void);
+
+// Virtual clock
+
+int64_t host_sim_now_us(void);
+
+// Advances the virtual clock, firing due esp_timers in deadline order.
+void host_sim_advance_us(int64_t delta_us);
+
+// mbuf pool
+
+struct host_sim_mbuf_stats {
+    uint32_t blocks_in_use;
+    uint32_t blocks_high_water;
+    uint32_t alloc_count;
+    uint32_t alloc_failures;
+    uint64_t bytes_appended;
+};
+
+// Block size is the data capacity of each mbuf; takes effect on reset.
+void host_sim_mbuf_configure(uint16_t block_size, uint16_t block_count);
+
+void host_sim_mbuf_stats(struct host_sim_mbuf_stats* stats);
+
+// FreeRTOS tasks
+
+struct tskTaskControlBlock;
+
+// Returns and clears the notification count of a task created through the
+// stub, which never runs on its own.
+uint32_t host_sim_task_take_notify(struct tskTaskControlBlock* task);
+
+// NimBLE host task
+
+// Events put on the default event queue run at once, as on a host task
+// that is idle and outranks the caller; one put from inside an event runs
+// after it. While held they wait, and repeated puts of a queued event
+// collapse, until the release runs them.
+void host_sim_hold_host_task(void);
+
+void host_sim_release_host_task(void);
+
+// Events the host task has run since reset.
+uint32_t host_sim_host_events(void);
+
+// GATT
+
+// Returns the value handle of a registered characteristic, or 0.
+uint16_t host_sim_find_chr(uint16_t uuid16);
+
+// Writes through the access callback as a central would; the value is split
+// across mbufs of the configured block size. Returns the ATT error, or 0.
+int host_sim_write(uint16_t conn_handle, uint16_t attr_handle,
+                   const void* data, uint16_t len);
+
+int host_sim_read(uint16_t conn_handle, uint16_t attr_handle,
+                  void* buf, uint16_t buf_size, uint16_t* out_len);
+
+// GAP
+
+// Connects a simulated central to the active advertisement.
+int host_sim_connect(const uint8_t peer_addr[6], uint16_t* out_conn_handle);
+
+int host_sim_disconnect(uint16_t conn_handle, int reason);
+
+// Connections get the lowest free handle of first, first + step, ... The
+// default, 0 and 1, is what most controllers do; others hand out sparse
+// handles. Takes effect for the next connection; reset restores it.
+void host_sim_set_conn_handles(uint16_t first, uint16_t step);
+
+int host_sim_subscribe(uint16_t conn_handle, uint16_t attr_handle,
+                       bool notify, bool indicate);
+
+int host_sim_exchange_mtu(uint16_t conn_handle, uint16_t mtu);
+
+bool host_sim_advertising(void);
+
+struct host_sim_adv_stats {
+    uint32_t starts;
+    uint32_t data_sets;
+    // Advertising events on air, at the timing host_sim_scan_connect uses
+    uint32_t events;
+};
+
+void host_sim_adv_stats(struct host_sim_adv_stats* stats);
+
+// Extended advertising set 0 is the advertising above, so connections,
+// timeouts and scans work the same with either API. The other sets only
+// broadcast.
+#define HOST_SIM_EXT_ADV_INSTANCES 4
+#define HOST_SIM_EXT_ADV_MAX_SZ    1650
+
+struct host_sim_ext_adv_stats {
+    uint32_t data_sets;
+    uint32_t periodic_data_sets;
+    // Advertising data bytes handed to the controller
+    uint64_t data_bytes;
+    // Events on air, extended ones at the interval plus the mean advDelay
+    uint32_t events;
+    uint32_t periodic_events;
+};
+
+void host_sim_ext_adv_stats(uint8_t instance, struct host_sim_ext_adv_stats* stats);
+
+// What a passive observer receives from a broadcast set right now: the
+// periodic advertising data while that runs, the extended advertising data
+// otherwise. BLE_HS_ENOENT while the set is off.
+int host_sim_observe(uint8_t instance, uint8_t* buf, size_t buf_size, size_t* out_len);
+
+// A central's initiator: scans for window_us every interval_us from
+// start_us.
+struct host_sim_scan {
+    int64_t start_us;
+    uint32_t interval_us;
+    uint32_t window_us;
+};
+
+// Runs the clock through the advertising events, each at its interval plus
+// the random advDelay (3.75 ms apart for high duty directed), and connects
+// the central at the first one inside a scan window that it may connect
+// to. Whatever the application does with advertising meanwhile applies.
+// Returns BLE_HS_ETIMEOUT with the clock at limit_us if none is.
+int host_sim_scan_connect(const uint8_t peer_addr[6], const struct host_sim_scan* scan,
+                          int64_t limit_us, uint16_t* out_conn_handle);
+
+// Bonds with the central, which re-encrypts with the bond whenever it
+// connects again: ENC_CHANGE follows CONNECT. Bonds last until reset; the
+// oldest goes when CONFIG_BT_NIMBLE_MAX_BONDS are stored.
+int host_sim_bond(uint16_t conn_handle);
+
+// Restarts the last advertisement with the same parameters and callback, for
+// drivers that need more centrals than the application re-advertises for.
+int host_sim_restart_advertising(void);
+
+// How simulated centrals answer the peripheral's link layer and ATT
+// requests. Each one completes a few connection events after it is made,
+// as over the air.
+struct host_sim_central {
+    // Fastest interval granted, in 1.25 ms units. A parameter update that
+    // only allows faster ones is refused; otherwise the central picks the
+    // fastest interval allowed.
+    uint16_t itvl_floor;
+
+    // Parameter updates refused before any is considered
+    uint8_t reject_updates;
+
+    bool phy_2m;
+    uint16_t max_tx_octets;
+    uint16_t mtu;
+};
+
+// Applies to connections made after the call. Reset restores a central
+// that grants 7.5 ms, 2M, 251 byte PDUs and a 517 byte MTU.
+void host_sim_set_central(const struct host_sim_central* central);
+
+struct host_sim_conn_stats {
+    uint32_t notify_count;
+    uint64_t notify_bytes;
+    uint16_t last_attr_handle;
+    uint16_t last_len;
+    uint8_t last[256];
+};
+
+// Notifications that reached the simulated link of a connection.
+const struct host_sim_conn_stats* host_sim_conn_stats(uint16_t conn_handle);
+
+// Makes notifications wait for host_sim_conn_event, which sends at most
+// packets_per_event of them, holding on to their mbufs until then as the
+// controller would. NOTIFY_TX still comes when a notification is queued.
+// 0, the default, sends them at once.
+int host_sim_set_link_capacity(uint16_t conn_handle, uint16_t packets_per_event);
+
+// Runs a connection event, sending queued notifications.
+int host_sim_conn_event(uint16_t conn_handle);
+
+typedef void host_sim_notify_fn(uint16_t conn_handle, uint16_t attr_handle,
+                                const uint8_t* data, uint16_t len, void* context);
+
+// Called for every notification as it reaches the link.
+void host_sim_set_notify_hook(host_sim_notify_fn* fn, void* context);
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#define BLE_ADDR_PUBLIC     0x00
+#define BLE_ADDR_RANDOM     0x01
+
+typedef struct {
+    uint8_t type;
+    uint8_t val[6];
+} ble_addr_t;
+
+static inline int ble_addr_cmp(const ble_addr_t* a, const ble_addr_t* b)
+{
+    int type_diff = a->type - b->type;
+    if (type_diff != 0)
+    {
+        return type_diff;
+    }
+
+    return memcmp(a->val, b->val, sizeof(a->val));
+}
+
+#define BLE_HCI_LE_PHY_1M           1
+#define BLE_HCI_LE_PHY_2M           2
+#define BLE_HCI_LE_PHY_CODED        3
+
+#define BLE_GAP_LE_PHY_1M_MASK      0x01
+#define BLE_GAP_LE_PHY_2M_MASK      0x02
+#define BLE_GAP_LE_PHY_CODED_MASK   0x04
+#define BLE_GAP_LE_PHY_ANY_MASK     0x0f
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// The NimBLE porting layer event queue. The default queue is the one the
+// host task drains; see host_sim_hold_host_task() for when its events run.
+
+struct ble_npl_event;
+
+typedef void ble_npl_event_fn(struct ble_npl_event* ev);
+
+struct ble_npl_event {
+    bool queued;
+    ble_npl_event_fn* fn;
+    void* arg;
+    struct ble_npl_event* next;
+};
+
+struct ble_npl_eventq {
+    struct ble_npl_event* head;
+    struct ble_npl_event* tail;
+};
+
+void ble_npl_event_init(struct ble_npl_event* ev, ble_npl_event_fn* fn, void* arg);
+
+void* ble_npl_event_get_arg(struct ble_npl_event* ev);
+
+bool ble_npl_event_is_queued(struct ble_npl_event* ev);
+
+// Adding an event that is already queued does nothing, as in NimBLE.
+void ble_npl_eventq_put(struct ble_npl_eventq* evq, struct ble_npl_event* ev);
+
+void ble_npl_eventq_remove(struct ble_npl_eventq* evq, struct ble_npl_event* ev);
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+// On the host this synchronises the stack immediately (runs ble_hs_cfg.sync_cb)
+// instead of spawning the host task.
+void nimble_port_freertos_init(TaskFunction_t host_task_fn);
+
+void nimble_port_freertos_deinit(void);
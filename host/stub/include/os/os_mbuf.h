@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+
+// Layout-compatible subset of the NimBLE/Mynewt mbuf API, backed by a fixed
+// block pool so that allocation failures and fragmented chains can be
+// reproduced on the host (see host_sim_mbuf_configure()).
+
+struct os_mbuf_pool;
+
+struct os_mbuf {
+    uint8_t* om_data;
+    uint8_t om_flags;
+    uint8_t om_pkthdr_len;
+    uint16_t om_len;
+    struct os_mbuf_pool* om_omp;
+    struct {
+        struct os_mbuf* sle_next;
+    } om_next;
+    uint8_t om_databuf[0];
+};
+
+struct os_mbuf_pkthdr {
+    uint16_t omp_len;
+    uint16_t omp_flags;
+    struct {
+        struct os_mbuf_pkthdr* stqe_next;
+    } omp_next;
+};
+
+#define SLIST_NEXT(elm, field) ((elm)->field.sle_next)
+
+#define OS_MBUF_PKTHDR(__om) \
+    ((struct os_mbuf_pkthdr*)(void*)((uint8_t*)&(__om)->om_data + sizeof(struct os_mbuf)))
+
+#define OS_MBUF_PKTLEN(__om) (OS_MBUF_PKTHDR(__om)->omp_len)
+
+#define OS_MBUF_DATA(__om, __type) (__type)((__om)->om_data)
+
+#define OS_MBUF_IS_PKTHDR(__om) \
+    ((__om)->om_pkthdr_len >= sizeof(struct os_mbuf_pkthdr))
+
+struct os_mbuf* os_msys_get_pkthdr(uint16_t dsize, uint16_t user_hdr_len);
+
+struct os_mbuf* os_msys_get(uint16_t dsize, uint16_t leadingspace);
+
+int os_msys_count(void);
+
+int os_msys_num_free(void);
+
+int os_mbuf_append(struct os_mbuf* om, const void* data, uint16_t len);
+
+void* os_mbuf_extend(struct os_mbuf* om, uint16_t len);
+
+// Trims req_len bytes from the front of the chain, or from the back if
+// negative.
+void os_mbuf_adj(struct os_mbuf* mp, int req_len);
+
+int os_mbuf_copydata(const struct os_mbuf* m, int off, int len, void* dst);
+
+struct os_mbuf* os_mbuf_dup(struct os_mbuf* m);
+
+int os_mbuf_free(struct os_mbuf* mb);
+
+int os_mbuf_free_chain(struct os_mbuf* om);
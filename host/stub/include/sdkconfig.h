@@ -0,0 +1,79 @@
+/*
+ * Host build configuration. Mirrors the values in the project sdkconfig that
+ * the gble sources depend on; anything else keeps the ESP-IDF default.
+ */
+
+#pragma once
+
+#ifndef CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#define CONFIG_BT_NIMBLE_MAX_CONNECTIONS 3
+#endif
+
+#ifndef CONFIG_NIMBLE_MAX_CONNECTIONS
+#define CONFIG_NIMBLE_MAX_CONNECTIONS CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#endif
+
+// The host build turns on extended advertising, which the project leaves
+// off, to run the sensor broadcast set next to the connectable one.
+// -DCONFIG_BT_NIMBLE_EXT_ADV=0 builds the legacy advertising instead.
+#ifndef CONFIG_BT_NIMBLE_EXT_ADV
+#define CONFIG_BT_NIMBLE_EXT_ADV 1
+#endif
+
+#if CONFIG_BT_NIMBLE_EXT_ADV
+#define CONFIG_BT_NIMBLE_MAX_EXT_ADV_INSTANCES 2
+#define CONFIG_BT_NIMBLE_EXT_ADV_MAX_SIZE 251
+#define CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV 1
+#define CONFIG_GBLE_BROADCAST 1
+#define CONFIG_GBLE_BROADCAST_PERIODIC 1
+#endif
+
+#define CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU 256
+#define CONFIG_BT_NIMBLE_MAX_BONDS 3
+#define CONFIG_BT_NIMBLE_MSYS_1_BLOCK_COUNT 12
+#define CONFIG_BT_NIMBLE_MSYS_1_BLOCK_SIZE 256
+#define CONFIG_FREERTOS_HZ 1000
+#define CONFIG_LOG_DEFAULT_LEVEL 2
+
+#ifndef CONFIG_GBLE_RUNTIME_DESCRIPTOR
+#define CONFIG_GBLE_RUNTIME_DESCRIPTOR 1
+#endif
+
+#define CONFIG_GBLE_ACTUATOR_TASK_PRIORITY 5
+#define CONFIG_GBLE_ACTUATOR_TASK_STACK_SIZE 3072
+#define CONFIG_GBLE_ACTUATOR_TASK_MAX_ACTUATORS 16
+#define CONFIG_GBLE_RAMP_TICK_HZ 1000
+#define CONFIG_GBLE_RAMP_MAX_ACTUATORS 16
+#define CONFIG_GBLE_MOTION_TICK_HZ 1000
+#define CONFIG_GBLE_MOTION_MAX_ACTUATORS 8
+#define CONFIG_GBLE_PATTERN_TICK_HZ 100
+#define CONFIG_GBLE_PATTERN_MAX_ACTUATORS 16
+#define CONFIG_GBLE_PATTERN_POOL_SIZE 8
+#define CONFIG_GBLE_PATTERN_MAX_KEYFRAMES 64
+#define CONFIG_GBLE_PATTERN_NVS 1
+#define CONFIG_GBLE_JITTER_TICK_HZ 1000
+#define CONFIG_GBLE_JITTER_DEPTH_MS 60
+#define CONFIG_GBLE_JITTER_QUEUE_DEPTH 8
+#define CONFIG_GBLE_JITTER_MAX_ACTUATORS 16
+#define CONFIG_GBLE_TIME_SYNC_WINDOW 64
+#define CONFIG_GBLE_SENSOR_COALESCE_MS 10
+#define CONFIG_GBLE_NOTIFY_QUEUE_DEPTH 8
+#define CONFIG_GBLE_NOTIFY_STACK_BLOCKS 4
+#define CONFIG_GBLE_MAX_WRITE_SIZE 512
+#define CONFIG_GBLE_STREAM_MAX_SENSORS 8
+#define CONFIG_GBLE_CONN_PROFILE 1
+#define CONFIG_GBLE_CONN_PARAM_RETRIES 2
+#define CONFIG_GBLE_CONN_PARAM_RETRY_MS 1000
+#define CONFIG_GBLE_CONN_IDLE_MS 2000
+#define CONFIG_GBLE_CONN_ACTIVE_COMMANDS 1
+#define CONFIG_GBLE_ARBITER_POLICY 0
+#define CONFIG_GBLE_ARBITER_LEASE_MS 1000
+#define CONFIG_GBLE_ARBITER_MAX_CLIENTS 4
+#define CONFIG_GBLE_ARBITER_MAX_ACTUATORS 16
+#define CONFIG_GBLE_ADV_DIRECTED_MS 1280
+#define CONFIG_GBLE_ADV_FAST_MS 30000
+#define CONFIG_GBLE_ADV_FAST_ITVL_MS 30
+#define CONFIG_GBLE_ADV_SLOW_ITVL_MS 211
+#define CONFIG_GBLE_BROADCAST_INTERVAL_MS 100
+#define CONFIG_GBLE_BROADCAST_COMPANY_ID 0xFFFF
+#define CONFIG_GBLE_BROADCAST_MAX_SENSORS 16
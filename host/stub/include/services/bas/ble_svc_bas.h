@@ -0,0 +1,4 @@
+#pragma once
+
+#define BLE_SVC_BAS_UUID16                  0x180F
+#define BLE_SVC_BAS_CHR_UUID16_BATTERY_LEVEL 0x2A19
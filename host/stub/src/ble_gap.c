@@ -0,0 +1,1383 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "esp_timer.h"
+
+#include "host_sim_priv.h"
+
+// Defaults a typical phone central picks: 30 ms interval, no latency, 4 s
+// supervision timeout.
+#define HOST_SIM_DEFAULT_ITVL       24
+#define HOST_SIM_DEFAULT_TIMEOUT    400
+
+// NimBLE's undirected advertising interval when none is given, 30 ms, and
+// the high duty cycle directed one
+#define HOST_SIM_DEFAULT_ADV_ITVL   48
+#define HOST_SIM_HIGH_DUTY_ADV_US   3750
+#define HOST_SIM_ADV_DELAY_MAX_US   10000
+
+// Connection events before a requested procedure completes: a parameter
+// update waits for its instant, the others for a request and response.
+#define HOST_SIM_UPDATE_EVENTS      6
+#define HOST_SIM_PHY_EVENTS         2
+#define HOST_SIM_DATA_LEN_EVENTS    1
+#define HOST_SIM_MTU_EVENTS         2
+
+enum host_sim_proc_kind {
+    HOST_SIM_PROC_CONN_UPDATE,
+    HOST_SIM_PROC_PHY,
+    HOST_SIM_PROC_DATA_LEN,
+    HOST_SIM_PROC_MTU,
+    HOST_SIM_PROC_COUNT
+};
+
+// A procedure the peripheral started, answered when its timer fires
+struct host_sim_proc {
+    esp_timer_handle_t timer;
+    enum host_sim_proc_kind kind;
+    uint16_t conn_handle;
+    struct ble_gap_upd_params params;
+    uint16_t value;
+};
+
+struct host_sim_adv {
+    bool active;
+    ble_gap_event_fn* cb;
+    void* cb_arg;
+    struct ble_gap_adv_params params;
+    bool directed;
+    ble_addr_t direct_addr;
+
+    esp_timer_handle_t timer;
+
+    uint8_t data[BLE_HS_ADV_MAX_SZ];
+    uint8_t data_len;
+
+    // Bumped on every start, so a scan notices advertising changed
+    uint32_t generation;
+    int64_t next_event_us;
+    uint32_t seed;
+
+    struct host_sim_adv_stats stats;
+
+    // Started as extended advertising set 0, which reports the connection
+    // that ends it
+    bool ext;
+};
+
+static struct host_sim_adv adv;
+
+struct host_sim_ext_set {
+    bool configured;
+    bool active;
+    struct ble_gap_ext_adv_params params;
+    ble_gap_event_fn* cb;
+    void* cb_arg;
+    int64_t active_since_us;
+
+    uint8_t data[HOST_SIM_EXT_ADV_MAX_SZ];
+    uint16_t data_len;
+
+    bool periodic_configured;
+    bool periodic_active;
+    struct ble_gap_periodic_adv_params periodic_params;
+    int64_t periodic_since_us;
+
+    uint8_t periodic_data[HOST_SIM_EXT_ADV_MAX_SZ];
+    uint16_t periodic_data_len;
+
+    struct host_sim_ext_adv_stats stats;
+};
+
+static struct host_sim_ext_set ext_sets[HOST_SIM_EXT_ADV_INSTANCES];
+
+static ble_addr_t bonds[CONFIG_BT_NIMBLE_MAX_BONDS];
+static int bond_count;
+
+static int bond_find(const ble_addr_t* addr)
+{
+    for (int idx = 0; idx < bond_count; ++idx)
+    {
+        if (ble_addr_cmp(&bonds[idx], addr) == 0)
+        {
+            return idx;
+        }
+    }
+
+    return -1;
+}
+static struct host_sim_conn conns[HOST_SIM_MAX_CONNECTIONS];
+
+static host_sim_notify_fn* notify_hook;
+static void* notify_hook_context;
+
+static uint16_t conn_handle_first;
+static uint16_t conn_handle_step = 1;
+
+static struct host_sim_proc procs[HOST_SIM_MAX_CONNECTIONS][HOST_SIM_PROC_COUNT];
+
+static const struct host_sim_central default_central = {
+    .itvl_floor = 6,
+    .reject_updates = 0,
+    .phy_2m = true,
+    .max_tx_octets = 251,
+    .mtu = 517,
+};
+static struct host_sim_central central;
+
+void host_sim_gap_reset(void)
+{
+    if (adv.timer)
+    {
+        esp_timer_delete(adv.timer);
+    }
+
+    for (size_t idx = 0; idx < HOST_SIM_MAX_CONNECTIONS; ++idx)
+    {
+        for (size_t kind = 0; kind < HOST_SIM_PROC_COUNT; ++kind)
+        {
+            if (procs[idx][kind].timer)
+            {
+                esp_timer_delete(procs[idx][kind].timer);
+            }
+        }
+    }
+
+    memset(&adv, 0, sizeof(adv));
+    adv.seed = 1;
+    memset(ext_sets, 0, sizeof(ext_sets));
+    memset(conns, 0, sizeof(conns));
+    bond_count = 0;
+    memset(procs, 0, sizeof(procs));
+    central = default_central;
+
+    notify_hook = NULL;
+    notify_hook_context = NULL;
+
+    conn_handle_first = 0;
+    conn_handle_step = 1;
+}
+
+void host_sim_set_conn_handles(uint16_t first, uint16_t step)
+{
+    conn_handle_first = first;
+    conn_handle_step = step ? step : 1;
+}
+
+void host_sim_set_central(const struct host_sim_central* policy)
+{
+    central = *policy;
+}
+
+struct host_sim_conn* host_sim_conn_get(uint16_t conn_handle)
+{
+    for (size_t idx = 0; idx < HOST_SIM_MAX_CONNECTIONS; ++idx)
+    {
+        if (conns[idx].used && conns[idx].conn_handle == conn_handle)
+        {
+            return &conns[idx];
+        }
+    }
+
+    return NULL;
+}
+
+static int conn_event(struct host_sim_conn* conn, struct ble_gap_event* event)
+{
+    return conn->cb ? conn->cb(event, conn->cb_arg) : 0;
+}
+
+void host_sim_set_notify_hook(host_sim_notify_fn* fn, void* context)
+{
+    notify_hook = fn;
+    notify_hook_context = context;
+}
+
+// Puts a notification on the air and frees it
+static void link_send(struct host_sim_conn* conn, uint16_t attr_handle, struct os_mbuf* om)
+{
+    struct host_sim_conn_stats* stats = &conn->stats;
+    uint16_t len = OS_MBUF_PKTLEN(om);
+    uint16_t max_len = conn->mtu - 3;
+
+    if (len > max_len)
+    {
+        len = max_len;
+    }
+
+    ++stats->notify_count;
+    stats->notify_bytes += len;
+    stats->last_attr_handle = attr_handle;
+    ble_hs_mbuf_to_flat(om, stats->last, sizeof(stats->last), &stats->last_len);
+
+    if (notify_hook)
+    {
+        notify_hook(conn->conn_handle, attr_handle, stats->last,
+                    stats->last_len < len ? stats->last_len : len, notify_hook_context);
+    }
+
+    os_mbuf_free_chain(om);
+}
+
+static void link_flush(struct host_sim_conn* conn)
+{
+    while (conn->link_queue_count > 0)
+    {
+        os_mbuf_free_chain(conn->link_queue[conn->link_queue_head].om);
+        conn->link_queue_head = (conn->link_queue_head + 1) % HOST_SIM_LINK_QUEUE;
+        --conn->link_queue_count;
+    }
+}
+
+int host_sim_gap_tx_notify(uint16_t conn_handle, uint16_t attr_handle,
+                           struct os_mbuf* om)
+{
+    struct host_sim_conn* conn = host_sim_conn_get(conn_handle);
+    int rc = om ? 0 : BLE_HS_ENOMEM;
+
+    if (om && conn->link_capacity == 0)
+    {
+        link_send(conn, attr_handle, om);
+    }
+    else if (om && conn->link_queue_count == HOST_SIM_LINK_QUEUE)
+    {
+        os_mbuf_free_chain(om);
+        rc = BLE_HS_ENOMEM;
+    }
+    else if (om)
+    {
+        const size_t tail = (conn->link_queue_head + conn->link_queue_count) % HOST_SIM_LINK_QUEUE;
+        conn->link_queue[tail].attr_handle = attr_handle;
+        conn->link_queue[tail].om = om;
+        ++conn->link_queue_count;
+    }
+
+    struct ble_gap_event event = { .type = BLE_GAP_EVENT_NOTIFY_TX };
+    event.notify_tx.status = rc;
+    event.notify_tx.conn_handle = conn_handle;
+    event.notify_tx.attr_handle = attr_handle;
+    event.notify_tx.indication = 0;
+    conn_event(conn, &event);
+
+    return rc;
+}
+
+int host_sim_set_link_capacity(uint16_t conn_handle, uint16_t packets_per_event)
+{
+    struct host_sim_conn* conn = host_sim_conn_get(conn_handle);
+    if (!conn)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+
+    conn->link_capacity = packets_per_event;
+    return 0;
+}
+
+int host_sim_conn_event(uint16_t conn_handle)
+{
+    struct host_sim_conn* conn = host_sim_conn_get(conn_handle);
+    if (!conn)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+
+    for (uint16_t sent = 0; sent < conn->link_capacity && conn->link_queue_count > 0; ++sent)
+    {
+        const size_t head = conn->link_queue_head;
+        conn->link_queue_head = (head + 1) % HOST_SIM_LINK_QUEUE;
+        --conn->link_queue_count;
+
+        link_send(conn, conn->link_queue[head].attr_handle, conn->link_queue[head].om);
+    }
+
+    return 0;
+}
+
+// Advertising
+
+static int64_t adv_itvl_us(void)
+{
+    if (adv.directed && adv.params.high_duty_cycle)
+    {
+        return HOST_SIM_HIGH_DUTY_ADV_US;
+    }
+
+    const uint16_t itvl = adv.params.itvl_min ? adv.params.itvl_min : HOST_SIM_DEFAULT_ADV_ITVL;
+    return (int64_t)itvl * BLE_HCI_ADV_ITVL;
+}
+
+// The next event follows at the interval plus advDelay, which high duty
+// cycle directed advertising goes without
+static void adv_next_event(void)
+{
+    adv.next_event_us += adv_itvl_us();
+    ++adv.stats.events;
+
+    if (!(adv.directed && adv.params.high_duty_cycle))
+    {
+        adv.seed = adv.seed * 1103515245 + 12345;
+        adv.next_event_us += (adv.seed >> 8) % (HOST_SIM_ADV_DELAY_MAX_US + 1);
+    }
+}
+
+// Counts the advertising events sent up to until_us. Nobody scanned for
+// them, so they are spaced by the mean advDelay rather than one at a time.
+static void adv_run_events(int64_t until_us)
+{
+    if (adv.next_event_us > until_us)
+    {
+        return;
+    }
+
+    int64_t gap_us = adv_itvl_us();
+    if (!(adv.directed && adv.params.high_duty_cycle))
+    {
+        gap_us += HOST_SIM_ADV_DELAY_MAX_US / 2;
+    }
+
+    const int64_t count = (until_us - adv.next_event_us) / gap_us + 1;
+
+    adv.next_event_us += count * gap_us;
+    adv.stats.events += count;
+}
+
+static void adv_timeout(void* arg)
+{
+    if (!adv.active)
+    {
+        return;
+    }
+
+    adv_run_events(host_sim_now_us());
+    adv.active = false;
+
+    struct ble_gap_event event = { .type = BLE_GAP_EVENT_ADV_COMPLETE };
+    event.adv_complete.reason = BLE_HS_ETIMEOUT;
+
+    if (adv.cb)
+    {
+        adv.cb(&event, adv.cb_arg);
+    }
+}
+
+int ble_gap_adv_start(uint8_t own_addr_type, const ble_addr_t* direct_addr,
+                      int32_t duration_ms,
+                      const struct ble_gap_adv_params* adv_params,
+                      ble_gap_event_fn* cb, void* cb_arg)
+{
+    if (adv.active)
+    {
+        return BLE_HS_EALREADY;
+    }
+
+    adv.active = true;
+    adv.cb = cb;
+    adv.cb_arg = cb_arg;
+    adv.params = *adv_params;
+    adv.directed = direct_addr != NULL;
+    adv.ext = false;
+    adv.next_event_us = host_sim_now_us();
+    ++adv.generation;
+    ++adv.stats.starts;
+
+    if (direct_addr)
+    {
+        adv.direct_addr = *direct_addr;
+    }
+
+    if (!adv.timer)
+    {
+        const esp_timer_create_args_t args = {
+            .callback = adv_timeout,
+            .name = "host_sim_adv",
+        };
+        esp_timer_create(&args, &adv.timer);
+    }
+
+    if (duration_ms != BLE_HS_FOREVER)
+    {
+        esp_timer_start_once(adv.timer, (uint64_t)duration_ms * 1000);
+    }
+
+    return 0;
+}
+
+int ble_gap_adv_stop(void)
+{
+    if (!adv.active)
+    {
+        return BLE_HS_EALREADY;
+    }
+
+    adv_run_events(host_sim_now_us());
+    adv.active = false;
+
+    if (esp_timer_is_active(adv.timer))
+    {
+        esp_timer_stop(adv.timer);
+    }
+
+    return 0;
+}
+
+int ble_gap_adv_active(void)
+{
+    return adv.active;
+}
+
+int ble_gap_adv_set_data(const uint8_t* data, int data_len)
+{
+    if (data_len > BLE_HS_ADV_MAX_SZ)
+    {
+        return BLE_HS_EINVAL;
+    }
+
+    memcpy(adv.data, data, data_len);
+    adv.data_len = data_len;
+    ++adv.stats.data_sets;
+    return 0;
+}
+
+int ble_gap_adv_set_fields(const struct ble_hs_adv_fields* adv_fields)
+{
+    uint8_t buf[BLE_HS_ADV_MAX_SZ];
+    uint8_t buf_len;
+
+    int rc = ble_hs_adv_set_fields(adv_fields, buf, &buf_len, sizeof(buf));
+    if (rc != 0)
+    {
+        return rc;
+    }
+
+    return ble_gap_adv_set_data(buf, buf_len);
+}
+
+bool host_sim_advertising(void)
+{
+    return adv.active;
+}
+
+void host_sim_adv_stats(struct host_sim_adv_stats* stats)
+{
+    if (adv.active)
+    {
+        adv_run_events(host_sim_now_us());
+    }
+
+    *stats = adv.stats;
+}
+
+int host_sim_scan_connect(const uint8_t peer_addr[6], const struct host_sim_scan* scan,
+                          int64_t limit_us, uint16_t* out_conn_handle)
+{
+    while (true)
+    {
+        const int64_t now_us = host_sim_now_us();
+
+        // Nothing on air: wait for the application to advertise again
+        if (!adv.active)
+        {
+            if (now_us >= limit_us)
+            {
+                return BLE_HS_ETIMEOUT;
+            }
+
+            host_sim_advance_us(limit_us - now_us < 1000 ? limit_us - now_us : 1000);
+            continue;
+        }
+
+        const uint32_t generation = adv.generation;
+        const int64_t event_us = adv.next_event_us;
+
+        if (event_us > limit_us)
+        {
+            host_sim_advance_us(limit_us - now_us);
+            return BLE_HS_ETIMEOUT;
+        }
+
+        if (event_us > now_us)
+        {
+            host_sim_advance_us(event_us - now_us);
+        }
+
+        // A timer stopped or restarted advertising on the way
+        if (!adv.active || adv.generation != generation)
+        {
+            continue;
+        }
+
+        adv_next_event();
+
+        if (event_us < scan->start_us ||
+            (event_us - scan->start_us) % scan->interval_us >= scan->window_us ||
+            adv.params.conn_mode == BLE_GAP_CONN_MODE_NON ||
+            (adv.directed && memcmp(adv.direct_addr.val, peer_addr, 6) != 0))
+        {
+            continue;
+        }
+
+        return host_sim_connect(peer_addr, out_conn_handle);
+    }
+}
+
+int host_sim_restart_advertising(void)
+{
+    if (adv.active)
+    {
+        return BLE_HS_EALREADY;
+    }
+
+    if (!adv.cb)
+    {
+        return BLE_HS_EINVAL;
+    }
+
+    adv.active = true;
+    return 0;
+}
+
+// Extended advertising
+
+static void ext_set_run_events(struct host_sim_ext_set* set)
+{
+    const int64_t now_us = host_sim_now_us();
+
+    if (set->active)
+    {
+        const int64_t gap_us = (int64_t)set->params.itvl_min * BLE_HCI_ADV_ITVL +
+                               HOST_SIM_ADV_DELAY_MAX_US / 2;
+        const int64_t count = (now_us - set->active_since_us) / gap_us;
+
+        set->stats.events += count;
+        set->active_since_us += count * gap_us;
+    }
+
+    if (set->active && set->periodic_active)
+    {
+        const int64_t gap_us = (int64_t)set->periodic_params.itvl_min * 1250;
+        const int64_t count = (now_us - set->periodic_since_us) / gap_us;
+
+        set->stats.periodic_events += count;
+        set->periodic_since_us += count * gap_us;
+    }
+}
+
+static int ext_set_copy_data(struct os_mbuf* data, uint8_t* dst, uint16_t max_len, uint16_t* out_len)
+{
+    const uint16_t len = data ? OS_MBUF_PKTLEN(data) : 0;
+    int rc = 0;
+
+    if (len > max_len)
+    {
+        rc = BLE_HS_EINVAL;
+    }
+    else
+    {
+        if (len)
+        {
+            os_mbuf_copydata(data, 0, len, dst);
+        }
+        *out_len = len;
+    }
+
+    if (data)
+    {
+        os_mbuf_free_chain(data);
+    }
+
+    return rc;
+}
+
+int ble_gap_ext_adv_configure(uint8_t instance, const struct ble_gap_ext_adv_params* params,
+                              int8_t* selected_tx_power, ble_gap_event_fn* cb, void* cb_arg)
+{
+    if (instance >= HOST_SIM_EXT_ADV_INSTANCES || (params->legacy_pdu && params->itvl_min < 32))
+    {
+        return BLE_HS_EINVAL;
+    }
+
+    struct host_sim_ext_set* set = &ext_sets[instance];
+
+    if (set->active || (instance == 0 && adv.active))
+    {
+        return BLE_HS_EBUSY;
+    }
+
+    // Only set 0 takes connections
+    if (instance != 0 && params->connectable)
+    {
+        return BLE_HS_EINVAL;
+    }
+
+    set->configured = true;
+    set->params = *params;
+    set->cb = cb;
+    set->cb_arg = cb_arg;
+    set->data_len = 0;
+
+    if (selected_tx_power)
+    {
+        *selected_tx_power = 0;
+    }
+
+    return 0;
+}
+
+int ble_gap_ext_adv_set_data(uint8_t instance, struct os_mbuf* data)
+{
+    if (instance >= HOST_SIM_EXT_ADV_INSTANCES || !ext_sets[instance].configured)
+    {
+        os_mbuf_free_chain(data);
+        return BLE_HS_EINVAL;
+    }
+
+    struct host_sim_ext_set* set = &ext_sets[instance];
+
+    if (instance == 0)
+    {
+        uint16_t len;
+        const int rc = ext_set_copy_data(data, adv.data, sizeof(adv.data), &len);
+        if (rc == 0)
+        {
+            adv.data_len = len;
+            ++adv.stats.data_sets;
+        }
+        return rc;
+    }
+
+    const int rc = ext_set_copy_data(data, set->data, sizeof(set->data), &set->data_len);
+    if (rc == 0)
+    {
+        ++set->stats.data_sets;
+        set->stats.data_bytes += set->data_len;
+    }
+    return rc;
+}
+
+int ble_gap_ext_adv_start(uint8_t instance, int duration, int max_events)
+{
+    if (instance >= HOST_SIM_EXT_ADV_INSTANCES || !ext_sets[instance].configured)
+    {
+        return BLE_HS_EINVAL;
+    }
+
+    struct host_sim_ext_set* set = &ext_sets[instance];
+
+    if (instance == 0)
+    {
+        struct ble_gap_adv_params params = {
+            .conn_mode = !set->params.connectable ? BLE_GAP_CONN_MODE_NON :
+                         set->params.directed ? BLE_GAP_CONN_MODE_DIR : BLE_GAP_CONN_MODE_UND,
+            .disc_mode = set->params.directed ? BLE_GAP_DISC_MODE_NON : BLE_GAP_DISC_MODE_GEN,
+            .itvl_min = set->params.itvl_min,
+            .itvl_max = set->params.itvl_max,
+            .high_duty_cycle = set->params.high_duty_directed,
+        };
+
+        const int rc = ble_gap_adv_start(set->params.own_addr_type,
+                                         set->params.directed ? &set->params.peer : NULL,
+                                         duration ? duration * 10 : BLE_HS_FOREVER,
+                                         &params, set->cb, set->cb_arg);
+        if (rc == 0)
+        {
+            adv.ext = true;
+        }
+        return rc;
+    }
+
+    if (set->active)
+    {
+        return BLE_HS_EALREADY;
+    }
+
+    set->active = true;
+    set->active_since_us = host_sim_now_us();
+    set->periodic_since_us = set->active_since_us;
+    return 0;
+}
+
+int ble_gap_ext_adv_stop(uint8_t instance)
+{
+    if (instance >= HOST_SIM_EXT_ADV_INSTANCES)
+    {
+        return BLE_HS_EINVAL;
+    }
+
+    if (instance == 0)
+    {
+        return ble_gap_adv_stop();
+    }
+
+    struct host_sim_ext_set* set = &ext_sets[instance];
+
+    if (!set->active)
+    {
+        return BLE_HS_EALREADY;
+    }
+
+    ext_set_run_events(set);
+    set->active = false;
+    return 0;
+}
+
+bool ble_gap_ext_adv_active(uint8_t instance)
+{
+    if (instance >= HOST_SIM_EXT_ADV_INSTANCES)
+    {
+        return false;
+    }
+
+    return instance == 0 ? adv.active : ext_sets[instance].active;
+}
+
+int ble_gap_periodic_adv_configure(uint8_t instance, const struct ble_gap_periodic_adv_params* params)
+{
+    if (instance == 0 || instance >= HOST_SIM_EXT_ADV_INSTANCES || !ext_sets[instance].configured ||
+        ext_sets[instance].params.legacy_pdu || ext_sets[instance].params.scannable ||
+        params->itvl_min < 6)
+    {
+        return BLE_HS_EINVAL;
+    }
+
+    struct host_sim_ext_set* set = &ext_sets[instance];
+
+    if (set->periodic_active)
+    {
+        return BLE_HS_EBUSY;
+    }
+
+    set->periodic_configured = true;
+    set->periodic_params = *params;
+    set->periodic_data_len = 0;
+    return 0;
+}
+
+int ble_gap_periodic_adv_set_data(uint8_t instance, struct os_mbuf* data)
+{
+    if (instance >= HOST_SIM_EXT_ADV_INSTANCES || !ext_sets[instance].periodic_configured)
+    {
+        os_mbuf_free_chain(data);
+        return BLE_HS_EINVAL;
+    }
+
+    struct host_sim_ext_set* set = &ext_sets[instance];
+
+    const int rc = ext_set_copy_data(data, set->periodic_data, sizeof(set->periodic_data), &set->periodic_data_len);
+    if (rc == 0)
+    {
+        ++set->stats.periodic_data_sets;
+        set->stats.data_bytes += set->periodic_data_len;
+    }
+    return rc;
+}
+
+int ble_gap_periodic_adv_start(uint8_t instance)
+{
+    if (instance >= HOST_SIM_EXT_ADV_INSTANCES || !ext_sets[instance].periodic_configured)
+    {
+        return BLE_HS_EINVAL;
+    }
+
+    struct host_sim_ext_set* set = &ext_sets[instance];
+
+    ext_set_run_events(set);
+    set->periodic_active = true;
+    set->periodic_since_us = host_sim_now_us();
+    return 0;
+}
+
+int ble_gap_periodic_adv_stop(uint8_t instance)
+{
+    if (instance >= HOST_SIM_EXT_ADV_INSTANCES || !ext_sets[instance].periodic_active)
+    {
+        return BLE_HS_EALREADY;
+    }
+
+    ext_set_run_events(&ext_sets[instance]);
+    ext_sets[instance].periodic_active = false;
+    return 0;
+}
+
+void host_sim_ext_adv_stats(uint8_t instance, struct host_sim_ext_adv_stats* stats)
+{
+    if (instance == 0 || instance >= HOST_SIM_EXT_ADV_INSTANCES)
+    {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    ext_set_run_events(&ext_sets[instance]);
+    *stats = ext_sets[instance].stats;
+}
+
+int host_sim_observe(uint8_t instance, uint8_t* buf, size_t buf_size, size_t* out_len)
+{
+    if (instance == 0 || instance >= HOST_SIM_EXT_ADV_INSTANCES || !ext_sets[instance].active)
+    {
+        return BLE_HS_ENOENT;
+    }
+
+    const struct host_sim_ext_set* set = &ext_sets[instance];
+    const uint8_t* data = set->periodic_active ? set->periodic_data : set->data;
+    const uint16_t len = set->periodic_active ? set->periodic_data_len : set->data_len;
+
+    if (len > buf_size)
+    {
+        return BLE_HS_ENOMEM;
+    }
+
+    memcpy(buf, data, len);
+    *out_len = len;
+    return 0;
+}
+
+// Connections
+
+static void conn_desc(const struct host_sim_conn* conn, struct ble_gap_conn_desc* desc)
+{
+    memset(desc, 0, sizeof(*desc));
+    desc->conn_handle = conn->conn_handle;
+    desc->peer_id_addr = conn->peer_addr;
+    desc->peer_ota_addr = conn->peer_addr;
+    desc->conn_itvl = conn->conn_itvl;
+    desc->conn_latency = conn->conn_latency;
+    desc->supervision_timeout = conn->supervision_timeout;
+    desc->role = BLE_GAP_ROLE_SLAVE;
+    desc->sec_state.encrypted = conn->bonded;
+    desc->sec_state.bonded = conn->bonded;
+}
+
+int ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc* out_desc)
+{
+    const struct host_sim_conn* conn = host_sim_conn_get(handle);
+    if (!conn)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+
+    if (out_desc)
+    {
+        conn_desc(conn, out_desc);
+    }
+
+    return 0;
+}
+
+int host_sim_connect(const uint8_t peer_addr[6], uint16_t* out_conn_handle)
+{
+    if (!adv.active || adv.params.conn_mode == BLE_GAP_CONN_MODE_NON)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+
+    if (adv.directed && memcmp(adv.direct_addr.val, peer_addr, 6) != 0)
+    {
+        return BLE_HS_EREJECT;
+    }
+
+    const bool adv_ext = adv.ext;
+    ble_gap_event_fn* const adv_cb = adv.cb;
+    void* const adv_cb_arg = adv.cb_arg;
+
+    struct host_sim_conn* conn = NULL;
+    for (size_t idx = 0; idx < HOST_SIM_MAX_CONNECTIONS; ++idx)
+    {
+        if (!conns[idx].used)
+        {
+            conn = &conns[idx];
+            break;
+        }
+    }
+
+    if (!conn)
+    {
+        return BLE_HS_ENOMEM;
+    }
+
+    // Controllers hand out the lowest free handle.
+    uint16_t conn_handle = conn_handle_first;
+    while (host_sim_conn_get(conn_handle))
+    {
+        conn_handle += conn_handle_step;
+    }
+
+    memset(conn, 0, sizeof(*conn));
+    conn->used = true;
+    conn->conn_handle = conn_handle;
+    conn->peer_addr.type = BLE_ADDR_PUBLIC;
+    memcpy(conn->peer_addr.val, peer_addr, 6);
+    conn->mtu = BLE_ATT_MTU_DFLT;
+    conn->conn_itvl = HOST_SIM_DEFAULT_ITVL;
+    conn->supervision_timeout = HOST_SIM_DEFAULT_TIMEOUT;
+    conn->tx_phy = BLE_HCI_LE_PHY_1M;
+    conn->tx_octets = 27;
+    conn->central = central;
+    conn->cb = adv.cb;
+    conn->cb_arg = adv.cb_arg;
+
+    // A legacy advertisement ends when a central connects to it.
+    ble_gap_adv_stop();
+
+    if (out_conn_handle)
+    {
+        *out_conn_handle = conn_handle;
+    }
+
+    struct ble_gap_event event = { .type = BLE_GAP_EVENT_CONNECT };
+    event.connect.status = 0;
+    event.connect.conn_handle = conn_handle;
+    conn_event(conn, &event);
+
+    if (bond_find(&conn->peer_addr) >= 0 && host_sim_conn_get(conn_handle))
+    {
+        conn->bonded = true;
+
+        struct ble_gap_event enc = { .type = BLE_GAP_EVENT_ENC_CHANGE };
+        enc.enc_change.status = 0;
+        enc.enc_change.conn_handle = conn_handle;
+        conn_event(conn, &enc);
+    }
+
+    // The controller ends the extended advertising set after the
+    // connection, naming it
+    if (adv_ext && adv_cb)
+    {
+        struct ble_gap_event complete = { .type = BLE_GAP_EVENT_ADV_COMPLETE };
+        complete.adv_complete.reason = 0;
+        complete.adv_complete.instance = 0;
+        complete.adv_complete.conn_handle = conn_handle;
+        adv_cb(&complete, adv_cb_arg);
+    }
+
+    return 0;
+}
+
+int host_sim_bond(uint16_t conn_handle)
+{
+    struct host_sim_conn* conn = host_sim_conn_get(conn_handle);
+    if (!conn)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+
+    if (bond_find(&conn->peer_addr) < 0)
+    {
+        if (bond_count == CONFIG_BT_NIMBLE_MAX_BONDS)
+        {
+            memmove(&bonds[0], &bonds[1], sizeof(bonds[0]) * (bond_count - 1));
+            --bond_count;
+        }
+
+        bonds[bond_count++] = conn->peer_addr;
+    }
+
+    conn->bonded = true;
+
+    struct ble_gap_event event = { .type = BLE_GAP_EVENT_ENC_CHANGE };
+    event.enc_change.status = 0;
+    event.enc_change.conn_handle = conn_handle;
+    conn_event(conn, &event);
+
+    return 0;
+}
+
+int ble_store_util_delete_peer(const ble_addr_t* peer_id_addr)
+{
+    const int idx = bond_find(peer_id_addr);
+    if (idx < 0)
+    {
+        return BLE_HS_ENOENT;
+    }
+
+    memmove(&bonds[idx], &bonds[idx + 1], sizeof(bonds[0]) * (bond_count - idx - 1));
+    --bond_count;
+    return 0;
+}
+
+int ble_store_util_bonded_peers(ble_addr_t* out_peer_id_addrs, int* out_num_peers,
+                                int max_peers)
+{
+    const int count = bond_count < max_peers ? bond_count : max_peers;
+
+    memcpy(out_peer_id_addrs, bonds, sizeof(bonds[0]) * count);
+    *out_num_peers = count;
+    return 0;
+}
+
+int host_sim_disconnect(uint16_t conn_handle, int reason)
+{
+    struct host_sim_conn* conn = host_sim_conn_get(conn_handle);
+    if (!conn)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+
+    link_flush(conn);
+
+    struct host_sim_proc* conn_procs = procs[conn - conns];
+    for (size_t kind = 0; kind < HOST_SIM_PROC_COUNT; ++kind)
+    {
+        if (conn_procs[kind].timer && esp_timer_is_active(conn_procs[kind].timer))
+        {
+            esp_timer_stop(conn_procs[kind].timer);
+        }
+    }
+
+    // The host forgets the connection before telling the application.
+    struct host_sim_conn copy = *conn;
+    conn->used = false;
+
+    struct ble_gap_event event = { .type = BLE_GAP_EVENT_DISCONNECT };
+    event.disconnect.reason = reason;
+    conn_desc(&copy, &event.disconnect.conn);
+    conn_event(&copy, &event);
+
+    return 0;
+}
+
+int ble_gap_terminate(uint16_t conn_handle, uint8_t hci_reason)
+{
+    if (!host_sim_conn_get(conn_handle))
+    {
+        return BLE_HS_ENOTCONN;
+    }
+
+    return host_sim_disconnect(conn_handle, BLE_HS_HCI_ERR(BLE_ERR_CONN_TERM_LOCAL));
+}
+
+int host_sim_subscribe(uint16_t conn_handle, uint16_t attr_handle,
+                       bool notify, bool indicate)
+{
+    struct host_sim_conn* conn = host_sim_conn_get(conn_handle);
+    if (!conn)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+
+    struct ble_gap_event event = { .type = BLE_GAP_EVENT_SUBSCRIBE };
+    event.subscribe.conn_handle = conn_handle;
+    event.subscribe.attr_handle = attr_handle;
+    event.subscribe.reason = BLE_GAP_SUBSCRIBE_REASON_WRITE;
+    event.subscribe.cur_notify = notify;
+    event.subscribe.cur_indicate = indicate;
+    conn_event(conn, &event);
+
+    return 0;
+}
+
+int host_sim_exchange_mtu(uint16_t conn_handle, uint16_t mtu)
+{
+    struct host_sim_conn* conn = host_sim_conn_get(conn_handle);
+    if (!conn)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+
+    if (mtu > CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU)
+    {
+        mtu = CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU;
+    }
+
+    conn->mtu = mtu;
+
+    struct ble_gap_event event = { .type = BLE_GAP_EVENT_MTU };
+    event.mtu.conn_handle = conn_handle;
+    event.mtu.channel_id = 4;
+    event.mtu.value = mtu;
+    conn_event(conn, &event);
+
+    return 0;
+}
+
+const struct host_sim_conn_stats* host_sim_conn_stats(uint16_t conn_handle)
+{
+    const struct host_sim_conn* conn = host_sim_conn_get(conn_handle);
+    return conn ? &conn->stats : NULL;
+}
+
+uint16_t ble_att_mtu(uint16_t conn_handle)
+{
+    const struct host_sim_conn* conn = host_sim_conn_get(conn_handle);
+    return conn ? conn->mtu : 0;
+}
+
+// Answers a procedure the way the connection's central is set up to
+static void proc_complete(void* arg)
+{
+    struct host_sim_proc* proc = arg;
+
+    struct host_sim_conn* conn = host_sim_conn_get(proc->conn_handle);
+    if (!conn)
+    {
+        return;
+    }
+
+    struct ble_gap_event event;
+    memset(&event, 0, sizeof(event));
+
+    switch (proc->kind)
+    {
+        case HOST_SIM_PROC_CONN_UPDATE:
+            event.type = BLE_GAP_EVENT_CONN_UPDATE;
+            event.conn_update.conn_handle = conn->conn_handle;
+
+            if (conn->update_requests++ < conn->central.reject_updates ||
+                proc->params.itvl_max < conn->central.itvl_floor)
+            {
+                event.conn_update.status = BLE_HS_HCI_ERR(BLE_ERR_UNACCEPTABLE_CONN_PARAMS);
+                break;
+            }
+
+            conn->conn_itvl = proc->params.itvl_min > conn->central.itvl_floor ?
+                              proc->params.itvl_min : conn->central.itvl_floor;
+            conn->conn_latency = proc->params.latency;
+            conn->supervision_timeout = proc->params.supervision_timeout;
+            event.conn_update.status = 0;
+            break;
+
+        case HOST_SIM_PROC_PHY:
+            conn->tx_phy = (proc->value & BLE_GAP_LE_PHY_2M_MASK) && conn->central.phy_2m ?
+                           BLE_HCI_LE_PHY_2M : BLE_HCI_LE_PHY_1M;
+
+            event.type = BLE_GAP_EVENT_PHY_UPDATE_COMPLETE;
+            event.phy_updated.status = 0;
+            event.phy_updated.conn_handle = conn->conn_handle;
+            event.phy_updated.tx_phy = conn->tx_phy;
+            event.phy_updated.rx_phy = conn->tx_phy;
+            break;
+
+        case HOST_SIM_PROC_DATA_LEN:
+            conn->tx_octets = proc->value < conn->central.max_tx_octets ?
+                              proc->value : conn->central.max_tx_octets;
+
+            event.type = BLE_GAP_EVENT_DATA_LEN_CHG;
+            event.data_len_chg.conn_handle = conn->conn_handle;
+            event.data_len_chg.max_tx_octets = conn->tx_octets;
+            event.data_len_chg.max_tx_time = (conn->tx_octets + 14) * 8;
+            event.data_len_chg.max_rx_octets = conn->tx_octets;
+            event.data_len_chg.max_rx_time = (conn->tx_octets + 14) * 8;
+            break;
+
+        case HOST_SIM_PROC_MTU:
+            conn->mtu = conn->central.mtu < CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU ?
+                        conn->central.mtu : CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU;
+
+            event.type = BLE_GAP_EVENT_MTU;
+            event.mtu.conn_handle = conn->conn_handle;
+            event.mtu.channel_id = 4;
+            event.mtu.value = conn->mtu;
+            break;
+
+        default:
+            return;
+    }
+
+    conn_event(conn, &event);
+}
+
+// Starts a procedure answered `events` connection events from now. One of
+// each kind at a time per connection, as in NimBLE.
+static struct host_sim_proc* proc_start(struct host_sim_conn* conn, enum host_sim_proc_kind kind,
+                                        unsigned events)
+{
+    struct host_sim_proc* proc = &procs[conn - conns][kind];
+
+    if (!proc->timer)
+    {
+        const esp_timer_create_args_t timer_args = {
+            .callback = proc_complete,
+            .arg = proc,
+            .name = "host_sim_proc",
+        };
+
+        if (esp_timer_create(&timer_args, &proc->timer) != ESP_OK)
+        {
+            return NULL;
+        }
+    }
+    else if (esp_timer_is_active(proc->timer))
+    {
+        return NULL;
+    }
+
+    proc->kind = kind;
+    proc->conn_handle = conn->conn_handle;
+    esp_timer_start_once(proc->timer, (uint64_t)events * conn->conn_itvl * 1250);
+
+    return proc;
+}
+
+int ble_gap_update_params(uint16_t conn_handle,
+                          const struct ble_gap_upd_params* params)
+{
+    struct host_sim_conn* conn = host_sim_conn_get(conn_handle);
+    if (!conn)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+
+    if (params->itvl_min > params->itvl_max)
+    {
+        return BLE_HS_EINVAL;
+    }
+
+    struct host_sim_proc* proc = proc_start(conn, HOST_SIM_PROC_CONN_UPDATE, HOST_SIM_UPDATE_EVENTS);
+    if (!proc)
+    {
+        return BLE_HS_EALREADY;
+    }
+
+    proc->params = *params;
+    return 0;
+}
+
+int ble_gap_set_prefered_le_phy(uint16_t conn_handle, uint8_t tx_phys_mask,
+                                uint8_t rx_phys_mask, uint16_t phy_opts)
+{
+    struct host_sim_conn* conn = host_sim_conn_get(conn_handle);
+    if (!conn)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+
+    struct host_sim_proc* proc = proc_start(conn, HOST_SIM_PROC_PHY, HOST_SIM_PHY_EVENTS);
+    if (!proc)
+    {
+        return BLE_HS_EALREADY;
+    }
+
+    proc->value = tx_phys_mask & rx_phys_mask;
+    return 0;
+}
+
+int ble_gap_set_data_len(uint16_t conn_handle, uint16_t tx_octets,
+                         uint16_t tx_time)
+{
+    struct host_sim_conn* conn = host_sim_conn_get(conn_handle);
+    if (!conn)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+
+    struct host_sim_proc* proc = proc_start(conn, HOST_SIM_PROC_DATA_LEN, HOST_SIM_DATA_LEN_EVENTS);
+    if (!proc)
+    {
+        return BLE_HS_EALREADY;
+    }
+
+    proc->value = tx_octets;
+    return 0;
+}
+
+// Only the MTU event reports the result; the callback is not called.
+int ble_gattc_exchange_mtu(uint16_t conn_handle,
+                           int (*cb)(uint16_t conn_handle, const void* error,
+                                     uint16_t mtu, void* arg),
+                           void* cb_arg)
+{
+    struct host_sim_conn* conn = host_sim_conn_get(conn_handle);
+    if (!conn)
+    {
+        return BLE_HS_ENOTCONN;
+    }
+
+    return proc_start(conn, HOST_SIM_PROC_MTU, HOST_SIM_MTU_EVENTS) ? 0 : BLE_HS_EALREADY;
+}
+
+// Advertising data encoding
+
+static int adv_put(uint8_t* dst, uint8_t* len, uint8_t max_len,
+                   uint8_t type, const void* data, uint8_t data_len)
+{
+    if (*len + 2 + data_len > max_len)
+    {
+        return BLE_HS_EMSGSIZE;
+    }
+
+    dst[(*len)++] = data_len + 1;
+    dst[(*len)++] = type;
+    memcpy(dst + *len, data, data_len);
+    *len += data_len;
+    return 0;
+}
+
+int ble_hs_adv_set_fields(const struct ble_hs_adv_fields* adv_fields,
+                          uint8_t* dst, uint8_t* dst_len, uint8_t max_len)
+{
+    int rc = 0;
+    *dst_len = 0;
+
+    if (adv_fields->flags)
+    {
+        rc = adv_put(dst, dst_len, max_len, BLE_HS_ADV_TYPE_FLAGS, &adv_fields->flags, 1);
+    }
+
+    if (rc == 0 && adv_fields->tx_pwr_lvl_is_present)
+    {
+        int8_t level = adv_fields->tx_pwr_lvl == BLE_HS_ADV_TX_PWR_LVL_AUTO ?
+                       0 : adv_fields->tx_pwr_lvl;
+        rc = adv_put(dst, dst_len, max_len, BLE_HS_ADV_TYPE_TX_PWR_LVL, &level, 1);
+    }
+
+    if (rc == 0 && adv_fields->name)
+    {
+        rc = adv_put(dst, dst_len, max_len,
+                     adv_fields->name_is_complete ? BLE_HS_ADV_TYPE_COMP_NAME :
+                                                    BLE_HS_ADV_TYPE_INCOMP_NAME,
+                     adv_fields->name, adv_fields->name_len);
+    }
+
+    if (rc == 0 && adv_fields->adv_itvl_is_present)
+    {
+        uint8_t itvl[2] = { adv_fields->adv_itvl & 0xff, adv_fields->adv_itvl >> 8 };
+        rc = adv_put(dst, dst_len, max_len, BLE_HS_ADV_TYPE_ADV_ITVL, itvl, sizeof(itvl));
+    }
+
+    if (rc == 0 && adv_fields->mfg_data)
+    {
+        rc = adv_put(dst, dst_len, max_len, BLE_HS_ADV_TYPE_MFG_DATA,
+                     adv_fields->mfg_data, adv_fields->mfg_data_len);
+    }
+
+    return rc;
+}
+
+int ble_hs_adv_parse(const uint8_t* data, uint8_t length,
+                     ble_hs_adv_parse_func_t func, void* user_data)
+{
+    while (length > 1)
+    {
+        const struct ble_hs_adv_field* field = (const struct ble_hs_adv_field*)data;
+        if (field->length == 0 || field->length + 1 > length)
+        {
+            return BLE_HS_EBADDATA;
+        }
+
+        if (func(field, user_data) == 0)
+        {
+            return 0;
+        }
+
+        length -= field->length + 1;
+        data += field->length + 1;
+    }
+
+    return 0;
+}
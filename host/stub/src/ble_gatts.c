@@ -0,0 +1,308 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdio.h>
+
+#include "host_sim_priv.h"
+
+#define HOST_SIM_MAX_ATTRS 64
+
+// Only attributes with an access callback are tracked: characteristic values
+// and descriptors. Declarations just consume a handle.
+struct host_sim_attr {
+    uint16_t handle;
+    uint16_t uuid16;
+    bool is_dsc;
+
+    const struct ble_gatt_chr_def* chr;
+    const struct ble_gatt_dsc_def* dsc;
+};
+
+static struct host_sim_attr attrs[HOST_SIM_MAX_ATTRS];
+static size_t attr_count;
+static uint16_t next_handle;
+
+void host_sim_gatts_reset(void)
+{
+    attr_count = 0;
+    next_handle = 1;
+}
+
+static const struct host_sim_attr* attr_find(uint16_t handle)
+{
+    for (size_t idx = 0; idx < attr_count; ++idx)
+    {
+        if (attrs[idx].handle == handle)
+        {
+            return &attrs[idx];
+        }
+    }
+
+    return NULL;
+}
+
+static int attr_add(uint16_t handle, const struct ble_gatt_chr_def* chr,
+                    const struct ble_gatt_dsc_def* dsc)
+{
+    if (attr_count == HOST_SIM_MAX_ATTRS)
+    {
+        return BLE_HS_ENOMEM;
+    }
+
+    struct host_sim_attr* attr = &attrs[attr_count++];
+    attr->handle = handle;
+    attr->is_dsc = dsc != NULL;
+    attr->chr = chr;
+    attr->dsc = dsc;
+    attr->uuid16 = ble_uuid_u16(dsc ? dsc->uuid : chr->uuid);
+    return 0;
+}
+
+uint16_t host_sim_find_chr(uint16_t uuid16)
+{
+    for (size_t idx = 0; idx < attr_count; ++idx)
+    {
+        if (!attrs[idx].is_dsc && attrs[idx].uuid16 == uuid16)
+        {
+            return attrs[idx].handle;
+        }
+    }
+
+    return 0;
+}
+
+// ble_uuid
+
+uint16_t ble_uuid_u16(const ble_uuid_t* uuid)
+{
+    return uuid->type == BLE_UUID_TYPE_16 ? ((const ble_uuid16_t*)uuid)->value : 0;
+}
+
+int ble_uuid_cmp(const ble_uuid_t* uuid1, const ble_uuid_t* uuid2)
+{
+    if (uuid1->type != uuid2->type)
+    {
+        return uuid1->type - uuid2->type;
+    }
+
+    return (int)ble_uuid_u16(uuid1) - (int)ble_uuid_u16(uuid2);
+}
+
+char* ble_uuid_to_str(const ble_uuid_t* uuid, char* dst)
+{
+    snprintf(dst, BLE_UUID_STR_LEN, "0x%04x", ble_uuid_u16(uuid));
+    return dst;
+}
+
+// ble_gatts
+
+int ble_gatts_count_cfg(const struct ble_gatt_svc_def* defs)
+{
+    return 0;
+}
+
+int ble_gatts_add_svcs(const struct ble_gatt_svc_def* svcs)
+{
+    for (const struct ble_gatt_svc_def* svc = svcs; svc->type != BLE_GATT_SVC_TYPE_END; ++svc)
+    {
+        struct ble_gatt_register_ctxt reg = { .op = BLE_GATT_REGISTER_OP_SVC };
+        reg.svc.handle = next_handle++;
+        reg.svc.svc_def = svc;
+
+        if (ble_hs_cfg.gatts_register_cb)
+        {
+            ble_hs_cfg.gatts_register_cb(&reg, ble_hs_cfg.gatts_register_arg);
+        }
+
+        for (const struct ble_gatt_chr_def* chr = svc->characteristics; chr && chr->uuid; ++chr)
+        {
+            memset(&reg, 0, sizeof(reg));
+            reg.op = BLE_GATT_REGISTER_OP_CHR;
+            reg.chr.def_handle = next_handle++;
+            reg.chr.val_handle = next_handle++;
+            reg.chr.chr_def = chr;
+            reg.chr.svc_def = svc;
+
+            int rc = attr_add(reg.chr.val_handle, chr, NULL);
+            if (rc != 0)
+            {
+                return rc;
+            }
+
+            if (chr->val_handle)
+            {
+                *chr->val_handle = reg.chr.val_handle;
+            }
+
+            if (ble_hs_cfg.gatts_register_cb)
+            {
+                ble_hs_cfg.gatts_register_cb(&reg, ble_hs_cfg.gatts_register_arg);
+            }
+
+            // CCCD
+            if (chr->flags & (BLE_GATT_CHR_F_NOTIFY | BLE_GATT_CHR_F_INDICATE))
+            {
+                ++next_handle;
+            }
+
+            for (const struct ble_gatt_dsc_def* dsc = chr->descriptors; dsc && dsc->uuid; ++dsc)
+            {
+                memset(&reg, 0, sizeof(reg));
+                reg.op = BLE_GATT_REGISTER_OP_DSC;
+                reg.dsc.handle = next_handle++;
+                reg.dsc.dsc_def = dsc;
+                reg.dsc.chr_def = chr;
+                reg.dsc.svc_def = svc;
+
+                rc = attr_add(reg.dsc.handle, chr, dsc);
+                if (rc != 0)
+                {
+                    return rc;
+                }
+
+                if (ble_hs_cfg.gatts_register_cb)
+                {
+                    ble_hs_cfg.gatts_register_cb(&reg, ble_hs_cfg.gatts_register_arg);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int attr_access(uint16_t conn_handle, const struct host_sim_attr* attr,
+                       uint8_t op, struct os_mbuf* om)
+{
+    struct ble_gatt_access_ctxt ctxt = { .op = op, .om = om };
+    ble_gatt_access_fn* access_cb;
+    void* arg;
+
+    if (attr->is_dsc)
+    {
+        ctxt.dsc = attr->dsc;
+        access_cb = attr->dsc->access_cb;
+        arg = attr->dsc->arg;
+    }
+    else
+    {
+        ctxt.chr = attr->chr;
+        access_cb = attr->chr->access_cb;
+        arg = attr->chr->arg;
+    }
+
+    return access_cb(conn_handle, attr->handle, &ctxt, arg);
+}
+
+int ble_gatts_notify_custom(uint16_t conn_handle, uint16_t att_handle,
+                            struct os_mbuf* om)
+{
+    if (!host_sim_conn_get(conn_handle))
+    {
+        os_mbuf_free_chain(om);
+        return BLE_HS_ENOTCONN;
+    }
+
+    if (!om)
+    {
+        const struct host_sim_attr* attr = attr_find(att_handle);
+        if (!attr || attr->is_dsc)
+        {
+            return BLE_HS_ENOENT;
+        }
+
+        om = os_msys_get_pkthdr(0, 0);
+        if (!om)
+        {
+            return host_sim_gap_tx_notify(conn_handle, att_handle, NULL);
+        }
+
+        int rc = attr_access(conn_handle, attr, BLE_GATT_ACCESS_OP_READ_CHR, om);
+        if (rc != 0)
+        {
+            os_mbuf_free_chain(om);
+            return BLE_HS_EAPP;
+        }
+    }
+
+    return host_sim_gap_tx_notify(conn_handle, att_handle, om);
+}
+
+int ble_gatts_notify(uint16_t conn_handle, uint16_t chr_val_handle)
+{
+    return ble_gatts_notify_custom(conn_handle, chr_val_handle, NULL);
+}
+
+int ble_gatts_indicate(uint16_t conn_handle, uint16_t chr_val_handle)
+{
+    return ble_gatts_notify(conn_handle, chr_val_handle);
+}
+
+// Driver side
+
+int host_sim_write(uint16_t conn_handle, uint16_t attr_handle,
+                   const void* data, uint16_t len)
+{
+    const struct host_sim_attr* attr = attr_find(attr_handle);
+    if (!attr)
+    {
+        return BLE_ATT_ERR_INVALID_HANDLE;
+    }
+
+    struct os_mbuf* om = os_msys_get_pkthdr(len, 0);
+    if (!om || os_mbuf_append(om, data, len) != 0)
+    {
+        os_mbuf_free_chain(om);
+        return BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
+
+    int rc = attr_access(conn_handle, attr,
+                         attr->is_dsc ? BLE_GATT_ACCESS_OP_WRITE_DSC : BLE_GATT_ACCESS_OP_WRITE_CHR,
+                         om);
+
+    os_mbuf_free_chain(om);
+    return rc;
+}
+
+int host_sim_read(uint16_t conn_handle, uint16_t attr_handle,
+                  void* buf, uint16_t buf_size, uint16_t* out_len)
+{
+    const struct host_sim_attr* attr = attr_find(attr_handle);
+    if (!attr)
+    {
+        return BLE_ATT_ERR_INVALID_HANDLE;
+    }
+
+    struct os_mbuf* om = os_msys_get_pkthdr(0, 0);
+    if (!om)
+    {
+        return BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
+
+    int rc = attr_access(conn_handle, attr,
+                         attr->is_dsc ? BLE_GATT_ACCESS_OP_READ_DSC : BLE_GATT_ACCESS_OP_READ_CHR,
+                         om);
+    if (rc == 0)
+    {
+        ble_hs_mbuf_to_flat(om, buf, buf_size, out_len);
+    }
+
+    os_mbuf_free_chain(om);
+    return rc;
+}
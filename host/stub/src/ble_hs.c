@@ -0,0 +1,138 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdio.h>
+
+#include "nvs_flash.h"
+#include "host/util/util.h"
+#include "nimble/nimble_port.h"
+#include "nimble/nimble_port_freertos.h"
+#include "services/gap/ble_svc_gap.h"
+#include "services/gatt/ble_svc_gatt.h"
+
+#include "host_sim_priv.h"
+
+struct ble_hs_cfg ble_hs_cfg;
+
+static const uint8_t own_addr[6] = { 0x01, 0x00, 0x00, 0x00, 0x0b, 0xe5 };
+
+static char device_name[32] = "nimble";
+
+// Host stack lifecycle
+
+esp_err_t nimble_port_init(void)
+{
+    host_sim_reset();
+    return ESP_OK;
+}
+
+void nimble_port_run(void)
+{
+}
+
+void nimble_port_freertos_init(TaskFunction_t host_task_fn)
+{
+    if (ble_hs_cfg.sync_cb)
+    {
+        ble_hs_cfg.sync_cb();
+    }
+}
+
+void nimble_port_freertos_deinit(void)
+{
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    return ESP_OK;
+}
+
+// Identity
+
+int ble_hs_util_ensure_addr(int prefer_random)
+{
+    return 0;
+}
+
+int ble_hs_id_infer_auto(int privacy, uint8_t* out_addr_type)
+{
+    *out_addr_type = BLE_ADDR_PUBLIC;
+    return 0;
+}
+
+int ble_hs_id_copy_addr(uint8_t id_addr_type, uint8_t* out_id_addr, int* out_is_nrpa)
+{
+    memcpy(out_id_addr, own_addr, sizeof(own_addr));
+
+    if (out_is_nrpa)
+    {
+        *out_is_nrpa = 0;
+    }
+
+    return 0;
+}
+
+// Services
+
+void ble_svc_gap_init(void)
+{
+}
+
+void ble_svc_gatt_init(void)
+{
+}
+
+const char* ble_svc_gap_device_name(void)
+{
+    return device_name;
+}
+
+int ble_svc_gap_device_name_set(const char* name)
+{
+    if (strlen(name) >= sizeof(device_name))
+    {
+        return BLE_HS_EINVAL;
+    }
+
+    strcpy(device_name, name);
+    return 0;
+}
+
+// Security manager and bond store; bonds are made by host_sim_bond, see
+// ble_gap.c.
+
+int ble_sm_inject_io(uint16_t conn_handle, struct ble_sm_io* pkey)
+{
+    return 0;
+}
+
+void ble_store_config_init(void)
+{
+}
+
+int ble_store_util_status_rr(struct ble_store_status_event* event, void* arg)
+{
+    return 0;
+}
+
@@ -0,0 +1,51 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "esp_log.h"
+#include "host_sim.h"
+
+esp_log_level_t host_sim_log_level = CONFIG_LOG_DEFAULT_LEVEL;
+
+void esp_log_level_set(const char* tag, esp_log_level_t level)
+{
+    host_sim_log_level = level;
+}
+
+esp_log_level_t esp_log_level_get(const char* tag)
+{
+    return host_sim_log_level;
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...)
+{
+    static const char letters[] = "NEWIDV";
+
+    fprintf(stderr, "%c (%lld) %s: ", letters[level],
+            (long long)(host_sim_now_us() / 1000), tag);
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+
+    fputc('\n', stderr);
+}
@@ -0,0 +1,210 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdlib.h>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "host_sim_priv.h"
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+
+    bool active;
+    int64_t deadline_us;
+    uint64_t period_us;
+
+    struct esp_timer* next;
+};
+
+static int64_t now_us;
+
+// All created timers, active or not; small enough that a linear scan for the
+// next deadline is fine.
+static struct esp_timer* timers;
+
+void host_sim_clock_reset(void)
+{
+    now_us = 0;
+
+    for (struct esp_timer* timer = timers; timer; timer = timer->next)
+    {
+        timer->active = false;
+    }
+}
+
+void host_sim_reset(void)
+{
+    host_sim_clock_reset();
+    host_sim_mbuf_reset();
+    host_sim_gatts_reset();
+    host_sim_gap_reset();
+    host_sim_task_reset();
+    host_sim_nvs_reset();
+}
+
+int64_t host_sim_now_us(void)
+{
+    return now_us;
+}
+
+static struct esp_timer* next_due(int64_t until_us)
+{
+    struct esp_timer* due = NULL;
+
+    for (struct esp_timer* timer = timers; timer; timer = timer->next)
+    {
+        if (timer->active && timer->deadline_us <= until_us &&
+            (!due || timer->deadline_us < due->deadline_us))
+        {
+            due = timer;
+        }
+    }
+
+    return due;
+}
+
+void host_sim_advance_us(int64_t delta_us)
+{
+    const int64_t until_us = now_us + delta_us;
+
+    struct esp_timer* timer;
+    while ((timer = next_due(until_us)) != NULL)
+    {
+        if (timer->deadline_us > now_us)
+        {
+            now_us = timer->deadline_us;
+        }
+
+        if (timer->period_us)
+        {
+            timer->deadline_us += timer->period_us;
+        }
+        else
+        {
+            timer->active = false;
+        }
+
+        timer->callback(timer->arg);
+    }
+
+    now_us = until_us;
+}
+
+// esp_timer
+
+int64_t esp_timer_get_time(void)
+{
+    return now_us;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args,
+                           esp_timer_handle_t* out_handle)
+{
+    if (!create_args || !create_args->callback || !out_handle)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct esp_timer* timer = calloc(1, sizeof(*timer));
+    if (!timer)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->next = timers;
+    timers = timer;
+
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    if (timer->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->active = true;
+    timer->deadline_us = now_us + (int64_t)timeout_us;
+    timer->period_us = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    if (timer->active || period == 0)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->active = true;
+    timer->deadline_us = now_us + (int64_t)period;
+    timer->period_us = period;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    for (struct esp_timer** link = &timers; *link; link = &(*link)->next)
+    {
+        if (*link == timer)
+        {
+            *link = timer->next;
+            free(timer);
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_INVALID_ARG;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer->active;
+}
+
+// FreeRTOS
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(now_us * configTICK_RATE_HZ / 1000000);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    host_sim_advance_us((int64_t)ticks * 1000000 / configTICK_RATE_HZ);
+}
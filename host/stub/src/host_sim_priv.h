@@ -0,0 +1,75 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include "host/ble_hs.h"
+#include "host_sim.h"
+
+// Shared between the stub modules; not part of the driver-facing API.
+
+// Notifications a link can hold before they go out on a connection event
+#define HOST_SIM_LINK_QUEUE 64
+
+struct host_sim_conn {
+    bool used;
+    uint16_t conn_handle;
+    ble_addr_t peer_addr;
+    uint16_t mtu;
+    uint16_t conn_itvl;
+    uint16_t conn_latency;
+    uint16_t supervision_timeout;
+    uint8_t tx_phy;
+    uint16_t tx_octets;
+    bool bonded;
+
+    // How the central answers link requests, and the parameter updates
+    // it has seen
+    struct host_sim_central central;
+    uint32_t update_requests;
+
+    ble_gap_event_fn* cb;
+    void* cb_arg;
+
+    struct host_sim_conn_stats stats;
+
+    // With a capacity set, notifications wait here, holding their mbufs,
+    // until host_sim_conn_event sends them
+    uint16_t link_capacity;
+    struct {
+        uint16_t attr_handle;
+        struct os_mbuf* om;
+    } link_queue[HOST_SIM_LINK_QUEUE];
+    size_t link_queue_head;
+    size_t link_queue_count;
+};
+
+struct host_sim_conn* host_sim_conn_get(uint16_t conn_handle);
+
+// Records a notification on the simulated link and reports NOTIFY_TX.
+// Consumes om.
+int host_sim_gap_tx_notify(uint16_t conn_handle, uint16_t attr_handle,
+                           struct os_mbuf* om);
+
+void host_sim_clock_reset(void);
+void host_sim_mbuf_reset(void);
+void host_sim_gatts_reset(void);
+void host_sim_gap_reset(void);
+void host_sim_task_reset(void);
+void host_sim_nvs_reset(void);
@@ -0,0 +1,306 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdlib.h>
+
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nimble/nimble_port.h"
+
+#include "host_sim_priv.h"
+
+struct tskTaskControlBlock {
+    TaskFunction_t fn;
+    void* param;
+    UBaseType_t priority;
+    uint32_t notify_count;
+
+    struct tskTaskControlBlock* next;
+};
+
+static struct tskTaskControlBlock* tasks;
+
+static struct ble_npl_eventq dflt_eventq;
+static bool host_task_held;
+static bool host_task_running;
+static uint32_t host_events;
+
+void host_sim_task_reset(void)
+{
+    while (tasks)
+    {
+        struct tskTaskControlBlock* next = tasks->next;
+        free(tasks);
+        tasks = next;
+    }
+
+    // Events belong to their owners; just forget they were queued
+    while (dflt_eventq.head)
+    {
+        struct ble_npl_event* ev = dflt_eventq.head;
+        dflt_eventq.head = ev->next;
+        ev->queued = false;
+        ev->next = NULL;
+    }
+    dflt_eventq.tail = NULL;
+
+    host_task_held = false;
+    host_task_running = false;
+    host_events = 0;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stack_depth,
+                       void* param, UBaseType_t priority, TaskHandle_t* out_handle)
+{
+    struct tskTaskControlBlock* task = calloc(1, sizeof(*task));
+    if (!task)
+    {
+        return pdFAIL;
+    }
+
+    task->fn = fn;
+    task->param = param;
+    task->priority = priority;
+    task->next = tasks;
+    tasks = task;
+
+    if (out_handle)
+    {
+        *out_handle = task;
+    }
+
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack_depth,
+                                   void* param, UBaseType_t priority, TaskHandle_t* out_handle,
+                                   BaseType_t core_id)
+{
+    return xTaskCreate(fn, name, stack_depth, param, priority, out_handle);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    for (struct tskTaskControlBlock** link = &tasks; *link; link = &(*link)->next)
+    {
+        if (*link == task)
+        {
+            *link = task->next;
+            free(task);
+            return;
+        }
+    }
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    ++task->notify_count;
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    // Only reachable from a task body, and task bodies never run here.
+    return 0;
+}
+
+uint32_t host_sim_task_take_notify(TaskHandle_t task)
+{
+    uint32_t count = task->notify_count;
+    task->notify_count = 0;
+    return count;
+}
+
+struct QueueDefinition {
+    uint32_t holders;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return calloc(1, sizeof(struct QueueDefinition));
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait)
+{
+    if (semaphore->holders)
+    {
+        // Would block forever: nothing else can run to give it back
+        return pdFALSE;
+    }
+
+    ++semaphore->holders;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    if (!semaphore->holders)
+    {
+        return pdFALSE;
+    }
+
+    --semaphore->holders;
+    return pdTRUE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+    return calloc(1, sizeof(struct QueueDefinition));
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait)
+{
+    ++semaphore->holders;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore)
+{
+    return xSemaphoreGive(semaphore);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    free(semaphore);
+}
+
+// NimBLE porting layer events
+
+static void run_host_task(void)
+{
+    if (host_task_held || host_task_running)
+    {
+        return;
+    }
+
+    host_task_running = true;
+
+    while (dflt_eventq.head && !host_task_held)
+    {
+        struct ble_npl_event* ev = dflt_eventq.head;
+        dflt_eventq.head = ev->next;
+        if (!dflt_eventq.head)
+        {
+            dflt_eventq.tail = NULL;
+        }
+        ev->queued = false;
+        ev->next = NULL;
+
+        ++host_events;
+        ev->fn(ev);
+    }
+
+    host_task_running = false;
+}
+
+void host_sim_hold_host_task(void)
+{
+    host_task_held = true;
+}
+
+void host_sim_release_host_task(void)
+{
+    host_task_held = false;
+    run_host_task();
+}
+
+uint32_t host_sim_host_events(void)
+{
+    return host_events;
+}
+
+struct ble_npl_eventq* nimble_port_get_dflt_eventq(void)
+{
+    return &dflt_eventq;
+}
+
+void ble_npl_event_init(struct ble_npl_event* ev, ble_npl_event_fn* fn, void* arg)
+{
+    ev->queued = false;
+    ev->fn = fn;
+    ev->arg = arg;
+    ev->next = NULL;
+}
+
+void* ble_npl_event_get_arg(struct ble_npl_event* ev)
+{
+    return ev->arg;
+}
+
+bool ble_npl_event_is_queued(struct ble_npl_event* ev)
+{
+    return ev->queued;
+}
+
+void ble_npl_eventq_put(struct ble_npl_eventq* evq, struct ble_npl_event* ev)
+{
+    if (!ev->queued)
+    {
+        ev->queued = true;
+        ev->next = NULL;
+
+        if (evq->tail)
+        {
+            evq->tail->next = ev;
+        }
+        else
+        {
+            evq->head = ev;
+        }
+        evq->tail = ev;
+    }
+
+    if (evq == &dflt_eventq)
+    {
+        run_host_task();
+    }
+}
+
+void ble_npl_eventq_remove(struct ble_npl_eventq* evq, struct ble_npl_event* ev)
+{
+    if (!ev->queued)
+    {
+        return;
+    }
+
+    struct ble_npl_event* prev = NULL;
+    for (struct ble_npl_event* cur = evq->head; cur; prev = cur, cur = cur->next)
+    {
+        if (cur == ev)
+        {
+            if (prev)
+            {
+                prev->next = ev->next;
+            }
+            else
+            {
+                evq->head = ev->next;
+            }
+
+            if (evq->tail == ev)
+            {
+                evq->tail = prev;
+            }
+            break;
+        }
+    }
+
+    ev->queued = false;
+    ev->next = NULL;
+}
@@ -0,0 +1,193 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvs.h"
+
+#include "host_sim_priv.h"
+
+#define HOST_SIM_NVS_MAX_NAMESPACES 8
+#define HOST_SIM_NVS_NAME_MAX       16
+
+struct host_sim_nvs_entry {
+    char namespace_name[HOST_SIM_NVS_NAME_MAX];
+    char key[HOST_SIM_NVS_NAME_MAX];
+    void* value;
+    size_t length;
+
+    struct host_sim_nvs_entry* next;
+};
+
+static char namespaces[HOST_SIM_NVS_MAX_NAMESPACES][HOST_SIM_NVS_NAME_MAX];
+static struct host_sim_nvs_entry* entries;
+
+void host_sim_nvs_reset(void)
+{
+    while (entries)
+    {
+        struct host_sim_nvs_entry* next = entries->next;
+        free(entries->value);
+        free(entries);
+        entries = next;
+    }
+
+    memset(namespaces, 0, sizeof(namespaces));
+}
+
+// Handles are namespace index + 1
+static const char* host_sim_nvs_namespace(nvs_handle_t handle)
+{
+    if (handle == 0 || handle > HOST_SIM_NVS_MAX_NAMESPACES || !namespaces[handle - 1][0])
+    {
+        return NULL;
+    }
+
+    return namespaces[handle - 1];
+}
+
+static struct host_sim_nvs_entry** host_sim_nvs_find(const char* namespace_name, const char* key)
+{
+    struct host_sim_nvs_entry** link = &entries;
+    for (; *link; link = &(*link)->next)
+    {
+        if (!strcmp((*link)->namespace_name, namespace_name) && !strcmp((*link)->key, key))
+        {
+            break;
+        }
+    }
+
+    return link;
+}
+
+esp_err_t nvs_open(const char* namespace_name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle)
+{
+    if (strlen(namespace_name) >= HOST_SIM_NVS_NAME_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (size_t idx = 0; idx < HOST_SIM_NVS_MAX_NAMESPACES; ++idx)
+    {
+        if (!namespaces[idx][0] || !strcmp(namespaces[idx], namespace_name))
+        {
+            strcpy(namespaces[idx], namespace_name);
+            *out_handle = idx + 1;
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length)
+{
+    const char* namespace_name = host_sim_nvs_namespace(handle);
+    if (!namespace_name || strlen(key) >= HOST_SIM_NVS_NAME_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    void* copy = malloc(length ? length : 1);
+    if (!copy)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, value, length);
+
+    struct host_sim_nvs_entry** link = host_sim_nvs_find(namespace_name, key);
+    if (!*link)
+    {
+        *link = calloc(1, sizeof(**link));
+        if (!*link)
+        {
+            free(copy);
+            return ESP_ERR_NO_MEM;
+        }
+
+        strcpy((*link)->namespace_name, namespace_name);
+        strcpy((*link)->key, key);
+    }
+
+    free((*link)->value);
+    (*link)->value = copy;
+    (*link)->length = length;
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length)
+{
+    const char* namespace_name = host_sim_nvs_namespace(handle);
+    if (!namespace_name)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct host_sim_nvs_entry* entry = *host_sim_nvs_find(namespace_name, key);
+    if (!entry)
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    if (out_value)
+    {
+        if (*length < entry->length)
+        {
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+
+        memcpy(out_value, entry->value, entry->length);
+    }
+
+    *length = entry->length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key)
+{
+    const char* namespace_name = host_sim_nvs_namespace(handle);
+    if (!namespace_name)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct host_sim_nvs_entry** link = host_sim_nvs_find(namespace_name, key);
+    if (!*link)
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    struct host_sim_nvs_entry* entry = *link;
+    *link = entry->next;
+    free(entry->value);
+    free(entry);
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return host_sim_nvs_namespace(handle) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
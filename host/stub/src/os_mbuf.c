@@ -0,0 +1,392 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_sim_priv.h"
+
+#define OS_ENOMEM 1
+#define OS_EINVAL 2
+
+// Each block holds the mbuf header, room for a packet header and
+// block_size bytes of data, like a msys block. Data always starts after the
+// packet header slot so every mbuf in a chain carries block_size bytes.
+#define BLOCK_HDR_SIZE (sizeof(struct os_mbuf) + sizeof(struct os_mbuf_pkthdr))
+
+static uint16_t block_size = CONFIG_BT_NIMBLE_MSYS_1_BLOCK_SIZE;
+static uint16_t block_count = CONFIG_BT_NIMBLE_MSYS_1_BLOCK_COUNT;
+
+static uint8_t* pool;
+static struct os_mbuf* free_list;
+
+static struct host_sim_mbuf_stats stats;
+
+void host_sim_mbuf_configure(uint16_t size, uint16_t count)
+{
+    block_size = size;
+    block_count = count;
+}
+
+void host_sim_mbuf_stats(struct host_sim_mbuf_stats* out)
+{
+    *out = stats;
+}
+
+static size_t block_stride(void)
+{
+    return (BLOCK_HDR_SIZE + block_size + 7) & ~(size_t)7;
+}
+
+void host_sim_mbuf_reset(void)
+{
+    free(pool);
+    pool = calloc(block_count, block_stride());
+    assert(pool);
+
+    free_list = NULL;
+    for (size_t idx = block_count; idx > 0; --idx)
+    {
+        struct os_mbuf* om = (struct os_mbuf*)(pool + (idx - 1) * block_stride());
+        SLIST_NEXT(om, om_next) = free_list;
+        free_list = om;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+}
+
+static uint8_t* block_end(const struct os_mbuf* om)
+{
+    return (uint8_t*)om + BLOCK_HDR_SIZE + block_size;
+}
+
+static uint16_t trailing_space(const struct os_mbuf* om)
+{
+    return block_end(om) - (om->om_data + om->om_len);
+}
+
+static struct os_mbuf* block_get(void)
+{
+    if (!pool)
+    {
+        host_sim_mbuf_reset();
+    }
+
+    struct os_mbuf* om = free_list;
+    if (!om)
+    {
+        ++stats.alloc_failures;
+        return NULL;
+    }
+
+    free_list = SLIST_NEXT(om, om_next);
+
+    memset(om, 0, BLOCK_HDR_SIZE);
+    om->om_data = om->om_databuf;
+
+    ++stats.alloc_count;
+    if (++stats.blocks_in_use > stats.blocks_high_water)
+    {
+        stats.blocks_high_water = stats.blocks_in_use;
+    }
+
+    return om;
+}
+
+struct os_mbuf* os_msys_get(uint16_t dsize, uint16_t leadingspace)
+{
+    struct os_mbuf* om = block_get();
+    if (om)
+    {
+        om->om_data += sizeof(struct os_mbuf_pkthdr) + leadingspace;
+    }
+
+    return om;
+}
+
+int os_msys_count(void)
+{
+    return block_count;
+}
+
+int os_msys_num_free(void)
+{
+    return block_count - stats.blocks_in_use;
+}
+
+struct os_mbuf* os_msys_get_pkthdr(uint16_t dsize, uint16_t user_hdr_len)
+{
+    struct os_mbuf* om = block_get();
+    if (om)
+    {
+        om->om_pkthdr_len = sizeof(struct os_mbuf_pkthdr) + user_hdr_len;
+        om->om_data = om->om_databuf + om->om_pkthdr_len;
+    }
+
+    return om;
+}
+
+int os_mbuf_free(struct os_mbuf* mb)
+{
+    SLIST_NEXT(mb, om_next) = free_list;
+    free_list = mb;
+    --stats.blocks_in_use;
+    return 0;
+}
+
+int os_mbuf_free_chain(struct os_mbuf* om)
+{
+    while (om)
+    {
+        struct os_mbuf* next = SLIST_NEXT(om, om_next);
+        os_mbuf_free(om);
+        om = next;
+    }
+
+    return 0;
+}
+
+static struct os_mbuf* last_of(struct os_mbuf* om)
+{
+    while (SLIST_NEXT(om, om_next))
+    {
+        om = SLIST_NEXT(om, om_next);
+    }
+
+    return om;
+}
+
+int os_mbuf_append(struct os_mbuf* om, const void* data, uint16_t len)
+{
+    if (!om)
+    {
+        return OS_EINVAL;
+    }
+
+    const uint8_t* src = data;
+    uint16_t remaining = len;
+    struct os_mbuf* last = last_of(om);
+
+    while (remaining > 0)
+    {
+        uint16_t space = trailing_space(last);
+        if (space == 0)
+        {
+            struct os_mbuf* next = os_msys_get(0, 0);
+            if (!next)
+            {
+                break;
+            }
+
+            SLIST_NEXT(last, om_next) = next;
+            last = next;
+            continue;
+        }
+
+        uint16_t chunk = remaining < space ? remaining : space;
+        memcpy(last->om_data + last->om_len, src, chunk);
+        last->om_len += chunk;
+        src += chunk;
+        remaining -= chunk;
+    }
+
+    uint16_t appended = len - remaining;
+    stats.bytes_appended += appended;
+
+    if (OS_MBUF_IS_PKTHDR(om))
+    {
+        OS_MBUF_PKTLEN(om) += appended;
+    }
+
+    return remaining ? OS_ENOMEM : 0;
+}
+
+void* os_mbuf_extend(struct os_mbuf* om, uint16_t len)
+{
+    struct os_mbuf* last = last_of(om);
+
+    if (len > block_size)
+    {
+        return NULL;
+    }
+
+    if (trailing_space(last) < len)
+    {
+        struct os_mbuf* next = os_msys_get(0, 0);
+        if (!next)
+        {
+            return NULL;
+        }
+
+        SLIST_NEXT(last, om_next) = next;
+        last = next;
+    }
+
+    void* data = last->om_data + last->om_len;
+    last->om_len += len;
+
+    if (OS_MBUF_IS_PKTHDR(om))
+    {
+        OS_MBUF_PKTLEN(om) += len;
+    }
+
+    return data;
+}
+
+void os_mbuf_adj(struct os_mbuf* mp, int req_len)
+{
+    if (!mp)
+    {
+        return;
+    }
+
+    int total = 0;
+    for (const struct os_mbuf* cur = mp; cur; cur = SLIST_NEXT(cur, om_next))
+    {
+        total += cur->om_len;
+    }
+
+    int len = req_len < 0 ? -req_len : req_len;
+    if (len > total)
+    {
+        len = total;
+    }
+
+    if (req_len >= 0)
+    {
+        int remaining = len;
+        for (struct os_mbuf* cur = mp; cur && remaining > 0; cur = SLIST_NEXT(cur, om_next))
+        {
+            int chunk = cur->om_len < remaining ? cur->om_len : remaining;
+            cur->om_data += chunk;
+            cur->om_len -= chunk;
+            remaining -= chunk;
+        }
+    }
+    else
+    {
+        // Emptied blocks stay in the chain, as in NimBLE
+        int keep = total - len;
+        for (struct os_mbuf* cur = mp; cur; cur = SLIST_NEXT(cur, om_next))
+        {
+            if (cur->om_len > keep)
+            {
+                cur->om_len = keep;
+            }
+            keep -= cur->om_len;
+        }
+    }
+
+    if (OS_MBUF_IS_PKTHDR(mp))
+    {
+        OS_MBUF_PKTLEN(mp) -= len;
+    }
+}
+
+int os_mbuf_copydata(const struct os_mbuf* m, int off, int len, void* dst)
+{
+    uint8_t* out = dst;
+
+    while (m && off >= m->om_len)
+    {
+        off -= m->om_len;
+        m = SLIST_NEXT(m, om_next);
+    }
+
+    while (len > 0 && m)
+    {
+        int chunk = m->om_len - off;
+        if (chunk > len)
+        {
+            chunk = len;
+        }
+
+        memcpy(out, m->om_data + off, chunk);
+        out += chunk;
+        len -= chunk;
+        off = 0;
+        m = SLIST_NEXT(m, om_next);
+    }
+
+    return len > 0 ? -1 : 0;
+}
+
+struct os_mbuf* os_mbuf_dup(struct os_mbuf* m)
+{
+    struct os_mbuf* copy = os_msys_get_pkthdr(0, 0);
+    if (!copy)
+    {
+        return NULL;
+    }
+
+    for (const struct os_mbuf* cur = m; cur; cur = SLIST_NEXT(cur, om_next))
+    {
+        if (os_mbuf_append(copy, cur->om_data, cur->om_len) != 0)
+        {
+            os_mbuf_free_chain(copy);
+            return NULL;
+        }
+    }
+
+    return copy;
+}
+
+// ble_hs_mbuf
+
+struct os_mbuf* ble_hs_mbuf_from_flat(const void* buf, uint16_t len)
+{
+    struct os_mbuf* om = os_msys_get_pkthdr(len, 0);
+    if (!om)
+    {
+        return NULL;
+    }
+
+    if (os_mbuf_append(om, buf, len) != 0)
+    {
+        os_mbuf_free_chain(om);
+        return NULL;
+    }
+
+    return om;
+}
+
+int ble_hs_mbuf_to_flat(const struct os_mbuf* om, void* flat, uint16_t max_len,
+                        uint16_t* out_copy_len)
+{
+    uint16_t len = OS_MBUF_PKTLEN(om);
+    int rc = 0;
+
+    if (len > max_len)
+    {
+        len = max_len;
+        rc = BLE_HS_EMSGSIZE;
+    }
+
+    if (os_mbuf_copydata(om, 0, len, flat) != 0)
+    {
+        return BLE_HS_EUNKNOWN;
+    }
+
+    if (out_copy_len)
+    {
+        *out_copy_len = len;
+    }
+
+    return rc;
+}
@@ -0,0 +1,152 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Drives the same setup as main.c through the host stand-in: one central
+// connects, subscribes to RX and then streams actuator writes while the
+// application streams sensor updates. Exits non-zero if any write or
+// notification went missing, so it doubles as a CI smoke run.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "esp_log.h"
+
+#include "ble_func.h"
+#include "gatt_svr.h"
+#include "gatt_svr_priv.h"
+#include "generic_btle.h"
+#include "host_sim.h"
+
+static uint32_t actuator_calls;
+
+static void handle_actuator_change(gble_actuator_id actuator_id, uint32_t value, void* context)
+{
+    ++actuator_calls;
+}
+
+static gble_actuator_feature actuators[] = {
+    {
+        .description = "Actuator 1",
+        .feature_type = GBLE_ACTUATOR_TYPE_VIBRATE,
+        .step_range_low = 0,
+        .step_range_high = 20,
+        .message_type = GBLE_ACTUATOR_MSG_SCALAR,
+        .cb = handle_actuator_change,
+    },
+    {
+        .description = "Actuator 2",
+        .feature_type = GBLE_ACTUATOR_TYPE_VIBRATE,
+        .step_range_low = 0,
+        .step_range_high = 20,
+        .message_type = GBLE_ACTUATOR_MSG_SCALAR,
+        .cb = handle_actuator_change,
+    },
+};
+
+static gble_sensor_feature sensors[] = {
+    {
+        .description = "Sensor 1",
+        .feature_type = GBLE_SENSOR_TYPE_PRESSURE,
+        .value_range_low = 0,
+        .value_range_high = 16,
+        .message_type = GBLE_SENSOR_MSG_SUBSCRIBE,
+    },
+    {
+        .description = "State 1",
+        .feature_type = GBLE_SENSOR_TYPE_BUTTON,
+        .value_range_low = 0,
+        .value_range_high = 2,
+        .message_type = GBLE_SENSOR_MSG_SUBSCRIBE,
+    },
+};
+
+static gble_server server;
+
+static double elapsed_s(const struct timespec* start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char** argv)
+{
+    const uint32_t count = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+    static const uint8_t central[6] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+
+    esp_log_level_set("*", ESP_LOG_ERROR);
+
+    if (!gble_init(&server, "Generic Device", actuators, COUNT_OF(actuators), sensors, COUNT_OF(sensors)) ||
+        !ble_init(gatt_svr_init))
+    {
+        fprintf(stderr, "init failed\n");
+        return 1;
+    }
+
+    ble_func_register_disconnect_cb(gatt_svr_client_disconnected_ctx, NULL);
+    ble_func_register_subscribe_cb(gatt_svr_handle_subscribe_ctx, NULL);
+    ble_func_register_notify_tx_cb(gatt_svr_handle_notify_tx_ctx, NULL);
+
+    gatt_svr_register_descriptor_cb(gble_get_descriptor_ctx, &server);
+    gatt_svr_register_write_cb(gble_handle_actuators_changed_ctx, &server);
+    gatt_svr_register_write_reader_cb(gble_handle_actuators_changed_reader_ctx, &server);
+
+    gble_set_sensor_callback_fn(&server, gatt_svr_set_read_value_ctx, NULL);
+
+    uint16_t conn_handle;
+    if (host_sim_connect(central, &conn_handle) != 0)
+    {
+        fprintf(stderr, "connect failed\n");
+        return 1;
+    }
+
+    host_sim_subscribe(conn_handle, Svc_char_handles[HANDLE_MAIN_RX], true, false);
+
+    // Actuator writes: [actuator, value], alternating so every write is a change.
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (uint32_t idx = 0; idx < count; ++idx)
+    {
+        const uint8_t msg[3] = { 0x82, idx % COUNT_OF(actuators), ((idx / COUNT_OF(actuators)) + 1) & 1 };
+        host_sim_write(conn_handle, Svc_char_handles[HANDLE_MAIN_TX], msg, sizeof(msg));
+    }
+
+    double write_s = elapsed_s(&start);
+
+    // Sensor updates fanned out as notifications.
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (uint32_t idx = 0; idx < count; ++idx)
+    {
+        gble_set_sensor_value(&server, idx % COUNT_OF(sensors), idx & 0xf);
+    }
+
+    double notify_s = elapsed_s(&start);
+
+    const struct host_sim_conn_stats* stats = host_sim_conn_stats(conn_handle);
+
+    printf("writes:  %u in %.3f s (%.2f M msg/s), %u actuator callbacks\n",
+           count, write_s, count / write_s / 1e6, actuator_calls);
+    printf("notifies: %u in %.3f s (%.2f M msg/s), %u notifications\n",
+           count, notify_s, count / notify_s / 1e6, stats->notify_count);
+
+    return (actuator_calls == count && stats->notify_count == count) ? 0 : 1;
+}
@@ -0,0 +1,694 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "host/ble_hs.h"
+#include "nimble/nimble_port.h"
+
+#include "ble_conn_profile.h"
+
+static const char* TAG = "ConnProfile";
+
+// Longest connection interval the spec allows, 4 s
+#define BLE_CONN_PROFILE_ITVL_LIMIT 3200
+
+// Window CONFIG_GBLE_CONN_ACTIVE_COMMANDS commands have to land in
+#define BLE_CONN_PROFILE_ACTIVE_WINDOW_US 1000000
+
+static const ble_conn_profile Profiles[BLE_CONN_PROFILE_COUNT] = {
+    [BLE_CONN_PROFILE_NONE] = {
+        .name = "none",
+        .fallback = BLE_CONN_PROFILE_NONE,
+    },
+    [BLE_CONN_PROFILE_LOW_LATENCY] = {
+        .name = "low latency",
+        .mtu = 247,
+        .tx_octets = 251,
+        .phy_mask = BLE_GAP_LE_PHY_2M_MASK,
+        .itvl_min = 6,
+        .itvl_max = 12,
+        .latency = 0,
+        .supervision_timeout = 200,
+        .fallback = BLE_CONN_PROFILE_THROUGHPUT,
+    },
+    [BLE_CONN_PROFILE_THROUGHPUT] = {
+        .name = "throughput",
+        .mtu = 247,
+        .tx_octets = 251,
+        .phy_mask = BLE_GAP_LE_PHY_2M_MASK,
+        .itvl_min = 12,
+        .itvl_max = 24,
+        .latency = 0,
+        .supervision_timeout = 400,
+        .fallback = BLE_CONN_PROFILE_THROUGHPUT,
+    },
+    [BLE_CONN_PROFILE_LOW_POWER] = {
+        .name = "low power",
+        .itvl_min = 80,
+        .itvl_max = 160,
+        .latency = 4,
+        .supervision_timeout = 600,
+        .fallback = BLE_CONN_PROFILE_LOW_POWER,
+    },
+};
+
+struct ble_conn_profile_conn {
+    bool used;
+    uint16_t conn_handle;
+
+    // Longest interval allowed by the next or open parameter request, and
+    // the retries of params_profile so far
+    uint16_t itvl_max;
+    uint8_t attempts;
+
+    // Requests without an answer yet
+    bool mtu_pending;
+    bool data_len_pending;
+    bool phy_pending;
+    bool params_pending;
+    bool retry_pending;
+
+    // ATT allows one exchange per connection, whoever starts it
+    bool mtu_exchanged;
+
+    ble_conn_profile_status status;
+
+    // The timers fire on the esp_timer task and post the events, so the
+    // retry and the idle check run on the host task
+    esp_timer_handle_t retry_timer;
+    struct ble_npl_event retry_event;
+    esp_timer_handle_t idle_timer;
+    struct ble_npl_event idle_event;
+    bool idle_armed;
+
+    // Adaptive state: the last command or notification, the commands in
+    // the current window, and the command that started a wake
+    int64_t activity_us;
+    int64_t window_start_us;
+    uint32_t window_commands;
+    int64_t wake_start_us;
+
+    // Since when status.profile was asked for
+    int64_t profile_since_us;
+};
+
+static struct ble_conn_profile_conn Conns[CONFIG_BT_NIMBLE_MAX_CONNECTIONS];
+static ble_conn_profile_id Default_profile;
+
+static ble_conn_profile_id Adaptive_active;
+static ble_conn_profile_id Adaptive_idle;
+static int64_t Adaptive_idle_us;
+
+static struct ble_conn_profile_conn* ble_conn_profile_find(uint16_t conn_handle)
+{
+    for (size_t idx = 0; idx < CONFIG_BT_NIMBLE_MAX_CONNECTIONS; ++idx)
+    {
+        if (Conns[idx].used && Conns[idx].conn_handle == conn_handle)
+        {
+            return &Conns[idx];
+        }
+    }
+
+    return NULL;
+}
+
+static void ble_conn_profile_retry_timer_cb(void* arg)
+{
+    struct ble_conn_profile_conn* conn = arg;
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &conn->retry_event);
+}
+
+static void ble_conn_profile_cancel_retry(struct ble_conn_profile_conn* conn)
+{
+    if (conn->retry_pending)
+    {
+        esp_timer_stop(conn->retry_timer);
+        ble_npl_eventq_remove(nimble_port_get_dflt_eventq(), &conn->retry_event);
+        conn->retry_pending = false;
+    }
+}
+
+static void ble_conn_profile_idle_timer_cb(void* arg)
+{
+    struct ble_conn_profile_conn* conn = arg;
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &conn->idle_event);
+}
+
+static void ble_conn_profile_arm_idle(struct ble_conn_profile_conn* conn, int64_t delay_us)
+{
+    if (!conn->idle_armed)
+    {
+        conn->idle_armed = true;
+        esp_timer_start_once(conn->idle_timer, delay_us);
+    }
+}
+
+static void ble_conn_profile_cancel_idle(struct ble_conn_profile_conn* conn)
+{
+    if (conn->idle_armed)
+    {
+        esp_timer_stop(conn->idle_timer);
+        ble_npl_eventq_remove(nimble_port_get_dflt_eventq(), &conn->idle_event);
+        conn->idle_armed = false;
+    }
+}
+
+// Longest interval that still fits the supervision timeout
+static uint16_t ble_conn_profile_itvl_limit(const ble_conn_profile* profile)
+{
+    // timeout * 10 ms > (1 + latency) * interval * 1.25 ms * 2
+    const uint32_t limit = (uint32_t)profile->supervision_timeout * 4 / (1 + profile->latency) - 1;
+    return limit < BLE_CONN_PROFILE_ITVL_LIMIT ? (uint16_t)limit : BLE_CONN_PROFILE_ITVL_LIMIT;
+}
+
+static void ble_conn_profile_settle(struct ble_conn_profile_conn* conn)
+{
+    if (conn->mtu_pending || conn->data_len_pending || conn->phy_pending ||
+        conn->params_pending || conn->retry_pending || conn->status.settled_us)
+    {
+        return;
+    }
+
+    const ble_conn_profile_status* status = &conn->status;
+    conn->status.settled_us = esp_timer_get_time();
+
+    if (conn->wake_start_us)
+    {
+        const int64_t wake_us = conn->status.settled_us - conn->wake_start_us;
+        ++conn->status.wakes;
+        conn->status.wake_us_total += wake_us;
+        conn->status.wake_us_max = wake_us > conn->status.wake_us_max ? wake_us : conn->status.wake_us_max;
+        conn->wake_start_us = 0;
+    }
+
+    ESP_LOGI(TAG, "Connection %hu %s: mtu %hu, %hu byte PDUs, PHY %hhu, interval %hu latency %hu timeout %hu%s",
+             conn->conn_handle, Profiles[status->profile].name, status->mtu, status->tx_octets,
+             status->tx_phy, status->itvl, status->latency, status->supervision_timeout,
+             status->params_granted || !Profiles[status->profile].itvl_max ? "" : " (refused)");
+}
+
+static void ble_conn_profile_request_params(struct ble_conn_profile_conn* conn);
+
+static void ble_conn_profile_params_refused(struct ble_conn_profile_conn* conn)
+{
+    ++conn->status.param_refusals;
+    conn->status.params_granted = false;
+
+    const ble_conn_profile* profile = &Profiles[conn->status.params_profile];
+    const uint16_t limit = ble_conn_profile_itvl_limit(profile);
+
+    if (conn->attempts < CONFIG_GBLE_CONN_PARAM_RETRIES && conn->itvl_max < limit)
+    {
+        ++conn->attempts;
+        conn->itvl_max = conn->itvl_max * 2 < limit ? conn->itvl_max * 2 : limit;
+    }
+    else if (profile->fallback != conn->status.params_profile)
+    {
+        ESP_LOGW(TAG, "Connection %hu refused %s parameters, falling back to %s",
+                 conn->conn_handle, profile->name, Profiles[profile->fallback].name);
+
+        conn->status.params_profile = profile->fallback;
+        conn->attempts = 0;
+        conn->itvl_max = Profiles[profile->fallback].itvl_max;
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Connection %hu refused %s parameters, keeping interval %hu",
+                 conn->conn_handle, profile->name, conn->status.itvl);
+        ble_conn_profile_settle(conn);
+        return;
+    }
+
+    conn->retry_pending = true;
+    esp_timer_start_once(conn->retry_timer, (uint64_t)CONFIG_GBLE_CONN_PARAM_RETRY_MS * 1000);
+}
+
+static void ble_conn_profile_request_params(struct ble_conn_profile_conn* conn)
+{
+    const ble_conn_profile* profile = &Profiles[conn->status.params_profile];
+
+    const struct ble_gap_upd_params params = {
+        .itvl_min = profile->itvl_min < conn->itvl_max ? profile->itvl_min : conn->itvl_max,
+        .itvl_max = conn->itvl_max,
+        .latency = profile->latency,
+        .supervision_timeout = profile->supervision_timeout,
+        .min_ce_len = 0,
+        .max_ce_len = 0,
+    };
+
+    ++conn->status.param_requests;
+
+    int rc = ble_gap_update_params(conn->conn_handle, &params);
+    if (rc != 0)
+    {
+        ESP_LOGW(TAG, "Connection %hu parameter update failed; rc=%d", conn->conn_handle, rc);
+        ble_conn_profile_params_refused(conn);
+        return;
+    }
+
+    conn->params_pending = true;
+}
+
+static void ble_conn_profile_retry_event_cb(struct ble_npl_event* ev)
+{
+    struct ble_conn_profile_conn* conn = ble_npl_event_get_arg(ev);
+
+    if (!conn->used || !conn->retry_pending)
+    {
+        return;
+    }
+
+    conn->retry_pending = false;
+    ble_conn_profile_request_params(conn);
+}
+
+// Drops an active connection to the idle profile once it has been quiet
+// for the idle time, or checks again when it would have been
+static void ble_conn_profile_idle_event_cb(struct ble_npl_event* ev)
+{
+    struct ble_conn_profile_conn* conn = ble_npl_event_get_arg(ev);
+
+    if (!conn->used)
+    {
+        return;
+    }
+
+    conn->idle_armed = false;
+
+    if (!Adaptive_idle_us || conn->status.profile != Adaptive_active)
+    {
+        return;
+    }
+
+    const int64_t quiet_us = esp_timer_get_time() - conn->activity_us;
+    if (quiet_us >= Adaptive_idle_us)
+    {
+        ESP_LOGI(TAG, "Connection %hu idle", conn->conn_handle);
+        ble_conn_profile_apply(conn->conn_handle, Adaptive_idle);
+    }
+    else
+    {
+        ble_conn_profile_arm_idle(conn, Adaptive_idle_us - quiet_us);
+    }
+}
+
+static void ble_conn_profile_create_timer(esp_timer_cb_t callback, void* arg, esp_timer_handle_t* timer)
+{
+    if (*timer)
+    {
+        return;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = callback,
+        .arg = arg,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "conn_profile",
+    };
+
+    if (esp_timer_create(&timer_args, timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create timer");
+    }
+}
+
+void ble_conn_profile_init(ble_conn_profile_id default_profile)
+{
+    for (size_t idx = 0; idx < CONFIG_BT_NIMBLE_MAX_CONNECTIONS; ++idx)
+    {
+        struct ble_conn_profile_conn* conn = &Conns[idx];
+
+        if (conn->used)
+        {
+            ble_conn_profile_cancel_retry(conn);
+            ble_conn_profile_cancel_idle(conn);
+        }
+
+        esp_timer_handle_t retry_timer = conn->retry_timer;
+        esp_timer_handle_t idle_timer = conn->idle_timer;
+        memset(conn, 0, sizeof(*conn));
+        conn->retry_timer = retry_timer;
+        conn->idle_timer = idle_timer;
+
+        ble_npl_event_init(&conn->retry_event, ble_conn_profile_retry_event_cb, conn);
+        ble_npl_event_init(&conn->idle_event, ble_conn_profile_idle_event_cb, conn);
+
+        ble_conn_profile_create_timer(ble_conn_profile_retry_timer_cb, conn, &conn->retry_timer);
+        ble_conn_profile_create_timer(ble_conn_profile_idle_timer_cb, conn, &conn->idle_timer);
+    }
+
+    Adaptive_idle_us = 0;
+    ble_conn_profile_set_default(default_profile);
+}
+
+void ble_conn_profile_set_adaptive(ble_conn_profile_id active, ble_conn_profile_id idle, uint32_t idle_ms)
+{
+    if (active >= BLE_CONN_PROFILE_COUNT || idle >= BLE_CONN_PROFILE_COUNT)
+    {
+        ESP_LOGE(TAG, "Invalid profiles %d, %d", active, idle);
+        return;
+    }
+
+    Adaptive_active = active;
+    Adaptive_idle = idle;
+    Adaptive_idle_us = (int64_t)idle_ms * 1000;
+}
+
+void ble_conn_profile_note_command(uint16_t conn_handle)
+{
+    struct ble_conn_profile_conn* conn = ble_conn_profile_find(conn_handle);
+    if (!conn)
+    {
+        return;
+    }
+
+    const int64_t now_us = esp_timer_get_time();
+    conn->activity_us = now_us;
+
+    if (!Adaptive_idle_us || conn->status.profile == Adaptive_active)
+    {
+        return;
+    }
+
+    if (now_us - conn->window_start_us > BLE_CONN_PROFILE_ACTIVE_WINDOW_US)
+    {
+        conn->window_start_us = now_us;
+        conn->window_commands = 0;
+    }
+
+    if (++conn->window_commands < CONFIG_GBLE_CONN_ACTIVE_COMMANDS)
+    {
+        return;
+    }
+
+    ESP_LOGI(TAG, "Connection %hu active", conn_handle);
+
+    conn->wake_start_us = now_us;
+    conn->window_commands = 0;
+    ble_conn_profile_apply(conn_handle, Adaptive_active);
+    ble_conn_profile_arm_idle(conn, Adaptive_idle_us);
+}
+
+const ble_conn_profile* ble_conn_profile_get(ble_conn_profile_id id)
+{
+    return id < BLE_CONN_PROFILE_COUNT ? &Profiles[id] : NULL;
+}
+
+void ble_conn_profile_set_default(ble_conn_profile_id id)
+{
+    if (id >= BLE_CONN_PROFILE_COUNT)
+    {
+        ESP_LOGE(TAG, "Invalid profile %d", id);
+        return;
+    }
+
+    Default_profile = id;
+}
+
+bool ble_conn_profile_apply(uint16_t conn_handle, ble_conn_profile_id id)
+{
+    if (id >= BLE_CONN_PROFILE_COUNT)
+    {
+        ESP_LOGE(TAG, "Invalid profile %d", id);
+        return false;
+    }
+
+    struct ble_conn_profile_conn* conn = ble_conn_profile_find(conn_handle);
+    if (!conn)
+    {
+        ESP_LOGE(TAG, "Unknown connection %hu", conn_handle);
+        return false;
+    }
+
+    const ble_conn_profile* profile = &Profiles[id];
+    const int64_t now_us = esp_timer_get_time();
+
+    ble_conn_profile_cancel_retry(conn);
+    conn->status.profile_us[conn->status.profile] += now_us - conn->profile_since_us;
+    conn->profile_since_us = now_us;
+    conn->status.profile = id;
+    conn->status.params_profile = id;
+    conn->status.params_granted = false;
+    conn->status.settled_us = 0;
+    conn->attempts = 0;
+
+    int rc;
+
+    if (profile->mtu > BLE_ATT_MTU_DFLT && !conn->mtu_exchanged)
+    {
+        rc = ble_gattc_exchange_mtu(conn_handle, NULL, NULL);
+        if (rc == 0)
+        {
+            conn->mtu_pending = true;
+            conn->mtu_exchanged = true;
+        }
+        else
+        {
+            ESP_LOGW(TAG, "Connection %hu MTU exchange failed; rc=%d", conn_handle, rc);
+        }
+    }
+
+    if (profile->tx_octets > conn->status.tx_octets)
+    {
+        // Time for the PDU on 1M, which also covers 2M
+        rc = ble_gap_set_data_len(conn_handle, profile->tx_octets, (profile->tx_octets + 14) * 8);
+        if (rc == 0)
+        {
+#ifdef BLE_GAP_EVENT_DATA_LEN_CHG
+            conn->data_len_pending = true;
+#else
+            // No event to say what the controllers agreed on
+            conn->status.tx_octets = profile->tx_octets;
+#endif
+        }
+        else
+        {
+            ESP_LOGW(TAG, "Connection %hu data length failed; rc=%d", conn_handle, rc);
+        }
+    }
+
+    if (profile->phy_mask && !(profile->phy_mask & (1 << (conn->status.tx_phy - 1))))
+    {
+        rc = ble_gap_set_prefered_le_phy(conn_handle, profile->phy_mask, profile->phy_mask, 0);
+        if (rc == 0)
+        {
+            conn->phy_pending = true;
+        }
+        else
+        {
+            ESP_LOGW(TAG, "Connection %hu PHY update failed; rc=%d", conn_handle, rc);
+        }
+    }
+
+    if (profile->itvl_max)
+    {
+        conn->itvl_max = profile->itvl_max;
+        ble_conn_profile_request_params(conn);
+    }
+
+    ble_conn_profile_settle(conn);
+
+    return true;
+}
+
+bool ble_conn_profile_get_status(uint16_t conn_handle, ble_conn_profile_status* status)
+{
+    const struct ble_conn_profile_conn* conn = ble_conn_profile_find(conn_handle);
+    if (!conn)
+    {
+        return false;
+    }
+
+    *status = conn->status;
+    status->profile_us[status->profile] += esp_timer_get_time() - conn->profile_since_us;
+    return true;
+}
+
+static void ble_conn_profile_update_desc(struct ble_conn_profile_conn* conn)
+{
+    struct ble_gap_conn_desc desc;
+    if (ble_gap_conn_find(conn->conn_handle, &desc) == 0)
+    {
+        conn->status.itvl = desc.conn_itvl;
+        conn->status.latency = desc.conn_latency;
+        conn->status.supervision_timeout = desc.supervision_timeout;
+    }
+}
+
+static void ble_conn_profile_connected(uint16_t conn_handle)
+{
+    struct ble_conn_profile_conn* conn = NULL;
+    for (size_t idx = 0; idx < CONFIG_BT_NIMBLE_MAX_CONNECTIONS && !conn; ++idx)
+    {
+        if (!Conns[idx].used)
+        {
+            conn = &Conns[idx];
+        }
+    }
+
+    if (!conn)
+    {
+        ESP_LOGE(TAG, "No room for connection %hu", conn_handle);
+        return;
+    }
+
+    conn->used = true;
+    conn->conn_handle = conn_handle;
+    conn->mtu_pending = false;
+    conn->data_len_pending = false;
+    conn->phy_pending = false;
+    conn->params_pending = false;
+    conn->retry_pending = false;
+    conn->mtu_exchanged = false;
+    conn->idle_armed = false;
+    conn->window_start_us = 0;
+    conn->window_commands = 0;
+    conn->wake_start_us = 0;
+
+    memset(&conn->status, 0, sizeof(conn->status));
+    conn->status.mtu = ble_att_mtu(conn_handle);
+    conn->status.tx_octets = 27;
+    conn->status.tx_phy = BLE_HCI_LE_PHY_1M;
+    conn->status.rx_phy = BLE_HCI_LE_PHY_1M;
+    conn->status.connected_us = esp_timer_get_time();
+    conn->profile_since_us = conn->status.connected_us;
+    conn->activity_us = conn->status.connected_us;
+    ble_conn_profile_update_desc(conn);
+
+    if (Adaptive_idle_us)
+    {
+        ble_conn_profile_apply(conn_handle, Adaptive_active);
+        ble_conn_profile_arm_idle(conn, Adaptive_idle_us);
+    }
+    else
+    {
+        ble_conn_profile_apply(conn_handle, Default_profile);
+    }
+}
+
+void ble_conn_profile_handle_gap_event(const struct ble_gap_event* event)
+{
+    struct ble_conn_profile_conn* conn;
+
+    switch (event->type)
+    {
+        case BLE_GAP_EVENT_CONNECT:
+            if (event->connect.status == 0)
+            {
+                ble_conn_profile_connected(event->connect.conn_handle);
+            }
+            break;
+
+        case BLE_GAP_EVENT_DISCONNECT:
+            conn = ble_conn_profile_find(event->disconnect.conn.conn_handle);
+            if (conn)
+            {
+                ble_conn_profile_cancel_retry(conn);
+                ble_conn_profile_cancel_idle(conn);
+                conn->used = false;
+            }
+            break;
+
+        case BLE_GAP_EVENT_NOTIFY_TX:
+            conn = ble_conn_profile_find(event->notify_tx.conn_handle);
+            if (conn)
+            {
+                conn->activity_us = esp_timer_get_time();
+            }
+            break;
+
+        case BLE_GAP_EVENT_CONN_UPDATE:
+            conn = ble_conn_profile_find(event->conn_update.conn_handle);
+            if (!conn)
+            {
+                break;
+            }
+
+            ble_conn_profile_update_desc(conn);
+
+            // Updates the central started are tracked but not judged
+            if (!conn->params_pending)
+            {
+                break;
+            }
+
+            conn->params_pending = false;
+
+            if (event->conn_update.status != 0 || conn->status.itvl > conn->itvl_max)
+            {
+                ble_conn_profile_params_refused(conn);
+            }
+            else
+            {
+                conn->status.params_granted = true;
+            }
+
+            ble_conn_profile_settle(conn);
+            break;
+
+        case BLE_GAP_EVENT_MTU:
+            conn = ble_conn_profile_find(event->mtu.conn_handle);
+            if (conn)
+            {
+                conn->status.mtu = event->mtu.value;
+                conn->mtu_pending = false;
+                conn->mtu_exchanged = true;
+                ble_conn_profile_settle(conn);
+            }
+            break;
+
+        case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+            conn = ble_conn_profile_find(event->phy_updated.conn_handle);
+            if (conn)
+            {
+                if (event->phy_updated.status == 0)
+                {
+                    conn->status.tx_phy = event->phy_updated.tx_phy;
+                    conn->status.rx_phy = event->phy_updated.rx_phy;
+                }
+                conn->phy_pending = false;
+                ble_conn_profile_settle(conn);
+            }
+            break;
+
+#ifdef BLE_GAP_EVENT_DATA_LEN_CHG
+        case BLE_GAP_EVENT_DATA_LEN_CHG:
+            conn = ble_conn_profile_find(event->data_len_chg.conn_handle);
+            if (conn)
+            {
+                conn->status.tx_octets = event->data_len_chg.max_tx_octets;
+                conn->data_len_pending = false;
+                ble_conn_profile_settle(conn);
+            }
+            break;
+#endif
+
+        default:
+            break;
+    }
+}
+
+// Wrapper functions to work with other APIs
+void ble_conn_profile_note_command_ctx(uint16_t conn_handle, void* context)
+{
+    ble_conn_profile_note_command(conn_handle);
+}
@@ -0,0 +1,157 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+// Connection profiles. Centrals pick the link they like: 1M PHY, 27 byte
+// PDUs, the default ATT MTU and a 30-50 ms interval. A profile is what the
+// peripheral asks for after connecting instead:
+//
+//   low latency  7.5-15 ms, no latency, 2M, 251 byte PDUs, 247 byte MTU
+//   throughput   15-30 ms, no latency, 2M, 251 byte PDUs, 247 byte MTU
+//   low power    100-200 ms, latency 4, link left as is
+//
+// What the central grants is tracked per connection. MTU, data length and
+// PHY are asked once and the answer stands; a 2M request on a 1M-only
+// central just stays on 1M. A parameter update that is refused, or granted
+// with a slower interval than asked, is asked again after
+// CONFIG_GBLE_CONN_PARAM_RETRY_MS allowing twice the longest interval, up to
+// CONFIG_GBLE_CONN_PARAM_RETRIES times, then with the parameters of the
+// profile's fallback; when that runs out too the connection keeps what it
+// has.
+//
+// With adaptive parameters a connection starts on the active profile and
+// drops to the idle one after idle_ms without commands or notifications.
+// CONFIG_GBLE_CONN_ACTIVE_COMMANDS commands within a second bring it back.
+// The switch down waits out the whole idle time while the switch up comes
+// at once, so a lull between commands does not make the link flap. The
+// first command after idle still arrives at the idle interval and latency,
+// and the ones after it until the central grants the active parameters;
+// that wait is reported as the wake time.
+//
+// Runs on the NimBLE host task: ble_func.c passes every GAP event to
+// ble_conn_profile_handle_gap_event, and the GATT server reports writes
+// through ble_conn_profile_note_command_ctx.
+//
+//   ble_conn_profile_init(CONFIG_GBLE_CONN_PROFILE);
+//   ble_conn_profile_set_adaptive(BLE_CONN_PROFILE_LOW_LATENCY, BLE_CONN_PROFILE_LOW_POWER, 2000);
+//   gatt_svr_register_write_activity_cb(ble_conn_profile_note_command_ctx, NULL);
+//   ... later, on the host task:
+//   ble_conn_profile_apply(conn_handle, BLE_CONN_PROFILE_THROUGHPUT);
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "host/ble_gap.h"
+
+typedef enum {
+    BLE_CONN_PROFILE_NONE,
+    BLE_CONN_PROFILE_LOW_LATENCY,
+    BLE_CONN_PROFILE_THROUGHPUT,
+    BLE_CONN_PROFILE_LOW_POWER,
+    BLE_CONN_PROFILE_COUNT
+} ble_conn_profile_id;
+
+struct ble_conn_profile {
+    const char* name;
+
+    // ATT MTU to exchange, 0 to leave it to the central
+    uint16_t mtu;
+
+    // Data length extension PDU size, 0 to leave it
+    uint16_t tx_octets;
+
+    // BLE_GAP_LE_PHY_*_MASK to prefer, 0 to leave it
+    uint8_t phy_mask;
+
+    // Connection parameters in 1.25 ms units, 10 ms units for the
+    // timeout. An itvl_max of 0 leaves them.
+    uint16_t itvl_min;
+    uint16_t itvl_max;
+    uint16_t latency;
+    uint16_t supervision_timeout;
+
+    // Whose parameters to ask for when these are refused for good; itself
+    // to stop there
+    ble_conn_profile_id fallback;
+};
+typedef struct ble_conn_profile ble_conn_profile;
+
+// What a connection asked for and was granted
+struct ble_conn_profile_status {
+    ble_conn_profile_id profile;
+
+    // The profile whose parameters are asked for, after any fallback
+    ble_conn_profile_id params_profile;
+
+    uint16_t mtu;
+    uint16_t tx_octets;
+    uint8_t tx_phy;
+    uint8_t rx_phy;
+    uint16_t itvl;
+    uint16_t latency;
+    uint16_t supervision_timeout;
+
+    // The interval granted is within what was asked
+    bool params_granted;
+
+    uint8_t param_requests;
+    uint8_t param_refusals;
+
+    // When the connection was made, and when the last request of the
+    // profile was answered; 0 while some are open
+    int64_t connected_us;
+    int64_t settled_us;
+
+    // Time spent on each profile, up to the call for the current one
+    int64_t profile_us[BLE_CONN_PROFILE_COUNT];
+
+    // Adaptive switches from idle to active, and the time from the command
+    // that caused each to the active parameters being answered
+    uint32_t wakes;
+    int64_t wake_us_total;
+    int64_t wake_us_max;
+};
+typedef struct ble_conn_profile_status ble_conn_profile_status;
+
+// Forgets all connections; new ones get default_profile.
+void ble_conn_profile_init(ble_conn_profile_id default_profile);
+
+const ble_conn_profile* ble_conn_profile_get(ble_conn_profile_id id);
+
+// For connections made from now on.
+void ble_conn_profile_set_default(ble_conn_profile_id id);
+
+// Asks an open connection for a profile's link; NONE asks for nothing.
+bool ble_conn_profile_apply(uint16_t conn_handle, ble_conn_profile_id id);
+
+bool ble_conn_profile_get_status(uint16_t conn_handle, ble_conn_profile_status* status);
+
+// Switches connections between two profiles by activity; 0 idle_ms turns
+// it off and leaves them where they are. New connections start on active.
+void ble_conn_profile_set_adaptive(ble_conn_profile_id active, ble_conn_profile_id idle, uint32_t idle_ms);
+
+// A command arrived on the connection.
+void ble_conn_profile_note_command(uint16_t conn_handle);
+
+void ble_conn_profile_handle_gap_event(const struct ble_gap_event* event);
+
+// Wrapper functions to work with other APIs
+void ble_conn_profile_note_command_ctx(uint16_t conn_handle, void* context);
@@ -17,6 +17,8 @@
  * under the License.
  */
 
+#include <inttypes.h>
+
 #include "nvs_flash.h"
 #include "esp_log.h"
 #include "esp_mac.h"
@@ -36,6 +38,7 @@
 #include "nimble/nimble_port_freertos.h"
 #include "host/util/util.h"
 
+#include "ble_conn_profile.h"
 #include "ble_func.h"
 
 #define MAC2STR_REV(a) (a)[5], (a)[4], (a)[3], (a)[2], (a)[1], (a)[0]
@@ -45,6 +48,53 @@ static const char *TAG = "BleFunc";
 static int bleprph_gap_event(struct ble_gap_event *event, void *arg);
 static uint8_t own_addr_type;
 
+struct ble_func_conn {
+    bool used;
+    ble_func_conn_info info;
+};
+
+static struct ble_func_conn Conns[CONFIG_BT_NIMBLE_MAX_CONNECTIONS];
+static size_t Conn_count;
+
+#if CONFIG_BT_NIMBLE_EXT_ADV
+// Advertising set of the connectable advertising
+#define BLE_FUNC_ADV_INSTANCE 0
+#endif
+
+#if CONFIG_GBLE_BROADCAST
+// Advertising set of the sensor broadcast, non-connectable
+#define BLE_FUNC_BROADCAST_INSTANCE 1
+
+// Broadcast data, kept until the host syncs and the set starts. Written
+// from any task under Broadcast_lock; the host task hands it to the set
+// when Broadcast_event runs.
+static SemaphoreHandle_t Broadcast_lock;
+static struct ble_npl_event Broadcast_event;
+static uint8_t Broadcast_data[CONFIG_BT_NIMBLE_EXT_ADV_MAX_SIZE];
+static size_t Broadcast_data_size;
+// Host task only; cleared by a host reset, which removes the set
+static bool Broadcast_started;
+#endif
+
+#define BLE_FUNC_NVS_NAMESPACE "gble_adv"
+#define BLE_FUNC_NVS_LAST_PEER "last_peer"
+
+// Longest high duty cycle directed advertising the spec allows
+#define BLE_FUNC_DIRECTED_MS_MAX 1280
+
+// Advertisement data, encoded and sent on first use, whenever the
+// configuration changes and after a host reset
+static uint8_t Adv_data[BLE_HS_ADV_MAX_SZ];
+static uint8_t Adv_data_len;
+
+static ble_func_adv_config Adv_config;
+static ble_func_adv_phase Adv_phase;
+static ble_func_adv_stats Adv_stats;
+
+// The peer that last bonded or reconnected encrypted, kept in NVS
+static ble_addr_t Last_peer;
+static bool Last_peer_known;
+
 ble_func_disconnect_callback_fn* disconnect_cb = NULL;
 void* disconnect_cb_context = NULL;
 
@@ -65,6 +115,94 @@ void ble_func_register_subscribe_cb(ble_func_subscribe_callback_fn* fn,
     subscribe_cb_context = context;
 }
 
+ble_func_notify_tx_callback_fn* notify_tx_cb = NULL;
+void* notify_tx_cb_context = NULL;
+
+void ble_func_register_notify_tx_cb(ble_func_notify_tx_callback_fn* fn,
+                                    void* context)
+{
+    notify_tx_cb = fn;
+    notify_tx_cb_context = context;
+}
+
+static struct ble_func_conn* ble_func_conn_find(uint16_t conn_handle)
+{
+    for (size_t idx = 0; idx < CONFIG_BT_NIMBLE_MAX_CONNECTIONS; ++idx)
+    {
+        if (Conns[idx].used && Conns[idx].info.conn_handle == conn_handle)
+        {
+            return &Conns[idx];
+        }
+    }
+
+    return NULL;
+}
+
+static void ble_func_conn_add(const struct ble_gap_conn_desc* desc)
+{
+    struct ble_func_conn* conn = ble_func_conn_find(desc->conn_handle);
+
+    for (size_t idx = 0; idx < CONFIG_BT_NIMBLE_MAX_CONNECTIONS && !conn; ++idx)
+    {
+        if (!Conns[idx].used)
+        {
+            conn = &Conns[idx];
+            ++Conn_count;
+        }
+    }
+
+    if (!conn)
+    {
+        ESP_LOGE(TAG, "No room for connection %hu", desc->conn_handle);
+        return;
+    }
+
+    memset(conn, 0, sizeof(*conn));
+    conn->used = true;
+    conn->info.conn_handle = desc->conn_handle;
+    memcpy(conn->info.peer_addr, desc->peer_id_addr.val, sizeof(conn->info.peer_addr));
+    conn->info.mtu = ble_att_mtu(desc->conn_handle);
+    conn->info.tx_phy = BLE_HCI_LE_PHY_1M;
+    conn->info.rx_phy = BLE_HCI_LE_PHY_1M;
+}
+
+static void ble_func_conn_remove(uint16_t conn_handle)
+{
+    struct ble_func_conn* conn = ble_func_conn_find(conn_handle);
+    if (conn)
+    {
+        conn->used = false;
+        --Conn_count;
+    }
+}
+
+bool ble_func_get_conn(uint16_t conn_handle, ble_func_conn_info* info)
+{
+    const struct ble_func_conn* conn = ble_func_conn_find(conn_handle);
+    if (!conn)
+    {
+        return false;
+    }
+
+    *info = conn->info;
+    return true;
+}
+
+size_t ble_func_get_conns(ble_func_conn_info* infos, size_t max)
+{
+    size_t count = 0;
+
+    for (size_t idx = 0; idx < CONFIG_BT_NIMBLE_MAX_CONNECTIONS; ++idx)
+    {
+        if (Conns[idx].used && count < max)
+        {
+            infos[count++] = Conns[idx].info;
+        }
+    }
+
+    return Conn_count;
+}
+
 /**
  * Logs information about a connection to the console.
  */
@@ -100,25 +238,18 @@ int user_parse(const struct ble_hs_adv_field *data, void *arg)
 }
 
 /**
- * Enables advertising with the following parameters:
- *     o General discoverable mode.
- *     o Undirected connectable mode.
+ * Encodes the advertisement data once and hands it to the controller, which
+ * keeps it across advertising starts:
+ *     o Flags (indicates advertisement type and other general info).
+ *     o Advertising tx power.
+ *     o Device name.
  */
-static void bleprph_advertise(void)
+static bool bleprph_set_adv_data(void)
 {
-    struct ble_gap_adv_params adv_params;
     struct ble_hs_adv_fields fields;
     const char *name;
     int rc;
 
-    /**
-     *  Set the advertisement data included in our advertisements:
-     *     o Flags (indicates advertisement type and other general info).
-     *     o Advertising tx power.
-     *     o Device name.
-     *     o 16-bit service UUIDs (alert notifications).
-     */
-
     memset(&fields, 0, sizeof fields);
 
     /* Advertise two flags:
@@ -136,7 +267,7 @@ static void bleprph_advertise(void)
     fields.tx_pwr_lvl = BLE_HS_ADV_TX_PWR_LVL_AUTO;
 
     fields.adv_itvl_is_present = 1;
-    fields.adv_itvl = 40;
+    fields.adv_itvl = BLE_GAP_ADV_ITVL_MS(Adv_config.fast_itvl_ms);
 
     name = ble_svc_gap_device_name();
     fields.name = (uint8_t *)name;
@@ -149,34 +280,480 @@ static void bleprph_advertise(void)
     if (rc != 0)
     {
         ESP_LOGE(TAG, "error setting advertisement data to buf; rc=%d", rc);
-        return;
+        return false;
     }
     if (buf_sz > BLE_HS_ADV_MAX_SZ)
     {
         ESP_LOGE(TAG, "Too long advertising data: name %s, appearance %x, advsize = %d",
             name, fields.appearance, buf_sz);
         ble_hs_adv_parse(buf, buf_sz, user_parse, NULL);
-        return;
+        return false;
     }
 
-    rc = ble_gap_adv_set_fields(&fields);
+    memcpy(Adv_data, buf, buf_sz);
+    Adv_data_len = buf_sz;
+    ++Adv_stats.data_encodes;
+
+#if !CONFIG_BT_NIMBLE_EXT_ADV
+    rc = ble_gap_adv_set_data(Adv_data, Adv_data_len);
     if (rc != 0)
     {
         ESP_LOGE(TAG, "error setting advertisement data; rc=%d", rc);
+        Adv_data_len = 0;
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+#if CONFIG_BT_NIMBLE_EXT_ADV
+/**
+ * With extended advertising on, the legacy advertising calls are gone and
+ * the connectable advertising runs as set BLE_FUNC_ADV_INSTANCE with legacy
+ * PDUs, so every central still finds it. The set is configured for each
+ * start and takes the cached data again.
+ */
+static int ble_func_adv_start(const ble_addr_t* direct_addr, int32_t duration_ms,
+                              const struct ble_gap_adv_params* adv_params)
+{
+    struct ble_gap_ext_adv_params params;
+    struct os_mbuf* data;
+    int rc;
+
+    memset(&params, 0, sizeof(params));
+    params.legacy_pdu = 1;
+    params.connectable = adv_params->conn_mode != BLE_GAP_CONN_MODE_NON;
+    params.scannable = adv_params->conn_mode != BLE_GAP_CONN_MODE_DIR;
+    params.directed = direct_addr != NULL;
+    params.high_duty_directed = adv_params->high_duty_cycle;
+    params.itvl_min = adv_params->itvl_min ? adv_params->itvl_min : BLE_GAP_ADV_ITVL_MS(30);
+    params.itvl_max = adv_params->itvl_max ? adv_params->itvl_max : BLE_GAP_ADV_ITVL_MS(60);
+    params.own_addr_type = own_addr_type;
+    params.primary_phy = BLE_HCI_LE_PHY_1M;
+    params.secondary_phy = BLE_HCI_LE_PHY_1M;
+    params.tx_power = 127;
+    params.sid = BLE_FUNC_ADV_INSTANCE;
+
+    if (direct_addr)
+    {
+        params.peer = *direct_addr;
+    }
+
+    rc = ble_gap_ext_adv_configure(BLE_FUNC_ADV_INSTANCE, &params, NULL, bleprph_gap_event, NULL);
+    if (rc != 0)
+    {
+        return rc;
+    }
+
+    /* Directed advertising carries no data. */
+    if (!direct_addr)
+    {
+        data = os_msys_get_pkthdr(Adv_data_len, 0);
+        if (!data)
+        {
+            return BLE_HS_ENOMEM;
+        }
+
+        rc = os_mbuf_append(data, Adv_data, Adv_data_len);
+        if (rc != 0)
+        {
+            os_mbuf_free_chain(data);
+            return rc;
+        }
+
+        rc = ble_gap_ext_adv_set_data(BLE_FUNC_ADV_INSTANCE, data);
+        if (rc != 0)
+        {
+            return rc;
+        }
+    }
+
+    return ble_gap_ext_adv_start(BLE_FUNC_ADV_INSTANCE,
+                                 duration_ms == BLE_HS_FOREVER ? 0 : duration_ms / 10, 0);
+}
+
+static void ble_func_adv_stop(void)
+{
+    ble_gap_ext_adv_stop(BLE_FUNC_ADV_INSTANCE);
+}
+
+static bool ble_func_adv_active(void)
+{
+    return ble_gap_ext_adv_active(BLE_FUNC_ADV_INSTANCE);
+}
+#else
+static int ble_func_adv_start(const ble_addr_t* direct_addr, int32_t duration_ms,
+                              const struct ble_gap_adv_params* adv_params)
+{
+    return ble_gap_adv_start(own_addr_type, direct_addr, duration_ms, adv_params,
+                             bleprph_gap_event, NULL);
+}
+
+static void ble_func_adv_stop(void)
+{
+    ble_gap_adv_stop();
+}
+
+static bool ble_func_adv_active(void)
+{
+    return ble_gap_adv_active();
+}
+#endif
+
+static void ble_func_load_last_peer(void)
+{
+    nvs_handle_t nvs = 0;
+    size_t size = sizeof(Last_peer);
+
+    Last_peer_known = nvs_open(BLE_FUNC_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK &&
+                      nvs_get_blob(nvs, BLE_FUNC_NVS_LAST_PEER, &Last_peer, &size) == ESP_OK &&
+                      size == sizeof(Last_peer);
+
+    if (nvs)
+    {
+        nvs_close(nvs);
+    }
+}
+
+static void ble_func_save_last_peer(const ble_addr_t* peer)
+{
+    if (Last_peer_known && ble_addr_cmp(&Last_peer, peer) == 0)
+    {
+        return;
+    }
+
+    Last_peer = *peer;
+    Last_peer_known = true;
+
+    nvs_handle_t nvs;
+    if (nvs_open(BLE_FUNC_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to open NVS namespace %s", BLE_FUNC_NVS_NAMESPACE);
+        return;
+    }
+
+    if (nvs_set_blob(nvs, BLE_FUNC_NVS_LAST_PEER, peer, sizeof(*peer)) != ESP_OK ||
+        nvs_commit(nvs) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to save last peer");
+    }
+
+    nvs_close(nvs);
+}
+
+// The last bonded peer, while its bond is still in the store and it is
+// not connected
+static bool ble_func_last_peer_away(void)
+{
+    if (!Last_peer_known)
+    {
+        return false;
+    }
+
+    for (size_t idx = 0; idx < CONFIG_BT_NIMBLE_MAX_CONNECTIONS; ++idx)
+    {
+        if (Conns[idx].used && memcmp(Conns[idx].info.peer_addr, Last_peer.val, sizeof(Last_peer.val)) == 0)
+        {
+            return false;
+        }
+    }
+
+    ble_addr_t peers[CONFIG_BT_NIMBLE_MAX_BONDS];
+    int peer_count = 0;
+
+    if (ble_store_util_bonded_peers(peers, &peer_count, CONFIG_BT_NIMBLE_MAX_BONDS) != 0)
+    {
+        return false;
+    }
+
+    for (int idx = 0; idx < peer_count; ++idx)
+    {
+        if (ble_addr_cmp(&peers[idx], &Last_peer) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Enables advertising in one of the reconnect phases:
+ *     o Directed, high duty cycle, to the last bonded peer.
+ *     o Undirected connectable, general discoverable, at the fast interval.
+ *     o The same at the slow interval, until a central connects.
+ *
+ * Does nothing while advertising or once every connection is taken.
+ */
+static void bleprph_advertise_phase(ble_func_adv_phase phase)
+{
+    struct ble_gap_adv_params adv_params;
+    int32_t duration_ms = BLE_HS_FOREVER;
+    int rc;
+
+    if (ble_func_adv_active() || Conn_count >= CONFIG_BT_NIMBLE_MAX_CONNECTIONS)
+    {
+        return;
+    }
+
+    if (!Adv_data_len && !bleprph_set_adv_data())
+    {
         return;
     }
 
-    /* Begin advertising. */
     memset(&adv_params, 0, sizeof adv_params);
-    adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
-    adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
-    rc = ble_gap_adv_start(own_addr_type, NULL, BLE_HS_FOREVER,
-                           &adv_params, bleprph_gap_event, NULL);
+
+    switch (phase)
+    {
+        case BLE_FUNC_ADV_DIRECTED:
+            adv_params.conn_mode = BLE_GAP_CONN_MODE_DIR;
+            adv_params.disc_mode = BLE_GAP_DISC_MODE_NON;
+            adv_params.high_duty_cycle = 1;
+            duration_ms = Adv_config.directed_ms < BLE_FUNC_DIRECTED_MS_MAX ?
+                          Adv_config.directed_ms : BLE_FUNC_DIRECTED_MS_MAX;
+            break;
+
+        case BLE_FUNC_ADV_FAST:
+            adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
+            adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
+            adv_params.itvl_min = BLE_GAP_ADV_ITVL_MS(Adv_config.fast_itvl_ms);
+            adv_params.itvl_max = adv_params.itvl_min;
+            if (Adv_config.fast_ms)
+            {
+                duration_ms = Adv_config.fast_ms;
+            }
+            break;
+
+        default:
+            phase = BLE_FUNC_ADV_SLOW;
+            adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
+            adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
+            adv_params.itvl_min = BLE_GAP_ADV_ITVL_MS(Adv_config.slow_itvl_ms);
+            adv_params.itvl_max = adv_params.itvl_min;
+            break;
+    }
+
+    rc = ble_func_adv_start(phase == BLE_FUNC_ADV_DIRECTED ? &Last_peer : NULL,
+                            duration_ms, &adv_params);
     if (rc != 0)
     {
         ESP_LOGE(TAG, "error enabling advertisement; rc=%d", rc);
         return;
     }
+
+    Adv_phase = phase;
+    ++Adv_stats.starts[phase];
+}
+
+/**
+ * Starts advertising from the first reconnect phase that applies: directed
+ * when the last bonded peer is away, fast otherwise. The peer going away
+ * cuts short undirected advertising that was running for other centrals.
+ */
+static void bleprph_advertise(void)
+{
+    const bool directed = Adv_config.directed_ms && ble_func_last_peer_away();
+
+    if (directed && ble_func_adv_active() && Adv_phase != BLE_FUNC_ADV_DIRECTED)
+    {
+        ble_func_adv_stop();
+        Adv_phase = BLE_FUNC_ADV_IDLE;
+    }
+
+    bleprph_advertise_phase(directed ? BLE_FUNC_ADV_DIRECTED : BLE_FUNC_ADV_FAST);
+}
+
+void ble_func_set_adv_config(const ble_func_adv_config* config)
+{
+    Adv_config = *config;
+    Adv_data_len = 0;
+
+    // Restart in the new configuration
+    if (ble_func_adv_active())
+    {
+        ble_func_adv_stop();
+        Adv_phase = BLE_FUNC_ADV_IDLE;
+        bleprph_advertise();
+    }
+}
+
+ble_func_adv_phase ble_func_get_adv_phase(void)
+{
+    return ble_func_adv_active() ? Adv_phase : BLE_FUNC_ADV_IDLE;
+}
+
+void ble_func_get_adv_stats(ble_func_adv_stats* stats)
+{
+    *stats = Adv_stats;
+}
+
+#if CONFIG_GBLE_BROADCAST
+// Hands the broadcast data to the periodic advertising train, or to the
+// extended advertising itself without periodic advertising. Nothing to do
+// before any data is set. Runs on the host task.
+static bool ble_func_broadcast_set_data(void)
+{
+    struct os_mbuf* data;
+    int rc;
+
+    xSemaphoreTake(Broadcast_lock, portMAX_DELAY);
+
+    if (Broadcast_data_size == 0)
+    {
+        xSemaphoreGive(Broadcast_lock);
+        return true;
+    }
+
+    data = os_msys_get_pkthdr(Broadcast_data_size, 0);
+    rc = data ? os_mbuf_append(data, Broadcast_data, Broadcast_data_size) : 0;
+
+    xSemaphoreGive(Broadcast_lock);
+
+    if (!data)
+    {
+        ESP_LOGE(TAG, "no mbuf for broadcast data");
+        return false;
+    }
+
+    if (rc != 0)
+    {
+        os_mbuf_free_chain(data);
+        ESP_LOGE(TAG, "error copying broadcast data; rc=%d", rc);
+        return false;
+    }
+
+#if CONFIG_GBLE_BROADCAST_PERIODIC
+    rc = ble_gap_periodic_adv_set_data(BLE_FUNC_BROADCAST_INSTANCE, data);
+#else
+    rc = ble_gap_ext_adv_set_data(BLE_FUNC_BROADCAST_INSTANCE, data);
+#endif
+    if (rc != 0)
+    {
+        ESP_LOGE(TAG, "error setting broadcast data; rc=%d", rc);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Starts the broadcast set next to the connectable one: non-connectable,
+ * non-scannable extended advertising every CONFIG_GBLE_BROADCAST_INTERVAL_MS,
+ * carrying a periodic advertising train at the same interval that observers
+ * sync to when CONFIG_GBLE_BROADCAST_PERIODIC is on.
+ */
+static void ble_func_broadcast_start(void)
+{
+    struct ble_gap_ext_adv_params params;
+    int rc;
+
+    if (Broadcast_started)
+    {
+        return;
+    }
+
+    memset(&params, 0, sizeof(params));
+    params.itvl_min = BLE_GAP_ADV_ITVL_MS(CONFIG_GBLE_BROADCAST_INTERVAL_MS);
+    params.itvl_max = params.itvl_min;
+    params.own_addr_type = own_addr_type;
+    params.primary_phy = BLE_HCI_LE_PHY_1M;
+    params.secondary_phy = BLE_HCI_LE_PHY_1M;
+    params.tx_power = 127;
+    params.sid = BLE_FUNC_BROADCAST_INSTANCE;
+
+    rc = ble_gap_ext_adv_configure(BLE_FUNC_BROADCAST_INSTANCE, &params, NULL, NULL, NULL);
+    if (rc != 0)
+    {
+        ESP_LOGE(TAG, "error configuring broadcast set; rc=%d", rc);
+        return;
+    }
+
+#if CONFIG_GBLE_BROADCAST_PERIODIC
+    struct ble_gap_periodic_adv_params periodic_params;
+
+    memset(&periodic_params, 0, sizeof(periodic_params));
+    periodic_params.itvl_min = BLE_GAP_PERIODIC_ITVL_MS(CONFIG_GBLE_BROADCAST_INTERVAL_MS);
+    periodic_params.itvl_max = periodic_params.itvl_min;
+
+    rc = ble_gap_periodic_adv_configure(BLE_FUNC_BROADCAST_INSTANCE, &periodic_params);
+    if (rc != 0)
+    {
+        ESP_LOGE(TAG, "error configuring periodic broadcast; rc=%d", rc);
+        return;
+    }
+#endif
+
+    if (!ble_func_broadcast_set_data())
+    {
+        return;
+    }
+
+#if CONFIG_GBLE_BROADCAST_PERIODIC
+    rc = ble_gap_periodic_adv_start(BLE_FUNC_BROADCAST_INSTANCE);
+    if (rc != 0)
+    {
+        ESP_LOGE(TAG, "error starting periodic broadcast; rc=%d", rc);
+        return;
+    }
+#endif
+
+    rc = ble_gap_ext_adv_start(BLE_FUNC_BROADCAST_INSTANCE, 0, 0);
+    if (rc != 0)
+    {
+        ESP_LOGE(TAG, "error starting broadcast set; rc=%d", rc);
+        return;
+    }
+
+    Broadcast_started = true;
+}
+
+// New data set from another task; before the set starts, starting it
+// picks the data up
+static void ble_func_broadcast_event_cb(struct ble_npl_event* ev)
+{
+    if (Broadcast_started)
+    {
+        ble_func_broadcast_set_data();
+    }
+}
+#endif
+
+bool ble_func_set_broadcast_data(const uint8_t* data, size_t size)
+{
+#if CONFIG_GBLE_BROADCAST
+    if (size > sizeof(Broadcast_data))
+    {
+        ESP_LOGE(TAG, "Broadcast data of %zu bytes, at most %zu fit", size, sizeof(Broadcast_data));
+        return false;
+    }
+
+    xSemaphoreTake(Broadcast_lock, portMAX_DELAY);
+    memcpy(Broadcast_data, data, size);
+    Broadcast_data_size = size;
+    xSemaphoreGive(Broadcast_lock);
+
+    // The advertising set belongs to the host task; puts while the event is
+    // pending collapse into one update with the latest data
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &Broadcast_event);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ble_func_set_broadcast_data_ctx(const uint8_t* data, size_t size, void* context)
+{
+    ble_func_set_broadcast_data(data, size);
+}
+
+size_t ble_func_get_broadcast_size_max(void)
+{
+#if CONFIG_GBLE_BROADCAST
+    return CONFIG_BT_NIMBLE_EXT_ADV_MAX_SIZE;
+#else
+    return 0;
+#endif
 }
 
 // default password for bonding
@@ -201,6 +778,8 @@ static int bleprph_gap_event(struct ble_gap_event *event, void *arg)
     struct ble_gap_conn_desc desc;
     int rc;
 
+    ble_conn_profile_handle_gap_event(event);
+
     switch (event->type)
     {
         case BLE_GAP_EVENT_CONNECT:
@@ -218,12 +797,21 @@ static int bleprph_gap_event(struct ble_gap_event *event, void *arg)
                     return 0;
                 }
                 bleprph_print_conn_desc(&desc);
+                ble_func_conn_add(&desc);
+
+                ++Adv_stats.connects[Adv_phase];
+                Adv_phase = BLE_FUNC_ADV_IDLE;
+
+                if (desc.sec_state.bonded)
+                {
+                    ble_func_save_last_peer(&desc.peer_id_addr);
+                }
             }
-            else
-            {
-                /* Connection failed; resume advertising. */
-                bleprph_advertise();
-            }
+
+            /* Keep advertising for the next central, or again after a
+             * failed attempt.
+             */
+            bleprph_advertise();
             return 0;
 
         case BLE_GAP_EVENT_DISCONNECT:
@@ -234,6 +822,8 @@ static int bleprph_gap_event(struct ble_gap_event *event, void *arg)
                 disconnect_cb(event->disconnect.conn.conn_handle, disconnect_cb_context);
             }
 
+            ble_func_conn_remove(event->disconnect.conn.conn_handle);
+
             /* Connection terminated; resume advertising. */
             bleprph_advertise();
             return 0;
@@ -249,16 +839,69 @@ static int bleprph_gap_event(struct ble_gap_event *event, void *arg)
                      event->conn_update.status);
             return 0;
 
+        case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+            ESP_LOGI(TAG, "phy update; status=%d conn_handle=%d tx_phy=%d rx_phy=%d",
+                     event->phy_updated.status,
+                     event->phy_updated.conn_handle,
+                     event->phy_updated.tx_phy,
+                     event->phy_updated.rx_phy);
+
+            if (event->phy_updated.status == 0)
+            {
+                struct ble_func_conn* conn = ble_func_conn_find(event->phy_updated.conn_handle);
+                if (conn)
+                {
+                    conn->info.tx_phy = event->phy_updated.tx_phy;
+                    conn->info.rx_phy = event->phy_updated.rx_phy;
+                }
+            }
+            return 0;
+
+#ifdef BLE_GAP_EVENT_DATA_LEN_CHG
+        case BLE_GAP_EVENT_DATA_LEN_CHG:
+            ESP_LOGI(TAG, "data length change; conn_handle=%d max_tx_octets=%d",
+                     event->data_len_chg.conn_handle,
+                     event->data_len_chg.max_tx_octets);
+            return 0;
+#endif
+
         case BLE_GAP_EVENT_ADV_COMPLETE:
             ESP_LOGI(TAG, "advertise complete; reason=%d",
                      event->adv_complete.reason);
-            bleprph_advertise();
+
+#if CONFIG_BT_NIMBLE_EXT_ADV
+            /* The set ended with a connection, handled above. */
+            if (event->adv_complete.reason == 0)
+            {
+                bleprph_advertise();
+                return 0;
+            }
+#endif
+
+            /* A phase that ran its course hands over to the next one. */
+            {
+                ble_func_adv_phase phase = Adv_phase == BLE_FUNC_ADV_IDLE ? BLE_FUNC_ADV_FAST : Adv_phase;
+                if (event->adv_complete.reason == BLE_HS_ETIMEOUT && phase < BLE_FUNC_ADV_SLOW)
+                {
+                    ++phase;
+                }
+
+                Adv_phase = BLE_FUNC_ADV_IDLE;
+                bleprph_advertise_phase(phase);
+            }
             return 0;
 
         case BLE_GAP_EVENT_ENC_CHANGE:
             /* Encryption has been enabled or disabled for this connection. */
             ESP_LOGI(TAG, "encryption change event; status=%d",
                      event->enc_change.status);
+
+            if (event->enc_change.status == 0 &&
+                ble_gap_conn_find(event->enc_change.conn_handle, &desc) == 0 &&
+                desc.sec_state.bonded)
+            {
+                ble_func_save_last_peer(&desc.peer_id_addr);
+            }
             return 0;
 
         case BLE_GAP_EVENT_SUBSCRIBE:
@@ -272,6 +915,17 @@ static int bleprph_gap_event(struct ble_gap_event *event, void *arg)
                      event->subscribe.prev_indicate,
                      event->subscribe.cur_indicate);
 
+            {
+                struct ble_func_conn* conn = ble_func_conn_find(event->subscribe.conn_handle);
+                const bool was = event->subscribe.prev_notify || event->subscribe.prev_indicate;
+                const bool is = event->subscribe.cur_notify || event->subscribe.cur_indicate;
+
+                if (conn && was != is)
+                {
+                    conn->info.subscriptions += is ? 1 : -1;
+                }
+            }
+
             if (subscribe_cb)
             {
                 subscribe_cb(event->subscribe.conn_handle,
@@ -283,11 +937,19 @@ static int bleprph_gap_event(struct ble_gap_event *event, void *arg)
             return 0;
 
         case BLE_GAP_EVENT_NOTIFY_TX:
-            ESP_LOGI(TAG, "notify event; status=%d conn_handle=%d attr_handle=%04X type=%s",
+            ESP_LOGD(TAG, "notify event; status=%d conn_handle=%d attr_handle=%04X type=%s",
                      event->notify_tx.status,
                      event->notify_tx.conn_handle,
                      event->notify_tx.attr_handle,
                      event->notify_tx.indication ? "indicate" : "notify");
+
+            if (notify_tx_cb)
+            {
+                notify_tx_cb(event->notify_tx.conn_handle,
+                             event->notify_tx.attr_handle,
+                             event->notify_tx.status,
+                             notify_tx_cb_context);
+            }
             return 0;
 
         case BLE_GAP_EVENT_MTU:
@@ -295,6 +957,14 @@ static int bleprph_gap_event(struct ble_gap_event *event, void *arg)
                      event->mtu.conn_handle,
                      event->mtu.channel_id,
                      event->mtu.value);
+
+            {
+                struct ble_func_conn* conn = ble_func_conn_find(event->mtu.conn_handle);
+                if (conn)
+                {
+                    conn->info.mtu = event->mtu.value;
+                }
+            }
             return 0;
 
         case BLE_GAP_EVENT_REPEAT_PAIRING:
@@ -325,7 +995,7 @@ static int bleprph_gap_event(struct ble_gap_event *event, void *arg)
                 /* This is the passkey to be entered on peer */
                 pkey.passkey = Disp_password;
 
-                ESP_LOGI(TAG, "Enter passkey %lu on the peer side", pkey.passkey);
+                ESP_LOGI(TAG, "Enter passkey %" PRIu32 " on the peer side", pkey.passkey);
 
                 rc = ble_sm_inject_io(event->passkey.conn_handle, &pkey);
 
@@ -351,6 +1021,15 @@ static void
 bleprph_on_reset(int reason)
 {
     ESP_LOGE(TAG, "Resetting state; reason=%d", reason);
+
+    // The reset wiped the advertising data in the controller, so the next
+    // start after sync has to send it again
+    Adv_data_len = 0;
+
+#if CONFIG_GBLE_BROADCAST
+    // The broadcast set went with it; sync starts it over with the data kept
+    Broadcast_started = false;
+#endif
 }
 
 static void
@@ -375,6 +1054,10 @@ bleprph_on_sync(void)
 
     /* Begin advertising. */
     bleprph_advertise();
+
+#if CONFIG_GBLE_BROADCAST
+    ble_func_broadcast_start();
+#endif
 }
 
 void
@@ -424,6 +1107,39 @@ bool ble_init(gatt_init_callback_fn* gatt_init_fn)
 {
     nimble_port_init();
 
+    memset(Conns, 0, sizeof(Conns));
+    Conn_count = 0;
+
+    Adv_config = (ble_func_adv_config) {
+        .directed_ms = CONFIG_GBLE_ADV_DIRECTED_MS,
+        .fast_ms = CONFIG_GBLE_ADV_FAST_MS,
+        .fast_itvl_ms = CONFIG_GBLE_ADV_FAST_ITVL_MS,
+        .slow_itvl_ms = CONFIG_GBLE_ADV_SLOW_ITVL_MS,
+    };
+    Adv_data_len = 0;
+    Adv_phase = BLE_FUNC_ADV_IDLE;
+    memset(&Adv_stats, 0, sizeof(Adv_stats));
+    ble_func_load_last_peer();
+
+#if CONFIG_GBLE_BROADCAST
+    if (!Broadcast_lock)
+    {
+        Broadcast_lock = xSemaphoreCreateMutex();
+        if (!Broadcast_lock)
+        {
+            ESP_LOGE(TAG, "Failed to create broadcast lock");
+            return false;
+        }
+    }
+
+    ble_npl_event_init(&Broadcast_event, ble_func_broadcast_event_cb, NULL);
+    Broadcast_data_size = 0;
+    Broadcast_started = false;
+#endif
+
+    ble_conn_profile_init(CONFIG_GBLE_CONN_PROFILE);
+    ble_conn_profile_set_adaptive(CONFIG_GBLE_CONN_PROFILE, BLE_CONN_PROFILE_LOW_POWER, CONFIG_GBLE_CONN_IDLE_MS);
+
     /* Initialize the NimBLE host configuration. */
     ble_hs_cfg.reset_cb = bleprph_on_reset;
     ble_hs_cfg.sync_cb = bleprph_on_sync;
@@ -433,12 +1149,13 @@ bool ble_init(gatt_init_callback_fn* gatt_init_fn)
     // set to BLE_SM_IO_CAP_NO_IO to bond with no prompt
     ble_hs_cfg.sm_io_cap = BLE_SM_IO_CAP_NO_IO;
 
-    // TODO: Do these work?
-    // ble_hs_cfg.sm_bonding = 1;
-    // ble_hs_cfg.sm_mitm = 1;
-    // ble_hs_cfg.sm_sc = 1;
-    // ble_hs_cfg.sm_our_key_dist = 1;
-    // ble_hs_cfg.sm_their_key_dist = 1;
+    // Bond, so a central that reconnects is found in the store for the
+    // directed advertising phase. Both sides hand out their LTK and their
+    // identity, so a central using a resolvable private address still
+    // matches its bond.
+    ble_hs_cfg.sm_bonding = 1;
+    ble_hs_cfg.sm_our_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+    ble_hs_cfg.sm_their_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
 
     ble_hs_cfg.sm_sc = 0;
 
@@ -20,6 +20,8 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 typedef int gatt_init_callback_fn(void);
 
@@ -38,3 +40,82 @@ typedef void ble_func_subscribe_callback_fn(uint16_t conn_handle,
 
 void ble_func_register_subscribe_cb(ble_func_subscribe_callback_fn* fn,
                                     void* context);
+
+// status is 0 when the notification was handed to the controller
+typedef void ble_func_notify_tx_callback_fn(uint16_t conn_handle,
+                                            uint16_t attr_handle,
+                                            int status,
+                                            void* context);
+
+void ble_func_register_notify_tx_cb(ble_func_notify_tx_callback_fn* fn,
+                                    void* context);
+
+// The device keeps advertising while it has fewer than
+// CONFIG_BT_NIMBLE_MAX_CONNECTIONS centrals, so a control app and a
+// monitoring app can be connected at the same time. What is known about
+// each of them:
+typedef struct {
+    uint16_t conn_handle;
+    uint8_t peer_addr[6];
+    uint16_t mtu;
+    uint8_t tx_phy;
+    uint8_t rx_phy;
+
+    // Characteristics with notifications or indications enabled
+    uint8_t subscriptions;
+} ble_func_conn_info;
+
+// Fills info for a connected central; returns false for an unknown handle.
+bool ble_func_get_conn(uint16_t conn_handle, ble_func_conn_info* info);
+
+// Copies up to max connections into infos and returns how many are up.
+size_t ble_func_get_conns(ble_func_conn_info* infos, size_t max);
+
+// Advertising runs in phases so a central that dropped out reconnects
+// quickly: high duty cycle directed advertising to the last bonded peer,
+// kept in NVS, while it is away; then undirected at the fast interval; then
+// at the slow one until a central connects. Other restarts begin at fast.
+typedef enum {
+    BLE_FUNC_ADV_IDLE,
+    BLE_FUNC_ADV_DIRECTED,
+    BLE_FUNC_ADV_FAST,
+    BLE_FUNC_ADV_SLOW,
+    BLE_FUNC_ADV_PHASE_COUNT,
+} ble_func_adv_phase;
+
+typedef struct {
+    // Directed phase, at most 1280; 0 skips it
+    uint32_t directed_ms;
+    // Fast phase; 0 stays fast
+    uint32_t fast_ms;
+    uint32_t fast_itvl_ms;
+    uint32_t slow_itvl_ms;
+} ble_func_adv_config;
+
+typedef struct {
+    uint32_t starts[BLE_FUNC_ADV_PHASE_COUNT];
+    // Connections made in each phase
+    uint32_t connects[BLE_FUNC_ADV_PHASE_COUNT];
+    // Times the advertisement data was encoded
+    uint32_t data_encodes;
+} ble_func_adv_stats;
+
+// Replaces the CONFIG_GBLE_ADV_* configuration set by ble_init.
+void ble_func_set_adv_config(const ble_func_adv_config* config);
+
+ble_func_adv_phase ble_func_get_adv_phase(void);
+
+void ble_func_get_adv_stats(ble_func_adv_stats* stats);
+
+// Sensor broadcast, see gble_broadcast.h. With CONFIG_GBLE_BROADCAST on,
+// data goes into a non-connectable advertising set next to the connectable
+// one, in its periodic advertising with CONFIG_GBLE_BROADCAST_PERIODIC.
+// Safe from any task: the data is copied and handed to the set on the
+// NimBLE host task. Data set before the host syncs goes out once the set
+// starts. Returns false with broadcasting off or data too large.
+bool ble_func_set_broadcast_data(const uint8_t* data, size_t size);
+
+void ble_func_set_broadcast_data_ctx(const uint8_t* data, size_t size, void* context);
+
+// Largest broadcast data, 0 with broadcasting off
+size_t ble_func_get_broadcast_size_max(void);
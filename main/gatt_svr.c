@@ -22,6 +22,9 @@
 #include <string.h>
 
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 #include "gatt_svr.h"
 #include "gatt_svr_priv.h"
@@ -30,15 +33,59 @@
 
 static const char *TAG = "GattSvr";
 
+// Wait before sending again after running out of mbufs
+#define GATT_SVR_NOTIFY_RETRY_US 5000
+
+// Recursive: NOTIFY_TX comes back on the sending task, inside the send
+static SemaphoreHandle_t Notify_lock;
+static esp_timer_handle_t Notify_retry_timer;
+
+static void gatt_svr_notify_retry_cb(void* arg);
+static void gatt_svr_notify_event_cb(struct ble_npl_event* ev);
+
 int gatt_svr_init(void)
 {
     memset(&gatt_server_instance, 0, sizeof(gatt_server_instance));
+    ble_npl_event_init(&gatt_server_instance.notify_event, gatt_svr_notify_event_cb, NULL);
 
     ble_svc_gap_init();
     ble_svc_gatt_init();
 
     memset(&Svc_char_handles, 0, sizeof(Svc_char_handles[0]) * HANDLE_HID_COUNT);
 
+    gatt_server_instance.notify_policies[GATT_SVR_NOTIFY_URGENT] = GATT_SVR_NOTIFY_DROP_OLDEST;
+    gatt_server_instance.notify_policies[GATT_SVR_NOTIFY_NORMAL] = GATT_SVR_NOTIFY_MERGE_LATEST;
+    gatt_server_instance.notify_policies[GATT_SVR_NOTIFY_BULK] = GATT_SVR_NOTIFY_DROP_OLDEST;
+
+    if (!Notify_lock)
+    {
+        Notify_lock = xSemaphoreCreateRecursiveMutex();
+        if (!Notify_lock)
+        {
+            ESP_LOGE(TAG, "error creating notify lock");
+            return BLE_HS_ENOMEM;
+        }
+    }
+
+    if (!Notify_retry_timer)
+    {
+        const esp_timer_create_args_t timer_args = {
+            .callback = gatt_svr_notify_retry_cb,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "gatt_notify",
+        };
+
+        if (esp_timer_create(&timer_args, &Notify_retry_timer) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "error creating notify retry timer");
+            return BLE_HS_ENOMEM;
+        }
+    }
+    else
+    {
+        esp_timer_stop(Notify_retry_timer);
+    }
+
     int rc = ble_gatts_count_cfg(Gatt_svr_included_services);
     if (rc != 0)
     {
@@ -89,49 +136,511 @@ void gatt_svr_register_write_cb(gatt_svr_write_callback_fn* fn,
     gatt_server_instance.write_cb_context = context;
 }
 
+void gatt_svr_register_write_reader_cb(gatt_svr_write_reader_callback_fn* fn,
+                                       void* context)
+{
+    gatt_server_instance.write_reader_cb = fn;
+    gatt_server_instance.write_reader_cb_context = context;
+}
+
+void gatt_svr_register_write_activity_cb(gatt_svr_write_activity_callback_fn* fn,
+                                         void* context)
+{
+    gatt_server_instance.write_activity_cb = fn;
+    gatt_server_instance.write_activity_cb_context = context;
+}
+
+void gatt_svr_register_notify_key_cb(gatt_svr_notify_key_callback_fn* fn,
+                                     void* context)
+{
+    gatt_server_instance.notify_key_cb = fn;
+    gatt_server_instance.notify_key_cb_context = context;
+}
+
+void gatt_svr_register_time_sync_cb(gatt_svr_time_sync_callback_fn* sync_fn,
+                                    gatt_svr_time_status_callback_fn* status_fn,
+                                    void* context)
+{
+    gatt_server_instance.time_sync_cb = sync_fn;
+    gatt_server_instance.time_status_cb = status_fn;
+    gatt_server_instance.time_cb_context = context;
+}
+
+static void gatt_svr_notify_lock(void)
+{
+    xSemaphoreTakeRecursive(Notify_lock, portMAX_DELAY);
+}
+
+static void gatt_svr_notify_unlock(void)
+{
+    xSemaphoreGiveRecursive(Notify_lock);
+}
+
+// Takes the lowest slot out of mask
+static inline int gatt_svr_slot_pop(gatt_svr_slot_mask* mask)
+{
+    const int slot = __builtin_ctz(*mask);
+    *mask &= *mask - 1;
+    return slot;
+}
+
+// Returns the slot of a connection, or -1. Called with the notify lock held.
+static int gatt_svr_slot_find(uint16_t conn_handle)
+{
+    for (gatt_svr_slot_mask used = gatt_server_instance.slots_used; used;)
+    {
+        const int slot = gatt_svr_slot_pop(&used);
+        if (gatt_server_instance.slot_conn_handles[slot] == conn_handle)
+        {
+            return slot;
+        }
+    }
+
+    return -1;
+}
+
+// Finds or takes the slot of a connection; -1 if all are taken. Called with
+// the notify lock held.
+static int gatt_svr_slot_take(uint16_t conn_handle)
+{
+    int slot = gatt_svr_slot_find(conn_handle);
+    if (slot >= 0)
+    {
+        return slot;
+    }
+
+    gatt_svr_slot_mask free_slots = ~gatt_server_instance.slots_used & GATT_SVR_SLOT_ALL;
+    if (!free_slots)
+    {
+        return -1;
+    }
+
+    slot = gatt_svr_slot_pop(&free_slots);
+    gatt_server_instance.slots_used |= (gatt_svr_slot_mask)1 << slot;
+    gatt_server_instance.slot_conn_handles[slot] = conn_handle;
+
+    return slot;
+}
+
+// Copies a notification value into an mbuf of its own for NimBLE to consume
+static struct os_mbuf* gatt_svr_notify_mbuf(const uint8_t* buf, size_t buf_size)
+{
+    struct os_mbuf* om = ble_hs_mbuf_from_flat(buf, buf_size);
+    if (om)
+    {
+        gatt_server_instance.copy_stats.notify_bytes += buf_size;
+    }
+
+    return om;
+}
+
+// Called with the notify lock held
+static void gatt_svr_read_value_publish(gatt_svr_notify_class cls, const uint8_t* buf, size_t buf_size)
+{
+    struct gatt_svr_read_value* value = &gatt_server_instance.read_values[cls];
+    const unsigned next = atomic_load_explicit(&value->published, memory_order_relaxed) + 1;
+
+    // Readers of the buffer about to be reused see this before its bytes
+    atomic_store_explicit(&value->writing, next, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    memcpy(value->bufs[next & 1], buf, buf_size);
+    value->sizes[next & 1] = buf_size;
+
+    atomic_store_explicit(&value->published, next, memory_order_release);
+    atomic_store_explicit(&gatt_server_instance.read_cls, cls, memory_order_release);
+}
+
+// Appends the latest read value to om without taking the notify lock.
+// Returns the length appended, or -1 when om ran out of room.
+static int gatt_svr_read_value_append(struct os_mbuf* om)
+{
+    for (;;)
+    {
+        const unsigned cls = atomic_load_explicit(&gatt_server_instance.read_cls, memory_order_acquire);
+        const struct gatt_svr_read_value* value = &gatt_server_instance.read_values[cls];
+        const unsigned published = atomic_load_explicit(&value->published, memory_order_acquire);
+        const size_t len = value->sizes[published & 1];
+
+        if (len > 0 && os_mbuf_append(om, value->bufs[published & 1], len) != 0)
+        {
+            return -1;
+        }
+
+        // Only a write two ahead reuses the buffer just copied
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&value->writing, memory_order_relaxed) - published < 2)
+        {
+            return len;
+        }
+
+        os_mbuf_adj(om, -(int)len);
+    }
+}
+
+static void gatt_svr_notify_remove(struct gatt_svr_notify_queue* queue, size_t idx)
+{
+    --queue->count;
+    if (idx != queue->count)
+    {
+        queue->entries[idx] = queue->entries[queue->count];
+    }
+    queue->stats.depth = queue->count;
+}
+
+static void gatt_svr_notify_set_value(struct gatt_svr_notify_entry* entry, const uint8_t* buf, size_t buf_size)
+{
+    memcpy(entry->value, buf, buf_size);
+    entry->size = (uint16_t)buf_size;
+    gatt_server_instance.copy_stats.queue_bytes += buf_size;
+}
+
+// Oldest entry of the least urgent class, no more urgent than cls; count if
+// there is none
+static size_t gatt_svr_notify_victim(const struct gatt_svr_notify_queue* queue, gatt_svr_notify_class cls)
+{
+    size_t victim = queue->count;
+    for (size_t idx = 0; idx < queue->count; ++idx)
+    {
+        const struct gatt_svr_notify_entry* entry = &queue->entries[idx];
+        if (entry->cls < cls)
+        {
+            continue;
+        }
+
+        if (victim == queue->count || entry->cls > queue->entries[victim].cls ||
+            (entry->cls == queue->entries[victim].cls && entry->seq < queue->entries[victim].seq))
+        {
+            victim = idx;
+        }
+    }
+
+    return victim;
+}
+
+// Called with the notify lock held
+static void gatt_svr_notify_enqueue(int slot, uint16_t attr_handle, gatt_svr_notify_class cls,
+                                    uint64_t key, const uint8_t* buf, size_t buf_size)
+{
+    struct gatt_svr_notify_queue* queue = &gatt_server_instance.notify_queues[slot];
+
+    const bool battery = attr_handle == Svc_char_handles[HANDLE_BATTERY_LEVEL];
+
+    ++queue->stats.queued;
+
+    // Only the latest matters: a queued value of the same sensors takes this
+    // one in its place in the queue, however deep it is, so the pump never
+    // sends a stale value ahead of it. Likewise for the battery level.
+    if (key && (battery || gatt_server_instance.notify_policies[cls] == GATT_SVR_NOTIFY_MERGE_LATEST))
+    {
+        for (size_t idx = 0; idx < queue->count; ++idx)
+        {
+            struct gatt_svr_notify_entry* entry = &queue->entries[idx];
+            if (entry->key == key && entry->attr_handle == attr_handle && entry->cls == cls)
+            {
+                gatt_svr_notify_set_value(entry, buf, buf_size);
+                ++queue->stats.merged;
+                return;
+            }
+        }
+    }
+
+    if (queue->count == COUNT_OF(queue->entries))
+    {
+        const size_t victim = gatt_svr_notify_victim(queue, cls);
+
+        ++queue->stats.dropped;
+
+        if (victim == queue->count)
+        {
+            return;
+        }
+
+        gatt_svr_notify_remove(queue, victim);
+    }
+
+    struct gatt_svr_notify_entry* entry = &queue->entries[queue->count++];
+    entry->seq = ++gatt_server_instance.notify_seq;
+    entry->attr_handle = attr_handle;
+    entry->cls = cls;
+    entry->key = key;
+    gatt_svr_notify_set_value(entry, buf, buf_size);
+
+    queue->stats.depth = queue->count;
+    if (queue->count > queue->stats.depth_max)
+    {
+        queue->stats.depth_max = queue->count;
+    }
+}
+
+// Called with the notify lock held
+static void gatt_svr_notify_arm_retry(void)
+{
+    if (!gatt_server_instance.notify_retry_armed)
+    {
+        gatt_server_instance.notify_retry_armed = true;
+        esp_timer_start_once(Notify_retry_timer, GATT_SVR_NOTIFY_RETRY_US);
+    }
+}
+
+// Sends from every connection's queue, copying each value into an mbuf of
+// its own, until the stack holds CONFIG_GBLE_NOTIFY_STACK_BLOCKS msys
+// blocks.
+// Called with the notify lock held.
+static void gatt_svr_notify_pump(void)
+{
+    // A NOTIFY_TX from inside a send lands here; the outer pass picks it up
+    if (gatt_server_instance.notify_pumping)
+    {
+        gatt_server_instance.notify_pump_again = true;
+        return;
+    }
+
+    gatt_server_instance.notify_pumping = true;
+
+    do
+    {
+        gatt_server_instance.notify_pump_again = false;
+
+        for (gatt_svr_slot_mask used = gatt_server_instance.slots_used; used;)
+        {
+            const int slot = gatt_svr_slot_pop(&used);
+            const uint16_t conn_handle = gatt_server_instance.slot_conn_handles[slot];
+            struct gatt_svr_notify_queue* queue = &gatt_server_instance.notify_queues[slot];
+
+            while (queue->count > 0)
+            {
+                // NOTIFY_TX comes back before the packet leaves, so what the
+                // stack holds of the pool is what tracks the link; queued
+                // entries hold none of it. While it is behind, entries wait
+                // here in class order rather than in its FIFO, where nothing
+                // can overtake them, and the rest of the pool stays free for
+                // ATT responses and other connections.
+                if (os_msys_count() - os_msys_num_free() >= CONFIG_GBLE_NOTIFY_STACK_BLOCKS)
+                {
+                    ++queue->stats.retries;
+                    gatt_svr_notify_arm_retry();
+                    goto done;
+                }
+
+                size_t next = 0;
+                for (size_t idx = 1; idx < queue->count; ++idx)
+                {
+                    const struct gatt_svr_notify_entry* entry = &queue->entries[idx];
+                    if (entry->cls < queue->entries[next].cls ||
+                        (entry->cls == queue->entries[next].cls && entry->seq < queue->entries[next].seq))
+                    {
+                        next = idx;
+                    }
+                }
+
+                struct gatt_svr_notify_entry* entry = &queue->entries[next];
+
+                // mbufs are shared by all connections, so none of them can
+                // send until some come back. NimBLE frees the mbuf even when
+                // it fails, but the entry keeps the value for the retry.
+                struct os_mbuf* om = gatt_svr_notify_mbuf(entry->value, entry->size);
+                int rc = om ? ble_gatts_notify_custom(conn_handle, entry->attr_handle, om) : BLE_HS_ENOMEM;
+
+                if (rc == BLE_HS_ENOMEM)
+                {
+                    ++queue->stats.retries;
+                    gatt_svr_notify_arm_retry();
+                    goto done;
+                }
+
+                if (rc == 0)
+                {
+                    ++queue->stats.sent;
+                }
+                else
+                {
+                    ESP_LOGW(TAG, "Error notifying client %hu, rc = %d", conn_handle, rc);
+                    ++queue->stats.failed;
+                }
+
+                gatt_svr_notify_remove(queue, next);
+            }
+        }
+    } while (gatt_server_instance.notify_pump_again);
+
+done:
+    gatt_server_instance.notify_pumping = false;
+}
+
+// Runs the pump on the NimBLE host task. Safe from any task; puts while the
+// event is pending collapse into one pass.
+static void gatt_svr_notify_schedule(void)
+{
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &gatt_server_instance.notify_event);
+}
+
+static void gatt_svr_notify_event_cb(struct ble_npl_event* ev)
+{
+    gatt_svr_notify_lock();
+    gatt_svr_notify_pump();
+    gatt_svr_notify_unlock();
+}
+
+static void gatt_svr_notify_retry_cb(void* arg)
+{
+    gatt_svr_notify_lock();
+    gatt_server_instance.notify_retry_armed = false;
+    gatt_svr_notify_unlock();
+
+    gatt_svr_notify_schedule();
+}
+
+void gatt_svr_handle_notify_tx(uint16_t conn_handle, uint16_t attr_handle, int status)
+{
+    // Time sync responses bypass the queue
+    if (attr_handle == Svc_char_handles[HANDLE_MAIN_TIME])
+    {
+        return;
+    }
+
+    gatt_svr_notify_lock();
+
+    if (gatt_svr_slot_find(conn_handle) >= 0)
+    {
+        gatt_svr_notify_pump();
+    }
+
+    gatt_svr_notify_unlock();
+}
+
+void gatt_svr_set_notify_policy(gatt_svr_notify_class cls, gatt_svr_notify_policy policy)
+{
+    if (cls < GATT_SVR_NOTIFY_CLASS_COUNT)
+    {
+        gatt_server_instance.notify_policies[cls] = policy;
+    }
+}
+
+void gatt_svr_get_copy_stats(gatt_svr_copy_stats* stats)
+{
+    gatt_svr_notify_lock();
+    *stats = gatt_server_instance.copy_stats;
+    gatt_svr_notify_unlock();
+}
+
+bool gatt_svr_get_notify_stats(uint16_t conn_handle, gatt_svr_notify_stats* stats)
+{
+    gatt_svr_notify_lock();
+
+    const int slot = gatt_svr_slot_find(conn_handle);
+    if (slot >= 0)
+    {
+        *stats = gatt_server_instance.notify_queues[slot].stats;
+    }
+
+    gatt_svr_notify_unlock();
+
+    return slot >= 0;
+}
+
 bool gatt_svr_set_read_value(const uint8_t* buf, size_t buf_size)
 {
-    if (buf_size > sizeof(gatt_server_instance.read_buf))
+    return gatt_svr_notify_read_value(buf, buf_size, GATT_SVR_NOTIFY_NORMAL);
+}
+
+bool gatt_svr_notify_read_value(const uint8_t* buf, size_t buf_size, gatt_svr_notify_class cls)
+{
+    if (buf_size > GATT_SVR_NOTIFY_VALUE_MAX)
     {
-        ESP_LOGE(TAG, "read value too large for buffer: %zu > %zu",
-                 buf_size, sizeof(gatt_server_instance.read_buf));
+        ESP_LOGE(TAG, "read value too large for buffer: %zu > %d",
+                 buf_size, GATT_SVR_NOTIFY_VALUE_MAX);
         return false;
     }
 
-    memcpy(gatt_server_instance.read_buf, buf, buf_size);
-    gatt_server_instance.read_buf_size = buf_size;
+    if (cls >= GATT_SVR_NOTIFY_CLASS_COUNT)
+    {
+        ESP_LOGE(TAG, "Invalid notify class %hhu", cls);
+        return false;
+    }
+
+    const uint64_t key = gatt_server_instance.notify_key_cb ?
+                         gatt_server_instance.notify_key_cb(buf, buf_size, gatt_server_instance.notify_key_cb_context) :
+                         0;
+
+    gatt_svr_notify_lock();
+
+    gatt_svr_read_value_publish(cls, buf, buf_size);
+    gatt_server_instance.copy_stats.value_bytes += buf_size;
 
     ESP_LOGD(TAG, "Notifying read subscribers");
 
-    for (int conn_handle = 0; conn_handle < sizeof(gatt_server_instance.conn_handle_read_subs); ++conn_handle)
+    for (gatt_svr_slot_mask subs = gatt_server_instance.subs[GATT_SVR_SUB_RX]; subs;)
+    {
+        const int slot = gatt_svr_slot_pop(&subs);
+        ESP_LOGD(TAG, "Queueing client %hu for read change", gatt_server_instance.slot_conn_handles[slot]);
+        gatt_svr_notify_enqueue(slot, Svc_char_handles[HANDLE_MAIN_RX], cls, key, buf, buf_size);
+    }
+
+    const bool queued = gatt_server_instance.subs[GATT_SVR_SUB_RX] != 0;
+
+    gatt_svr_notify_unlock();
+
+    if (queued)
+    {
+        gatt_svr_notify_schedule();
+    }
+
+    return true;
+}
+
+size_t gatt_svr_get_notify_size_max(void)
+{
+    size_t size_max = GATT_SVR_NOTIFY_VALUE_MAX;
+
+    gatt_svr_notify_lock();
+
+    const gatt_svr_slot_mask read_subs = gatt_server_instance.subs[GATT_SVR_SUB_RX];
+    for (gatt_svr_slot_mask subs = read_subs; subs;)
     {
-        if (gatt_server_instance.conn_handle_read_subs[conn_handle])
+        const int slot = gatt_svr_slot_pop(&subs);
+
+        uint16_t mtu = ble_att_mtu(gatt_server_instance.slot_conn_handles[slot]);
+        if (mtu > 3 && mtu - 3 < size_max)
         {
-            ESP_LOGD(TAG, "Notifying client %hu for read change", conn_handle);
-            ble_gatts_notify(conn_handle, Svc_char_handles[HANDLE_MAIN_RX]);
+            size_max = mtu - 3;
         }
     }
 
-    return true;
+    gatt_svr_notify_unlock();
+
+    return read_subs ? size_max : BLE_ATT_MTU_DFLT - 3;
 }
 
 bool gatt_svr_set_battery_level(uint8_t value)
 {
-    if (gatt_server_instance.battery_level == value)
+    gatt_svr_notify_lock();
+
+    if (atomic_load_explicit(&gatt_server_instance.battery_level, memory_order_relaxed) == value)
     {
+        gatt_svr_notify_unlock();
         return false;
     }
 
     ESP_LOGI(TAG, "Updating battery level to %hhu", value);
-    gatt_server_instance.battery_level = value;
+    atomic_store_explicit(&gatt_server_instance.battery_level, value, memory_order_relaxed);
 
-    for (int conn_handle = 0; conn_handle < sizeof(gatt_server_instance.conn_handle_battery_subs); ++conn_handle)
+    for (gatt_svr_slot_mask subs = gatt_server_instance.subs[GATT_SVR_SUB_BATTERY]; subs;)
     {
-        if (gatt_server_instance.conn_handle_battery_subs[conn_handle])
-        {
-            ESP_LOGI(TAG, "Notifying client %hu for battery level change", conn_handle);
-            ble_gatts_notify(conn_handle, Svc_char_handles[HANDLE_BATTERY_LEVEL]);
-        }
+        const int slot = gatt_svr_slot_pop(&subs);
+        ESP_LOGI(TAG, "Queueing client %hu for battery level change", gatt_server_instance.slot_conn_handles[slot]);
+        // One value, so every frame has the same key
+        gatt_svr_notify_enqueue(slot, Svc_char_handles[HANDLE_BATTERY_LEVEL],
+                                GATT_SVR_NOTIFY_NORMAL, 1, &value, sizeof(value));
+    }
+
+    const bool queued = gatt_server_instance.subs[GATT_SVR_SUB_BATTERY] != 0;
+
+    gatt_svr_notify_unlock();
+
+    if (queued)
+    {
+        gatt_svr_notify_schedule();
     }
 
     return true;
@@ -145,39 +654,65 @@ void gatt_svr_handle_subscribe(uint16_t conn_handle,
     ESP_LOGI(TAG, "Connection %hu subscribing to attr %hu (notify: %s, indicate: %s)",
              conn_handle, attr_handle, BOOL_STR(can_notify), BOOL_STR(can_indicate));
 
-    if (conn_handle > COUNT_OF(gatt_server_instance.conn_handle_battery_subs))
-    {
-        ESP_LOGE(TAG, "Invalid connection handle: %hu", conn_handle);
-        return;
-    }
-
+    size_t sub;
     if (attr_handle == Svc_char_handles[HANDLE_BATTERY_LEVEL])
     {
-        gatt_server_instance.conn_handle_battery_subs[conn_handle] = can_notify;
+        sub = GATT_SVR_SUB_BATTERY;
     }
     else if (attr_handle == Svc_char_handles[HANDLE_MAIN_RX])
     {
-        gatt_server_instance.conn_handle_read_subs[conn_handle] = can_notify;
+        sub = GATT_SVR_SUB_RX;
+    }
+    else if (attr_handle == Svc_char_handles[HANDLE_MAIN_TIME])
+    {
+        sub = GATT_SVR_SUB_TIME;
     }
     else
     {
         ESP_LOGW(TAG, "Connection %hu unknown attr: %hu", conn_handle, attr_handle);
         return;
     }
+
+    gatt_svr_notify_lock();
+
+    const int slot = can_notify ? gatt_svr_slot_take(conn_handle) : gatt_svr_slot_find(conn_handle);
+    if (slot >= 0)
+    {
+        const gatt_svr_slot_mask bit = (gatt_svr_slot_mask)1 << slot;
+        gatt_server_instance.subs[sub] = can_notify ? gatt_server_instance.subs[sub] | bit :
+                                                      gatt_server_instance.subs[sub] & ~bit;
+    }
+    else if (can_notify)
+    {
+        ESP_LOGE(TAG, "No slot left for connection %hu", conn_handle);
+    }
+
+    gatt_svr_notify_unlock();
 }
 
 void gatt_svr_client_disconnected(uint16_t conn_handle)
 {
     ESP_LOGI(TAG, "Client %hu disconnected", conn_handle);
 
-    if (conn_handle > COUNT_OF(gatt_server_instance.conn_handle_battery_subs))
+    gatt_svr_notify_lock();
+
+    // Connections that never subscribed have no slot
+    const int slot = gatt_svr_slot_find(conn_handle);
+    if (slot >= 0)
     {
-        ESP_LOGE(TAG, "Invalid connection handle: %hu", conn_handle);
-        return;
+        const gatt_svr_slot_mask bit = (gatt_svr_slot_mask)1 << slot;
+        for (size_t sub = 0; sub < GATT_SVR_SUB_COUNT; ++sub)
+        {
+            gatt_server_instance.subs[sub] &= ~bit;
+        }
+        gatt_server_instance.slots_used &= ~bit;
+
+        struct gatt_svr_notify_queue* queue = &gatt_server_instance.notify_queues[slot];
+        queue->count = 0;
+        memset(&queue->stats, 0, sizeof(queue->stats));
     }
 
-    gatt_server_instance.conn_handle_battery_subs[conn_handle] = false;
-    gatt_server_instance.conn_handle_read_subs[conn_handle] = false;
+    gatt_svr_notify_unlock();
 }
 
 int gatt_svr_battery_access(uint16_t conn_handle, uint16_t attr_handle,
@@ -193,9 +728,9 @@ int gatt_svr_battery_access(uint16_t conn_handle, uint16_t attr_handle,
         case BLE_SVC_BAS_CHR_UUID16_BATTERY_LEVEL:
             if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR)
             {
-                int rc = os_mbuf_append(ctxt->om,
-                                        &gatt_server_instance.battery_level,
-                                        sizeof(gatt_server_instance.battery_level));
+                const uint8_t level = atomic_load_explicit(&gatt_server_instance.battery_level,
+                                                           memory_order_relaxed);
+                int rc = os_mbuf_append(ctxt->om, &level, sizeof(level));
                 if (rc)
                 {
                     ESP_LOGW(TAG, "Error reading battery level, rc = %d", rc);
@@ -315,6 +850,235 @@ int gatt_svr_dis_access(uint16_t conn_handle, uint16_t attr_handle,
         return BLE_ATT_ERR_INSUFFICIENT_RES;
     }
 
+    gatt_server_instance.copy_stats.read_bytes += info_len;
+
+    return 0;
+}
+
+static int gatt_svr_time_access(uint16_t conn_handle, struct ble_gatt_access_ctxt *ctxt)
+{
+    // Stamped before anything else so the round trip only counts the link
+    const int64_t rx_us = esp_timer_get_time();
+
+    uint8_t buf[32];
+    size_t buf_size = sizeof(buf);
+    void* ctx = gatt_server_instance.time_cb_context;
+
+    if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR)
+    {
+        if (!gatt_server_instance.time_status_cb)
+        {
+            return 0;
+        }
+
+        buf_size = gatt_server_instance.time_status_cb(buf, sizeof(buf), ctx);
+        int rc = os_mbuf_append(ctxt->om, buf, buf_size);
+        if (rc)
+        {
+            ESP_LOGW(TAG, "Error filling buffer, rc = %d", rc);
+            return BLE_ATT_ERR_INSUFFICIENT_RES;
+        }
+
+        return 0;
+    }
+
+    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR)
+    {
+        ESP_LOGW(TAG, "Invalid op %d for time chr", ctxt->op);
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    if (!gatt_server_instance.time_sync_cb)
+    {
+        return 0;
+    }
+
+    uint16_t om_len = OS_MBUF_PKTLEN(ctxt->om);
+    if (om_len > sizeof(buf))
+    {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+
+    uint16_t flat_len;
+    int rc = ble_hs_mbuf_to_flat(ctxt->om, buf, sizeof(buf), &flat_len);
+    if (rc != 0)
+    {
+        ESP_LOGE(TAG, "Error copying time request, rc= %d", rc);
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    uint8_t resp[32];
+    size_t resp_size = sizeof(resp);
+    if (!gatt_server_instance.time_sync_cb(conn_handle, buf, flat_len, rx_us, resp, &resp_size, ctx))
+    {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+
+    gatt_svr_notify_lock();
+    const int slot = gatt_svr_slot_find(conn_handle);
+    const bool subscribed = slot >= 0 && (gatt_server_instance.subs[GATT_SVR_SUB_TIME] & ((gatt_svr_slot_mask)1 << slot));
+    gatt_svr_notify_unlock();
+
+    if (subscribed)
+    {
+        struct os_mbuf* om = ble_hs_mbuf_from_flat(resp, resp_size);
+        if (!om)
+        {
+            ESP_LOGW(TAG, "No mbuf for time response");
+            return 0;
+        }
+
+        rc = ble_gatts_notify_custom(conn_handle, Svc_char_handles[HANDLE_MAIN_TIME], om);
+        if (rc != 0)
+        {
+            ESP_LOGW(TAG, "Error notifying time response, rc = %d", rc);
+        }
+    }
+
+    return 0;
+}
+
+// tinycbor reader over a write's mbuf chain, from the piece holding the read
+// position onwards
+struct gatt_svr_mbuf_reader
+{
+    const struct os_mbuf* om;
+    uint16_t off;
+    size_t remaining;
+};
+
+// Strings split across two pieces are put back together here. Access
+// callbacks only run on the host task, one at a time.
+static uint8_t Write_string_buf[CONFIG_GBLE_MAX_WRITE_SIZE];
+
+static void gatt_svr_mbuf_seek(const struct os_mbuf** om, uint16_t* off, size_t len)
+{
+    while (*om && len >= (size_t)((*om)->om_len - *off))
+    {
+        len -= (*om)->om_len - *off;
+        *om = SLIST_NEXT(*om, om_next);
+        *off = 0;
+    }
+
+    *off += len;
+}
+
+static bool gatt_svr_mbuf_can_read_bytes(void* token, size_t len)
+{
+    return len <= ((struct gatt_svr_mbuf_reader*)token)->remaining;
+}
+
+static void* gatt_svr_mbuf_read_bytes(void* token, void* dst, size_t offset, size_t len)
+{
+    const struct gatt_svr_mbuf_reader* reader = (const struct gatt_svr_mbuf_reader*)token;
+    const struct os_mbuf* om = reader->om;
+    uint16_t off = reader->off;
+    uint8_t* out = (uint8_t*)dst;
+
+    gatt_svr_mbuf_seek(&om, &off, offset);
+
+    while (om && len > 0)
+    {
+        size_t chunk = om->om_len - off;
+        chunk = chunk < len ? chunk : len;
+
+        memcpy(out, om->om_data + off, chunk);
+        out += chunk;
+        len -= chunk;
+
+        om = SLIST_NEXT(om, om_next);
+        off = 0;
+    }
+
+    return dst;
+}
+
+static void gatt_svr_mbuf_advance_bytes(void* token, size_t len)
+{
+    struct gatt_svr_mbuf_reader* reader = (struct gatt_svr_mbuf_reader*)token;
+
+    gatt_svr_mbuf_seek(&reader->om, &reader->off, len);
+    reader->remaining -= len;
+}
+
+static CborError gatt_svr_mbuf_transfer_string(void* token, const void** userptr, size_t offset, size_t len)
+{
+    struct gatt_svr_mbuf_reader* reader = (struct gatt_svr_mbuf_reader*)token;
+
+    if (offset + len > reader->remaining)
+    {
+        return CborErrorUnexpectedEOF;
+    }
+
+    const struct os_mbuf* om = reader->om;
+    uint16_t off = reader->off;
+    gatt_svr_mbuf_seek(&om, &off, offset);
+
+    if (om && om->om_len - off >= len)
+    {
+        *userptr = om->om_data + off;
+    }
+    else if (len <= sizeof(Write_string_buf))
+    {
+        *userptr = gatt_svr_mbuf_read_bytes(reader, Write_string_buf, offset, len);
+    }
+    else
+    {
+        return CborErrorDataTooLarge;
+    }
+
+    gatt_svr_mbuf_advance_bytes(reader, offset + len);
+
+    return CborNoError;
+}
+
+static const struct CborParserOperations Gatt_svr_mbuf_reader_ops = {
+    .can_read_bytes = gatt_svr_mbuf_can_read_bytes,
+    .read_bytes = gatt_svr_mbuf_read_bytes,
+    .advance_bytes = gatt_svr_mbuf_advance_bytes,
+    .transfer_string = gatt_svr_mbuf_transfer_string,
+};
+
+static int gatt_svr_tx_access(uint16_t conn_handle, struct ble_gatt_access_ctxt *ctxt)
+{
+    const uint16_t om_len = OS_MBUF_PKTLEN(ctxt->om);
+    if (om_len > CONFIG_GBLE_MAX_WRITE_SIZE)
+    {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+
+    if (gatt_server_instance.write_activity_cb)
+    {
+        gatt_server_instance.write_activity_cb(conn_handle, gatt_server_instance.write_activity_cb_context);
+    }
+
+    // Most writes fit one mbuf and are decoded where they are
+    if (!SLIST_NEXT(ctxt->om, om_next))
+    {
+        if (gatt_server_instance.write_cb)
+        {
+            void* ctx = gatt_server_instance.write_cb_context;
+            gatt_server_instance.write_cb(conn_handle, ctxt->om->om_data, ctxt->om->om_len, ctx);
+        }
+
+        return 0;
+    }
+
+    if (!gatt_server_instance.write_reader_cb)
+    {
+        ESP_LOGW(TAG, "No reader for a %hu byte write in pieces", om_len);
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    struct gatt_svr_mbuf_reader reader = {
+        .om = ctxt->om,
+        .off = 0,
+        .remaining = om_len,
+    };
+
+    void* ctx = gatt_server_instance.write_reader_cb_context;
+    gatt_server_instance.write_reader_cb(conn_handle, &Gatt_svr_mbuf_reader_ops, &reader, ctx);
+
     return 0;
 }
 
@@ -336,7 +1100,7 @@ int gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
                 break;
             }
 
-            uint8_t* resp_buf = NULL;
+            const uint8_t* resp_buf = NULL;
             size_t resp_len = 0;
 
             if (uuid16 == GATT_UUID_GBLE_FIRMWARE_CHR && gatt_server_instance.descriptor_cb)
@@ -346,8 +1110,15 @@ int gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
             }
             else if (uuid16 == GATT_UUID_GBLE_RX_CHR)
             {
-                resp_buf = gatt_server_instance.read_buf;
-                resp_len = gatt_server_instance.read_buf_size;
+                const int len = gatt_svr_read_value_append(ctxt->om);
+                if (len < 0)
+                {
+                    ESP_LOGW(TAG, "Error filling buffer for read value");
+                    return BLE_ATT_ERR_INSUFFICIENT_RES;
+                }
+
+                gatt_server_instance.copy_stats.read_bytes += len;
+                return 0;
             }
 
             if (resp_len > 0)
@@ -358,6 +1129,8 @@ int gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
                     ESP_LOGW(TAG, "Error filling buffer, rc = %d", rc);
                     return BLE_ATT_ERR_INSUFFICIENT_RES;
                 }
+
+                gatt_server_instance.copy_stats.read_bytes += resp_len;
             }
 
             return 0;
@@ -369,28 +1142,10 @@ int gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
                 break;
             }
 
-            if (gatt_server_instance.write_cb)
-            {
-                uint8_t scratch[256];
+            return gatt_svr_tx_access(conn_handle, ctxt);
 
-                uint16_t om_len = OS_MBUF_PKTLEN(ctxt->om);
-                if (om_len > sizeof(scratch)) {
-                    return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
-                }
-
-                uint16_t flat_len;
-                int rc = ble_hs_mbuf_to_flat(ctxt->om, scratch, sizeof(scratch), &flat_len);
-                if (rc != 0)
-                {
-                    ESP_LOGE(TAG, "Error copying to scratch buffer, rc= %d", rc);
-                    return BLE_ATT_ERR_UNLIKELY;
-                }
-
-                void* ctx = gatt_server_instance.write_cb_context;
-                gatt_server_instance.write_cb(scratch, flat_len, ctx);
-            }
-
-            return 0;
+        case GATT_UUID_GBLE_TIME_CHR:
+            return gatt_svr_time_access(conn_handle, ctxt);
 
         default:
             ESP_LOGW(TAG, "Unknown attr UUID %02hx", uuid16);
@@ -401,9 +1156,19 @@ int gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
 }
 
 // Wrapper functions to work with other APIs
-void gatt_svr_set_read_value_ctx(uint8_t* buf, size_t buf_size, void* context)
+void gatt_svr_set_read_value_ctx(uint8_t* buf, size_t buf_size, uint8_t priority, void* context)
+{
+    gatt_svr_notify_read_value(buf, buf_size, priority);
+}
+
+void gatt_svr_handle_notify_tx_ctx(uint16_t conn_handle, uint16_t attr_handle, int status, void* context)
+{
+    gatt_svr_handle_notify_tx(conn_handle, attr_handle, status);
+}
+
+size_t gatt_svr_get_notify_size_max_ctx(void* context)
 {
-    gatt_svr_set_read_value(buf, buf_size);
+    return gatt_svr_get_notify_size_max();
 }
 
 void gatt_svr_handle_subscribe_ctx(uint16_t conn_handle,
@@ -33,8 +33,82 @@
 #include "nimble/nimble_port_freertos.h"
 #include "host/util/util.h"
 
-typedef uint8_t* gatt_svr_descriptor_callback_fn(size_t* buf_size, void* context);
-typedef void gatt_svr_write_callback_fn(uint8_t* buf, size_t buf_size, void* context);
+// Notification priority classes, most urgent first; the same order as
+// gble_sensor_priority
+#define GATT_SVR_NOTIFY_URGENT      0
+#define GATT_SVR_NOTIFY_NORMAL      1
+#define GATT_SVR_NOTIFY_BULK        2
+#define GATT_SVR_NOTIFY_CLASS_COUNT 3
+typedef uint8_t gatt_svr_notify_class;
+
+// How a connection queue takes another notification of a class. Under
+// DROP_OLDEST it is queued, and a full queue drops the oldest of the least
+// urgent queued. MERGE_LATEST, for values where only the latest matters,
+// first replaces a queued one of the same characteristic and class that
+// carries the same values, at whatever depth, so the latest goes out in its
+// place. The read characteristic carries many values, so merging it needs
+// the notify key callback; frames without a key are queued as under
+// DROP_OLDEST.
+#define GATT_SVR_NOTIFY_DROP_OLDEST  0
+#define GATT_SVR_NOTIFY_MERGE_LATEST 1
+typedef uint8_t gatt_svr_notify_policy;
+
+struct gatt_svr_notify_stats {
+    uint32_t queued;
+    // Handed to the stack
+    uint32_t sent;
+    // Pushed out of a full queue, or refused by one full of more urgent ones
+    uint32_t dropped;
+    // Replaced in the queue by a newer value
+    uint32_t merged;
+    // Sends put off for lack of mbufs
+    uint32_t retries;
+    // Sends the stack refused for good
+    uint32_t failed;
+    uint16_t depth;
+    uint16_t depth_max;
+};
+typedef struct gatt_svr_notify_stats gatt_svr_notify_stats;
+
+// Bytes the server copies. NimBLE wants every notification and read reply in
+// an mbuf of its own, so a value is copied once into the read value, and per
+// subscriber once into its queue and once into an mbuf when sent; reads
+// append straight from the source.
+struct gatt_svr_copy_stats {
+    // Into the read value
+    uint64_t value_bytes;
+    // Into notification queues
+    uint64_t queue_bytes;
+    // Into notification mbufs
+    uint64_t notify_bytes;
+    // Into read replies
+    uint64_t read_bytes;
+};
+typedef struct gatt_svr_copy_stats gatt_svr_copy_stats;
+
+typedef const uint8_t* gatt_svr_descriptor_callback_fn(size_t* buf_size, void* context);
+// TX writes, with the connection they came on
+typedef void gatt_svr_write_callback_fn(uint16_t conn_handle, uint8_t* buf, size_t buf_size, void* context);
+
+// Told of every TX write before it is handled, with the connection it came on
+typedef void gatt_svr_write_activity_callback_fn(uint16_t conn_handle, void* context);
+
+// For writes that arrive as an mbuf chain rather than one piece: a tinycbor
+// reader (cbor_parser_init_reader) over the chain, valid during the call
+struct CborParserOperations;
+typedef void gatt_svr_write_reader_callback_fn(uint16_t conn_handle, const struct CborParserOperations* ops, void* token,
+                                               void* context);
+
+// Which values a read notification carries, so a newer one only replaces a
+// queued frame of the same values; 0 for frames that are never replaced
+typedef uint64_t gatt_svr_notify_key_callback_fn(const uint8_t* buf, size_t buf_size, void* context);
+
+// Handles a time sync write stamped with rx_us on arrival; fills in resp
+// (resp_size in: capacity, out: length) to notify back
+typedef bool gatt_svr_time_sync_callback_fn(uint16_t conn_handle, const uint8_t* buf, size_t buf_size,
+                                            int64_t rx_us, uint8_t* resp, size_t* resp_size, void* context);
+// Fills in the time characteristic read value, returns its length
+typedef size_t gatt_svr_time_status_callback_fn(uint8_t* buf, size_t buf_size, void* context);
 
 int gatt_svr_init(void);
 
@@ -44,11 +118,41 @@ void gatt_svr_register_descriptor_cb(gatt_svr_descriptor_callback_fn* fn,
 void gatt_svr_register_write_cb(gatt_svr_write_callback_fn* fn,
                                 void* context);
 
+void gatt_svr_register_write_reader_cb(gatt_svr_write_reader_callback_fn* fn,
+                                       void* context);
+
+void gatt_svr_register_write_activity_cb(gatt_svr_write_activity_callback_fn* fn,
+                                         void* context);
+
+void gatt_svr_register_notify_key_cb(gatt_svr_notify_key_callback_fn* fn,
+                                     void* context);
+
+void gatt_svr_register_time_sync_cb(gatt_svr_time_sync_callback_fn* sync_fn,
+                                    gatt_svr_time_status_callback_fn* status_fn,
+                                    void* context);
+
 
 bool gatt_svr_set_battery_level(uint8_t value);
 
 bool gatt_svr_set_read_value(const uint8_t* buf, size_t buf_size);
 
+// Sets the read value and queues it to every subscriber in the given class.
+// Each connection sends from its queue, most urgent first, while the stack
+// holds fewer than CONFIG_GBLE_NOTIFY_STACK_BLOCKS msys blocks; otherwise
+// the send is retried shortly.
+bool gatt_svr_notify_read_value(const uint8_t* buf, size_t buf_size, gatt_svr_notify_class cls);
+
+void gatt_svr_set_notify_policy(gatt_svr_notify_class cls, gatt_svr_notify_policy policy);
+
+bool gatt_svr_get_notify_stats(uint16_t conn_handle, gatt_svr_notify_stats* stats);
+
+void gatt_svr_handle_notify_tx(uint16_t conn_handle, uint16_t attr_handle, int status);
+
+void gatt_svr_get_copy_stats(gatt_svr_copy_stats* stats);
+
+// Largest read value every subscriber gets whole in a notification
+size_t gatt_svr_get_notify_size_max(void);
+
 void gatt_svr_handle_subscribe(uint16_t conn_handle,
                                uint16_t attr_handle,
                                bool can_notify,
@@ -57,7 +161,11 @@ void gatt_svr_handle_subscribe(uint16_t conn_handle,
 void gatt_svr_client_disconnected(uint16_t conn_handle);
 
 // Wrapper functions to work with other APIs
-void gatt_svr_set_read_value_ctx(uint8_t* buf, size_t buf_size, void* context);
+void gatt_svr_set_read_value_ctx(uint8_t* buf, size_t buf_size, uint8_t priority, void* context);
+
+void gatt_svr_handle_notify_tx_ctx(uint16_t conn_handle, uint16_t attr_handle, int status, void* context);
+
+size_t gatt_svr_get_notify_size_max_ctx(void* context);
 
 void gatt_svr_handle_subscribe_ctx(uint16_t conn_handle,
                                    uint16_t attr_handle,
@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include <stdatomic.h>
 #include <stdbool.h>
 
 #include "nimble/ble.h"
@@ -38,6 +39,64 @@
 #define CONFIG_NIMBLE_MAX_CONNECTIONS 3
 #endif
 
+// Connections that subscribe get a slot, as handles are not dense; sets of
+// them are bit masks by slot
+#if CONFIG_NIMBLE_MAX_CONNECTIONS > 32
+#error "Connection slot masks hold 32 connections"
+#endif
+typedef uint32_t gatt_svr_slot_mask;
+#define GATT_SVR_SLOT_ALL ((gatt_svr_slot_mask)((1ULL << CONFIG_NIMBLE_MAX_CONNECTIONS) - 1))
+
+// Characteristics clients subscribe to
+#define GATT_SVR_SUB_BATTERY 0
+#define GATT_SVR_SUB_RX      1
+#define GATT_SVR_SUB_TIME    2
+#define GATT_SVR_SUB_COUNT   3
+
+// Largest notification, the size of the read value buffer
+#define GATT_SVR_NOTIFY_VALUE_MAX 256
+
+// The latest value of a class. Writers hold the notify lock and fill the
+// buffer that is not published; a read on the host task copies the
+// published one without locking and starts over only if a second write
+// began on that buffer meanwhile, so it never stalls a writer or returns
+// half a value.
+struct gatt_svr_read_value
+{
+    uint8_t bufs[2][GATT_SVR_NOTIFY_VALUE_MAX];
+    size_t sizes[2];
+
+    // bufs[published & 1] is current; writing runs ahead of it by one
+    // while a write is under way
+    atomic_uint published;
+    atomic_uint writing;
+};
+
+struct gatt_svr_notify_entry
+{
+    // Queue order within a class
+    uint32_t seq;
+    uint16_t attr_handle;
+    gatt_svr_notify_class cls;
+    // From the notify key callback; MERGE_LATEST only replaces an entry
+    // with the same key
+    uint64_t key;
+
+    // Copied into an mbuf only when sent, so queued values hold none of
+    // the msys pool NimBLE needs for everything else
+    uint16_t size;
+    uint8_t value[GATT_SVR_NOTIFY_VALUE_MAX];
+};
+
+// Unordered; the next to send is the lowest class, then the lowest seq
+struct gatt_svr_notify_queue
+{
+    struct gatt_svr_notify_entry entries[CONFIG_GBLE_NOTIFY_QUEUE_DEPTH];
+    size_t count;
+
+    gatt_svr_notify_stats stats;
+};
+
 struct gatt_server
 {
     // Called when a client reads the descriptor
@@ -47,15 +106,46 @@ struct gatt_server
     // Called when a client sends a write
     gatt_svr_write_callback_fn* write_cb;
     void* write_cb_context;
-
-    // Cached read values
-    uint8_t read_buf[256];
-    size_t read_buf_size;
-
-    uint8_t battery_level;
-
-    bool conn_handle_battery_subs[CONFIG_NIMBLE_MAX_CONNECTIONS];
-    bool conn_handle_read_subs[CONFIG_NIMBLE_MAX_CONNECTIONS];
+    gatt_svr_write_reader_callback_fn* write_reader_cb;
+    void* write_reader_cb_context;
+    gatt_svr_write_activity_callback_fn* write_activity_cb;
+    void* write_activity_cb_context;
+
+    // Tells which values a read notification carries
+    gatt_svr_notify_key_callback_fn* notify_key_cb;
+    void* notify_key_cb_context;
+
+    // Called when a client writes or reads the time characteristic
+    gatt_svr_time_sync_callback_fn* time_sync_cb;
+    gatt_svr_time_status_callback_fn* time_status_cb;
+    void* time_cb_context;
+
+    // Cached read values, the latest of each class. A read gets the latest
+    // of all, from read_cls.
+    struct gatt_svr_read_value read_values[GATT_SVR_NOTIFY_CLASS_COUNT];
+    atomic_uint read_cls;
+
+    // Set under the notify lock, read from any task
+    atomic_uint_least8_t battery_level;
+
+    // Connection handle of each slot, the slots taken and the subscribers
+    // of each GATT_SVR_SUB_ characteristic. Changed under the notify lock.
+    uint16_t slot_conn_handles[CONFIG_NIMBLE_MAX_CONNECTIONS];
+    gatt_svr_slot_mask slots_used;
+    gatt_svr_slot_mask subs[GATT_SVR_SUB_COUNT];
+
+    // Outbound notifications, by slot
+    struct gatt_svr_notify_queue notify_queues[CONFIG_NIMBLE_MAX_CONNECTIONS];
+    gatt_svr_notify_policy notify_policies[GATT_SVR_NOTIFY_CLASS_COUNT];
+    uint32_t notify_seq;
+    bool notify_pumping;
+    bool notify_pump_again;
+    bool notify_retry_armed;
+
+    // Sends run on the NimBLE host task; other tasks post this
+    struct ble_npl_event notify_event;
+
+    gatt_svr_copy_stats copy_stats;
 };
 typedef struct gatt_server gatt_server;
 
@@ -65,6 +155,7 @@ typedef struct gatt_server gatt_server;
 #define GATT_UUID_GBLE_FIRMWARE_CHR             0xffe1
 #define GATT_UUID_GBLE_RX_CHR                   0xffe2
 #define GATT_UUID_GBLE_TX_CHR                   0xffe3
+#define GATT_UUID_GBLE_TIME_CHR                 0xffe4
 
 #define GATT_UUID_BAT_PRESENT_DESCR             0x2904
 
@@ -128,7 +219,8 @@ enum attr_handles {
     HANDLE_MAIN_FIRMWARE,             //  9
     HANDLE_MAIN_RX,             //  9
     HANDLE_MAIN_TX,           // 10
-    HANDLE_HID_COUNT                    // 11
+    HANDLE_MAIN_TIME,                   // 11
+    HANDLE_HID_COUNT                    // 12
 };
 
 // Globals
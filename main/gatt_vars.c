@@ -164,6 +164,14 @@ const struct ble_gatt_svc_def Gatt_svr_svcs[] = {
                 .val_handle = &Svc_char_handles[HANDLE_MAIN_TX],
                 .flags = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP,
                 NO_ARG_DESCR_MKS,
+            }, {
+            /*** Time sync */
+                .uuid = BLE_UUID16_DECLARE(GATT_UUID_GBLE_TIME_CHR),
+                .access_cb = gatt_svr_chr_access,
+                .val_handle = &Svc_char_handles[HANDLE_MAIN_TIME],
+                .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE |
+                         BLE_GATT_CHR_F_WRITE_NO_RSP | BLE_GATT_CHR_F_NOTIFY,
+                NO_ARG_DESCR_MKS,
             }, {
                 0, /* No more characteristics in this service. */
             }
@@ -0,0 +1,192 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "gble_actuator_task.h"
+
+static const char* TAG = "GbleActuatorTask";
+
+static void gble_actuator_task_main(void* param)
+{
+    gble_actuator_task* task = param;
+
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        gble_actuator_task_drain(task);
+    }
+}
+
+bool gble_actuator_task_start(gble_actuator_task* task, gble_server* server,
+                              UBaseType_t priority)
+{
+    if (server->actuator_count > CONFIG_GBLE_ACTUATOR_TASK_MAX_ACTUATORS)
+    {
+        ESP_LOGE(TAG, "%zu actuators, at most %d supported",
+                 server->actuator_count, CONFIG_GBLE_ACTUATOR_TASK_MAX_ACTUATORS);
+        return false;
+    }
+
+    memset(task, 0, sizeof(*task));
+    task->server = server;
+
+    task->producer_lock = xSemaphoreCreateMutex();
+    if (!task->producer_lock)
+    {
+        ESP_LOGE(TAG, "Failed to create producer lock");
+        return false;
+    }
+
+    for (size_t idx = 0; idx < server->actuator_count; ++idx)
+    {
+        atomic_init(&task->slots[idx].command, server->actuators[idx].last_value);
+    }
+
+    if (xTaskCreate(gble_actuator_task_main, "gble_actuator",
+                    CONFIG_GBLE_ACTUATOR_TASK_STACK_SIZE, task, priority,
+                    &task->handle) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create actuator task");
+        vSemaphoreDelete(task->producer_lock);
+        task->producer_lock = NULL;
+        return false;
+    }
+
+    server->actuator_task = task;
+
+    return true;
+}
+
+void gble_actuator_task_lock(gble_actuator_task* task)
+{
+    xSemaphoreTake(task->producer_lock, portMAX_DELAY);
+}
+
+void gble_actuator_task_push(gble_actuator_task* task, const gble_actuator_command* command)
+{
+    struct gble_actuator_slot* slot = &task->slots[command->id];
+
+    const uint32_t aux = command->duration_ms | command->clockwise;
+    atomic_store_explicit(&slot->command, ((uint64_t)aux << 32) | command->value, memory_order_relaxed);
+    atomic_store_explicit(&slot->written_us, esp_timer_get_time(), memory_order_relaxed);
+
+    ++task->stats.commands;
+
+    // The task clears the flag before reading the value, so a value it
+    // misses is queued again.
+    if (atomic_exchange_explicit(&slot->queued, true, memory_order_acq_rel))
+    {
+        ++task->stats.coalesced;
+        return;
+    }
+
+    task->ring[task->ring_pending_tail % CONFIG_GBLE_ACTUATOR_TASK_MAX_ACTUATORS] = command->id;
+    ++task->ring_pending_tail;
+}
+
+void gble_actuator_task_commit(gble_actuator_task* task)
+{
+    const unsigned tail = atomic_load_explicit(&task->ring_tail, memory_order_relaxed);
+    if (task->ring_pending_tail == tail)
+    {
+        xSemaphoreGive(task->producer_lock);
+        return;
+    }
+
+    atomic_store_explicit(&task->ring_tail, task->ring_pending_tail, memory_order_release);
+
+    const unsigned depth = task->ring_pending_tail -
+                           atomic_load_explicit(&task->ring_head, memory_order_relaxed);
+    if (depth > task->stats.queue_high_water)
+    {
+        task->stats.queue_high_water = depth;
+    }
+
+    xSemaphoreGive(task->producer_lock);
+
+    if (task->handle)
+    {
+        xTaskNotifyGive(task->handle);
+    }
+}
+
+size_t gble_actuator_task_drain(gble_actuator_task* task)
+{
+    gble_server* server = task->server;
+    size_t dispatched = 0;
+
+    unsigned head = atomic_load_explicit(&task->ring_head, memory_order_relaxed);
+    const unsigned tail = atomic_load_explicit(&task->ring_tail, memory_order_acquire);
+
+    while (head != tail)
+    {
+        const gble_actuator_id actuator_id = task->ring[head % CONFIG_GBLE_ACTUATOR_TASK_MAX_ACTUATORS];
+        struct gble_actuator_slot* slot = &task->slots[actuator_id];
+
+        ++head;
+        atomic_store_explicit(&task->ring_head, head, memory_order_release);
+
+        // Pairs with the exchange in gble_actuator_task_push
+        atomic_exchange_explicit(&slot->queued, false, memory_order_acq_rel);
+
+        const uint64_t packed = atomic_load_explicit(&slot->command, memory_order_acquire);
+        const int64_t written_us = atomic_load_explicit(&slot->written_us, memory_order_relaxed);
+
+        const int64_t latency_us = esp_timer_get_time() - written_us;
+        task->stats.latency_us_last = latency_us > 0 ? (uint32_t)latency_us : 0;
+        task->stats.latency_us_total += task->stats.latency_us_last;
+        if (task->stats.latency_us_last > task->stats.latency_us_max)
+        {
+            task->stats.latency_us_max = task->stats.latency_us_last;
+        }
+
+        gble_actuator_feature* actuator = &server->actuators[actuator_id];
+
+        const uint32_t aux = (uint32_t)(packed >> 32);
+        const gble_actuator_command command = {
+            .id = actuator_id,
+            .value = (uint32_t)packed,
+            .duration_ms = actuator->message_type == GBLE_ACTUATOR_MSG_LINEAR ? aux : 0,
+            .clockwise = actuator->message_type == GBLE_ACTUATOR_MSG_ROTATE && aux,
+        };
+
+        gble_dispatch_actuator_command(actuator, &command);
+
+        ++dispatched;
+    }
+
+    task->stats.dispatched += dispatched;
+
+    if (dispatched && server->actuators_applied_cb)
+    {
+        server->actuators_applied_cb(dispatched, server->actuators_applied_cb_context);
+    }
+
+    return dispatched;
+}
+
+void gble_actuator_task_get_stats(gble_actuator_task* task, gble_actuator_task_stats* stats)
+{
+    *stats = task->stats;
+}
@@ -0,0 +1,109 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+// Runs actuator callbacks on their own task instead of the NimBLE host task.
+// Writes decoded on the host task only record the new value in a
+// per-actuator slot and queue the actuator id in a lock-free single producer,
+// single consumer ring; the actuator task drains the ring and calls the
+// callbacks. An actuator is in the ring at most once, so when the task falls
+// behind, further writes only overwrite the slot and the latest value wins.
+//
+// Writes are not the only producer: timed commands and patterns release from
+// esp_timer callbacks. Producers serialize on a mutex held from the first
+// push to the commit, so the ring still sees one producer at a time.
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "generic_btle.h"
+
+struct gble_actuator_slot {
+    // Command value in the low half; LINEAR duration or ROTATE direction in
+    // the high half, so a command is stored and read as a whole
+    _Atomic uint64_t command;
+    // esp_timer time of the write that stored `command`
+    _Atomic int64_t written_us;
+    atomic_bool queued;
+};
+
+struct gble_actuator_task_stats {
+    // Writes that changed an actuator value
+    uint32_t commands;
+    // Writes that replaced a value the task had not applied yet
+    uint32_t coalesced;
+    // Callbacks run by the task
+    uint32_t dispatched;
+    // Most ids waiting in the ring at once
+    uint32_t queue_high_water;
+
+    // Write to callback, in microseconds
+    uint32_t latency_us_last;
+    uint32_t latency_us_max;
+    uint64_t latency_us_total;
+};
+typedef struct gble_actuator_task_stats gble_actuator_task_stats;
+
+struct gble_actuator_task {
+    gble_server* server;
+    TaskHandle_t handle;
+
+    struct gble_actuator_slot slots[CONFIG_GBLE_ACTUATOR_TASK_MAX_ACTUATORS];
+
+    uint16_t ring[CONFIG_GBLE_ACTUATOR_TASK_MAX_ACTUATORS];
+    // Free-running counters; the producer owns tail, the consumer head
+    atomic_uint ring_head;
+    atomic_uint ring_tail;
+    // Tail including pushes not yet published by gble_actuator_task_commit
+    unsigned ring_pending_tail;
+    // Held by the producer from gble_actuator_task_lock to the commit
+    SemaphoreHandle_t producer_lock;
+
+    gble_actuator_task_stats stats;
+};
+typedef struct gble_actuator_task gble_actuator_task;
+
+// Starts the task and routes the server's actuator changes through it.
+bool gble_actuator_task_start(gble_actuator_task* task, gble_server* server,
+                              UBaseType_t priority);
+
+// Producer side, called by gble with the producer lock held: stores the
+// command and queues the actuator unless it is queued already. Nothing is
+// visible to the task until gble_actuator_task_commit, so a message is
+// applied as a group.
+void gble_actuator_task_lock(gble_actuator_task* task);
+
+void gble_actuator_task_push(gble_actuator_task* task, const gble_actuator_command* command);
+
+// Publishes the pushes and releases the producer lock.
+void gble_actuator_task_commit(gble_actuator_task* task);
+
+// Consumer side: runs the callbacks of every queued actuator, then the
+// server's actuators-applied callback. Returns the number of callbacks run.
+// This is the body of the task loop.
+size_t gble_actuator_task_drain(gble_actuator_task* task);
+
+void gble_actuator_task_get_stats(gble_actuator_task* task, gble_actuator_task_stats* stats);
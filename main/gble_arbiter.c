@@ -0,0 +1,372 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "gble_arbiter.h"
+
+static const char* TAG = "GbleArbiter";
+
+static void gble_arbiter_priority_cb(int32_t opcode, CborValue* args, size_t arg_count, void* context);
+
+static void gble_arbiter_lock(gble_arbiter* arbiter)
+{
+    xSemaphoreTake(arbiter->lock, portMAX_DELAY);
+}
+
+static void gble_arbiter_unlock(gble_arbiter* arbiter)
+{
+    xSemaphoreGive(arbiter->lock);
+}
+
+bool gble_arbiter_start(gble_arbiter* arbiter, gble_server* server,
+                        gble_arbiter_policy policy, uint32_t lease_ms)
+{
+    if (server->actuator_count > CONFIG_GBLE_ARBITER_MAX_ACTUATORS)
+    {
+        ESP_LOGE(TAG, "%zu actuators, at most %d supported",
+                 server->actuator_count, CONFIG_GBLE_ARBITER_MAX_ACTUATORS);
+        return false;
+    }
+
+    if (policy > GBLE_ARBITER_POLICY_SUM)
+    {
+        ESP_LOGE(TAG, "Invalid policy %hhu", policy);
+        return false;
+    }
+
+    memset(arbiter, 0, sizeof(*arbiter));
+    arbiter->server = server;
+    arbiter->policy = policy;
+    arbiter->lease_us = (int64_t)lease_ms * 1000;
+
+    for (size_t idx = 0; idx < CONFIG_GBLE_ARBITER_MAX_ACTUATORS; ++idx)
+    {
+        arbiter->actuators[idx].owner = -1;
+    }
+
+    arbiter->lock = xSemaphoreCreateMutex();
+    if (!arbiter->lock)
+    {
+        ESP_LOGE(TAG, "Failed to create lock");
+        return false;
+    }
+
+    if (policy == GBLE_ARBITER_POLICY_LAST_WRITE)
+    {
+        server->arbiter = NULL;
+        return true;
+    }
+
+    if (!gble_register_command(server, GBLE_COMMAND_ARBITER_PRIORITY, gble_arbiter_priority_cb, arbiter))
+    {
+        return false;
+    }
+
+    server->arbiter = arbiter;
+
+    return true;
+}
+
+static int gble_arbiter_find_client(const gble_arbiter* arbiter, gble_client_id client)
+{
+    for (int slot = 0; slot < CONFIG_GBLE_ARBITER_MAX_CLIENTS; ++slot)
+    {
+        if (arbiter->clients[slot].used && arbiter->clients[slot].id == client)
+        {
+            return slot;
+        }
+    }
+
+    return -1;
+}
+
+static int gble_arbiter_take_client(gble_arbiter* arbiter, gble_client_id client)
+{
+    int slot = gble_arbiter_find_client(arbiter, client);
+    if (slot >= 0)
+    {
+        return slot;
+    }
+
+    for (slot = 0; slot < CONFIG_GBLE_ARBITER_MAX_CLIENTS; ++slot)
+    {
+        struct gble_arbiter_client* entry = &arbiter->clients[slot];
+        if (!entry->used)
+        {
+            entry->used = true;
+            entry->id = client;
+            entry->priority = 0;
+            return slot;
+        }
+    }
+
+    ESP_LOGE(TAG, "No room for client %hu", client);
+    return -1;
+}
+
+bool gble_arbiter_set_priority(gble_arbiter* arbiter, gble_client_id client, uint8_t priority)
+{
+    gble_arbiter_lock(arbiter);
+
+    const int slot = gble_arbiter_take_client(arbiter, client);
+    if (slot >= 0)
+    {
+        arbiter->clients[slot].priority = priority;
+    }
+
+    gble_arbiter_unlock(arbiter);
+
+    return slot >= 0;
+}
+
+static bool gble_arbiter_live(const gble_arbiter* arbiter, const struct gble_arbiter_entry* entry, int64_t now_us)
+{
+    return entry->valid && (!arbiter->lease_us || now_us - entry->updated_us < arbiter->lease_us);
+}
+
+// Whether entry `slot` beats entry `best` under the policy; the more
+// recent one wins a tie
+static bool gble_arbiter_beats(const gble_arbiter* arbiter, const struct gble_arbiter_actuator* actuator,
+                               int slot, int best)
+{
+    const struct gble_arbiter_entry* entry = &actuator->entries[slot];
+    const struct gble_arbiter_entry* best_entry = &actuator->entries[best];
+
+    if (arbiter->policy == GBLE_ARBITER_POLICY_PRIORITY &&
+        arbiter->clients[slot].priority != arbiter->clients[best].priority)
+    {
+        return arbiter->clients[slot].priority > arbiter->clients[best].priority;
+    }
+
+    if (arbiter->policy != GBLE_ARBITER_POLICY_PRIORITY && entry->value != best_entry->value)
+    {
+        return entry->value > best_entry->value;
+    }
+
+    return entry->updated_us >= best_entry->updated_us;
+}
+
+// Fills in the merged command for command->id and returns the slot whose
+// entry it follows, or -1 when no client has a say and the actuator goes
+// back to step_range_low.
+static int gble_arbiter_resolve(gble_arbiter* arbiter, gble_actuator_command* command, int64_t now_us)
+{
+    const gble_actuator_feature* feature = &arbiter->server->actuators[command->id];
+    const struct gble_arbiter_actuator* actuator = &arbiter->actuators[command->id];
+    int best = -1;
+    uint64_t sum = 0;
+
+    if (arbiter->policy == GBLE_ARBITER_POLICY_EXCLUSIVE)
+    {
+        if (actuator->owner >= 0 && gble_arbiter_live(arbiter, &actuator->entries[actuator->owner], now_us))
+        {
+            best = actuator->owner;
+        }
+    }
+    else
+    {
+        for (int slot = 0; slot < CONFIG_GBLE_ARBITER_MAX_CLIENTS; ++slot)
+        {
+            if (!gble_arbiter_live(arbiter, &actuator->entries[slot], now_us))
+            {
+                continue;
+            }
+
+            sum += actuator->entries[slot].value;
+
+            if (best < 0 || gble_arbiter_beats(arbiter, actuator, slot, best))
+            {
+                best = slot;
+            }
+        }
+    }
+
+    if (best < 0)
+    {
+        command->value = feature->step_range_low;
+        command->duration_ms = 0;
+        command->clockwise = feature->last_clockwise;
+        return -1;
+    }
+
+    const struct gble_arbiter_entry* entry = &actuator->entries[best];
+    command->value = entry->value;
+    command->duration_ms = entry->duration_ms;
+    command->clockwise = entry->clockwise;
+
+    if (arbiter->policy == GBLE_ARBITER_POLICY_SUM)
+    {
+        command->value = sum > feature->step_range_high ? feature->step_range_high : (uint32_t)sum;
+        arbiter->stats.clamped += sum > feature->step_range_high;
+    }
+
+    return best;
+}
+
+static void gble_arbiter_merge_locked(gble_arbiter* arbiter, gble_client_id client,
+                                      gble_actuator_command* command)
+{
+    const int64_t now_us = esp_timer_get_time();
+    struct gble_arbiter_actuator* actuator = &arbiter->actuators[command->id];
+    const int slot = gble_arbiter_take_client(arbiter, client);
+
+    ++arbiter->stats.commands;
+
+    if (slot < 0)
+    {
+        ++arbiter->stats.overridden;
+        gble_arbiter_resolve(arbiter, command, now_us);
+        return;
+    }
+
+    for (int other = 0; other < CONFIG_GBLE_ARBITER_MAX_CLIENTS; ++other)
+    {
+        if (other != slot && gble_arbiter_live(arbiter, &actuator->entries[other], now_us))
+        {
+            ++arbiter->stats.contended;
+            break;
+        }
+    }
+
+    if (arbiter->policy == GBLE_ARBITER_POLICY_EXCLUSIVE && actuator->owner != slot)
+    {
+        if (actuator->owner >= 0 && gble_arbiter_live(arbiter, &actuator->entries[actuator->owner], now_us))
+        {
+            ++arbiter->stats.rejected;
+            ++arbiter->stats.overridden;
+            gble_arbiter_resolve(arbiter, command, now_us);
+            return;
+        }
+
+        arbiter->stats.takeovers += actuator->owner >= 0;
+        actuator->owner = slot;
+    }
+
+    struct gble_arbiter_entry* entry = &actuator->entries[slot];
+    entry->value = command->value;
+    entry->duration_ms = command->duration_ms;
+    entry->clockwise = command->clockwise;
+    entry->valid = true;
+    entry->updated_us = now_us;
+
+    // Under SUM every value counts
+    if (gble_arbiter_resolve(arbiter, command, now_us) != slot &&
+        arbiter->policy != GBLE_ARBITER_POLICY_SUM)
+    {
+        ++arbiter->stats.overridden;
+    }
+}
+
+void gble_arbiter_merge(gble_arbiter* arbiter, gble_client_id client, gble_actuator_command* command)
+{
+    gble_arbiter_lock(arbiter);
+    gble_arbiter_merge_locked(arbiter, client, command);
+    gble_arbiter_unlock(arbiter);
+}
+
+size_t gble_arbiter_release(gble_arbiter* arbiter, gble_client_id client, gble_actuator_command* commands)
+{
+    gble_arbiter_lock(arbiter);
+
+    const int slot = gble_arbiter_find_client(arbiter, client);
+    if (slot < 0)
+    {
+        gble_arbiter_unlock(arbiter);
+        return 0;
+    }
+
+    const int64_t now_us = esp_timer_get_time();
+    size_t count = 0;
+
+    for (size_t id = 0; id < arbiter->server->actuator_count; ++id)
+    {
+        struct gble_arbiter_actuator* actuator = &arbiter->actuators[id];
+        if (!actuator->entries[slot].valid)
+        {
+            continue;
+        }
+
+        actuator->entries[slot].valid = false;
+        if (actuator->owner == slot)
+        {
+            actuator->owner = -1;
+        }
+
+        const gble_actuator_feature* feature = &arbiter->server->actuators[id];
+        gble_actuator_command* command = &commands[count];
+        memset(command, 0, sizeof(*command));
+        command->id = id;
+        gble_arbiter_resolve(arbiter, command, now_us);
+
+        if (command->value != feature->last_value ||
+            (feature->message_type == GBLE_ACTUATOR_MSG_ROTATE && command->clockwise != feature->last_clockwise))
+        {
+            ++arbiter->stats.released;
+            ++count;
+        }
+    }
+
+    arbiter->clients[slot].used = false;
+
+    gble_arbiter_unlock(arbiter);
+
+    return count;
+}
+
+void gble_arbiter_get_stats(gble_arbiter* arbiter, gble_arbiter_stats* stats)
+{
+    gble_arbiter_lock(arbiter);
+    *stats = arbiter->stats;
+    gble_arbiter_unlock(arbiter);
+}
+
+static void gble_arbiter_priority_cb(int32_t opcode, CborValue* args, size_t arg_count, void* context)
+{
+    gble_arbiter* arbiter = (gble_arbiter*)context;
+
+    uint64_t priority;
+    if (arg_count != 1 ||
+        !cbor_value_is_unsigned_integer(args) ||
+        cbor_value_get_uint64(args, &priority) != CborNoError ||
+        priority > UINT8_MAX)
+    {
+        ESP_LOGE(TAG, "Expected [%d, priority]", GBLE_COMMAND_ARBITER_PRIORITY);
+        return;
+    }
+
+    gble_arbiter_lock(arbiter);
+
+    // Only downward, or any client could rank itself above a safety monitor
+    const int slot = gble_arbiter_take_client(arbiter, arbiter->server->command_client);
+    if (slot >= 0 && priority > arbiter->clients[slot].priority)
+    {
+        ESP_LOGE(TAG, "Client %hu may not raise its priority from %hhu to %hhu",
+                 arbiter->clients[slot].id, arbiter->clients[slot].priority, (uint8_t)priority);
+    }
+    else if (slot >= 0)
+    {
+        arbiter->clients[slot].priority = (uint8_t)priority;
+    }
+
+    gble_arbiter_unlock(arbiter);
+}
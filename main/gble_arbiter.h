@@ -0,0 +1,137 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+// Arbitrates actuator commands from several clients, such as a main
+// controller and a safety monitor connected at the same time. Without an
+// arbiter the last write wins and every flip between two clients runs the
+// callbacks. With one, gble records each client's latest command per
+// actuator and hands the merged result to the write path instead, in place
+// of the command that was written:
+//
+//   EXCLUSIVE  the first client to command an actuator owns it; others are
+//              rejected until the owner's lease lapses or it disconnects
+//   PRIORITY   the client with the highest priority wins, the most recent
+//              among equals; the device ranks clients, and a client can
+//              only lower its own with [-9, priority]
+//   MAX        the largest value asked for
+//   SUM        the values added up, clamped to step_range_high
+//
+// A client's command stays in the merge until it disconnects or, with a
+// lease, until lease_ms pass without a new one from it. Lapsed leases are
+// noticed on the next command for the actuator; a disconnect applies the
+// new merge at once. ROTATE direction and LINEAR duration come from the
+// client whose value is used (the largest one for SUM).
+//
+// Timed commands and pattern output are merged as the commands of the
+// client that sent them when they are released, on the esp_timer task, so
+// a client the arbiter rejects cannot get around it by timing its writes or
+// playing a pattern. Everything below may be called from any task.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "generic_btle.h"
+
+#define GBLE_ARBITER_POLICY_LAST_WRITE 0
+#define GBLE_ARBITER_POLICY_EXCLUSIVE  1
+#define GBLE_ARBITER_POLICY_PRIORITY   2
+#define GBLE_ARBITER_POLICY_MAX        3
+#define GBLE_ARBITER_POLICY_SUM        4
+typedef uint8_t gble_arbiter_policy;
+
+struct gble_arbiter_entry {
+    uint32_t value;
+    uint32_t duration_ms;
+    bool clockwise;
+    bool valid;
+    int64_t updated_us;
+};
+
+struct gble_arbiter_actuator {
+    // EXCLUSIVE: client slot holding the actuator, -1 for none
+    int8_t owner;
+    struct gble_arbiter_entry entries[CONFIG_GBLE_ARBITER_MAX_CLIENTS];
+};
+
+struct gble_arbiter_client {
+    bool used;
+    gble_client_id id;
+    uint8_t priority;
+};
+
+struct gble_arbiter_stats {
+    // Commands merged
+    uint32_t commands;
+    // Commands that arrived while another client's command for the same
+    // actuator was still in the merge
+    uint32_t contended;
+    // Commands whose value was not the one applied: rejected, outranked,
+    // or smaller than another under MAX
+    uint32_t overridden;
+    // EXCLUSIVE: commands from a client not holding the actuator
+    uint32_t rejected;
+    // EXCLUSIVE: actuators taken over after the owner's lease lapsed
+    uint32_t takeovers;
+    // SUM: merges cut to step_range_high
+    uint32_t clamped;
+    // Actuators that changed because their client disconnected
+    uint32_t released;
+};
+typedef struct gble_arbiter_stats gble_arbiter_stats;
+
+struct gble_arbiter {
+    gble_server* server;
+    gble_arbiter_policy policy;
+    int64_t lease_us;
+    // Held by every call below
+    SemaphoreHandle_t lock;
+
+    struct gble_arbiter_client clients[CONFIG_GBLE_ARBITER_MAX_CLIENTS];
+    struct gble_arbiter_actuator actuators[CONFIG_GBLE_ARBITER_MAX_ACTUATORS];
+
+    gble_arbiter_stats stats;
+};
+typedef struct gble_arbiter gble_arbiter;
+
+// Routes the server's client commands through the arbiter and registers
+// GBLE_COMMAND_ARBITER_PRIORITY. lease_ms 0 keeps commands until their
+// client disconnects. LAST_WRITE leaves the server without an arbiter.
+bool gble_arbiter_start(gble_arbiter* arbiter, gble_server* server,
+                        gble_arbiter_policy policy, uint32_t lease_ms);
+
+// Sets a client's PRIORITY rank, higher wins; clients start at 0. Call it
+// when a client connects, from what the device knows of it, such as its
+// bonded identity: ranks are forgotten on disconnect.
+bool gble_arbiter_set_priority(gble_arbiter* arbiter, gble_client_id client, uint8_t priority);
+
+// Records the command for client and replaces it with the merged command
+// for its actuator. Called by gble for each command of a client message.
+void gble_arbiter_merge(gble_arbiter* arbiter, gble_client_id client, gble_actuator_command* command);
+
+// Forgets the client and fills commands, one per actuator, with the merges
+// that changed without it. Returns how many.
+size_t gble_arbiter_release(gble_arbiter* arbiter, gble_client_id client, gble_actuator_command* commands);
+
+void gble_arbiter_get_stats(gble_arbiter* arbiter, gble_arbiter_stats* stats);
@@ -0,0 +1,177 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "gble_broadcast.h"
+
+static const char* TAG = "GbleBroadcast";
+
+#define GBLE_BROADCAST_AD_MANUFACTURER 0xff
+
+// Writes value zigzag encoded as a LEB128 varint, returning the bytes used
+static size_t gble_broadcast_encode_value(uint8_t* buf, int32_t value)
+{
+    uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    size_t size = 0;
+
+    while (zigzag >= 0x80)
+    {
+        buf[size++] = (uint8_t)(zigzag | 0x80);
+        zigzag >>= 7;
+    }
+
+    buf[size++] = (uint8_t)zigzag;
+    return size;
+}
+
+static void gble_broadcast_timer_cb(void* arg)
+{
+    gble_broadcast_tick((gble_broadcast*)arg);
+}
+
+bool gble_broadcast_start(gble_broadcast* broadcast, gble_server* server, uint32_t cadence_ms,
+                          size_t max_size)
+{
+    if (server->sensors_count > CONFIG_GBLE_BROADCAST_MAX_SENSORS)
+    {
+        ESP_LOGE(TAG, "%zu sensors, at most %d supported",
+                 server->sensors_count, CONFIG_GBLE_BROADCAST_MAX_SENSORS);
+        return false;
+    }
+
+    if (max_size < GBLE_BROADCAST_HEADER_SIZE || cadence_ms == 0)
+    {
+        ESP_LOGE(TAG, "Invalid data size %zu or cadence %" PRIu32 " ms", max_size, cadence_ms);
+        return false;
+    }
+
+    memset(broadcast, 0, sizeof(*broadcast));
+    broadcast->server = server;
+    broadcast->max_size = max_size < sizeof(broadcast->data) ? max_size : sizeof(broadcast->data);
+
+    const uint16_t company_id = CONFIG_GBLE_BROADCAST_COMPANY_ID;
+
+    broadcast->data[1] = GBLE_BROADCAST_AD_MANUFACTURER;
+    broadcast->data[2] = (uint8_t)company_id;
+    broadcast->data[3] = (uint8_t)(company_id >> 8);
+    broadcast->data[4] = GBLE_BROADCAST_VERSION;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = gble_broadcast_timer_cb,
+        .arg = broadcast,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "gble_broadcast",
+    };
+
+    if (esp_timer_create(&timer_args, &broadcast->timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create cadence timer");
+        return false;
+    }
+
+    if (esp_timer_start_periodic(broadcast->timer, (uint64_t)cadence_ms * 1000) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start cadence timer");
+        return false;
+    }
+
+    return true;
+}
+
+void gble_broadcast_stop(gble_broadcast* broadcast)
+{
+    if (broadcast->timer)
+    {
+        esp_timer_stop(broadcast->timer);
+        esp_timer_delete(broadcast->timer);
+        broadcast->timer = NULL;
+    }
+}
+
+void gble_broadcast_set_data_fn(gble_broadcast* broadcast, gble_broadcast_data_fn* cb, void* cb_context)
+{
+    broadcast->data_cb = cb;
+    broadcast->data_cb_context = cb_context;
+}
+
+void gble_broadcast_tick(gble_broadcast* broadcast)
+{
+    const gble_server* server = broadcast->server;
+    bool changed = !broadcast->sent;
+
+    ++broadcast->stats.ticks;
+
+    for (size_t idx = 0; idx < server->sensors_count; ++idx)
+    {
+        const int32_t value = server->sensors[idx].last_value;
+
+        if (broadcast->values[idx] != value)
+        {
+            broadcast->values[idx] = value;
+            changed = true;
+        }
+    }
+
+    if (!changed || !broadcast->data_cb)
+    {
+        return;
+    }
+
+    size_t size = GBLE_BROADCAST_HEADER_SIZE;
+    size_t count = 0;
+
+    for (; count < server->sensors_count; ++count)
+    {
+        uint8_t value[GBLE_BROADCAST_VALUE_MAX];
+        const size_t value_size = gble_broadcast_encode_value(value, broadcast->values[count]);
+
+        if (size + value_size > broadcast->max_size)
+        {
+            break;
+        }
+
+        memcpy(&broadcast->data[size], value, value_size);
+        size += value_size;
+    }
+
+    if (broadcast->sent)
+    {
+        ++broadcast->sequence;
+    }
+
+    broadcast->data[0] = (uint8_t)(size - 1);
+    broadcast->data[5] = broadcast->sequence;
+    broadcast->data_size = size;
+    broadcast->sent = true;
+
+    ++broadcast->stats.updates;
+    broadcast->stats.bytes += size;
+    broadcast->stats.truncated += count < server->sensors_count;
+
+    broadcast->data_cb(broadcast->data, size, broadcast->data_cb_context);
+}
+
+void gble_broadcast_get_stats(gble_broadcast* broadcast, gble_broadcast_stats* stats)
+{
+    *stats = broadcast->stats;
+}
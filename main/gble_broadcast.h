@@ -0,0 +1,105 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+// Connectionless sensor broadcast. Every cadence_ms the latest last_value of
+// each sensor is packed into one manufacturer specific data field
+//
+//   len 0xff company_id:le16 version:u8 sequence:u8 value*
+//
+// and handed to the data callback, which puts it in an advertising set of
+// its own (see ble_func_set_broadcast_data), so any number of passive
+// observers read the sensors without a connection or a notification each.
+//
+// Version GBLE_BROADCAST_VERSION has one value per sensor in id order, each
+// zigzag encoded (0, -1, 1, -2, ... become 0, 1, 2, 3, ...) as a LEB128
+// varint, so small values take one byte. Sensors that do not fit the data
+// size are left off the end. sequence goes up by one whenever a value
+// changed; the data is not handed over again while none did.
+//
+//   gble_broadcast_start(&broadcast, &server, CONFIG_GBLE_BROADCAST_INTERVAL_MS,
+//                        ble_func_get_broadcast_size_max());
+//   gble_broadcast_set_data_fn(&broadcast, ble_func_set_broadcast_data_ctx, NULL);
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "esp_timer.h"
+
+#include "generic_btle.h"
+
+#define GBLE_BROADCAST_VERSION 1
+
+// Field length, type, company id, version and sequence
+#define GBLE_BROADCAST_HEADER_SIZE 6
+
+// Longest zigzag varint of an int32
+#define GBLE_BROADCAST_VALUE_MAX 5
+
+#define GBLE_BROADCAST_MAX_DATA_SIZE \
+    (GBLE_BROADCAST_HEADER_SIZE + GBLE_BROADCAST_VALUE_MAX * CONFIG_GBLE_BROADCAST_MAX_SENSORS)
+
+typedef void gble_broadcast_data_fn(const uint8_t* data, size_t size, void* context);
+
+struct gble_broadcast_stats {
+    uint32_t ticks;
+    // Data handed to the data callback
+    uint32_t updates;
+    uint64_t bytes;
+    // Updates that left sensors off for size
+    uint32_t truncated;
+};
+typedef struct gble_broadcast_stats gble_broadcast_stats;
+
+struct gble_broadcast {
+    gble_server* server;
+
+    gble_broadcast_data_fn* data_cb;
+    void* data_cb_context;
+
+    size_t max_size;
+    esp_timer_handle_t timer;
+
+    // Values as last broadcast
+    int32_t values[CONFIG_GBLE_BROADCAST_MAX_SENSORS];
+    bool sent;
+    uint8_t sequence;
+
+    uint8_t data[GBLE_BROADCAST_MAX_DATA_SIZE];
+    size_t data_size;
+
+    gble_broadcast_stats stats;
+};
+typedef struct gble_broadcast gble_broadcast;
+
+// Broadcasts every cadence_ms in data of at most max_size bytes.
+bool gble_broadcast_start(gble_broadcast* broadcast, gble_server* server, uint32_t cadence_ms,
+                          size_t max_size);
+
+void gble_broadcast_stop(gble_broadcast* broadcast);
+
+void gble_broadcast_set_data_fn(gble_broadcast* broadcast, gble_broadcast_data_fn* cb, void* cb_context);
+
+// Encodes and hands over the values if any changed; run by the cadence timer
+void gble_broadcast_tick(gble_broadcast* broadcast);
+
+void gble_broadcast_get_stats(gble_broadcast* broadcast, gble_broadcast_stats* stats);
@@ -0,0 +1,392 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+// Compile-time descriptor generation. Declare the feature table constexpr
+// and the CBOR descriptor is encoded by the compiler into rodata, so there is
+// no encode at boot and no descriptor buffer in RAM:
+//
+//   static constexpr gble::feature_table<2, 1> Table = {
+//       "Generic Device",
+//       {{
+//           { "Actuator 1", GBLE_ACTUATOR_TYPE_VIBRATE, 0, 20, GBLE_ACTUATOR_MSG_SCALAR },
+//           { "Actuator 2", GBLE_ACTUATOR_TYPE_VIBRATE, 0, 20, GBLE_ACTUATOR_MSG_SCALAR },
+//       }},
+//       {{
+//           { "Sensor 1", GBLE_SENSOR_TYPE_PRESSURE, 0, 16, GBLE_SENSOR_MSG_SUBSCRIBE },
+//       }},
+//   };
+//
+//   static auto actuators = gble::make_actuator_features(Table);
+//   static auto sensors = gble::make_sensor_features(Table);
+//
+//   actuators[Table.actuator_index("Actuator 2")].cb = handle_actuator_change;
+//   gble::init_static<Table>(&server, actuators, sensors);
+//
+// A descriptor that does not fit GBLE_MAX_DESCRIPTOR_SIZE, or a feature with
+// an unknown type or an inverted range, fails the build.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "generic_btle.h"
+
+namespace gble
+{
+
+struct actuator
+{
+    const char* description;
+    gble_actuator_type feature_type;
+    uint32_t step_range_low;
+    uint32_t step_range_high;
+    gble_actuator_msg message_type;
+};
+
+struct sensor
+{
+    const char* description;
+    gble_sensor_type feature_type;
+    int32_t value_range_low;
+    int32_t value_range_high;
+    gble_sensor_msg message_type;
+};
+
+namespace detail
+{
+
+constexpr bool equal(const char* a, const char* b)
+{
+    while (*a && *a == *b)
+    {
+        ++a;
+        ++b;
+    }
+
+    return *a == *b;
+}
+
+constexpr size_t length(const char* str)
+{
+    size_t len = 0;
+    while (str[len])
+    {
+        ++len;
+    }
+
+    return len;
+}
+
+} // namespace detail
+
+template <size_t ActuatorCount, size_t SensorCount>
+struct feature_table
+{
+    const char* name;
+    std::array<actuator, ActuatorCount> actuators;
+    std::array<sensor, SensorCount> sensors;
+
+    // Feature ids are table indices. Returns the count when there is no such
+    // feature, so a static_assert on the result catches typos.
+    constexpr gble_actuator_id actuator_index(const char* description) const
+    {
+        for (size_t idx = 0; idx < ActuatorCount; ++idx)
+        {
+            if (detail::equal(actuators[idx].description, description))
+            {
+                return idx;
+            }
+        }
+
+        return ActuatorCount;
+    }
+
+    constexpr gble_sensor_id sensor_index(const char* description) const
+    {
+        for (size_t idx = 0; idx < SensorCount; ++idx)
+        {
+            if (detail::equal(sensors[idx].description, description))
+            {
+                return idx;
+            }
+        }
+
+        return SensorCount;
+    }
+};
+
+namespace detail
+{
+
+// Counts the bytes of the encoding, and stores them too when given a buffer.
+struct writer
+{
+    uint8_t* out;
+    size_t size;
+
+    constexpr void byte(uint8_t value)
+    {
+        if (out)
+        {
+            out[size] = value;
+        }
+        ++size;
+    }
+
+    // Shortest head, as tinycbor writes it
+    constexpr void head(uint8_t major_type, uint64_t value)
+    {
+        if (value < 24)
+        {
+            byte(major_type | (uint8_t)value);
+            return;
+        }
+
+        const unsigned width = value <= UINT8_MAX ? 1 :
+                               value <= UINT16_MAX ? 2 :
+                               value <= UINT32_MAX ? 4 : 8;
+
+        byte(major_type | (width == 1 ? 24 : width == 2 ? 25 : width == 4 ? 26 : 27));
+        for (unsigned idx = width; idx > 0; --idx)
+        {
+            byte((uint8_t)(value >> ((idx - 1) * 8)));
+        }
+    }
+
+    constexpr void encode_uint(uint64_t value)
+    {
+        head(0x00, value);
+    }
+
+    constexpr void encode_int(int64_t value)
+    {
+        if (value >= 0)
+        {
+            head(0x00, (uint64_t)value);
+        }
+        else
+        {
+            head(0x20, (uint64_t)(-1 - value));
+        }
+    }
+
+    constexpr void encode_text(const char* str)
+    {
+        const size_t len = length(str);
+
+        head(0x60, len);
+        for (size_t idx = 0; idx < len; ++idx)
+        {
+            byte((uint8_t)str[idx]);
+        }
+    }
+
+    constexpr void create_array(size_t len)
+    {
+        head(0x80, len);
+    }
+};
+
+// Same layout as gble_init: [version, name, [actuators...], [sensors...]]
+template <size_t A, size_t S>
+constexpr void encode(writer& w, const feature_table<A, S>& table)
+{
+    w.create_array(4);
+
+    w.encode_uint(GBLE_VERSION);
+    w.encode_text(table.name);
+
+    w.create_array(A);
+    for (const actuator& a : table.actuators)
+    {
+        w.create_array(5);
+        w.encode_text(a.description);
+        w.encode_uint(a.feature_type);
+        w.encode_uint(a.step_range_low);
+        w.encode_uint(a.step_range_high);
+        w.encode_uint(a.message_type);
+    }
+
+    w.create_array(S);
+    for (const sensor& s : table.sensors)
+    {
+        w.create_array(5);
+        w.encode_text(s.description);
+        w.encode_uint(s.feature_type);
+        w.encode_int(s.value_range_low);
+        w.encode_int(s.value_range_high);
+        w.encode_uint(s.message_type);
+    }
+}
+
+template <size_t A, size_t S>
+constexpr bool descriptions_valid(const feature_table<A, S>& table)
+{
+    if (!table.name)
+    {
+        return false;
+    }
+
+    for (const actuator& a : table.actuators)
+    {
+        if (!a.description)
+        {
+            return false;
+        }
+    }
+
+    for (const sensor& s : table.sensors)
+    {
+        if (!s.description)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template <size_t A, size_t S>
+constexpr bool actuators_valid(const feature_table<A, S>& table)
+{
+    for (const actuator& a : table.actuators)
+    {
+        if (a.feature_type < GBLE_ACTUATOR_TYPE_VIBRATE ||
+            a.feature_type > GBLE_ACTUATOR_TYPE_POSITION ||
+            a.message_type < GBLE_ACTUATOR_MSG_SCALAR ||
+            a.message_type > GBLE_ACTUATOR_MSG_LINEAR ||
+            a.step_range_low > a.step_range_high)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template <size_t A, size_t S>
+constexpr bool sensors_valid(const feature_table<A, S>& table)
+{
+    for (const sensor& s : table.sensors)
+    {
+        if (s.feature_type < GBLE_SENSOR_TYPE_BATTERY ||
+            s.feature_type > GBLE_SENSOR_TYPE_PRESSURE ||
+            s.message_type < GBLE_SENSOR_MSG_READ ||
+            s.message_type > GBLE_SENSOR_MSG_SUBSCRIBE ||
+            s.value_range_low > s.value_range_high)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template <size_t A, size_t S>
+constexpr size_t descriptor_size(const feature_table<A, S>& table)
+{
+    writer w{ nullptr, 0 };
+    encode(w, table);
+    return w.size;
+}
+
+template <size_t Size, size_t A, size_t S>
+constexpr std::array<uint8_t, Size> encode_descriptor(const feature_table<A, S>& table)
+{
+    std::array<uint8_t, Size> bytes{};
+    writer w{ bytes.data(), 0 };
+    encode(w, table);
+    return bytes;
+}
+
+} // namespace detail
+
+// The encoded descriptor of a constexpr feature table with static storage
+template <const auto& Table>
+struct descriptor
+{
+    static_assert(detail::descriptions_valid(Table),
+                  "Device name and every feature description must be set");
+    static_assert(detail::actuators_valid(Table),
+                  "Actuator with unknown type or message, or step_range_low > step_range_high");
+    static_assert(detail::sensors_valid(Table),
+                  "Sensor with unknown type or message, or value_range_low > value_range_high");
+
+    static constexpr size_t size = detail::descriptor_size(Table);
+
+    static_assert(size <= GBLE_MAX_DESCRIPTOR_SIZE,
+                  "Descriptor does not fit GBLE_MAX_DESCRIPTOR_SIZE, shorten the descriptions");
+
+    static constexpr std::array<uint8_t, size> bytes = detail::encode_descriptor<size>(Table);
+};
+
+// Runtime feature entries matching a table, for callbacks and last values
+template <size_t A, size_t S>
+constexpr std::array<gble_actuator_feature, A> make_actuator_features(const feature_table<A, S>& table)
+{
+    std::array<gble_actuator_feature, A> features{};
+
+    for (size_t idx = 0; idx < A; ++idx)
+    {
+        features[idx].description = table.actuators[idx].description;
+        features[idx].feature_type = table.actuators[idx].feature_type;
+        features[idx].step_range_low = table.actuators[idx].step_range_low;
+        features[idx].step_range_high = table.actuators[idx].step_range_high;
+        features[idx].message_type = table.actuators[idx].message_type;
+        features[idx].id = idx;
+    }
+
+    return features;
+}
+
+template <size_t A, size_t S>
+constexpr std::array<gble_sensor_feature, S> make_sensor_features(const feature_table<A, S>& table)
+{
+    std::array<gble_sensor_feature, S> features{};
+
+    for (size_t idx = 0; idx < S; ++idx)
+    {
+        features[idx].description = table.sensors[idx].description;
+        features[idx].feature_type = table.sensors[idx].feature_type;
+        features[idx].value_range_low = table.sensors[idx].value_range_low;
+        features[idx].value_range_high = table.sensors[idx].value_range_high;
+        features[idx].message_type = table.sensors[idx].message_type;
+        features[idx].id = idx;
+    }
+
+    return features;
+}
+
+template <const auto& Table, size_t A, size_t S>
+bool init_static(gble_server* server,
+                 std::array<gble_actuator_feature, A>& actuators,
+                 std::array<gble_sensor_feature, S>& sensors)
+{
+    static_assert(A == Table.actuators.size() && S == Table.sensors.size(),
+                  "Feature arrays do not match the table");
+
+    using desc = descriptor<Table>;
+
+    return gble_init_static(server, Table.name, desc::bytes.data(), desc::size,
+                            actuators.data(), A, sensors.data(), S);
+}
+
+} // namespace gble
@@ -0,0 +1,434 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "gble_jitter.h"
+
+static const char* TAG = "GbleJitter";
+
+// A transit this far from the estimate means the client clock jumped
+#define GBLE_JITTER_RESYNC_US 2000000
+
+// The estimate follows a shorter transit at once, a longer one by this
+// fraction per command, so it tracks clock drift without chasing jitter
+#define GBLE_JITTER_OFFSET_RISE_SHIFT 10
+
+static void gble_jitter_command_cb(int32_t opcode, CborValue* args, size_t arg_count, void* context);
+
+static void gble_jitter_timer_cb(void* arg)
+{
+    gble_jitter_tick((gble_jitter_buffer*)arg);
+}
+
+static void gble_jitter_lock(gble_jitter_buffer* buffer)
+{
+    xSemaphoreTake(buffer->lock, portMAX_DELAY);
+}
+
+static void gble_jitter_unlock(gble_jitter_buffer* buffer)
+{
+    xSemaphoreGive(buffer->lock);
+}
+
+bool gble_jitter_start(gble_jitter_buffer* buffer, gble_server* server,
+                       uint32_t tick_hz, uint32_t depth_ms)
+{
+    if (server->actuator_count > CONFIG_GBLE_JITTER_MAX_ACTUATORS)
+    {
+        ESP_LOGE(TAG, "%zu actuators, at most %d supported",
+                 server->actuator_count, CONFIG_GBLE_JITTER_MAX_ACTUATORS);
+        return false;
+    }
+
+    if (tick_hz == 0 || tick_hz > 1000000)
+    {
+        ESP_LOGE(TAG, "Invalid tick rate %" PRIu32 " Hz", tick_hz);
+        return false;
+    }
+
+    memset(buffer, 0, sizeof(*buffer));
+    buffer->server = server;
+    buffer->tick_hz = tick_hz;
+    buffer->depth_us = (int64_t)depth_ms * 1000;
+
+    buffer->lock = xSemaphoreCreateMutex();
+    if (!buffer->lock)
+    {
+        ESP_LOGE(TAG, "Failed to create lock");
+        return false;
+    }
+
+    if (!gble_register_command(server, GBLE_COMMAND_TIMED, gble_jitter_command_cb, buffer))
+    {
+        return false;
+    }
+
+    server->jitter = buffer;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = gble_jitter_timer_cb,
+        .arg = buffer,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "gble_jitter",
+        .skip_unhandled_events = true,
+    };
+
+    if (esp_timer_create(&timer_args, &buffer->timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create tick timer");
+        return false;
+    }
+
+    if (esp_timer_start_periodic(buffer->timer, 1000000 / tick_hz) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start tick timer");
+        esp_timer_delete(buffer->timer);
+        buffer->timer = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void gble_jitter_stop(gble_jitter_buffer* buffer)
+{
+    if (buffer->timer)
+    {
+        esp_timer_stop(buffer->timer);
+        esp_timer_delete(buffer->timer);
+        buffer->timer = NULL;
+    }
+}
+
+void gble_jitter_set_depth(gble_jitter_buffer* buffer, uint32_t depth_ms)
+{
+    gble_jitter_lock(buffer);
+    buffer->depth_us = (int64_t)depth_ms * 1000;
+    gble_jitter_unlock(buffer);
+}
+
+void gble_jitter_set_clock_offset(gble_jitter_buffer* buffer, gble_client_id client,
+                                  int64_t offset_us, int64_t at_us, int32_t drift_ppb)
+{
+    gble_jitter_lock(buffer);
+    buffer->synced = true;
+    buffer->sync_client = client;
+    buffer->sync_offset_us = offset_us;
+    buffer->sync_at_us = at_us;
+    buffer->sync_drift_ppb = drift_ppb;
+    gble_jitter_unlock(buffer);
+}
+
+void gble_jitter_clear_clock_offset(gble_jitter_buffer* buffer)
+{
+    gble_jitter_lock(buffer);
+    buffer->synced = false;
+    gble_jitter_unlock(buffer);
+}
+
+// Synced client time in microseconds to device time, as
+// gble_time_sync_to_device_us does
+static int64_t gble_jitter_synced_to_device_us(const gble_jitter_buffer* buffer, int64_t client_us)
+{
+    const int64_t device_us = client_us + buffer->sync_offset_us;
+    return device_us + (device_us - buffer->sync_at_us) * buffer->sync_drift_ppb / 1000000000;
+}
+
+// Device time of a synced timestamp, unwrapped to the synced clock's ms
+// closest to now
+static int64_t gble_jitter_synced_timestamp_us(const gble_jitter_buffer* buffer, uint32_t timestamp_ms, int64_t now_us)
+{
+    const int64_t drift_us = (now_us - buffer->sync_at_us) * buffer->sync_drift_ppb / 1000000000;
+    const int64_t client_now_ms = (now_us - buffer->sync_offset_us - drift_us) / 1000;
+    const int64_t client_ms = client_now_ms + (int32_t)(timestamp_ms - (uint32_t)client_now_ms);
+
+    return gble_jitter_synced_to_device_us(buffer, client_ms * 1000);
+}
+
+static int64_t gble_jitter_extend_timestamp(gble_jitter_buffer* buffer, uint32_t timestamp_ms)
+{
+    if (!buffer->timestamps_started)
+    {
+        buffer->last_timestamp_ext_ms = timestamp_ms;
+        buffer->timestamps_started = true;
+    }
+    else
+    {
+        buffer->last_timestamp_ext_ms += (int32_t)(timestamp_ms - buffer->last_timestamp_ms);
+    }
+
+    buffer->last_timestamp_ms = timestamp_ms;
+    return buffer->last_timestamp_ext_ms;
+}
+
+static void gble_jitter_update_offset(gble_jitter_buffer* buffer, int64_t transit_us)
+{
+    if (!buffer->offset_valid)
+    {
+        buffer->offset_us = transit_us;
+        buffer->offset_valid = true;
+        return;
+    }
+
+    const int64_t delta_us = transit_us - buffer->offset_us;
+
+    if (delta_us > GBLE_JITTER_RESYNC_US || delta_us < -GBLE_JITTER_RESYNC_US)
+    {
+        buffer->offset_us = transit_us;
+        ++buffer->stats.resyncs;
+    }
+    else if (delta_us < 0)
+    {
+        buffer->offset_us = transit_us;
+    }
+    else
+    {
+        buffer->offset_us += delta_us >> GBLE_JITTER_OFFSET_RISE_SHIFT;
+    }
+}
+
+// Removes and returns the first entry
+static struct gble_jitter_entry gble_jitter_pop(struct gble_jitter_queue* queue)
+{
+    const struct gble_jitter_entry entry = queue->entries[0];
+
+    --queue->count;
+    memmove(&queue->entries[0], &queue->entries[1], queue->count * sizeof(queue->entries[0]));
+
+    return entry;
+}
+
+// Releases commands in runs from the same client, each merged as its own
+static void gble_jitter_release(gble_jitter_buffer* buffer, gble_actuator_command* commands,
+                                const gble_client_id* clients, size_t command_count)
+{
+    size_t start = 0;
+
+    for (size_t idx = 1; idx <= command_count; ++idx)
+    {
+        if (idx == command_count || clients[idx] != clients[start])
+        {
+            gble_submit_actuator_commands(buffer->server, clients[start], &commands[start], idx - start);
+            start = idx;
+        }
+    }
+}
+
+static bool gble_jitter_queue_commands(gble_jitter_buffer* buffer, gble_client_id client, uint32_t timestamp_ms,
+                                       const gble_actuator_command* commands, size_t command_count)
+{
+    gble_actuator_command overflow[GBLE_MAX_ACTUATOR_BATCH];
+    gble_client_id overflow_clients[GBLE_MAX_ACTUATOR_BATCH];
+    size_t overflow_count = 0;
+
+    if (command_count > GBLE_MAX_ACTUATOR_BATCH)
+    {
+        ESP_LOGE(TAG, "Too many commands, got: %zu", command_count);
+        return false;
+    }
+
+    for (size_t idx = 0; idx < command_count; ++idx)
+    {
+        if (commands[idx].id >= buffer->server->actuator_count)
+        {
+            ESP_LOGE(TAG, "Invalid actuator id %" PRIu32, commands[idx].id);
+            return false;
+        }
+    }
+
+    const int64_t now_us = esp_timer_get_time();
+
+    gble_jitter_lock(buffer);
+
+    int64_t due_us;
+    if (buffer->synced && client == buffer->sync_client)
+    {
+        due_us = gble_jitter_synced_timestamp_us(buffer, timestamp_ms, now_us) + buffer->depth_us;
+    }
+    else
+    {
+        const int64_t timestamp_us = gble_jitter_extend_timestamp(buffer, timestamp_ms) * 1000;
+        gble_jitter_update_offset(buffer, now_us - timestamp_us);
+
+        due_us = timestamp_us + buffer->offset_us + buffer->depth_us;
+    }
+
+    for (size_t idx = 0; idx < command_count; ++idx)
+    {
+        struct gble_jitter_queue* queue = &buffer->queues[commands[idx].id];
+
+        if (due_us < now_us)
+        {
+            ++buffer->stats.late;
+
+            if (queue->count == 0)
+            {
+                ++buffer->stats.underruns;
+            }
+        }
+
+        if (queue->count == CONFIG_GBLE_JITTER_QUEUE_DEPTH)
+        {
+            const struct gble_jitter_entry entry = gble_jitter_pop(queue);
+
+            overflow[overflow_count] = entry.command;
+            overflow_clients[overflow_count++] = entry.client;
+            ++buffer->stats.overflows;
+        }
+
+        // After everything due at the same time or earlier, so equal
+        // timestamps keep their order
+        size_t pos = queue->count;
+        while (pos > 0 && queue->entries[pos - 1].due_us > due_us)
+        {
+            queue->entries[pos] = queue->entries[pos - 1];
+            --pos;
+        }
+
+        queue->entries[pos].due_us = due_us;
+        queue->entries[pos].command = commands[idx];
+        queue->entries[pos].client = client;
+        ++queue->count;
+
+        ++buffer->stats.queued;
+        if (queue->count > buffer->stats.queue_high_water)
+        {
+            buffer->stats.queue_high_water = queue->count;
+        }
+    }
+
+    gble_jitter_unlock(buffer);
+
+    gble_jitter_release(buffer, overflow, overflow_clients, overflow_count);
+
+    return true;
+}
+
+bool gble_jitter_submit(gble_jitter_buffer* buffer, uint32_t timestamp_ms,
+                        const gble_actuator_command* commands, size_t command_count)
+{
+    return gble_jitter_queue_commands(buffer, GBLE_CLIENT_LOCAL, timestamp_ms, commands, command_count);
+}
+
+void gble_jitter_drop_client(gble_jitter_buffer* buffer, gble_client_id client)
+{
+    gble_jitter_lock(buffer);
+
+    for (size_t idx = 0; idx < buffer->server->actuator_count; ++idx)
+    {
+        struct gble_jitter_queue* queue = &buffer->queues[idx];
+        size_t kept = 0;
+
+        for (size_t pos = 0; pos < queue->count; ++pos)
+        {
+            if (queue->entries[pos].client != client)
+            {
+                queue->entries[kept++] = queue->entries[pos];
+            }
+        }
+
+        buffer->stats.dropped += queue->count - kept;
+        queue->count = kept;
+    }
+
+    if (buffer->synced && buffer->sync_client == client)
+    {
+        buffer->synced = false;
+    }
+
+    gble_jitter_unlock(buffer);
+}
+
+void gble_jitter_tick(gble_jitter_buffer* buffer)
+{
+    gble_actuator_command due[GBLE_MAX_ACTUATOR_BATCH];
+    gble_client_id due_clients[GBLE_MAX_ACTUATOR_BATCH];
+    size_t due_count;
+
+    // In passes of at most one batch, so callbacks never run under the lock
+    do
+    {
+        due_count = 0;
+
+        const int64_t now_us = esp_timer_get_time();
+
+        gble_jitter_lock(buffer);
+
+        for (size_t idx = 0; idx < buffer->server->actuator_count && due_count < COUNT_OF(due); ++idx)
+        {
+            struct gble_jitter_queue* queue = &buffer->queues[idx];
+
+            while (queue->count > 0 && queue->entries[0].due_us <= now_us && due_count < COUNT_OF(due))
+            {
+                const struct gble_jitter_entry entry = gble_jitter_pop(queue);
+                const uint32_t error_us = (uint32_t)(now_us - entry.due_us);
+
+                due[due_count] = entry.command;
+                due_clients[due_count++] = entry.client;
+
+                ++buffer->stats.released;
+                buffer->stats.release_error_us_total += error_us;
+                if (error_us > buffer->stats.release_error_us_max)
+                {
+                    buffer->stats.release_error_us_max = error_us;
+                }
+            }
+        }
+
+        gble_jitter_unlock(buffer);
+
+        gble_jitter_release(buffer, due, due_clients, due_count);
+    } while (due_count == COUNT_OF(due));
+}
+
+void gble_jitter_get_stats(gble_jitter_buffer* buffer, gble_jitter_stats* stats)
+{
+    gble_jitter_lock(buffer);
+    *stats = buffer->stats;
+    gble_jitter_unlock(buffer);
+}
+
+static void gble_jitter_command_cb(int32_t opcode, CborValue* args, size_t arg_count, void* context)
+{
+    gble_jitter_buffer* buffer = (gble_jitter_buffer*)context;
+
+    uint64_t timestamp_ms;
+    if (arg_count != 2 ||
+        !cbor_value_is_unsigned_integer(args) ||
+        cbor_value_get_uint64(args, &timestamp_ms) != CborNoError ||
+        timestamp_ms > UINT32_MAX ||
+        cbor_value_advance_fixed(args) != CborNoError)
+    {
+        ESP_LOGE(TAG, "Expected [timestamp_ms, message] with a uint32 timestamp");
+        return;
+    }
+
+    gble_actuator_command commands[GBLE_MAX_ACTUATOR_BATCH];
+    const size_t command_count = gble_parse_actuator_message(buffer->server, args, commands);
+
+    if (command_count)
+    {
+        gble_jitter_queue_commands(buffer, buffer->server->command_client, (uint32_t)timestamp_ms,
+                                   commands, command_count);
+    }
+}
@@ -0,0 +1,161 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+// Jitter buffer for timestamped actuator commands. Connection events batch
+// writes, so a steady stream from the client arrives in bursts; a command
+// sent as
+//
+//   [-8, timestamp_ms, message]
+//
+// where message is any actuator message, single or batch, is held per
+// actuator and released by a periodic esp_timer tick at its scheduled time
+// instead of on arrival.
+//
+// timestamp_ms is a uint32 that may wrap. From a client without a clock
+// sync it is on any clock: it is unwrapped from the first such command on
+// and maps to the device clock through the smallest transit seen so far.
+// From the client gble_jitter_set_clock_offset has the gble_time_sync
+// estimate for, it is the low 32 bits of its synced clock in milliseconds
+// (its microseconds / 1000), unwrapped to the value nearest the device's
+// view of that clock and mapped with the offset and drift, so several
+// devices share one schedule. The sync ends when that client disconnects.
+// Each command is released at its device time plus depth, the playout
+// delay the buffer absorbs.
+//
+// A command that is already due on arrival is late and released on the next
+// tick; if its actuator had nothing queued, the buffer ran dry and that is
+// an underrun too. Released commands go through the arbiter as their
+// sender's, and through the actuator task when one runs, in order with
+// writes, else run the callbacks on the esp_timer task; either way they
+// update last_value like a write would. A client's commands still queued
+// when it disconnects are dropped.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "generic_btle.h"
+
+struct gble_jitter_entry {
+    int64_t due_us;
+    gble_actuator_command command;
+    // Sender, whom the arbiter merges the command for on release
+    gble_client_id client;
+};
+
+// Ordered by due time
+struct gble_jitter_queue {
+    struct gble_jitter_entry entries[CONFIG_GBLE_JITTER_QUEUE_DEPTH];
+    uint8_t count;
+};
+
+struct gble_jitter_stats {
+    uint32_t queued;
+    uint32_t released;
+    // Due on arrival
+    uint32_t late;
+    // Late with nothing queued for the actuator
+    uint32_t underruns;
+    // Released early because the actuator's queue was full
+    uint32_t overflows;
+    // Dropped because their client disconnected
+    uint32_t dropped;
+    // Offset reset after a client clock jump
+    uint32_t resyncs;
+    uint32_t queue_high_water;
+
+    // Release time past due time, in microseconds
+    uint32_t release_error_us_max;
+    uint64_t release_error_us_total;
+};
+typedef struct gble_jitter_stats gble_jitter_stats;
+
+struct gble_jitter_buffer {
+    gble_server* server;
+    uint32_t tick_hz;
+    esp_timer_handle_t timer;
+    // Held by the tick and by every call below
+    SemaphoreHandle_t lock;
+
+    int64_t depth_us;
+
+    // Device time minus client time, in microseconds, from the transit of
+    // commands from clients without a sync
+    int64_t offset_us;
+    bool offset_valid;
+
+    // From gble_jitter_set_clock_offset, for sync_client only: device time
+    // minus its time as of device time sync_at_us, with the device clock
+    // sync_drift_ppb faster
+    bool synced;
+    gble_client_id sync_client;
+    int64_t sync_offset_us;
+    int64_t sync_at_us;
+    int32_t sync_drift_ppb;
+
+    // Unsynced client timestamps extended past the uint32 wrap
+    bool timestamps_started;
+    uint32_t last_timestamp_ms;
+    int64_t last_timestamp_ext_ms;
+
+    struct gble_jitter_queue queues[CONFIG_GBLE_JITTER_MAX_ACTUATORS];
+
+    gble_jitter_stats stats;
+};
+typedef struct gble_jitter_buffer gble_jitter_buffer;
+
+// Registers GBLE_COMMAND_TIMED with the server and starts the release tick.
+bool gble_jitter_start(gble_jitter_buffer* buffer, gble_server* server,
+                       uint32_t tick_hz, uint32_t depth_ms);
+
+// Only stops the tick: the command stays registered, so the buffer has to
+// outlive the server.
+void gble_jitter_stop(gble_jitter_buffer* buffer);
+
+void gble_jitter_set_depth(gble_jitter_buffer* buffer, uint32_t depth_ms);
+
+// The gble_time_sync estimate for client: device esp_timer time minus its
+// time at device time at_us, and how much faster the device clock runs.
+// Used for client's commands instead of the transit estimate until
+// gble_jitter_clear_clock_offset, or until it disconnects; replaces the
+// sync of any other client.
+void gble_jitter_set_clock_offset(gble_jitter_buffer* buffer, gble_client_id client,
+                                  int64_t offset_us, int64_t at_us, int32_t drift_ppb);
+
+void gble_jitter_clear_clock_offset(gble_jitter_buffer* buffer);
+
+// Schedules commands for release at client time timestamp_ms, as
+// GBLE_CLIENT_LOCAL's. Returns false if they were not queued.
+bool gble_jitter_submit(gble_jitter_buffer* buffer, uint32_t timestamp_ms,
+                        const gble_actuator_command* commands, size_t command_count);
+
+// Drops the client's queued commands and its clock sync; called by
+// gble_client_disconnected.
+void gble_jitter_drop_client(gble_jitter_buffer* buffer, gble_client_id client);
+
+// Releases every due command; the timer callback.
+void gble_jitter_tick(gble_jitter_buffer* buffer);
+
+void gble_jitter_get_stats(gble_jitter_buffer* buffer, gble_jitter_stats* stats);
@@ -0,0 +1,331 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "gble_motion.h"
+
+static const char* TAG = "GbleMotion";
+
+static void gble_motion_timer_cb(void* arg)
+{
+    gble_motion_tick((gble_motion_engine*)arg);
+}
+
+bool gble_motion_start(gble_motion_engine* engine, gble_server* server, uint32_t tick_hz)
+{
+    if (server->actuator_count > CONFIG_GBLE_MOTION_MAX_ACTUATORS)
+    {
+        ESP_LOGE(TAG, "%zu actuators, at most %d supported",
+                 server->actuator_count, CONFIG_GBLE_MOTION_MAX_ACTUATORS);
+        return false;
+    }
+
+    if (tick_hz == 0 || tick_hz > 1000000)
+    {
+        ESP_LOGE(TAG, "Invalid tick rate %" PRIu32 " Hz", tick_hz);
+        return false;
+    }
+
+    memset(engine, 0, sizeof(*engine));
+    engine->server = server;
+    engine->tick_hz = tick_hz;
+
+    for (size_t idx = 0; idx < server->actuator_count; ++idx)
+    {
+        struct gble_motion_channel* channel = &engine->channels[idx];
+
+        atomic_init(&channel->command_seq, 0);
+        channel->position = server->actuators[idx].step_range_low;
+        channel->target = channel->position;
+    }
+
+    engine->submit_lock = xSemaphoreCreateMutex();
+    if (!engine->submit_lock)
+    {
+        ESP_LOGE(TAG, "Failed to create submit lock");
+        return false;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = gble_motion_timer_cb,
+        .arg = engine,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "gble_motion",
+        .skip_unhandled_events = true,
+    };
+
+    if (esp_timer_create(&timer_args, &engine->timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create tick timer");
+        vSemaphoreDelete(engine->submit_lock);
+        engine->submit_lock = NULL;
+        return false;
+    }
+
+    if (esp_timer_start_periodic(engine->timer, 1000000 / tick_hz) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start tick timer");
+        esp_timer_delete(engine->timer);
+        engine->timer = NULL;
+        vSemaphoreDelete(engine->submit_lock);
+        engine->submit_lock = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void gble_motion_stop(gble_motion_engine* engine)
+{
+    if (engine->timer)
+    {
+        esp_timer_stop(engine->timer);
+        esp_timer_delete(engine->timer);
+        engine->timer = NULL;
+    }
+
+    if (engine->submit_lock)
+    {
+        vSemaphoreDelete(engine->submit_lock);
+        engine->submit_lock = NULL;
+    }
+}
+
+bool gble_motion_configure(gble_motion_engine* engine, gble_actuator_id actuator_id,
+                           float max_velocity, float max_accel)
+{
+    if (actuator_id >= engine->server->actuator_count)
+    {
+        ESP_LOGE(TAG, "Invalid actuator id %" PRIu32, actuator_id);
+        return false;
+    }
+
+    if (!(max_velocity > 0) || !(max_accel > 0))
+    {
+        ESP_LOGE(TAG, "Motion limits must be positive");
+        return false;
+    }
+
+    engine->channels[actuator_id].max_velocity = max_velocity;
+    engine->channels[actuator_id].max_accel = max_accel;
+
+    return true;
+}
+
+bool gble_motion_set_output_fn(gble_motion_engine* engine, gble_actuator_id actuator_id,
+                               gble_motion_output_fn* cb, void* cb_context)
+{
+    if (actuator_id >= engine->server->actuator_count)
+    {
+        ESP_LOGE(TAG, "Invalid actuator id %" PRIu32, actuator_id);
+        return false;
+    }
+
+    engine->channels[actuator_id].output_cb = cb;
+    engine->channels[actuator_id].output_cb_context = cb_context;
+
+    return true;
+}
+
+void gble_motion_submit(gble_motion_engine* engine, const gble_actuator_command* command)
+{
+    if (command->id >= engine->server->actuator_count)
+    {
+        return;
+    }
+
+    struct gble_motion_channel* channel = &engine->channels[command->id];
+
+    // One writer at a time: without an actuator task the host task and the
+    // esp_timer task both submit
+    xSemaphoreTake(engine->submit_lock, portMAX_DELAY);
+
+    const unsigned seq = atomic_load_explicit(&channel->command_seq, memory_order_relaxed);
+    atomic_store_explicit(&channel->command_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    channel->command = *command;
+
+    atomic_store_explicit(&channel->command_seq, seq + 2, memory_order_release);
+
+    xSemaphoreGive(engine->submit_lock);
+}
+
+static bool gble_motion_take_command(struct gble_motion_channel* channel, gble_actuator_command* command)
+{
+    const unsigned seq = atomic_load_explicit(&channel->command_seq, memory_order_acquire);
+    if (seq == channel->applied_seq || (seq & 1))
+    {
+        return false;
+    }
+
+    *command = channel->command;
+
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&channel->command_seq, memory_order_relaxed) != seq)
+    {
+        // Overwritten while reading; take the newer one next tick
+        return false;
+    }
+
+    channel->applied_seq = seq;
+    return true;
+}
+
+// Cruise speed for a trapezoid from rest covering `distance` in `duration_s`
+// with acceleration `accel`: distance = v * duration - v^2 / accel. Returns
+// false when no cruise speed within `max_velocity` makes it in time.
+static bool gble_motion_plan_cruise(float distance, float duration_s, float accel,
+                                    float max_velocity, float* cruise)
+{
+    if (duration_s <= 0)
+    {
+        *cruise = max_velocity;
+        return true;
+    }
+
+    const float disc = accel * accel * duration_s * duration_s - 4.0f * accel * distance;
+    if (disc < 0)
+    {
+        // Even a triangle at full acceleration is too slow
+        *cruise = fminf(sqrtf(accel * distance), max_velocity);
+        return false;
+    }
+
+    const float v = (accel * duration_s - sqrtf(disc)) / 2.0f;
+    if (v > max_velocity)
+    {
+        *cruise = max_velocity;
+        return false;
+    }
+
+    *cruise = v;
+    return true;
+}
+
+static void gble_motion_apply_command(gble_motion_engine* engine, gble_actuator_feature* actuator,
+                                      struct gble_motion_channel* channel,
+                                      const gble_actuator_command* command)
+{
+    ++engine->stats.moves;
+
+    if (actuator->message_type == GBLE_ACTUATOR_MSG_ROTATE)
+    {
+        const float speed = fminf((float)command->value, channel->max_velocity);
+        channel->cruise_velocity = command->clockwise ? speed : -speed;
+        return;
+    }
+
+    float target = (float)command->value;
+    target = fmaxf(target, (float)actuator->step_range_low);
+    target = fminf(target, (float)actuator->step_range_high);
+    channel->target = target;
+
+    if (!gble_motion_plan_cruise(fabsf(target - channel->position), command->duration_ms / 1000.0f,
+                                 channel->max_accel, channel->max_velocity, &channel->cruise_velocity))
+    {
+        ++engine->stats.stretched;
+    }
+}
+
+static void gble_motion_step(struct gble_motion_channel* channel, bool rotate, float dt)
+{
+    const float max_dv = channel->max_accel * dt;
+
+    if (rotate)
+    {
+        const float dv = fmaxf(-max_dv, fminf(max_dv, channel->cruise_velocity - channel->velocity));
+        const float velocity = channel->velocity + dv;
+
+        channel->position += (channel->velocity + velocity) * 0.5f * dt;
+        channel->velocity = velocity;
+        return;
+    }
+
+    const float remaining = channel->target - channel->position;
+    const float direction = remaining < 0 ? -1.0f : 1.0f;
+    const float distance = fabsf(remaining);
+    const float toward = channel->velocity * direction;
+
+    // Cruise, but never faster than lets us stop at the target from where
+    // this tick ends up: v^2 = 2a (distance - (v0 + v) dt / 2)
+    const float q = 2.0f * channel->max_accel * distance - max_dv * toward;
+    const float stop_velocity = q > 0 ? (sqrtf(max_dv * max_dv + 4.0f * q) - max_dv) / 2.0f : 0;
+    const float desired = fminf(channel->cruise_velocity, stop_velocity);
+
+    const float dv = fmaxf(-max_dv, fminf(max_dv, desired - toward));
+    const float velocity = toward + dv;
+    const float moved = (toward + velocity) * 0.5f * dt;
+
+    if (moved >= distance && velocity <= max_dv)
+    {
+        // Arrived within this tick
+        channel->position = channel->target;
+        channel->velocity = 0;
+        return;
+    }
+
+    // Trapezoidal integration over the tick
+    channel->position += moved * direction;
+    channel->velocity = velocity * direction;
+}
+
+void gble_motion_tick(gble_motion_engine* engine)
+{
+    const float dt = 1.0f / engine->tick_hz;
+
+    ++engine->stats.ticks;
+
+    for (size_t idx = 0; idx < engine->server->actuator_count; ++idx)
+    {
+        gble_actuator_feature* actuator = &engine->server->actuators[idx];
+        struct gble_motion_channel* channel = &engine->channels[idx];
+
+        if (channel->max_accel <= 0)
+        {
+            continue;
+        }
+
+        gble_actuator_command command;
+        if (gble_motion_take_command(channel, &command))
+        {
+            gble_motion_apply_command(engine, actuator, channel, &command);
+        }
+
+        const float position = channel->position;
+        const float velocity = channel->velocity;
+
+        gble_motion_step(channel, actuator->message_type == GBLE_ACTUATOR_MSG_ROTATE, dt);
+
+        if (channel->output_cb && (channel->position != position || channel->velocity != velocity))
+        {
+            channel->output_cb(idx, channel->position, channel->velocity, channel->output_cb_context);
+        }
+    }
+}
+
+void gble_motion_command_cb(const gble_actuator_command* command, void* context)
+{
+    gble_motion_submit((gble_motion_engine*)context, command);
+}
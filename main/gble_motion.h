@@ -0,0 +1,124 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+// Motion planner for LINEAR and ROTATE actuators. A client sends one command
+// per stroke, [id, position, duration_ms] or [id, speed, clockwise], and a
+// periodic esp_timer samples a velocity and acceleration limited trajectory
+// toward it at a fixed tick:
+//
+//   - LINEAR moves follow a trapezoidal velocity profile: the cruise speed is
+//     chosen so the move takes duration_ms at the configured acceleration,
+//     capped at the configured speed. A new command replans from the current
+//     position and velocity, so reversals stay acceleration limited.
+//   - ROTATE ramps the signed speed (clockwise positive) toward the command
+//     at the configured acceleration.
+//
+// Hook it up as the actuator command callback:
+//
+//   actuator.command_cb = gble_motion_command_cb;
+//   actuator.cb_context = &motion;
+//   gble_motion_start(&motion, &server, CONFIG_GBLE_MOTION_TICK_HZ);
+//   gble_motion_configure(&motion, actuator.id, 400, 4000);
+//   gble_motion_set_output_fn(&motion, actuator.id, set_servo, NULL);
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "generic_btle.h"
+
+// Position in actuator steps for LINEAR (unused for ROTATE) and signed
+// velocity in steps per second
+typedef void gble_motion_output_fn(gble_actuator_id actuator_id, float position,
+                                   float velocity, void* context);
+
+struct gble_motion_channel {
+    float max_velocity;
+    float max_accel;
+
+    gble_motion_output_fn* output_cb;
+    void* output_cb_context;
+
+    // Latest command, published by gble_motion_submit under a sequence
+    // count: odd while being written
+    atomic_uint command_seq;
+    gble_actuator_command command;
+    uint32_t applied_seq;
+
+    // Tick state
+    float position;
+    float velocity;
+    float target;
+    float cruise_velocity;
+};
+
+struct gble_motion_stats {
+    uint32_t ticks;
+    // Commands taken up by the planner
+    uint32_t moves;
+    // LINEAR moves that could not finish in their duration within the limits
+    uint32_t stretched;
+};
+typedef struct gble_motion_stats gble_motion_stats;
+
+struct gble_motion_engine {
+    gble_server* server;
+    uint32_t tick_hz;
+    esp_timer_handle_t timer;
+    // Serializes gble_motion_submit, as the sequence counts allow one
+    // writer; the tick reads without it
+    SemaphoreHandle_t submit_lock;
+
+    struct gble_motion_channel channels[CONFIG_GBLE_MOTION_MAX_ACTUATORS];
+
+    gble_motion_stats stats;
+};
+typedef struct gble_motion_engine gble_motion_engine;
+
+// Starts the tick timer; channels start at rest at their actuator's
+// step_range_low, with no limits set.
+bool gble_motion_start(gble_motion_engine* engine, gble_server* server, uint32_t tick_hz);
+
+void gble_motion_stop(gble_motion_engine* engine);
+
+// Limits in steps per second and steps per second squared.
+bool gble_motion_configure(gble_motion_engine* engine, gble_actuator_id actuator_id,
+                           float max_velocity, float max_accel);
+
+bool gble_motion_set_output_fn(gble_motion_engine* engine, gble_actuator_id actuator_id,
+                               gble_motion_output_fn* cb, void* cb_context);
+
+// Safe from any task, such as the host task, the actuator task or timed
+// command and pattern releases on the esp_timer task; writers take turns on
+// a mutex. The planner picks the command up on its next tick.
+void gble_motion_submit(gble_motion_engine* engine, const gble_actuator_command* command);
+
+// Advances every channel by one tick; the timer callback.
+void gble_motion_tick(gble_motion_engine* engine);
+
+// gble_actuator_command_callback_fn for actuators driven by the planner; the
+// context is the engine.
+void gble_motion_command_cb(const gble_actuator_command* command, void* context);
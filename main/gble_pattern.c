@@ -0,0 +1,858 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "gble_pattern.h"
+
+static const char* TAG = "GblePattern";
+
+#define GBLE_PATTERN_NVS_NAMESPACE "gble_pattern"
+
+#define GBLE_PATTERN_MAX_UPLOAD (CONFIG_GBLE_PATTERN_MAX_KEYFRAMES * GBLE_PATTERN_KEYFRAME_SIZE)
+
+static const int32_t gble_pattern_opcodes[] = {
+    GBLE_COMMAND_PATTERN_UPLOAD,
+    GBLE_COMMAND_PATTERN_PLAY,
+    GBLE_COMMAND_PATTERN_STOP,
+    GBLE_COMMAND_PATTERN_SPEED,
+    GBLE_COMMAND_PATTERN_INTENSITY,
+    GBLE_COMMAND_PATTERN_SAVE,
+    GBLE_COMMAND_PATTERN_DELETE,
+};
+
+static void gble_pattern_command_cb(int32_t opcode, CborValue* args, size_t arg_count, void* context);
+
+static void gble_pattern_timer_cb(void* arg)
+{
+    gble_pattern_tick((gble_pattern_engine*)arg);
+}
+
+static void gble_pattern_lock(gble_pattern_engine* engine)
+{
+    xSemaphoreTake(engine->lock, portMAX_DELAY);
+}
+
+static void gble_pattern_unlock(gble_pattern_engine* engine)
+{
+    xSemaphoreGive(engine->lock);
+}
+
+bool gble_pattern_start(gble_pattern_engine* engine, gble_server* server, uint32_t tick_hz)
+{
+    if (server->actuator_count > CONFIG_GBLE_PATTERN_MAX_ACTUATORS)
+    {
+        ESP_LOGE(TAG, "%zu actuators, at most %d supported",
+                 server->actuator_count, CONFIG_GBLE_PATTERN_MAX_ACTUATORS);
+        return false;
+    }
+
+    if (tick_hz == 0 || tick_hz > 1000000)
+    {
+        ESP_LOGE(TAG, "Invalid tick rate %" PRIu32 " Hz", tick_hz);
+        return false;
+    }
+
+    memset(engine, 0, sizeof(*engine));
+    engine->server = server;
+    engine->tick_hz = tick_hz;
+
+    for (size_t idx = 0; idx < CONFIG_GBLE_PATTERN_MAX_ACTUATORS; ++idx)
+    {
+        engine->playbacks[idx].speed_percent = 100;
+        engine->playbacks[idx].intensity_percent = 100;
+    }
+
+    engine->lock = xSemaphoreCreateMutex();
+    if (!engine->lock)
+    {
+        ESP_LOGE(TAG, "Failed to create lock");
+        return false;
+    }
+
+#if CONFIG_GBLE_PATTERN_NVS
+    if (nvs_open(GBLE_PATTERN_NVS_NAMESPACE, NVS_READWRITE, &engine->nvs) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to open NVS namespace %s", GBLE_PATTERN_NVS_NAMESPACE);
+        return false;
+    }
+#endif
+
+    for (size_t idx = 0; idx < COUNT_OF(gble_pattern_opcodes); ++idx)
+    {
+        if (!gble_register_command(server, gble_pattern_opcodes[idx], gble_pattern_command_cb, engine))
+        {
+            return false;
+        }
+    }
+
+    server->patterns = engine;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = gble_pattern_timer_cb,
+        .arg = engine,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "gble_pattern",
+        .skip_unhandled_events = true,
+    };
+
+    if (esp_timer_create(&timer_args, &engine->timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create tick timer");
+        return false;
+    }
+
+    if (esp_timer_start_periodic(engine->timer, 1000000 / tick_hz) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start tick timer");
+        esp_timer_delete(engine->timer);
+        engine->timer = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+// Only stops the tick: the commands stay registered, so the engine has to
+// outlive the server.
+void gble_pattern_stop(gble_pattern_engine* engine)
+{
+    if (engine->timer)
+    {
+        esp_timer_stop(engine->timer);
+        esp_timer_delete(engine->timer);
+        engine->timer = NULL;
+    }
+}
+
+static struct gble_pattern_slot* gble_pattern_find(gble_pattern_engine* engine, uint32_t pattern_id)
+{
+    for (size_t idx = 0; idx < CONFIG_GBLE_PATTERN_POOL_SIZE; ++idx)
+    {
+        if (engine->pool[idx].used && engine->pool[idx].pattern_id == pattern_id)
+        {
+            return &engine->pool[idx];
+        }
+    }
+
+    return NULL;
+}
+
+static bool gble_pattern_slot_playing(gble_pattern_engine* engine, const struct gble_pattern_slot* slot)
+{
+    for (size_t idx = 0; idx < engine->server->actuator_count; ++idx)
+    {
+        if (engine->playbacks[idx].slot == slot)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// The same slot for a known id, else a free one, else the least recently
+// used that is not playing.
+static struct gble_pattern_slot* gble_pattern_pick_slot(gble_pattern_engine* engine, uint32_t pattern_id)
+{
+    struct gble_pattern_slot* slot = gble_pattern_find(engine, pattern_id);
+    if (slot)
+    {
+        return slot;
+    }
+
+    struct gble_pattern_slot* lru = NULL;
+
+    for (size_t idx = 0; idx < CONFIG_GBLE_PATTERN_POOL_SIZE; ++idx)
+    {
+        slot = &engine->pool[idx];
+
+        if (!slot->used)
+        {
+            return slot;
+        }
+
+        if (!gble_pattern_slot_playing(engine, slot) &&
+            (!lru || (int32_t)(slot->last_used - lru->last_used) < 0))
+        {
+            lru = slot;
+        }
+    }
+
+    if (lru)
+    {
+        ++engine->stats.evictions;
+    }
+
+    return lru;
+}
+
+static bool gble_pattern_decode(const uint8_t* keyframes, size_t keyframes_size,
+                                struct gble_pattern_slot* slot)
+{
+    if (keyframes_size == 0 || keyframes_size % GBLE_PATTERN_KEYFRAME_SIZE != 0 ||
+        keyframes_size > GBLE_PATTERN_MAX_UPLOAD)
+    {
+        ESP_LOGE(TAG, "Invalid keyframes size %zu", keyframes_size);
+        return false;
+    }
+
+    uint32_t at_ms = 0;
+
+    slot->keyframe_count = keyframes_size / GBLE_PATTERN_KEYFRAME_SIZE;
+
+    for (size_t idx = 0; idx < slot->keyframe_count; ++idx)
+    {
+        const uint8_t* keyframe = &keyframes[idx * GBLE_PATTERN_KEYFRAME_SIZE];
+
+        at_ms += ((uint32_t)keyframe[0] << 8) | keyframe[1];
+
+        slot->keyframes[idx].at_ms = at_ms;
+        slot->keyframes[idx].level = keyframe[2];
+    }
+
+    if (at_ms == 0)
+    {
+        ESP_LOGE(TAG, "Pattern has no duration");
+        return false;
+    }
+
+    return true;
+}
+
+static size_t gble_pattern_encode(const struct gble_pattern_slot* slot, uint8_t* keyframes)
+{
+    uint32_t at_ms = 0;
+
+    for (size_t idx = 0; idx < slot->keyframe_count; ++idx)
+    {
+        const uint32_t delta_ms = slot->keyframes[idx].at_ms - at_ms;
+        uint8_t* keyframe = &keyframes[idx * GBLE_PATTERN_KEYFRAME_SIZE];
+
+        keyframe[0] = (uint8_t)(delta_ms >> 8);
+        keyframe[1] = (uint8_t)delta_ms;
+        keyframe[2] = slot->keyframes[idx].level;
+
+        at_ms = slot->keyframes[idx].at_ms;
+    }
+
+    return slot->keyframe_count * GBLE_PATTERN_KEYFRAME_SIZE;
+}
+
+static bool gble_pattern_store(gble_pattern_engine* engine, uint32_t pattern_id,
+                               const uint8_t* keyframes, size_t keyframes_size, bool from_nvs)
+{
+    struct gble_pattern_slot decoded;
+    if (!gble_pattern_decode(keyframes, keyframes_size, &decoded))
+    {
+        return false;
+    }
+
+    gble_pattern_lock(engine);
+
+    struct gble_pattern_slot* slot = gble_pattern_pick_slot(engine, pattern_id);
+    if (!slot)
+    {
+        ++engine->stats.pool_full;
+        gble_pattern_unlock(engine);
+
+        ESP_LOGE(TAG, "No room for pattern %" PRIu32 ", every stored pattern is playing", pattern_id);
+        return false;
+    }
+
+    memcpy(slot->keyframes, decoded.keyframes, decoded.keyframe_count * sizeof(decoded.keyframes[0]));
+    slot->keyframe_count = decoded.keyframe_count;
+    slot->pattern_id = pattern_id;
+    slot->used = true;
+    slot->last_used = ++engine->use_counter;
+
+    // Playbacks of a replaced pattern carry on from the same position
+    for (size_t idx = 0; idx < engine->server->actuator_count; ++idx)
+    {
+        if (engine->playbacks[idx].slot == slot)
+        {
+            engine->playbacks[idx].cursor = 0;
+        }
+    }
+
+    if (from_nvs)
+    {
+        ++engine->stats.nvs_loads;
+    }
+    else
+    {
+        ++engine->stats.uploads;
+    }
+
+    gble_pattern_unlock(engine);
+
+    return true;
+}
+
+bool gble_pattern_upload(gble_pattern_engine* engine, uint32_t pattern_id,
+                         const uint8_t* keyframes, size_t keyframes_size)
+{
+    return gble_pattern_store(engine, pattern_id, keyframes, keyframes_size, false);
+}
+
+#if CONFIG_GBLE_PATTERN_NVS
+static void gble_pattern_nvs_key(uint32_t pattern_id, char* key, size_t key_size)
+{
+    snprintf(key, key_size, "p%lu", (unsigned long)pattern_id);
+}
+
+static bool gble_pattern_load(gble_pattern_engine* engine, uint32_t pattern_id)
+{
+    char key[16];
+    gble_pattern_nvs_key(pattern_id, key, sizeof(key));
+
+    uint8_t keyframes[GBLE_PATTERN_MAX_UPLOAD];
+    size_t keyframes_size = sizeof(keyframes);
+
+    if (nvs_get_blob(engine->nvs, key, keyframes, &keyframes_size) != ESP_OK)
+    {
+        return false;
+    }
+
+    return gble_pattern_store(engine, pattern_id, keyframes, keyframes_size, true);
+}
+#endif
+
+// Ends playback; fills command and returns 1 if the actuator has to go back
+// to its last written value, which the caller outputs after unlocking
+static size_t gble_pattern_restore(gble_pattern_engine* engine, gble_actuator_id actuator_id,
+                                   struct gble_pattern_playback* playback,
+                                   gble_actuator_command* command, gble_client_id* client)
+{
+    const gble_actuator_feature* actuator = &engine->server->actuators[actuator_id];
+    size_t count = 0;
+
+    if (playback->output_valid && playback->output != actuator->last_value)
+    {
+        command->id = actuator_id;
+        command->value = actuator->last_value;
+        command->duration_ms = 0;
+        command->clockwise = actuator->last_clockwise;
+        *client = playback->client;
+
+        ++engine->stats.outputs;
+        count = 1;
+    }
+
+    playback->slot = NULL;
+
+    return count;
+}
+
+// Callbacks never run under the engine lock, and go through the arbiter and
+// the actuator task when there are; in runs from the same client
+static void gble_pattern_output(gble_pattern_engine* engine, gble_actuator_command* commands,
+                                const gble_client_id* clients, size_t command_count)
+{
+    size_t start = 0;
+
+    for (size_t idx = 1; idx <= command_count; ++idx)
+    {
+        if (idx == command_count || clients[idx] != clients[start])
+        {
+            gble_output_actuator_commands(engine->server, clients[start], &commands[start], idx - start);
+            start = idx;
+        }
+    }
+}
+
+static bool gble_pattern_start_playback(gble_pattern_engine* engine, gble_client_id client,
+                                        gble_actuator_id actuator_id, uint32_t pattern_id, uint32_t loops)
+{
+    if (actuator_id >= engine->server->actuator_count)
+    {
+        ESP_LOGE(TAG, "Invalid actuator id %" PRIu32, actuator_id);
+        return false;
+    }
+
+#if CONFIG_GBLE_PATTERN_NVS
+    gble_pattern_lock(engine);
+    const bool in_pool = gble_pattern_find(engine, pattern_id) != NULL;
+    gble_pattern_unlock(engine);
+
+    // Flash reads stay outside the lock, so the tick never waits on them
+    if (!in_pool)
+    {
+        gble_pattern_load(engine, pattern_id);
+    }
+#endif
+
+    gble_pattern_lock(engine);
+
+    struct gble_pattern_slot* slot = gble_pattern_find(engine, pattern_id);
+    if (!slot)
+    {
+        gble_pattern_unlock(engine);
+
+        ESP_LOGE(TAG, "Unknown pattern %" PRIu32, pattern_id);
+        return false;
+    }
+
+    struct gble_pattern_playback* playback = &engine->playbacks[actuator_id];
+
+    playback->slot = slot;
+    playback->client = client;
+    playback->loops_left = loops;
+    playback->forever = loops == 0;
+    playback->position_us = 0;
+    playback->cursor = 0;
+    playback->written_value = engine->server->actuators[actuator_id].last_value;
+    playback->output_valid = false;
+
+    slot->last_used = ++engine->use_counter;
+    ++engine->stats.plays;
+
+    gble_pattern_unlock(engine);
+
+    return true;
+}
+
+bool gble_pattern_play(gble_pattern_engine* engine, gble_actuator_id actuator_id,
+                       uint32_t pattern_id, uint32_t loops)
+{
+    return gble_pattern_start_playback(engine, GBLE_CLIENT_LOCAL, actuator_id, pattern_id, loops);
+}
+
+bool gble_pattern_stop_playback(gble_pattern_engine* engine, gble_actuator_id actuator_id)
+{
+    if (actuator_id >= engine->server->actuator_count)
+    {
+        ESP_LOGE(TAG, "Invalid actuator id %" PRIu32, actuator_id);
+        return false;
+    }
+
+    gble_actuator_command command;
+    gble_client_id client;
+    size_t command_count = 0;
+
+    gble_pattern_lock(engine);
+
+    struct gble_pattern_playback* playback = &engine->playbacks[actuator_id];
+    if (playback->slot)
+    {
+        command_count = gble_pattern_restore(engine, actuator_id, playback, &command, &client);
+        ++engine->stats.stopped;
+    }
+
+    gble_pattern_unlock(engine);
+
+    gble_pattern_output(engine, &command, &client, command_count);
+
+    return true;
+}
+
+bool gble_pattern_set_speed(gble_pattern_engine* engine, gble_actuator_id actuator_id,
+                            uint32_t speed_percent)
+{
+    if (actuator_id >= engine->server->actuator_count)
+    {
+        ESP_LOGE(TAG, "Invalid actuator id %" PRIu32, actuator_id);
+        return false;
+    }
+
+    if (speed_percent < GBLE_PATTERN_SPEED_MIN || speed_percent > GBLE_PATTERN_SPEED_MAX)
+    {
+        ESP_LOGE(TAG, "Speed %" PRIu32 "%% out of range", speed_percent);
+        return false;
+    }
+
+    gble_pattern_lock(engine);
+    engine->playbacks[actuator_id].speed_percent = speed_percent;
+    gble_pattern_unlock(engine);
+
+    return true;
+}
+
+bool gble_pattern_set_intensity(gble_pattern_engine* engine, gble_actuator_id actuator_id,
+                                uint32_t intensity_percent)
+{
+    if (actuator_id >= engine->server->actuator_count)
+    {
+        ESP_LOGE(TAG, "Invalid actuator id %" PRIu32, actuator_id);
+        return false;
+    }
+
+    if (intensity_percent > 100)
+    {
+        ESP_LOGE(TAG, "Intensity %" PRIu32 "%% out of range", intensity_percent);
+        return false;
+    }
+
+    gble_pattern_lock(engine);
+    engine->playbacks[actuator_id].intensity_percent = intensity_percent;
+    gble_pattern_unlock(engine);
+
+    return true;
+}
+
+bool gble_pattern_save(gble_pattern_engine* engine, uint32_t pattern_id)
+{
+#if CONFIG_GBLE_PATTERN_NVS
+    uint8_t keyframes[GBLE_PATTERN_MAX_UPLOAD];
+    size_t keyframes_size = 0;
+
+    gble_pattern_lock(engine);
+
+    const struct gble_pattern_slot* slot = gble_pattern_find(engine, pattern_id);
+    if (slot)
+    {
+        keyframes_size = gble_pattern_encode(slot, keyframes);
+    }
+
+    gble_pattern_unlock(engine);
+
+    if (!slot)
+    {
+        ESP_LOGE(TAG, "Unknown pattern %" PRIu32, pattern_id);
+        return false;
+    }
+
+    char key[16];
+    gble_pattern_nvs_key(pattern_id, key, sizeof(key));
+
+    if (nvs_set_blob(engine->nvs, key, keyframes, keyframes_size) != ESP_OK ||
+        nvs_commit(engine->nvs) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to save pattern %" PRIu32, pattern_id);
+        return false;
+    }
+
+    gble_pattern_lock(engine);
+    ++engine->stats.nvs_saves;
+    gble_pattern_unlock(engine);
+
+    return true;
+#else
+    ESP_LOGE(TAG, "Pattern library disabled, enable CONFIG_GBLE_PATTERN_NVS");
+    return false;
+#endif
+}
+
+bool gble_pattern_delete(gble_pattern_engine* engine, uint32_t pattern_id)
+{
+    gble_actuator_command commands[CONFIG_GBLE_PATTERN_MAX_ACTUATORS];
+    gble_client_id clients[CONFIG_GBLE_PATTERN_MAX_ACTUATORS];
+    size_t command_count = 0;
+
+    gble_pattern_lock(engine);
+
+    struct gble_pattern_slot* slot = gble_pattern_find(engine, pattern_id);
+    bool found = slot != NULL;
+
+    if (slot)
+    {
+        for (size_t idx = 0; idx < engine->server->actuator_count; ++idx)
+        {
+            if (engine->playbacks[idx].slot == slot)
+            {
+                command_count += gble_pattern_restore(engine, idx, &engine->playbacks[idx],
+                                                      &commands[command_count], &clients[command_count]);
+                ++engine->stats.stopped;
+            }
+        }
+
+        slot->used = false;
+    }
+
+    gble_pattern_unlock(engine);
+
+    gble_pattern_output(engine, commands, clients, command_count);
+
+#if CONFIG_GBLE_PATTERN_NVS
+    char key[16];
+    gble_pattern_nvs_key(pattern_id, key, sizeof(key));
+
+    if (nvs_erase_key(engine->nvs, key) == ESP_OK)
+    {
+        nvs_commit(engine->nvs);
+        found = true;
+    }
+#endif
+
+    if (!found)
+    {
+        ESP_LOGE(TAG, "Unknown pattern %" PRIu32, pattern_id);
+    }
+
+    return found;
+}
+
+bool gble_pattern_is_playing(gble_pattern_engine* engine, gble_actuator_id actuator_id)
+{
+    if (actuator_id >= engine->server->actuator_count)
+    {
+        return false;
+    }
+
+    gble_pattern_lock(engine);
+    const bool playing = engine->playbacks[actuator_id].slot != NULL;
+    gble_pattern_unlock(engine);
+
+    return playing;
+}
+
+void gble_pattern_drop_client(gble_pattern_engine* engine, gble_client_id client)
+{
+    gble_actuator_command commands[CONFIG_GBLE_PATTERN_MAX_ACTUATORS];
+    gble_client_id clients[CONFIG_GBLE_PATTERN_MAX_ACTUATORS];
+    size_t command_count = 0;
+
+    gble_pattern_lock(engine);
+
+    for (size_t idx = 0; idx < engine->server->actuator_count; ++idx)
+    {
+        struct gble_pattern_playback* playback = &engine->playbacks[idx];
+
+        if (playback->slot && playback->client == client)
+        {
+            command_count += gble_pattern_restore(engine, idx, playback,
+                                                  &commands[command_count], &clients[command_count]);
+            ++engine->stats.stopped;
+        }
+    }
+
+    gble_pattern_unlock(engine);
+
+    gble_pattern_output(engine, commands, clients, command_count);
+}
+
+// Level at the playback position, 0..255 with fractions
+static float gble_pattern_level(struct gble_pattern_playback* playback)
+{
+    const struct gble_pattern_slot* slot = playback->slot;
+    const struct gble_pattern_keyframe* keyframes = slot->keyframes;
+
+    while (playback->cursor + 1 < slot->keyframe_count &&
+           keyframes[playback->cursor + 1].at_ms * 1000ull <= playback->position_us)
+    {
+        ++playback->cursor;
+    }
+
+    const struct gble_pattern_keyframe* from = &keyframes[playback->cursor];
+
+    // Before the first keyframe, or past the last
+    if (playback->position_us < from->at_ms * 1000ull || playback->cursor + 1 >= slot->keyframe_count)
+    {
+        return from->level;
+    }
+
+    const struct gble_pattern_keyframe* to = from + 1;
+    const float x = (playback->position_us - from->at_ms * 1000ull) / ((to->at_ms - from->at_ms) * 1000.0f);
+
+    return from->level + (to->level - from->level) * x;
+}
+
+void gble_pattern_tick(gble_pattern_engine* engine)
+{
+    const uint32_t tick_us = 1000000 / engine->tick_hz;
+
+    // At most an output and a restore per actuator
+    gble_actuator_command commands[2 * CONFIG_GBLE_PATTERN_MAX_ACTUATORS];
+    gble_client_id clients[2 * CONFIG_GBLE_PATTERN_MAX_ACTUATORS];
+    size_t command_count = 0;
+
+    gble_pattern_lock(engine);
+
+    ++engine->stats.ticks;
+
+    for (size_t idx = 0; idx < engine->server->actuator_count; ++idx)
+    {
+        struct gble_pattern_playback* playback = &engine->playbacks[idx];
+        gble_actuator_feature* actuator = &engine->server->actuators[idx];
+
+        if (!playback->slot)
+        {
+            continue;
+        }
+
+        if (actuator->last_value != playback->written_value)
+        {
+            // A regular write took over, and already set the output
+            playback->slot = NULL;
+            ++engine->stats.overridden;
+            continue;
+        }
+
+        const float range = (float)(actuator->step_range_high - actuator->step_range_low);
+        const float scale = playback->intensity_percent / (255.0f * 100.0f);
+        const uint32_t value = actuator->step_range_low +
+                               (uint32_t)lroundf(range * gble_pattern_level(playback) * scale);
+
+        if (!playback->output_valid || value != playback->output)
+        {
+            gble_actuator_command* command = &commands[command_count];
+            clients[command_count++] = playback->client;
+
+            command->id = idx;
+            command->value = value;
+            command->duration_ms = 0;
+            command->clockwise = actuator->last_clockwise;
+
+            ++engine->stats.outputs;
+
+            playback->output = value;
+            playback->output_valid = true;
+        }
+
+        playback->position_us += (uint64_t)tick_us * playback->speed_percent / 100;
+
+        const uint64_t duration_us =
+            playback->slot->keyframes[playback->slot->keyframe_count - 1].at_ms * 1000ull;
+
+        while (playback->position_us >= duration_us)
+        {
+            if (!playback->forever && --playback->loops_left == 0)
+            {
+                command_count += gble_pattern_restore(engine, idx, playback,
+                                                      &commands[command_count], &clients[command_count]);
+                ++engine->stats.finished;
+                break;
+            }
+
+            playback->position_us -= duration_us;
+            playback->cursor = 0;
+        }
+    }
+
+    gble_pattern_unlock(engine);
+
+    gble_pattern_output(engine, commands, clients, command_count);
+}
+
+void gble_pattern_get_stats(gble_pattern_engine* engine, gble_pattern_stats* stats)
+{
+    gble_pattern_lock(engine);
+    *stats = engine->stats;
+    gble_pattern_unlock(engine);
+}
+
+static bool gble_pattern_get_uint32_args(CborValue* args, size_t arg_count,
+                                         uint32_t* out, size_t count)
+{
+    if (arg_count != count)
+    {
+        ESP_LOGE(TAG, "Expected %zu arguments, got %zu", count, arg_count);
+        return false;
+    }
+
+    for (size_t idx = 0; idx < count; ++idx)
+    {
+        uint64_t value;
+        if (!cbor_value_is_unsigned_integer(args) ||
+            cbor_value_get_uint64(args, &value) != CborNoError ||
+            value > UINT32_MAX ||
+            cbor_value_advance_fixed(args) != CborNoError)
+        {
+            ESP_LOGE(TAG, "Expected argument %zu to be a uint32", idx);
+            return false;
+        }
+
+        out[idx] = (uint32_t)value;
+    }
+
+    return true;
+}
+
+static void gble_pattern_handle_upload(gble_pattern_engine* engine, CborValue* args, size_t arg_count)
+{
+    uint32_t pattern_id;
+    if (arg_count != 2 || !gble_pattern_get_uint32_args(args, 1, &pattern_id, 1))
+    {
+        ESP_LOGE(TAG, "Expected [pattern_id, keyframes] upload");
+        return;
+    }
+
+    uint8_t keyframes[GBLE_PATTERN_MAX_UPLOAD];
+    size_t keyframes_size = sizeof(keyframes);
+
+    if (!cbor_value_is_byte_string(args) ||
+        cbor_value_copy_byte_string(args, keyframes, &keyframes_size, NULL) != CborNoError)
+    {
+        ESP_LOGE(TAG, "Expected keyframes to be a byte string of at most %d keyframes",
+                 CONFIG_GBLE_PATTERN_MAX_KEYFRAMES);
+        return;
+    }
+
+    gble_pattern_upload(engine, pattern_id, keyframes, keyframes_size);
+}
+
+static void gble_pattern_command_cb(int32_t opcode, CborValue* args, size_t arg_count, void* context)
+{
+    gble_pattern_engine* engine = (gble_pattern_engine*)context;
+    uint32_t arg[3];
+
+    switch (opcode)
+    {
+        case GBLE_COMMAND_PATTERN_UPLOAD:
+            gble_pattern_handle_upload(engine, args, arg_count);
+            break;
+
+        case GBLE_COMMAND_PATTERN_PLAY:
+            if (gble_pattern_get_uint32_args(args, arg_count, arg, 3))
+            {
+                gble_pattern_start_playback(engine, engine->server->command_client, arg[0], arg[1], arg[2]);
+            }
+            break;
+
+        case GBLE_COMMAND_PATTERN_STOP:
+            if (gble_pattern_get_uint32_args(args, arg_count, arg, 1))
+            {
+                gble_pattern_stop_playback(engine, arg[0]);
+            }
+            break;
+
+        case GBLE_COMMAND_PATTERN_SPEED:
+            if (gble_pattern_get_uint32_args(args, arg_count, arg, 2))
+            {
+                gble_pattern_set_speed(engine, arg[0], arg[1]);
+            }
+            break;
+
+        case GBLE_COMMAND_PATTERN_INTENSITY:
+            if (gble_pattern_get_uint32_args(args, arg_count, arg, 2))
+            {
+                gble_pattern_set_intensity(engine, arg[0], arg[1]);
+            }
+            break;
+
+        case GBLE_COMMAND_PATTERN_SAVE:
+            if (gble_pattern_get_uint32_args(args, arg_count, arg, 1))
+            {
+                gble_pattern_save(engine, arg[0]);
+            }
+            break;
+
+        case GBLE_COMMAND_PATTERN_DELETE:
+            if (gble_pattern_get_uint32_args(args, arg_count, arg, 1))
+            {
+                gble_pattern_delete(engine, arg[0]);
+            }
+            break;
+    }
+}
@@ -0,0 +1,181 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+// Pattern playback. A client uploads a keyframe pattern once, then plays it
+// on an actuator by id; the device evaluates it on a fixed tick and calls
+// the actuator callbacks itself, so steady playback needs no writes at all
+// and radio jitter never reaches the output.
+//
+// Command frames, see GBLE_COMMAND_PATTERN_*:
+//
+//   [-1, pattern_id, h'keyframes']          upload, replacing any same id
+//   [-2, actuator_id, pattern_id, loops]    play; 0 loops repeats forever
+//   [-3, actuator_id]                       stop
+//   [-4, actuator_id, speed_percent]        10..1000, 100 is as uploaded
+//   [-5, actuator_id, intensity_percent]    0..100, scales the levels
+//   [-6, pattern_id]                        save to NVS
+//   [-7, pattern_id]                        delete from RAM and NVS
+//
+// Keyframes are 3 bytes each: big-endian uint16 milliseconds since the
+// previous keyframe, then a uint8 level where 255 is step_range_high. The
+// output is interpolated linearly between keyframes.
+//
+// Uploaded patterns live in a RAM pool; when it is full the least recently
+// used pattern that is not playing is evicted. Saved patterns are loaded
+// back from NVS when played.
+//
+// Playback ends after its loops, on stop, or when a regular write changes
+// the actuator's value. Ending by loops or stop restores the last written
+// value, and so does the disconnect of the client that started it.
+//
+// Outputs go through the arbiter as the starting client's commands, then
+// through the actuator task when one runs, else the callbacks run on the
+// esp_timer task; either way never under the engine lock.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#if CONFIG_GBLE_PATTERN_NVS
+#include "nvs.h"
+#endif
+
+#include "generic_btle.h"
+
+#define GBLE_PATTERN_KEYFRAME_SIZE 3
+
+#define GBLE_PATTERN_SPEED_MIN 10
+#define GBLE_PATTERN_SPEED_MAX 1000
+
+struct gble_pattern_keyframe {
+    // Since the start of the pattern
+    uint32_t at_ms;
+    uint8_t level;
+};
+
+struct gble_pattern_slot {
+    bool used;
+    uint32_t pattern_id;
+    // Engine use counter value when last uploaded or played
+    uint32_t last_used;
+
+    uint8_t keyframe_count;
+    struct gble_pattern_keyframe keyframes[CONFIG_GBLE_PATTERN_MAX_KEYFRAMES];
+};
+
+struct gble_pattern_playback {
+    struct gble_pattern_slot* slot;
+    // Who started it; outputs are merged by the arbiter as this client's
+    gble_client_id client;
+
+    // Remaining passes, 0 when repeating forever
+    uint32_t loops_left;
+    bool forever;
+
+    uint16_t speed_percent;
+    uint8_t intensity_percent;
+
+    uint64_t position_us;
+    // Keyframe at or before position_us
+    uint8_t cursor;
+
+    // Actuator value when playback started; any other value means a
+    // regular write took over
+    uint32_t written_value;
+    uint32_t output;
+    bool output_valid;
+};
+
+struct gble_pattern_stats {
+    uint32_t uploads;
+    uint32_t plays;
+    uint32_t finished;
+    uint32_t stopped;
+    // Ended by a regular write
+    uint32_t overridden;
+    uint32_t evictions;
+    // Uploads or loads with no slot to evict
+    uint32_t pool_full;
+    uint32_t nvs_saves;
+    uint32_t nvs_loads;
+    // Actuator callbacks run
+    uint32_t outputs;
+    uint32_t ticks;
+};
+typedef struct gble_pattern_stats gble_pattern_stats;
+
+struct gble_pattern_engine {
+    gble_server* server;
+    uint32_t tick_hz;
+    esp_timer_handle_t timer;
+    // Held by the tick and by every call below
+    SemaphoreHandle_t lock;
+#if CONFIG_GBLE_PATTERN_NVS
+    nvs_handle_t nvs;
+#endif
+
+    struct gble_pattern_slot pool[CONFIG_GBLE_PATTERN_POOL_SIZE];
+    uint32_t use_counter;
+
+    // Indexed by actuator id; active while slot is set
+    struct gble_pattern_playback playbacks[CONFIG_GBLE_PATTERN_MAX_ACTUATORS];
+
+    gble_pattern_stats stats;
+};
+typedef struct gble_pattern_engine gble_pattern_engine;
+
+// Registers the pattern commands with the server and starts the tick timer.
+bool gble_pattern_start(gble_pattern_engine* engine, gble_server* server, uint32_t tick_hz);
+
+void gble_pattern_stop(gble_pattern_engine* engine);
+
+// The same operations as the command frames, for local callers.
+bool gble_pattern_upload(gble_pattern_engine* engine, uint32_t pattern_id,
+                         const uint8_t* keyframes, size_t keyframes_size);
+
+// Plays as GBLE_CLIENT_LOCAL.
+bool gble_pattern_play(gble_pattern_engine* engine, gble_actuator_id actuator_id,
+                       uint32_t pattern_id, uint32_t loops);
+
+bool gble_pattern_stop_playback(gble_pattern_engine* engine, gble_actuator_id actuator_id);
+
+bool gble_pattern_set_speed(gble_pattern_engine* engine, gble_actuator_id actuator_id,
+                            uint32_t speed_percent);
+
+bool gble_pattern_set_intensity(gble_pattern_engine* engine, gble_actuator_id actuator_id,
+                                uint32_t intensity_percent);
+
+bool gble_pattern_save(gble_pattern_engine* engine, uint32_t pattern_id);
+
+bool gble_pattern_delete(gble_pattern_engine* engine, uint32_t pattern_id);
+
+bool gble_pattern_is_playing(gble_pattern_engine* engine, gble_actuator_id actuator_id);
+
+// Stops the client's playbacks; called by gble_client_disconnected.
+void gble_pattern_drop_client(gble_pattern_engine* engine, gble_client_id client);
+
+// Advances every playback by one tick; the timer callback.
+void gble_pattern_tick(gble_pattern_engine* engine);
+
+void gble_pattern_get_stats(gble_pattern_engine* engine, gble_pattern_stats* stats);
@@ -0,0 +1,303 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "gble_ramp.h"
+
+static const char* TAG = "GbleRamp";
+
+static void gble_ramp_timer_cb(void* arg)
+{
+    gble_ramp_tick((gble_ramp_engine*)arg);
+}
+
+bool gble_ramp_start(gble_ramp_engine* engine, gble_server* server, uint32_t tick_hz)
+{
+    if (server->actuator_count > CONFIG_GBLE_RAMP_MAX_ACTUATORS)
+    {
+        ESP_LOGE(TAG, "%zu actuators, at most %d supported",
+                 server->actuator_count, CONFIG_GBLE_RAMP_MAX_ACTUATORS);
+        return false;
+    }
+
+    if (tick_hz == 0 || tick_hz > 1000000)
+    {
+        ESP_LOGE(TAG, "Invalid tick rate %" PRIu32 " Hz", tick_hz);
+        return false;
+    }
+
+    memset(engine, 0, sizeof(*engine));
+    engine->server = server;
+    engine->tick_hz = tick_hz;
+    atomic_init(&engine->config_pending, false);
+
+    engine->lock = xSemaphoreCreateMutex();
+    if (!engine->lock)
+    {
+        ESP_LOGE(TAG, "Failed to create lock");
+        return false;
+    }
+
+    for (size_t idx = 0; idx < server->actuator_count; ++idx)
+    {
+        struct gble_ramp_channel* channel = &engine->channels[idx];
+        const uint32_t value = server->actuators[idx].last_value;
+
+        atomic_init(&channel->target, value);
+        channel->applied_target = value;
+        channel->value = value;
+        channel->profile = GBLE_RAMP_PROFILE_STEP;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = gble_ramp_timer_cb,
+        .arg = engine,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "gble_ramp",
+        .skip_unhandled_events = true,
+    };
+
+    if (esp_timer_create(&timer_args, &engine->timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create tick timer");
+        return false;
+    }
+
+    if (esp_timer_start_periodic(engine->timer, 1000000 / tick_hz) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start tick timer");
+        esp_timer_delete(engine->timer);
+        engine->timer = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void gble_ramp_stop(gble_ramp_engine* engine)
+{
+    if (engine->timer)
+    {
+        esp_timer_stop(engine->timer);
+        esp_timer_delete(engine->timer);
+        engine->timer = NULL;
+    }
+
+    if (engine->lock)
+    {
+        vSemaphoreDelete(engine->lock);
+        engine->lock = NULL;
+    }
+}
+
+static uint32_t gble_ramp_ms_to_ticks(gble_ramp_engine* engine, uint32_t ms)
+{
+    const uint64_t ticks = (uint64_t)ms * engine->tick_hz / 1000;
+    return ticks > 0 ? (uint32_t)ticks : 1;
+}
+
+bool gble_ramp_configure(gble_ramp_engine* engine, gble_actuator_id actuator_id,
+                         gble_ramp_profile profile, uint32_t param)
+{
+    if (actuator_id >= engine->server->actuator_count)
+    {
+        ESP_LOGE(TAG, "Invalid actuator id %" PRIu32, actuator_id);
+        return false;
+    }
+
+    if (profile > GBLE_RAMP_PROFILE_S_CURVE)
+    {
+        ESP_LOGE(TAG, "Invalid ramp profile %hhu", profile);
+        return false;
+    }
+
+    if (profile != GBLE_RAMP_PROFILE_STEP && param == 0)
+    {
+        ESP_LOGE(TAG, "Ramp profile %hhu needs a non-zero parameter", profile);
+        return false;
+    }
+
+    float coeff = 0;
+
+    if (profile == GBLE_RAMP_PROFILE_LINEAR)
+    {
+        // Steps per tick
+        coeff = (float)param / engine->tick_hz;
+    }
+    else if (profile == GBLE_RAMP_PROFILE_EXPONENTIAL)
+    {
+        // Fraction of the remaining distance covered per tick
+        coeff = 1.0f - expf(-1.0f / gble_ramp_ms_to_ticks(engine, param));
+    }
+
+    struct gble_ramp_channel* channel = &engine->channels[actuator_id];
+
+    xSemaphoreTake(engine->lock, portMAX_DELAY);
+
+    channel->pending_profile = profile;
+    channel->pending_param = param;
+    channel->pending_coeff = coeff;
+    channel->config_pending = true;
+    atomic_store_explicit(&engine->config_pending, true, memory_order_release);
+
+    xSemaphoreGive(engine->lock);
+
+    return true;
+}
+
+// Takes up the configurations gble_ramp_configure left; runs on the tick
+static void gble_ramp_apply_configs(gble_ramp_engine* engine)
+{
+    xSemaphoreTake(engine->lock, portMAX_DELAY);
+
+    atomic_store_explicit(&engine->config_pending, false, memory_order_relaxed);
+
+    for (size_t idx = 0; idx < engine->server->actuator_count; ++idx)
+    {
+        struct gble_ramp_channel* channel = &engine->channels[idx];
+
+        if (!channel->config_pending)
+        {
+            continue;
+        }
+
+        channel->config_pending = false;
+        channel->profile = channel->pending_profile;
+        channel->param = channel->pending_param;
+        channel->coeff = channel->pending_coeff;
+
+        // Restart any transition in progress under the new profile
+        channel->start = channel->value;
+        channel->elapsed_ticks = 0;
+        channel->total_ticks = channel->profile == GBLE_RAMP_PROFILE_S_CURVE ?
+                               gble_ramp_ms_to_ticks(engine, channel->param) : 0;
+    }
+
+    xSemaphoreGive(engine->lock);
+}
+
+bool gble_ramp_set_output_fn(gble_ramp_engine* engine, gble_actuator_id actuator_id,
+                             gble_ramp_output_fn* cb, void* cb_context)
+{
+    if (actuator_id >= engine->server->actuator_count)
+    {
+        ESP_LOGE(TAG, "Invalid actuator id %" PRIu32, actuator_id);
+        return false;
+    }
+
+    engine->channels[actuator_id].output_cb = cb;
+    engine->channels[actuator_id].output_cb_context = cb_context;
+
+    return true;
+}
+
+void gble_ramp_set_target(gble_ramp_engine* engine, gble_actuator_id actuator_id, uint32_t value)
+{
+    if (actuator_id >= engine->server->actuator_count)
+    {
+        return;
+    }
+
+    atomic_store_explicit(&engine->channels[actuator_id].target, value, memory_order_relaxed);
+}
+
+static float gble_ramp_next(struct gble_ramp_channel* channel, float target)
+{
+    const float value = channel->value;
+
+    switch (channel->profile)
+    {
+        case GBLE_RAMP_PROFILE_LINEAR:
+            if (fabsf(target - value) <= channel->coeff)
+            {
+                return target;
+            }
+            return target > value ? value + channel->coeff : value - channel->coeff;
+
+        case GBLE_RAMP_PROFILE_EXPONENTIAL:
+        {
+            const float next = value + (target - value) * channel->coeff;
+            // Settle instead of creeping toward the target forever
+            return fabsf(target - next) < 0.01f ? target : next;
+        }
+
+        case GBLE_RAMP_PROFILE_S_CURVE:
+        {
+            if (channel->elapsed_ticks >= channel->total_ticks)
+            {
+                return target;
+            }
+
+            ++channel->elapsed_ticks;
+
+            const float x = (float)channel->elapsed_ticks / channel->total_ticks;
+            return channel->start + (target - channel->start) * x * x * (3.0f - 2.0f * x);
+        }
+
+        default:
+            return target;
+    }
+}
+
+void gble_ramp_tick(gble_ramp_engine* engine)
+{
+    ++engine->ticks;
+
+    if (atomic_load_explicit(&engine->config_pending, memory_order_acquire))
+    {
+        gble_ramp_apply_configs(engine);
+    }
+
+    for (size_t idx = 0; idx < engine->server->actuator_count; ++idx)
+    {
+        struct gble_ramp_channel* channel = &engine->channels[idx];
+
+        const uint32_t target = atomic_load_explicit(&channel->target, memory_order_relaxed);
+        if (target != channel->applied_target)
+        {
+            channel->applied_target = target;
+            channel->start = channel->value;
+            channel->elapsed_ticks = 0;
+        }
+
+        const float next = gble_ramp_next(channel, (float)target);
+        if (next == channel->value)
+        {
+            continue;
+        }
+
+        channel->value = next;
+
+        if (channel->output_cb)
+        {
+            channel->output_cb(idx, next, channel->output_cb_context);
+            ++engine->outputs;
+        }
+    }
+}
+
+void gble_ramp_actuator_cb(gble_actuator_id actuator_id, uint32_t value, void* context)
+{
+    gble_ramp_set_target((gble_ramp_engine*)context, actuator_id, value);
+}
@@ -0,0 +1,129 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+// Actuator ramp engine. Decouples actuator output from radio timing: new
+// values only move a per-actuator target, and a periodic esp_timer at a fixed
+// tick rate moves each output toward its target with the actuator's profile,
+// calling the output callback whenever the output changes.
+//
+// Hook it up by making it the actuator callback:
+//
+//   actuator.cb = gble_ramp_actuator_cb;
+//   actuator.cb_context = &ramp;
+//   gble_ramp_start(&ramp, &server, CONFIG_GBLE_RAMP_TICK_HZ);
+//   gble_ramp_configure(&ramp, actuator.id, GBLE_RAMP_PROFILE_S_CURVE, 80);
+//   gble_ramp_set_output_fn(&ramp, actuator.id, set_motor_duty, NULL);
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "generic_btle.h"
+
+// Jump straight to the target
+#define GBLE_RAMP_PROFILE_STEP        0
+// Constant slew rate; param is steps per second
+#define GBLE_RAMP_PROFILE_LINEAR      1
+// First order approach; param is the time constant in milliseconds
+#define GBLE_RAMP_PROFILE_EXPONENTIAL 2
+// Smoothstep from the current output to the target; param is the transition
+// time in milliseconds
+#define GBLE_RAMP_PROFILE_S_CURVE     3
+typedef uint8_t gble_ramp_profile;
+
+// Output in actuator steps, with fractions, between step_range_low and
+// step_range_high
+typedef void gble_ramp_output_fn(gble_actuator_id actuator_id, float value, void* context);
+
+struct gble_ramp_channel {
+    gble_ramp_profile profile;
+    uint32_t param;
+
+    // Per-tick constant derived from the profile and the tick rate
+    float coeff;
+
+    gble_ramp_output_fn* output_cb;
+    void* output_cb_context;
+
+    // Written from the actuator callback, read by the tick
+    _Atomic uint32_t target;
+
+    // Written by gble_ramp_configure under the engine lock, taken up by
+    // the next tick
+    bool config_pending;
+    gble_ramp_profile pending_profile;
+    uint32_t pending_param;
+    float pending_coeff;
+
+    // Tick state
+    uint32_t applied_target;
+    float value;
+    float start;
+    uint32_t elapsed_ticks;
+    uint32_t total_ticks;
+};
+
+struct gble_ramp_engine {
+    gble_server* server;
+    uint32_t tick_hz;
+    esp_timer_handle_t timer;
+
+    struct gble_ramp_channel channels[CONFIG_GBLE_RAMP_MAX_ACTUATORS];
+
+    // Guards the pending configurations; config_pending tells the tick to
+    // look at them
+    SemaphoreHandle_t lock;
+    _Atomic bool config_pending;
+
+    uint32_t ticks;
+    uint32_t outputs;
+};
+typedef struct gble_ramp_engine gble_ramp_engine;
+
+// Creates the channels for the server's actuators, all STEP with no output,
+// and starts the tick timer.
+bool gble_ramp_start(gble_ramp_engine* engine, gble_server* server, uint32_t tick_hz);
+
+void gble_ramp_stop(gble_ramp_engine* engine);
+
+// Safe from any task while the engine runs; takes effect on the next tick,
+// restarting any transition in progress. A rejected configuration leaves
+// the channel as it was.
+bool gble_ramp_configure(gble_ramp_engine* engine, gble_actuator_id actuator_id,
+                         gble_ramp_profile profile, uint32_t param);
+
+bool gble_ramp_set_output_fn(gble_ramp_engine* engine, gble_actuator_id actuator_id,
+                             gble_ramp_output_fn* cb, void* cb_context);
+
+// Safe from any task; takes effect on the next tick.
+void gble_ramp_set_target(gble_ramp_engine* engine, gble_actuator_id actuator_id, uint32_t value);
+
+// Advances every channel by one tick; the timer callback.
+void gble_ramp_tick(gble_ramp_engine* engine);
+
+// gble_actuator_callback_fn for actuators driven through the engine; the
+// context is the engine.
+void gble_ramp_actuator_cb(gble_actuator_id actuator_id, uint32_t value, void* context);
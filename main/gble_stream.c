@@ -0,0 +1,378 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "gble_stream.h"
+
+static const char* TAG = "GbleStream";
+
+#define GBLE_STREAM_CBOR_UINT  0x00
+#define GBLE_STREAM_CBOR_BYTES 0x40
+#define GBLE_STREAM_CBOR_ARRAY 0x80
+
+static void gble_stream_timer_cb(void* arg)
+{
+    gble_stream_tick((gble_stream*)arg);
+}
+
+static void gble_stream_lock(gble_stream* stream)
+{
+    xSemaphoreTake(stream->lock, portMAX_DELAY);
+}
+
+static void gble_stream_unlock(gble_stream* stream)
+{
+    xSemaphoreGive(stream->lock);
+}
+
+bool gble_stream_start(gble_stream* stream, gble_server* server)
+{
+    if (server->sensors_count > CONFIG_GBLE_STREAM_MAX_SENSORS)
+    {
+        ESP_LOGE(TAG, "%zu sensors, at most %d supported",
+                 server->sensors_count, CONFIG_GBLE_STREAM_MAX_SENSORS);
+        return false;
+    }
+
+    memset(stream, 0, sizeof(*stream));
+    stream->server = server;
+    stream->armed_us = INT64_MAX;
+
+    stream->lock = xSemaphoreCreateMutex();
+    if (!stream->lock)
+    {
+        ESP_LOGE(TAG, "Failed to create lock");
+        return false;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = gble_stream_timer_cb,
+        .arg = stream,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "gble_stream",
+    };
+
+    if (esp_timer_create(&timer_args, &stream->timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create deadline timer");
+        vSemaphoreDelete(stream->lock);
+        stream->lock = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void gble_stream_stop(gble_stream* stream)
+{
+    if (stream->timer)
+    {
+        esp_timer_stop(stream->timer);
+        esp_timer_delete(stream->timer);
+        stream->timer = NULL;
+    }
+
+    if (stream->lock)
+    {
+        vSemaphoreDelete(stream->lock);
+        stream->lock = NULL;
+    }
+}
+
+void gble_stream_set_frame_size_fn(gble_stream* stream, gble_stream_frame_size_fn* cb, void* cb_context)
+{
+    gble_stream_lock(stream);
+    stream->frame_size_cb = cb;
+    stream->frame_size_cb_context = cb_context;
+    gble_stream_unlock(stream);
+}
+
+bool gble_stream_enable(gble_stream* stream, gble_sensor_id id, uint32_t period_us, uint32_t max_latency_ms)
+{
+    if (id >= stream->server->sensors_count)
+    {
+        ESP_LOGE(TAG, "Invalid sensor ID %" PRIu32, id);
+        return false;
+    }
+
+    const gble_sensor_feature* sensor = &stream->server->sensors[id];
+    if (sensor->message_type != GBLE_SENSOR_MSG_SUBSCRIBE)
+    {
+        ESP_LOGE(TAG, "Sensor %" PRIu32 " is not a subscribe sensor", id);
+        return false;
+    }
+
+    if (period_us == 0 || sensor->value_range_high < sensor->value_range_low)
+    {
+        ESP_LOGE(TAG, "Invalid period %" PRIu32 " us or range for sensor %" PRIu32, period_us, id);
+        return false;
+    }
+
+    const uint32_t span = (uint32_t)sensor->value_range_high - (uint32_t)sensor->value_range_low;
+
+    gble_stream_lock(stream);
+
+    struct gble_stream_channel* channel = &stream->channels[id];
+    memset(channel, 0, sizeof(*channel));
+    channel->enabled = true;
+    channel->period_us = period_us;
+    channel->max_latency_us = (int64_t)max_latency_ms * 1000;
+    channel->sample_size = span <= UINT8_MAX ? 1 : span <= UINT16_MAX ? 2 : 4;
+
+    gble_stream_unlock(stream);
+
+    return true;
+}
+
+void gble_stream_disable(gble_stream* stream, gble_sensor_id id)
+{
+    if (id >= stream->server->sensors_count)
+    {
+        return;
+    }
+
+    gble_stream_lock(stream);
+    stream->channels[id].enabled = false;
+    stream->channels[id].count = 0;
+    gble_stream_unlock(stream);
+}
+
+// Called with the lock held
+static void gble_stream_send(gble_stream* stream, gble_sensor_id id)
+{
+    struct gble_stream_channel* channel = &stream->channels[id];
+    if (channel->count == 0)
+    {
+        return;
+    }
+
+    const size_t samples_size = channel->count * channel->sample_size;
+    const size_t header_size = 1 +
+        gble_encode_cbor_head(NULL, GBLE_STREAM_CBOR_UINT, id) +
+        gble_encode_cbor_head(NULL, GBLE_STREAM_CBOR_UINT, (uint64_t)channel->base_us) +
+        gble_encode_cbor_head(NULL, GBLE_STREAM_CBOR_UINT, channel->period_us) +
+        gble_encode_cbor_head(NULL, GBLE_STREAM_CBOR_BYTES, samples_size);
+
+    uint8_t* frame = &channel->frame[GBLE_STREAM_FRAME_HEADER_MAX - header_size];
+    size_t frame_size = 0;
+
+    frame_size += gble_encode_cbor_head(&frame[frame_size], GBLE_STREAM_CBOR_ARRAY, 4);
+    frame_size += gble_encode_cbor_head(&frame[frame_size], GBLE_STREAM_CBOR_UINT, id);
+    frame_size += gble_encode_cbor_head(&frame[frame_size], GBLE_STREAM_CBOR_UINT, (uint64_t)channel->base_us);
+    frame_size += gble_encode_cbor_head(&frame[frame_size], GBLE_STREAM_CBOR_UINT, channel->period_us);
+    frame_size += gble_encode_cbor_head(&frame[frame_size], GBLE_STREAM_CBOR_BYTES, samples_size);
+    frame_size += samples_size;
+
+    channel->count = 0;
+
+    ++stream->stats.frames;
+    stream->stats.bytes += frame_size;
+
+    gble_server* server = stream->server;
+    if (server->sensor_cb)
+    {
+        server->sensor_cb(frame, frame_size, GBLE_SENSOR_PRIORITY_BULK, server->sensor_cb_context);
+    }
+}
+
+// Called with the lock held
+static void gble_stream_arm(gble_stream* stream, int64_t deadline_us)
+{
+    if (deadline_us >= stream->armed_us)
+    {
+        return;
+    }
+
+    const int64_t now_us = esp_timer_get_time();
+
+    esp_timer_stop(stream->timer);
+    esp_timer_start_once(stream->timer, deadline_us > now_us ? deadline_us - now_us : 0);
+    stream->armed_us = deadline_us;
+}
+
+// Called with the lock held
+static void gble_stream_begin_frame(gble_stream* stream, gble_sensor_id id, int64_t timestamp_us)
+{
+    struct gble_stream_channel* channel = &stream->channels[id];
+
+    size_t frame_size = GBLE_STREAM_DEFAULT_FRAME_SIZE;
+    if (stream->frame_size_cb)
+    {
+        frame_size = stream->frame_size_cb(stream->frame_size_cb_context);
+    }
+
+    if (frame_size > GBLE_STREAM_MAX_FRAME_SIZE)
+    {
+        frame_size = GBLE_STREAM_MAX_FRAME_SIZE;
+    }
+
+    // Sized from the actual header; the byte string head grows with its
+    // length, so take the worst case for what is left
+    const size_t header_size = 1 +
+        gble_encode_cbor_head(NULL, GBLE_STREAM_CBOR_UINT, id) +
+        gble_encode_cbor_head(NULL, GBLE_STREAM_CBOR_UINT, (uint64_t)timestamp_us) +
+        gble_encode_cbor_head(NULL, GBLE_STREAM_CBOR_UINT, channel->period_us);
+
+    size_t samples_size = frame_size > header_size ? frame_size - header_size : 0;
+    samples_size = samples_size > 0 ? samples_size - gble_encode_cbor_head(NULL, GBLE_STREAM_CBOR_BYTES, samples_size) : 0;
+
+    channel->capacity = samples_size / channel->sample_size;
+    if (channel->capacity == 0)
+    {
+        channel->capacity = 1;
+    }
+
+    channel->count = 0;
+    channel->base_us = timestamp_us;
+    channel->deadline_us = timestamp_us + channel->max_latency_us;
+
+    gble_stream_arm(stream, channel->deadline_us);
+}
+
+bool gble_stream_push(gble_stream* stream, gble_sensor_id id, int32_t value, int64_t timestamp_us)
+{
+    gble_server* server = stream->server;
+
+    if (id >= server->sensors_count)
+    {
+        ESP_LOGE(TAG, "Sensor %" PRIu32 " is not streaming", id);
+        return false;
+    }
+
+    gble_sensor_feature* sensor = &server->sensors[id];
+    struct gble_stream_channel* channel = &stream->channels[id];
+
+    gble_stream_lock(stream);
+
+    // Under the lock, so a sample racing gble_stream_disable cannot start a
+    // frame after it
+    if (!channel->enabled)
+    {
+        gble_stream_unlock(stream);
+        ESP_LOGE(TAG, "Sensor %" PRIu32 " is not streaming", id);
+        return false;
+    }
+
+    sensor->last_value = value;
+    ++stream->stats.samples;
+
+    if (channel->count > 0)
+    {
+        // Samples off the period by half of it cannot share the frame
+        const int64_t expected_us = channel->base_us + (int64_t)channel->count * channel->period_us;
+        const int64_t error_us = timestamp_us - expected_us;
+
+        if (error_us > (int64_t)channel->period_us / 2 || error_us < -(int64_t)channel->period_us / 2)
+        {
+            ++stream->stats.gap_flushes;
+            gble_stream_send(stream, id);
+        }
+    }
+
+    if (channel->count == 0)
+    {
+        gble_stream_begin_frame(stream, id, timestamp_us);
+    }
+
+    if (value < sensor->value_range_low)
+    {
+        value = sensor->value_range_low;
+    }
+    else if (value > sensor->value_range_high)
+    {
+        value = sensor->value_range_high;
+    }
+
+    const uint32_t packed = (uint32_t)value - (uint32_t)sensor->value_range_low;
+    uint8_t* sample = &channel->frame[GBLE_STREAM_FRAME_HEADER_MAX + channel->count * channel->sample_size];
+
+    for (size_t idx = 0; idx < channel->sample_size; ++idx)
+    {
+        sample[idx] = (uint8_t)(packed >> (8 * (channel->sample_size - 1 - idx)));
+    }
+
+    if (++channel->count >= channel->capacity)
+    {
+        ++stream->stats.full_flushes;
+        gble_stream_send(stream, id);
+    }
+
+    gble_stream_unlock(stream);
+
+    return true;
+}
+
+void gble_stream_flush(gble_stream* stream, gble_sensor_id id)
+{
+    if (id >= stream->server->sensors_count)
+    {
+        return;
+    }
+
+    gble_stream_lock(stream);
+    gble_stream_send(stream, id);
+    gble_stream_unlock(stream);
+}
+
+void gble_stream_tick(gble_stream* stream)
+{
+    gble_stream_lock(stream);
+
+    const int64_t now_us = esp_timer_get_time();
+    int64_t next_us = INT64_MAX;
+
+    for (size_t id = 0; id < stream->server->sensors_count; ++id)
+    {
+        struct gble_stream_channel* channel = &stream->channels[id];
+        if (channel->count == 0)
+        {
+            continue;
+        }
+
+        if (channel->deadline_us <= now_us)
+        {
+            ++stream->stats.deadline_flushes;
+            gble_stream_send(stream, id);
+        }
+        else if (channel->deadline_us < next_us)
+        {
+            next_us = channel->deadline_us;
+        }
+    }
+
+    // The timer is one-shot and has fired; arm it for what is left
+    stream->armed_us = INT64_MAX;
+    if (next_us != INT64_MAX)
+    {
+        gble_stream_arm(stream, next_us);
+    }
+
+    gble_stream_unlock(stream);
+}
+
+void gble_stream_get_stats(gble_stream* stream, gble_stream_stats* stats)
+{
+    gble_stream_lock(stream);
+    *stats = stream->stats;
+    gble_stream_unlock(stream);
+}
@@ -0,0 +1,139 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+// Sample streaming for GBLE_SENSOR_MSG_SUBSCRIBE sensors. Instead of one
+// [id, value] notification per sample, samples taken at a fixed period are
+// gathered per sensor and sent as one frame
+//
+//   [id, base_us, period_us, h'samples']
+//
+// where base_us is the device esp_timer time of the first sample (see
+// gble_time_sync.h to map it to the client clock) and sample n was taken at
+// base_us + n * period_us. Each sample is value - value_range_low, big-endian,
+// in as few bytes (1, 2 or 4) as the sensor's range needs.
+//
+// A frame goes out when the next sample would not fit the notification
+// size, when its first sample is max_latency_ms old (a one-shot esp_timer
+// armed for the earliest deadline), or when a sample does not land on the
+// period and the frame has to start over. Frames go through the server's
+// sensor callback like single values, as GBLE_SENSOR_PRIORITY_BULK.
+//
+//   gble_stream_start(&stream, &server);
+//   gble_stream_set_frame_size_fn(&stream, gatt_svr_get_notify_size_max_ctx, NULL);
+//   gble_stream_enable(&stream, pressure_id, 1000, 20);
+//   ... from the sampling task:
+//   gble_stream_push(&stream, pressure_id, value, esp_timer_get_time());
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "generic_btle.h"
+
+// Largest frame, the GATT server's read value buffer
+#define GBLE_STREAM_MAX_FRAME_SIZE 256
+
+// Frame size without a frame size callback: the default ATT MTU of 23 less
+// the notification header
+#define GBLE_STREAM_DEFAULT_FRAME_SIZE 20
+
+// Worst case frame header: array, uint32 id, uint64 base, uint32 period and
+// the byte string header
+#define GBLE_STREAM_FRAME_HEADER_MAX (1 + 5 + 9 + 5 + 3)
+
+// Largest notification every subscriber can take right now
+typedef size_t gble_stream_frame_size_fn(void* context);
+
+struct gble_stream_channel {
+    bool enabled;
+    uint32_t period_us;
+    int64_t max_latency_us;
+    uint8_t sample_size;
+
+    // Frame being filled
+    size_t count;
+    size_t capacity;
+    int64_t base_us;
+    int64_t deadline_us;
+    // Samples start at GBLE_STREAM_FRAME_HEADER_MAX and the header is
+    // written in right before them, so the frame goes out from here
+    uint8_t frame[GBLE_STREAM_FRAME_HEADER_MAX + GBLE_STREAM_MAX_FRAME_SIZE];
+};
+
+struct gble_stream_stats {
+    uint32_t samples;
+    uint32_t frames;
+    // Why frames went out
+    uint32_t full_flushes;
+    uint32_t deadline_flushes;
+    uint32_t gap_flushes;
+    // Encoded frame bytes handed to the sensor callback
+    uint64_t bytes;
+};
+typedef struct gble_stream_stats gble_stream_stats;
+
+struct gble_stream {
+    gble_server* server;
+
+    gble_stream_frame_size_fn* frame_size_cb;
+    void* frame_size_cb_context;
+
+    struct gble_stream_channel channels[CONFIG_GBLE_STREAM_MAX_SENSORS];
+
+    esp_timer_handle_t timer;
+    // Deadline the timer is armed for, INT64_MAX if idle
+    int64_t armed_us;
+
+    // Taken by push and the deadline timer
+    SemaphoreHandle_t lock;
+
+    gble_stream_stats stats;
+};
+typedef struct gble_stream gble_stream;
+
+bool gble_stream_start(gble_stream* stream, gble_server* server);
+
+// Does not flush; call gble_stream_flush first to send what is buffered.
+// Frees the lock, so nothing may push or flush meanwhile or after.
+void gble_stream_stop(gble_stream* stream);
+
+void gble_stream_set_frame_size_fn(gble_stream* stream, gble_stream_frame_size_fn* cb, void* cb_context);
+
+// Streams a subscribe sensor sampled every period_us. Its frames go out no
+// later than max_latency_ms after their first sample.
+bool gble_stream_enable(gble_stream* stream, gble_sensor_id id, uint32_t period_us, uint32_t max_latency_ms);
+
+void gble_stream_disable(gble_stream* stream, gble_sensor_id id);
+
+// Adds a sample taken at timestamp_us and updates the sensor's last_value.
+bool gble_stream_push(gble_stream* stream, gble_sensor_id id, int32_t value, int64_t timestamp_us);
+
+// Sends the sensor's buffered samples now
+void gble_stream_flush(gble_stream* stream, gble_sensor_id id);
+
+// Sends the frames that are due; run by the deadline timer
+void gble_stream_tick(gble_stream* stream);
+
+void gble_stream_get_stats(gble_stream* stream, gble_stream_stats* stats);
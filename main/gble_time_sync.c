@@ -0,0 +1,337 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "gble_time_sync.h"
+
+static const char* TAG = "GbleTimeSync";
+
+// Drift is measured between estimates at least this far apart
+#define GBLE_TIME_SYNC_DRIFT_SPAN_US 10000000
+
+// How long an estimate from a clean round holds against later rounds that
+// all waited for extra connection events
+#define GBLE_TIME_SYNC_HOLD_US 60000000
+
+// Beyond any crystal; a clock that jumps further is re-anchored instead
+#define GBLE_TIME_SYNC_MAX_DRIFT_PPB 1000000
+
+// Each drift measurement moves the estimate by 1/2^shift of the difference
+#define GBLE_TIME_SYNC_DRIFT_SHIFT 3
+
+static void gble_time_sync_put_u32(uint8_t* buf, uint32_t value)
+{
+    for (size_t idx = 0; idx < 4; ++idx)
+    {
+        buf[idx] = (uint8_t)(value >> (8 * idx));
+    }
+}
+
+static void gble_time_sync_put_i64(uint8_t* buf, int64_t value)
+{
+    for (size_t idx = 0; idx < 8; ++idx)
+    {
+        buf[idx] = (uint8_t)((uint64_t)value >> (8 * idx));
+    }
+}
+
+static uint32_t gble_time_sync_get_u32(const uint8_t* buf)
+{
+    uint32_t value = 0;
+    for (size_t idx = 0; idx < 4; ++idx)
+    {
+        value |= (uint32_t)buf[idx] << (8 * idx);
+    }
+
+    return value;
+}
+
+static int64_t gble_time_sync_get_i64(const uint8_t* buf)
+{
+    uint64_t value = 0;
+    for (size_t idx = 0; idx < 8; ++idx)
+    {
+        value |= (uint64_t)buf[idx] << (8 * idx);
+    }
+
+    return (int64_t)value;
+}
+
+void gble_time_sync_init(gble_time_sync* sync)
+{
+    memset(sync, 0, sizeof(*sync));
+}
+
+void gble_time_sync_set_update_fn(gble_time_sync* sync, gble_time_sync_update_fn* cb, void* cb_context)
+{
+    sync->update_cb = cb;
+    sync->update_cb_context = cb_context;
+}
+
+static void gble_time_sync_reset(gble_time_sync* sync, uint16_t conn_handle)
+{
+    sync->conn_valid = true;
+    sync->conn_handle = conn_handle;
+    sync->pending_valid = false;
+    sync->window_count = 0;
+    sync->window_next = 0;
+    sync->drift_anchor_valid = false;
+    sync->drift_valid = false;
+    memset(&sync->estimate, 0, sizeof(sync->estimate));
+}
+
+static void gble_time_sync_update_estimate(gble_time_sync* sync)
+{
+    const size_t count = sync->window_count;
+
+    uint32_t min_rtt_us = UINT32_MAX;
+    for (size_t idx = 0; idx < count; ++idx)
+    {
+        min_rtt_us = sync->window[idx].rtt_us < min_rtt_us ? sync->window[idx].rtt_us : min_rtt_us;
+    }
+
+    // A round that waited an extra connection event on either leg is off by
+    // half an interval; those are well beyond a quarter of the best round trip
+    const uint32_t max_rtt_us = min_rtt_us + min_rtt_us / 4;
+
+    gble_time_sync_estimate* estimate = &sync->estimate;
+    const int64_t latest_at_us = sync->window[(sync->window_next + CONFIG_GBLE_TIME_SYNC_WINDOW - 1) %
+                                              CONFIG_GBLE_TIME_SYNC_WINDOW].at_us;
+
+    if (estimate->valid && min_rtt_us > estimate->rtt_us + estimate->rtt_us / 4 &&
+        latest_at_us - estimate->at_us < GBLE_TIME_SYNC_HOLD_US)
+    {
+        return;
+    }
+
+    int64_t at_us = INT64_MIN;
+    for (size_t idx = 0; idx < count; ++idx)
+    {
+        if (sync->window[idx].rtt_us <= max_rtt_us && sync->window[idx].at_us > at_us)
+        {
+            at_us = sync->window[idx].at_us;
+        }
+    }
+
+    // Average of the kept rounds, each carried forward to the latest by the
+    // drift so far
+    int64_t offset_sum_us = 0;
+    int64_t kept = 0;
+    for (size_t idx = 0; idx < count; ++idx)
+    {
+        const struct gble_time_sync_round* round = &sync->window[idx];
+        if (round->rtt_us <= max_rtt_us)
+        {
+            offset_sum_us += round->offset_us + (at_us - round->at_us) * estimate->drift_ppb / 1000000000;
+            ++kept;
+        }
+    }
+
+    const int64_t offset_us = offset_sum_us / kept;
+
+    // Only estimates from equally clean rounds are compared, an anchor from
+    // before a clean round came along is replaced
+    if (!sync->drift_anchor_valid || sync->drift_anchor_rtt_us > max_rtt_us)
+    {
+        sync->drift_anchor_valid = true;
+        sync->drift_anchor_offset_us = offset_us;
+        sync->drift_anchor_at_us = at_us;
+        sync->drift_anchor_rtt_us = min_rtt_us;
+    }
+    else if (at_us - sync->drift_anchor_at_us >= GBLE_TIME_SYNC_DRIFT_SPAN_US)
+    {
+        const double drift_ppb = (double)(offset_us - sync->drift_anchor_offset_us) * 1e9 /
+                                 (double)(at_us - sync->drift_anchor_at_us);
+
+        if (fabs(drift_ppb) > GBLE_TIME_SYNC_MAX_DRIFT_PPB)
+        {
+            ESP_LOGW(TAG, "Client clock jumped, drift %.0f ppb", drift_ppb);
+            ++sync->stats.rejected;
+        }
+        else if (sync->drift_valid)
+        {
+            estimate->drift_ppb += (int32_t)((drift_ppb - estimate->drift_ppb) / (1 << GBLE_TIME_SYNC_DRIFT_SHIFT));
+        }
+        else
+        {
+            estimate->drift_ppb = (int32_t)drift_ppb;
+            sync->drift_valid = true;
+        }
+
+        sync->drift_anchor_offset_us = offset_us;
+        sync->drift_anchor_at_us = at_us;
+        sync->drift_anchor_rtt_us = min_rtt_us;
+    }
+
+    estimate->valid = true;
+    estimate->conn_handle = sync->conn_handle;
+    estimate->offset_us = offset_us;
+    estimate->at_us = at_us;
+    estimate->rtt_us = min_rtt_us;
+    estimate->rounds = count;
+
+    if (sync->update_cb)
+    {
+        sync->update_cb(estimate, sync->update_cb_context);
+    }
+}
+
+static void gble_time_sync_complete_round(gble_time_sync* sync, int64_t t3_us)
+{
+    const int64_t t0_us = sync->pending_t0_us;
+    const int64_t t1_us = sync->pending_t1_us;
+    const int64_t t2_us = sync->pending_t2_us;
+
+    const int64_t rtt_us = (t3_us - t0_us) - (t2_us - t1_us);
+    if (rtt_us < 0 || rtt_us > UINT32_MAX)
+    {
+        ++sync->stats.rejected;
+        return;
+    }
+
+    struct gble_time_sync_round* round = &sync->window[sync->window_next];
+    round->at_us = t1_us + (t2_us - t1_us) / 2;
+    round->offset_us = ((t1_us - t0_us) + (t2_us - t3_us)) / 2;
+    round->rtt_us = (uint32_t)rtt_us;
+
+    sync->window_next = (sync->window_next + 1) % CONFIG_GBLE_TIME_SYNC_WINDOW;
+    if (sync->window_count < CONFIG_GBLE_TIME_SYNC_WINDOW)
+    {
+        ++sync->window_count;
+    }
+
+    ++sync->stats.rounds;
+
+    gble_time_sync_update_estimate(sync);
+}
+
+bool gble_time_sync_handle_request(gble_time_sync* sync, uint16_t conn_handle,
+                                   const uint8_t* buf, size_t buf_size, int64_t rx_us,
+                                   uint8_t* resp, size_t* resp_size)
+{
+    if (buf_size != GBLE_TIME_SYNC_REQUEST_SIZE || *resp_size < GBLE_TIME_SYNC_RESPONSE_SIZE)
+    {
+        ESP_LOGE(TAG, "Expected %d byte request, got: %zu", GBLE_TIME_SYNC_REQUEST_SIZE, buf_size);
+        return false;
+    }
+
+    ++sync->stats.requests;
+
+    if (!sync->conn_valid || sync->conn_handle != conn_handle)
+    {
+        if (sync->conn_valid)
+        {
+            ++sync->stats.resets;
+        }
+
+        gble_time_sync_reset(sync, conn_handle);
+    }
+
+    const uint32_t seq = gble_time_sync_get_u32(&buf[0]);
+    const int64_t t0_us = gble_time_sync_get_i64(&buf[4]);
+    const int64_t prev_t3_us = gble_time_sync_get_i64(&buf[12]);
+
+    if (prev_t3_us != 0)
+    {
+        if (sync->pending_valid && sync->pending_seq == seq - 1)
+        {
+            gble_time_sync_complete_round(sync, prev_t3_us);
+        }
+        else
+        {
+            ++sync->stats.rejected;
+        }
+    }
+
+    // Stamped as late as possible, right before the response goes out
+    const int64_t t2_us = esp_timer_get_time();
+
+    sync->pending_valid = true;
+    sync->pending_seq = seq;
+    sync->pending_t0_us = t0_us;
+    sync->pending_t1_us = rx_us;
+    sync->pending_t2_us = t2_us;
+
+    gble_time_sync_put_u32(&resp[0], seq);
+    gble_time_sync_put_i64(&resp[4], rx_us);
+    gble_time_sync_put_i64(&resp[12], t2_us);
+    *resp_size = GBLE_TIME_SYNC_RESPONSE_SIZE;
+
+    return true;
+}
+
+size_t gble_time_sync_get_status(gble_time_sync* sync, uint8_t* buf, size_t buf_size)
+{
+    if (buf_size < GBLE_TIME_SYNC_STATUS_SIZE)
+    {
+        return 0;
+    }
+
+    const gble_time_sync_estimate* estimate = &sync->estimate;
+    int64_t offset_us = 0;
+
+    if (estimate->valid)
+    {
+        // Carried forward to now by the drift
+        const int64_t elapsed_us = esp_timer_get_time() - estimate->at_us;
+        offset_us = estimate->offset_us + elapsed_us * estimate->drift_ppb / 1000000000;
+    }
+
+    gble_time_sync_put_i64(&buf[0], offset_us);
+    gble_time_sync_put_u32(&buf[8], (uint32_t)estimate->drift_ppb);
+    gble_time_sync_put_u32(&buf[12], estimate->rtt_us);
+    gble_time_sync_put_u32(&buf[16], estimate->rounds);
+
+    return GBLE_TIME_SYNC_STATUS_SIZE;
+}
+
+void gble_time_sync_get_estimate(gble_time_sync* sync, gble_time_sync_estimate* estimate)
+{
+    *estimate = sync->estimate;
+}
+
+void gble_time_sync_get_stats(gble_time_sync* sync, gble_time_sync_stats* stats)
+{
+    *stats = sync->stats;
+}
+
+int64_t gble_time_sync_to_device_us(gble_time_sync* sync, int64_t client_us)
+{
+    const gble_time_sync_estimate* estimate = &sync->estimate;
+
+    const int64_t device_us = client_us + estimate->offset_us;
+    return device_us + (device_us - estimate->at_us) * estimate->drift_ppb / 1000000000;
+}
+
+bool gble_time_sync_handle_request_ctx(uint16_t conn_handle, const uint8_t* buf, size_t buf_size,
+                                       int64_t rx_us, uint8_t* resp, size_t* resp_size, void* context)
+{
+    return gble_time_sync_handle_request((gble_time_sync*)context, conn_handle,
+                                         buf, buf_size, rx_us, resp, resp_size);
+}
+
+size_t gble_time_sync_get_status_ctx(uint8_t* buf, size_t buf_size, void* context)
+{
+    return gble_time_sync_get_status((gble_time_sync*)context, buf, buf_size);
+}
@@ -0,0 +1,156 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+// Clock synchronization with a client, NTP style, over the time
+// characteristic. Each round the client writes its send time t0; the device
+// stamps the write on arrival (t1) and notifies its own time t2 as the
+// response goes out; the client stamps the notification on arrival (t3).
+// With all four,
+//
+//   offset = ((t1 - t0) + (t2 - t3)) / 2    device time minus client time
+//   rtt    = (t3 - t0) - (t2 - t1)
+//
+// The client sends t3 back with the next round, so the device keeps its own
+// estimate. Rounds that waited for extra connection events are skewed by
+// half an interval, so only those in the window within a quarter of the
+// shortest round trip are averaged for the offset. The drift is the change
+// in offset between estimates ten or more seconds apart, smoothed.
+//
+// Each leg waits for a connection event. The two legs only wait about as
+// long, and the offset only comes out right, when the client sends its
+// request right after something arrives from the device (any notification
+// marks a connection event) rather than at a random time.
+//
+// Wire format, little-endian, all times in microseconds:
+//
+//   write   uint32 seq, int64 t0, int64 t3 of round seq - 1 (0 if none)
+//   notify  uint32 seq, int64 t1, int64 t2
+//   read    int64 offset, int32 drift_ppb, uint32 rtt, uint32 rounds
+//
+// The synced client clock also times that client's GBLE_COMMAND_TIMED: their
+// timestamp is the low 32 bits of its milliseconds (see gble_jitter.h).
+//
+// One client syncs at a time; a round from another connection starts over.
+// Call everything from the NimBLE host task.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+#define GBLE_TIME_SYNC_REQUEST_SIZE  20
+#define GBLE_TIME_SYNC_RESPONSE_SIZE 20
+#define GBLE_TIME_SYNC_STATUS_SIZE   20
+
+struct gble_time_sync_estimate {
+    bool valid;
+    // Connection of the client whose clock this is
+    uint16_t conn_handle;
+    // Device esp_timer time minus client time, at device time at_us
+    int64_t offset_us;
+    int64_t at_us;
+    // How much faster the device clock runs, in parts per billion
+    int32_t drift_ppb;
+    // Shortest round trip in the window
+    uint32_t rtt_us;
+    // Rounds in the window
+    uint32_t rounds;
+};
+typedef struct gble_time_sync_estimate gble_time_sync_estimate;
+
+typedef void gble_time_sync_update_fn(const gble_time_sync_estimate* estimate, void* context);
+
+struct gble_time_sync_round {
+    // Device time halfway through the round
+    int64_t at_us;
+    int64_t offset_us;
+    uint32_t rtt_us;
+};
+
+struct gble_time_sync_stats {
+    uint32_t requests;
+    // Rounds completed by a matching t3
+    uint32_t rounds;
+    // t3 that did not match the previous round, or impossible stamps
+    uint32_t rejected;
+    // Started over for a new connection
+    uint32_t resets;
+};
+typedef struct gble_time_sync_stats gble_time_sync_stats;
+
+struct gble_time_sync {
+    bool conn_valid;
+    uint16_t conn_handle;
+
+    // Device side of the round awaiting its t3
+    bool pending_valid;
+    uint32_t pending_seq;
+    int64_t pending_t0_us;
+    int64_t pending_t1_us;
+    int64_t pending_t2_us;
+
+    struct gble_time_sync_round window[CONFIG_GBLE_TIME_SYNC_WINDOW];
+    size_t window_count;
+    size_t window_next;
+
+    // Earlier estimate the drift is measured against
+    bool drift_anchor_valid;
+    bool drift_valid;
+    int64_t drift_anchor_offset_us;
+    int64_t drift_anchor_at_us;
+    uint32_t drift_anchor_rtt_us;
+
+    gble_time_sync_estimate estimate;
+
+    gble_time_sync_update_fn* update_cb;
+    void* update_cb_context;
+
+    gble_time_sync_stats stats;
+};
+typedef struct gble_time_sync gble_time_sync;
+
+void gble_time_sync_init(gble_time_sync* sync);
+
+// Called with each new estimate
+void gble_time_sync_set_update_fn(gble_time_sync* sync, gble_time_sync_update_fn* cb, void* cb_context);
+
+// Handles a write stamped with rx_us on arrival, filling in the response to
+// notify. Returns false for a malformed request.
+bool gble_time_sync_handle_request(gble_time_sync* sync, uint16_t conn_handle,
+                                   const uint8_t* buf, size_t buf_size, int64_t rx_us,
+                                   uint8_t* resp, size_t* resp_size);
+
+// Fills in the read value. Returns its size.
+size_t gble_time_sync_get_status(gble_time_sync* sync, uint8_t* buf, size_t buf_size);
+
+void gble_time_sync_get_estimate(gble_time_sync* sync, gble_time_sync_estimate* estimate);
+
+void gble_time_sync_get_stats(gble_time_sync* sync, gble_time_sync_stats* stats);
+
+// Client time to device esp_timer time with the current estimate
+int64_t gble_time_sync_to_device_us(gble_time_sync* sync, int64_t client_us);
+
+// Wrapper functions to work with other APIs
+bool gble_time_sync_handle_request_ctx(uint16_t conn_handle, const uint8_t* buf, size_t buf_size,
+                                       int64_t rx_us, uint8_t* resp, size_t* resp_size, void* context);
+
+size_t gble_time_sync_get_status_ctx(uint8_t* buf, size_t buf_size, void* context);
@@ -18,12 +18,17 @@
  */
 
 #include <assert.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
 
 #include "esp_log.h"
 #include "generic_btle.h"
+#include "gble_actuator_task.h"
+#include "gble_arbiter.h"
+#include "gble_jitter.h"
+#include "gble_pattern.h"
 
 static const char* TAG = "GenericBtle";
 
@@ -50,16 +55,104 @@ static const char* TAG = "GenericBtle";
     CBOR_CHECKED_RET(stmt,)
 
 
-bool gble_init(gble_server* server, const char* name,
-               gble_actuator_feature* actuators, size_t actuator_count,
-               gble_sensor_feature* sensors, size_t sensor_count)
+size_t gble_encode_cbor_head(uint8_t* buf, uint8_t major_type, uint64_t value)
+{
+    size_t size;
+    uint8_t info;
+
+    if (value < 24)
+    {
+        if (buf)
+        {
+            buf[0] = major_type | (uint8_t)value;
+        }
+        return 1;
+    }
+    else if (value <= UINT8_MAX)
+    {
+        size = 1;
+        info = 24;
+    }
+    else if (value <= UINT16_MAX)
+    {
+        size = 2;
+        info = 25;
+    }
+    else if (value <= UINT32_MAX)
+    {
+        size = 4;
+        info = 26;
+    }
+    else
+    {
+        size = 8;
+        info = 27;
+    }
+
+    if (buf)
+    {
+        buf[0] = major_type | info;
+        for (size_t idx = 0; idx < size; ++idx)
+        {
+            buf[1 + idx] = (uint8_t)(value >> (8 * (size - 1 - idx)));
+        }
+    }
+
+    return 1 + size;
+}
+
+static void gble_init_sensor_frame(gble_sensor_feature* sensor)
+{
+    sensor->frame[0] = 0x82;
+    sensor->frame_header_size = 1 + gble_encode_cbor_head(&sensor->frame[1], 0x00, sensor->id);
+    sensor->frame_size = sensor->frame_header_size;
+}
+
+// Rewrites the value of a sensor's pre-encoded frame, picking the shortest
+// encoding for this value.
+static void gble_patch_sensor_frame(gble_sensor_feature* sensor, int32_t value)
+{
+    uint8_t* value_buf = &sensor->frame[sensor->frame_header_size];
+
+    // CBOR negative integers carry -1 - value
+    const size_t value_size = value >= 0 ?
+                              gble_encode_cbor_head(value_buf, 0x00, (uint32_t)value) :
+                              gble_encode_cbor_head(value_buf, 0x20, (uint32_t)(-1 - value));
+
+    sensor->frame_size = sensor->frame_header_size + value_size;
+}
+
+static void gble_init_features(gble_server* server, const char* name,
+                               gble_actuator_feature* actuators, size_t actuator_count,
+                               gble_sensor_feature* sensors, size_t sensor_count)
 {
+    server->descriptor = NULL;
     server->descriptor_size = 0;
     server->name = name;
     server->actuators = actuators;
     server->actuator_count = actuator_count;
     server->sensors = sensors;
     server->sensors_count = sensor_count;
+    server->command_client = GBLE_CLIENT_LOCAL;
+
+    for (size_t idx = 0; idx < actuator_count; ++idx)
+    {
+        actuators[idx].id = idx;
+    }
+
+    for (size_t idx = 0; idx < sensor_count; ++idx)
+    {
+        sensors[idx].id = idx;
+        gble_init_sensor_frame(&sensors[idx]);
+    }
+}
+
+#if CONFIG_GBLE_RUNTIME_DESCRIPTOR
+bool gble_init(gble_server* server, const char* name,
+               gble_actuator_feature* actuators, size_t actuator_count,
+               gble_sensor_feature* sensors, size_t sensor_count)
+{
+    gble_init_features(server, name, actuators, actuator_count, sensors, sensor_count);
 
     CborEncoder root_encoder;
     CborEncoder root_array_encoder;
@@ -90,8 +183,6 @@ bool gble_init(gble_server* server, const char* name,
 
         CBOR_CHECKED_RET_FALSE(cbor_encoder_close_container(&actuators_array, &tmp));
 
-        actuator->id = idx;
-
         ++actuator;
     }
 
@@ -109,14 +200,12 @@ bool gble_init(gble_server* server, const char* name,
 
         CBOR_CHECKED_RET_FALSE(cbor_encode_text_stringz(&tmp, sensor->description));
         CBOR_CHECKED_RET_FALSE(cbor_encode_uint(&tmp, sensor->feature_type));
-        CBOR_CHECKED_RET_FALSE(cbor_encode_uint(&tmp, sensor->value_range_low));
-        CBOR_CHECKED_RET_FALSE(cbor_encode_uint(&tmp, sensor->value_range_high));
+        CBOR_CHECKED_RET_FALSE(cbor_encode_int(&tmp, sensor->value_range_low));
+        CBOR_CHECKED_RET_FALSE(cbor_encode_int(&tmp, sensor->value_range_high));
         CBOR_CHECKED_RET_FALSE(cbor_encode_uint(&tmp, sensor->message_type));
 
         CBOR_CHECKED_RET_FALSE(cbor_encoder_close_container(&sensors_array, &tmp));
 
-        sensor->id = idx;
-
         ++sensor;
     }
 
@@ -124,10 +213,31 @@ bool gble_init(gble_server* server, const char* name,
 
     CBOR_CHECKED_RET_FALSE(cbor_encoder_close_container(&root_encoder, &root_array_encoder));
 
+    server->descriptor = server->descriptor_buffer;
     server->descriptor_size = cbor_encoder_get_buffer_size(&root_encoder, server->descriptor_buffer);
 
     return true;
 }
+#endif
+
+bool gble_init_static(gble_server* server, const char* name,
+                      const uint8_t* descriptor, size_t descriptor_size,
+                      gble_actuator_feature* actuators, size_t actuator_count,
+                      gble_sensor_feature* sensors, size_t sensor_count)
+{
+    gble_init_features(server, name, actuators, actuator_count, sensors, sensor_count);
+
+    if (!descriptor || descriptor_size > GBLE_MAX_DESCRIPTOR_SIZE)
+    {
+        ESP_LOGE(TAG, "Invalid static descriptor of %zu bytes", descriptor_size);
+        return false;
+    }
+
+    server->descriptor = descriptor;
+    server->descriptor_size = descriptor_size;
+
+    return true;
+}
 
 void gble_set_sensor_callback_fn(gble_server* server, gble_sensor_callback_fn* cb, void* cb_context)
 {
@@ -135,131 +245,976 @@ void gble_set_sensor_callback_fn(gble_server* server, gble_sensor_callback_fn* c
     server->sensor_cb_context = cb_context;
 }
 
-void gble_handle_actuators_changed(gble_server* server, uint8_t* buf, size_t buf_size)
+void gble_set_actuators_applied_callback_fn(gble_server* server, gble_actuators_applied_callback_fn* cb,
+                                            void* cb_context)
 {
-    CborParser parser;
-    CborValue root;
+    server->actuators_applied_cb = cb;
+    server->actuators_applied_cb_context = cb_context;
+}
 
-    CBOR_CHECKED(cbor_parser_init(buf, buf_size, 0, &parser, &root));
+bool gble_register_command(gble_server* server, int32_t opcode,
+                           gble_command_callback_fn* cb, void* cb_context)
+{
+    if (opcode >= 0)
+    {
+        ESP_LOGE(TAG, "Command opcodes must be negative, got %" PRId32, opcode);
+        return false;
+    }
 
-    if (!cbor_value_is_array(&root))
+    for (size_t idx = 0; idx < server->command_handler_count; ++idx)
     {
-        ESP_LOGE(TAG, "Expected actuators message to be an array, got: %hhu",
-                 cbor_value_get_type(&root));
-        return;
+        if (server->command_handlers[idx].opcode == opcode)
+        {
+            ESP_LOGE(TAG, "Command %" PRId32 " already registered", opcode);
+            return false;
+        }
     }
 
-    size_t array_len;
-    CBOR_CHECKED(cbor_value_get_array_length(&root, &array_len));
+    if (server->command_handler_count >= GBLE_MAX_COMMAND_HANDLERS)
+    {
+        ESP_LOGE(TAG, "Too many command handlers");
+        return false;
+    }
+
+    struct gble_command_handler* handler = &server->command_handlers[server->command_handler_count++];
+    handler->opcode = opcode;
+    handler->cb = cb;
+    handler->cb_context = cb_context;
+
+    return true;
+}
+
+static bool gble_get_uint32(const CborValue* item, uint32_t* out)
+{
+    uint64_t value;
+    if (!cbor_value_is_unsigned_integer(item) ||
+        cbor_value_get_uint64(item, &value) != CborNoError ||
+        value > UINT32_MAX)
+    {
+        return false;
+    }
+
+    *out = (uint32_t)value;
+    return true;
+}
+
+// Number of elements in a command for this actuator, id included
+static size_t gble_actuator_command_len(const gble_actuator_feature* actuator)
+{
+    switch (actuator->message_type)
+    {
+        case GBLE_ACTUATOR_MSG_LINEAR:
+        case GBLE_ACTUATOR_MSG_ROTATE:
+            return 3;
+
+        default:
+            return 2;
+    }
+}
+
+// Decodes one canonical CBOR unsigned integer of at most 32 bits, returning
+// the number of bytes used or 0 if `buf` holds anything else.
+static size_t gble_decode_uint32(const uint8_t* buf, size_t buf_size, uint32_t* out)
+{
+    if (buf_size == 0 || (buf[0] & 0xe0) != 0x00)
+    {
+        return 0;
+    }
+
+    const uint8_t info = buf[0] & 0x1f;
+
+    if (info < 24)
+    {
+        *out = info;
+        return 1;
+    }
+
+    const size_t width = info == 24 ? 1 :
+                         info == 25 ? 2 :
+                         info == 26 ? 4 : 0;
+
+    if (width == 0 || buf_size < 1 + width)
+    {
+        return 0;
+    }
+
+    uint32_t value = 0;
+    for (size_t idx = 1; idx <= width; ++idx)
+    {
+        value = (value << 8) | buf[idx];
+    }
+
+    *out = value;
+    return 1 + width;
+}
 
-    if (array_len != 2)
+// Decodes a canonical command, [uint, uint] or the three element LINEAR and
+// ROTATE forms, returning the number of bytes used or 0 if `buf` does not
+// start with one.
+static size_t gble_decode_actuator_command_fast(gble_server* server, const uint8_t* buf, size_t buf_size,
+                                                gble_actuator_command* command)
+{
+    if (buf_size < 3 || (buf[0] != 0x82 && buf[0] != 0x83))
+    {
+        return 0;
+    }
+
+    size_t offset = 1;
+
+    size_t used = gble_decode_uint32(&buf[offset], buf_size - offset, &command->id);
+    if (used == 0 || command->id >= server->actuator_count)
+    {
+        return 0;
+    }
+    offset += used;
+
+    const gble_actuator_feature* actuator = &server->actuators[command->id];
+    if ((buf[0] & 0x1f) != gble_actuator_command_len(actuator))
+    {
+        return 0;
+    }
+
+    used = gble_decode_uint32(&buf[offset], buf_size - offset, &command->value);
+    if (used == 0)
+    {
+        return 0;
+    }
+    offset += used;
+
+    command->duration_ms = 0;
+    command->clockwise = false;
+
+    if (actuator->message_type == GBLE_ACTUATOR_MSG_LINEAR)
+    {
+        used = gble_decode_uint32(&buf[offset], buf_size - offset, &command->duration_ms);
+        if (used == 0)
+        {
+            return 0;
+        }
+        offset += used;
+    }
+    else if (actuator->message_type == GBLE_ACTUATOR_MSG_ROTATE)
+    {
+        // CBOR false and true
+        if (offset == buf_size || (buf[offset] != 0xf4 && buf[offset] != 0xf5))
+        {
+            return 0;
+        }
+        command->clockwise = buf[offset] == 0xf5;
+        ++offset;
+    }
+
+    return offset;
+}
+
+// Fast path for what almost every write carries: a single canonical command,
+// or a batch of them in an array short enough for a one-byte header, filling
+// the whole buffer. Returns the number of commands, or 0 to leave the
+// message to tinycbor, which also reports what was wrong with it.
+static size_t gble_decode_actuators_fast(gble_server* server, const uint8_t* buf, size_t buf_size,
+                                         gble_actuator_command* commands)
+{
+    size_t used = gble_decode_actuator_command_fast(server, buf, buf_size, &commands[0]);
+    if (used != 0)
+    {
+        return used == buf_size ? 1 : 0;
+    }
+
+    if (buf_size == 0 || (buf[0] & 0xe0) != 0x80)
+    {
+        return 0;
+    }
+
+    const size_t command_count = buf[0] & 0x1f;
+    if (command_count == 0 || command_count > GBLE_MAX_ACTUATOR_BATCH || command_count >= 24)
+    {
+        return 0;
+    }
+
+    size_t offset = 1;
+
+    for (size_t idx = 0; idx < command_count; ++idx)
+    {
+        used = gble_decode_actuator_command_fast(server, &buf[offset], buf_size - offset, &commands[idx]);
+        if (used == 0)
+        {
+            return 0;
+        }
+        offset += used;
+    }
+
+    return offset == buf_size ? command_count : 0;
+}
+
+// Reads the `len` element command that `item` points into, leaving `item` on
+// the last element.
+static bool gble_parse_actuator_command(gble_server* server, CborValue* item, size_t len,
+                                        gble_actuator_command* command)
+{
+    // Check and get actuator id first
+
+    if (!gble_get_uint32(item, &command->id))
+    {
+        ESP_LOGE(TAG, "Expected uint32 for actuator id, got: %hhu",
+                 cbor_value_get_type(item));
+        return false;
+    }
+
+    if (command->id >= server->actuator_count)
+    {
+        ESP_LOGE(TAG, "Invalid actuator id, got: %" PRIu32,
+                 command->id);
+        return false;
+    }
+
+    const gble_actuator_feature* actuator = &server->actuators[command->id];
+    const size_t expected_len = gble_actuator_command_len(actuator);
+
+    if (len != expected_len)
+    {
+        ESP_LOGE(TAG, "Expected %zu elements for actuator %" PRIu32 ", got: %zu",
+                 expected_len, command->id, len);
+        return false;
+    }
+
+    CBOR_CHECKED_RET_FALSE(cbor_value_advance(item));
+
+    // Check and get actuator value second
+
+    if (!gble_get_uint32(item, &command->value))
+    {
+        ESP_LOGE(TAG, "Expected uint32 for actuator value, got: %hhu",
+                 cbor_value_get_type(item));
+        return false;
+    }
+
+    command->duration_ms = 0;
+    command->clockwise = false;
+
+    if (actuator->message_type == GBLE_ACTUATOR_MSG_LINEAR)
+    {
+        CBOR_CHECKED_RET_FALSE(cbor_value_advance(item));
+
+        if (!gble_get_uint32(item, &command->duration_ms))
+        {
+            ESP_LOGE(TAG, "Expected uint32 for linear duration, got: %hhu",
+                     cbor_value_get_type(item));
+            return false;
+        }
+    }
+    else if (actuator->message_type == GBLE_ACTUATOR_MSG_ROTATE)
+    {
+        CBOR_CHECKED_RET_FALSE(cbor_value_advance(item));
+
+        if (!cbor_value_is_boolean(item))
+        {
+            ESP_LOGE(TAG, "Expected boolean for rotate direction, got: %hhu",
+                     cbor_value_get_type(item));
+            return false;
+        }
+
+        CBOR_CHECKED_RET_FALSE(cbor_value_get_boolean(item, &command->clockwise));
+    }
+
+    return true;
+}
+
+// `entry` is the first command of the batch
+static size_t gble_parse_actuator_batch(gble_server* server, CborValue* entry, size_t array_len,
+                                        gble_actuator_command* commands)
+{
+    if (array_len > GBLE_MAX_ACTUATOR_BATCH)
     {
-        ESP_LOGE(TAG, "Expected 2 elements in message, got: %zu",
+        ESP_LOGE(TAG, "Too many actuators in batch, got: %zu",
                  array_len);
+        return 0;
+    }
+
+    for (size_t idx = 0; idx < array_len; ++idx)
+    {
+        size_t entry_len;
+        if (!cbor_value_is_array(entry) ||
+            cbor_value_get_array_length(entry, &entry_len) != CborNoError)
+        {
+            ESP_LOGE(TAG, "Expected command array at batch index %zu", idx);
+            return 0;
+        }
+
+        CborValue item;
+        CBOR_CHECKED_RET(cbor_value_enter_container(entry, &item), 0);
+
+        if (!gble_parse_actuator_command(server, &item, entry_len, &commands[idx]))
+        {
+            return 0;
+        }
+
+        CBOR_CHECKED_RET(cbor_value_advance(&item), 0);
+        CBOR_CHECKED_RET(cbor_value_leave_container(entry, &item), 0);
+    }
+
+    return array_len;
+}
+
+void gble_dispatch_actuator_command(gble_actuator_feature* actuator, const gble_actuator_command* command)
+{
+    if (actuator->command_cb)
+    {
+        actuator->command_cb(command, actuator->cb_context);
+    }
+    else if (actuator->cb)
+    {
+        actuator->cb(command->id, command->value, actuator->cb_context);
+    }
+}
+
+// Turns each command into what the arbiter makes of it, in place
+static void gble_merge_actuator_commands(gble_server* server, gble_client_id client,
+                                         gble_actuator_command* commands, size_t command_count)
+{
+    for (size_t idx = 0; idx < command_count; ++idx)
+    {
+        gble_arbiter_merge(server->arbiter, client, &commands[idx]);
+    }
+}
+
+// Records commands as written and runs the callbacks of those that changed.
+// With the actuator task, called with its producer lock held, which the
+// commit releases.
+static void gble_update_actuators(gble_server* server, const gble_actuator_command* commands,
+                                  size_t command_count, bool use_task)
+{
+    size_t changed_count = 0;
+
+    for (size_t idx = 0; idx < command_count; ++idx)
+    {
+        const gble_actuator_command* command = &commands[idx];
+        gble_actuator_feature* actuator = &server->actuators[command->id];
+
+        // A rotate command changing only direction is still a change
+        if (command->value != actuator->last_value ||
+            (actuator->message_type == GBLE_ACTUATOR_MSG_ROTATE &&
+             command->clockwise != actuator->last_clockwise))
+        {
+            if (use_task)
+            {
+                gble_actuator_task_push(server->actuator_task, command);
+            }
+            else
+            {
+                gble_dispatch_actuator_command(actuator, command);
+            }
+
+            ++changed_count;
+        }
+
+        actuator->last_value = command->value;
+        actuator->last_clockwise = command->clockwise;
+    }
+
+    if (use_task)
+    {
+        // The task runs the applied callback once it has run the others
+        gble_actuator_task_commit(server->actuator_task);
         return;
     }
 
+    if (changed_count && server->actuators_applied_cb)
+    {
+        server->actuators_applied_cb(changed_count, server->actuators_applied_cb_context);
+    }
+}
+
+static void gble_apply_actuator_commands(gble_server* server, gble_client_id client,
+                                         gble_actuator_command* commands,
+                                         size_t command_count, bool use_task)
+{
+    if (use_task)
+    {
+        // Merges and pushes from other tasks, and last_value, stay in order
+        gble_actuator_task_lock(server->actuator_task);
+    }
+
+    if (server->arbiter)
+    {
+        gble_merge_actuator_commands(server, client, commands, command_count);
+    }
+
+    gble_update_actuators(server, commands, command_count, use_task);
+}
+
+void gble_submit_actuator_commands(gble_server* server, gble_client_id client,
+                                   gble_actuator_command* commands, size_t command_count)
+{
+    gble_apply_actuator_commands(server, client, commands, command_count, server->actuator_task != NULL);
+}
+
+void gble_output_actuator_commands(gble_server* server, gble_client_id client,
+                                   gble_actuator_command* commands, size_t command_count)
+{
+    const bool use_task = server->actuator_task != NULL;
+
+    if (use_task)
+    {
+        gble_actuator_task_lock(server->actuator_task);
+    }
+
+    if (server->arbiter)
+    {
+        gble_merge_actuator_commands(server, client, commands, command_count);
+    }
+
+    for (size_t idx = 0; idx < command_count; ++idx)
+    {
+        if (use_task)
+        {
+            gble_actuator_task_push(server->actuator_task, &commands[idx]);
+        }
+        else
+        {
+            gble_dispatch_actuator_command(&server->actuators[commands[idx].id], &commands[idx]);
+        }
+    }
+
+    if (use_task)
+    {
+        gble_actuator_task_commit(server->actuator_task);
+    }
+}
+
+// `item` is the first element of the `array_len` element message. Only
+// ever moves forward, as a reader over an mbuf chain cannot go back.
+static size_t gble_parse_actuator_elements(gble_server* server, CborValue* item, size_t array_len,
+                                           gble_actuator_command* commands)
+{
+    if (array_len > 0 && cbor_value_is_array(item))
+    {
+        return gble_parse_actuator_batch(server, item, array_len, commands);
+    }
+
+    if (array_len < 2)
+    {
+        ESP_LOGE(TAG, "Expected at least 2 elements in message, got: %zu",
+                 array_len);
+        return 0;
+    }
+
+    return gble_parse_actuator_command(server, item, array_len, &commands[0]) ? 1 : 0;
+}
+
+size_t gble_parse_actuator_message(gble_server* server, CborValue* message,
+                                   gble_actuator_command* commands)
+{
+    if (!cbor_value_is_array(message))
+    {
+        ESP_LOGE(TAG, "Expected actuators message to be an array, got: %hhu",
+                 cbor_value_get_type(message));
+        return 0;
+    }
+
+    size_t array_len;
+    CBOR_CHECKED_RET(cbor_value_get_array_length(message, &array_len), 0);
+
     CborValue item;
-    CBOR_CHECKED(cbor_value_enter_container(&root, &item));
+    CBOR_CHECKED_RET(cbor_value_enter_container(message, &item), 0);
 
-    // Check and get actuator id first
+    return gble_parse_actuator_elements(server, &item, array_len, commands);
+}
+
+// item is the opcode
+static void gble_handle_command(gble_server* server, CborValue* item, size_t array_len)
+{
+    int64_t opcode;
+    CBOR_CHECKED(cbor_value_get_int64(item, &opcode));
+    CBOR_CHECKED(cbor_value_advance_fixed(item));
 
-    if (!cbor_value_is_integer(&item))
+    for (size_t idx = 0; idx < server->command_handler_count; ++idx)
     {
-        ESP_LOGE(TAG, "Expected integer for actuator id, got: %hhu",
-                 cbor_value_get_type(&root));
-        return;
+        struct gble_command_handler* handler = &server->command_handlers[idx];
+
+        if (handler->opcode == opcode)
+        {
+            handler->cb((int32_t)opcode, item, array_len - 1, handler->cb_context);
+            return;
+        }
     }
 
-    // TODO: Not sure how to actually get a uint32_t here
-    int int_value;
-    CBOR_CHECKED(cbor_value_get_int(&item, &int_value));
+    ESP_LOGE(TAG, "Unknown command %" PRId64, opcode);
+}
+
+// Everything tinycbor parses, whatever the source
+static void gble_handle_actuators_value(gble_server* server, gble_client_id client, CborValue* root)
+{
+    gble_actuator_command commands[GBLE_MAX_ACTUATOR_BATCH];
+    size_t command_count;
+
+    if (cbor_value_is_array(root))
+    {
+        size_t array_len;
+        CBOR_CHECKED(cbor_value_get_array_length(root, &array_len));
+
+        CborValue item;
+        CBOR_CHECKED(cbor_value_enter_container(root, &item));
+
+        if (array_len > 0 && cbor_value_is_negative_integer(&item))
+        {
+            server->command_client = client;
+            gble_handle_command(server, &item, array_len);
+            server->command_client = GBLE_CLIENT_LOCAL;
+            return;
+        }
+
+        command_count = gble_parse_actuator_elements(server, &item, array_len, commands);
+    }
+    else
+    {
+        command_count = gble_parse_actuator_message(server, root, commands);
+    }
 
-    uint32_t actuator_id = (uint32_t)int_value;
-    if (actuator_id >= server->actuator_count)
+    if (command_count == 0)
     {
-        ESP_LOGE(TAG, "Invalid actuator id, got: %lu",
-                 actuator_id);
         return;
     }
 
-    CBOR_CHECKED(cbor_value_advance(&item));
+    gble_apply_actuator_commands(server, client, commands, command_count, server->actuator_task != NULL);
+}
 
-    // Check and get actuator value second
+void gble_handle_client_actuators_changed(gble_server* server, gble_client_id client,
+                                          uint8_t* buf, size_t buf_size)
+{
+    gble_actuator_command commands[GBLE_MAX_ACTUATOR_BATCH];
+    size_t command_count = gble_decode_actuators_fast(server, buf, buf_size, commands);
 
-    if (!cbor_value_is_integer(&item))
+    if (command_count == 0)
     {
-        ESP_LOGE(TAG, "Expected integer for actuator value, got: %hhu",
-                 cbor_value_get_type(&root));
+        CborParser parser;
+        CborValue root;
+
+        CBOR_CHECKED(cbor_parser_init(buf, buf_size, 0, &parser, &root));
+
+        gble_handle_actuators_value(server, client, &root);
         return;
     }
 
-    // TODO: Not sure how to actually get a uint32_t here
-    CBOR_CHECKED(cbor_value_get_int(&item, &int_value));
+    gble_apply_actuator_commands(server, client, commands, command_count, server->actuator_task != NULL);
+}
+
+void gble_handle_client_actuators_changed_reader(gble_server* server, gble_client_id client,
+                                                 const struct CborParserOperations* ops, void* token)
+{
+    CborParser parser;
+    CborValue root;
+
+    CBOR_CHECKED(cbor_parser_init_reader(ops, &parser, &root, token));
+
+    gble_handle_actuators_value(server, client, &root);
+}
+
+void gble_handle_actuators_changed(gble_server* server, uint8_t* buf, size_t buf_size)
+{
+    gble_handle_client_actuators_changed(server, GBLE_CLIENT_LOCAL, buf, buf_size);
+}
+
+void gble_handle_actuators_changed_reader(gble_server* server, const struct CborParserOperations* ops, void* token)
+{
+    gble_handle_client_actuators_changed_reader(server, GBLE_CLIENT_LOCAL, ops, token);
+}
+
+void gble_client_disconnected(gble_server* server, gble_client_id client)
+{
+    // Nothing the client queued or started outlives it
+    if (server->jitter)
+    {
+        gble_jitter_drop_client(server->jitter, client);
+    }
 
-    gble_actuator_feature* actuator = &server->actuators[actuator_id];
+    if (server->patterns)
+    {
+        gble_pattern_drop_client(server->patterns, client);
+    }
 
-    uint32_t new_value = (uint32_t)int_value;
+    if (!server->arbiter)
+    {
+        return;
+    }
 
-    uint32_t last_value = actuator->last_value;
+    const bool use_task = server->actuator_task != NULL;
+    gble_actuator_command commands[CONFIG_GBLE_ARBITER_MAX_ACTUATORS];
 
-    if (new_value != last_value && actuator->cb)
+    if (use_task)
     {
-        actuator->cb(actuator_id, new_value, actuator->cb_context);
+        gble_actuator_task_lock(server->actuator_task);
     }
 
-    actuator->last_value = new_value;
+    const size_t command_count = gble_arbiter_release(server->arbiter, client, commands);
+
+    gble_update_actuators(server, commands, command_count, use_task);
 }
 
-uint8_t* gble_get_descriptor(gble_server* server, size_t* descriptor_size)
+const uint8_t* gble_get_descriptor(gble_server* server, size_t* descriptor_size)
 {
     *descriptor_size = server->descriptor_size;
-    return server->descriptor_buffer;
+    return server->descriptor;
+}
+
+static size_t gble_array_head_size(size_t count)
+{
+    return count < 24 ? 1 : count <= UINT8_MAX ? 2 : count <= UINT16_MAX ? 3 : 5;
+}
+
+// Called with the coalescing lock held
+static void gble_send_pending_sensor_values(gble_server* server)
+{
+    if (server->coalesce_pending_count == 0)
+    {
+        return;
+    }
+
+    if (server->coalesce_armed)
+    {
+        esp_timer_stop(server->coalesce_timer);
+        server->coalesce_armed = false;
+    }
+
+    size_t frame_size_max = GBLE_SENSOR_COALESCED_FRAME_DEFAULT;
+    if (server->sensor_frame_size_cb)
+    {
+        frame_size_max = server->sensor_frame_size_cb(server->sensor_frame_size_cb_context);
+    }
+
+    if (frame_size_max > GBLE_SENSOR_COALESCED_FRAME_MAX)
+    {
+        frame_size_max = GBLE_SENSOR_COALESCED_FRAME_MAX;
+    }
+
+    size_t next = 0;
+    while (next < server->sensors_count)
+    {
+        // Greedily take pending sensors in id order while they fit
+        size_t first = server->sensors_count;
+        size_t last = first;
+        size_t count = 0;
+        size_t values_size = 0;
+
+        for (size_t idx = next; idx < server->sensors_count; ++idx)
+        {
+            const gble_sensor_feature* sensor = &server->sensors[idx];
+            if (!sensor->pending)
+            {
+                continue;
+            }
+
+            if (count > 0 &&
+                gble_array_head_size(count + 1) + values_size + sensor->frame_size > frame_size_max)
+            {
+                break;
+            }
+
+            first = count == 0 ? idx : first;
+            last = idx;
+            ++count;
+            values_size += sensor->frame_size;
+        }
+
+        if (count == 0)
+        {
+            break;
+        }
+
+        uint8_t frame[GBLE_SENSOR_COALESCED_FRAME_MAX + GBLE_SENSOR_FRAME_MAX];
+        const uint8_t* out = frame;
+        size_t out_size;
+        gble_sensor_priority priority = GBLE_SENSOR_PRIORITY_NORMAL;
+
+        if (count == 1)
+        {
+            out = server->sensors[first].frame;
+            out_size = server->sensors[first].frame_size;
+        }
+        else
+        {
+            out_size = gble_encode_cbor_head(frame, 0x80, count);
+            for (size_t idx = first; idx <= last; ++idx)
+            {
+                gble_sensor_feature* sensor = &server->sensors[idx];
+                if (sensor->pending)
+                {
+                    memcpy(&frame[out_size], sensor->frame, sensor->frame_size);
+                    out_size += sensor->frame_size;
+                }
+            }
+        }
+
+        for (size_t idx = first; idx <= last; ++idx)
+        {
+            if (server->sensors[idx].pending && server->sensors[idx].urgent)
+            {
+                priority = GBLE_SENSOR_PRIORITY_URGENT;
+            }
+
+            server->sensors[idx].pending = false;
+        }
+
+        ++server->coalesce_stats.frames;
+        server->sensor_cb((uint8_t*)out, out_size, priority, server->sensor_cb_context);
+
+        next = last + 1;
+    }
+
+    server->coalesce_pending_count = 0;
+}
+
+static void gble_coalesce_timer_cb(void* arg)
+{
+    gble_server* server = (gble_server*)arg;
+
+    xSemaphoreTake(server->coalesce_lock, portMAX_DELAY);
+
+    // A flush may have beaten the timer to it
+    if (server->coalesce_armed)
+    {
+        server->coalesce_armed = false;
+        ++server->coalesce_stats.deadline_flushes;
+        gble_send_pending_sensor_values(server);
+    }
+
+    xSemaphoreGive(server->coalesce_lock);
+}
+
+bool gble_set_sensor_coalescing(gble_server* server, uint32_t window_ms)
+{
+    if (!server->coalesce_lock)
+    {
+        server->coalesce_lock = xSemaphoreCreateMutex();
+        if (!server->coalesce_lock)
+        {
+            ESP_LOGE(TAG, "Failed to create coalescing lock");
+            return false;
+        }
+    }
+
+    if (!server->coalesce_timer)
+    {
+        const esp_timer_create_args_t timer_args = {
+            .callback = gble_coalesce_timer_cb,
+            .arg = server,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "gble_coalesce",
+        };
+
+        if (esp_timer_create(&timer_args, &server->coalesce_timer) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to create coalescing timer");
+            return false;
+        }
+    }
+
+    xSemaphoreTake(server->coalesce_lock, portMAX_DELAY);
+
+    if (window_ms == 0 && server->sensor_cb)
+    {
+        gble_send_pending_sensor_values(server);
+    }
+
+    server->coalesce_window_us = window_ms * 1000;
+
+    xSemaphoreGive(server->coalesce_lock);
+
+    return true;
+}
+
+void gble_set_sensor_frame_size_fn(gble_server* server, gble_sensor_frame_size_fn* cb, void* cb_context)
+{
+    server->sensor_frame_size_cb = cb;
+    server->sensor_frame_size_cb_context = cb_context;
+}
+
+void gble_flush_sensor_values(gble_server* server)
+{
+    if (!server->coalesce_lock || !server->sensor_cb)
+    {
+        return;
+    }
+
+    xSemaphoreTake(server->coalesce_lock, portMAX_DELAY);
+    gble_send_pending_sensor_values(server);
+    xSemaphoreGive(server->coalesce_lock);
+}
+
+void gble_get_sensor_coalesce_stats(gble_server* server, gble_sensor_coalesce_stats* stats)
+{
+    if (!server->coalesce_lock)
+    {
+        *stats = server->coalesce_stats;
+        return;
+    }
+
+    xSemaphoreTake(server->coalesce_lock, portMAX_DELAY);
+    *stats = server->coalesce_stats;
+    xSemaphoreGive(server->coalesce_lock);
+}
+
+// Size of the CBOR head at buf, or 0 if it is cut off or indefinite
+static size_t gble_head_size(const uint8_t* buf, size_t buf_size)
+{
+    if (buf_size == 0)
+    {
+        return 0;
+    }
+
+    const uint8_t info = buf[0] & 0x1f;
+    const size_t size = info < 24 ? 1 :
+                        info == 24 ? 2 :
+                        info == 25 ? 3 :
+                        info == 26 ? 5 :
+                        info == 27 ? 9 : 0;
+
+    return size <= buf_size ? size : 0;
+}
+
+// Sets the bit of the [id, value] frame at buf in key; returns its size, or
+// 0 if it is not one
+static size_t gble_sensor_frame_key(const uint8_t* buf, size_t buf_size, uint64_t* key)
+{
+    uint32_t id;
+
+    if (buf_size < 3 || buf[0] != 0x82)
+    {
+        return 0;
+    }
+
+    const size_t id_size = gble_decode_uint32(&buf[1], buf_size - 1, &id);
+    if (id_size == 0 || id >= 64 || 1 + id_size == buf_size || (buf[1 + id_size] & 0xc0) != 0x00)
+    {
+        return 0;
+    }
+
+    const size_t value_size = gble_head_size(&buf[1 + id_size], buf_size - 1 - id_size);
+    if (value_size == 0)
+    {
+        return 0;
+    }
+
+    *key |= (uint64_t)1 << id;
+    return 1 + id_size + value_size;
+}
+
+uint64_t gble_get_sensor_frame_key(const uint8_t* buf, size_t buf_size)
+{
+    uint64_t key = 0;
+
+    if (gble_sensor_frame_key(buf, buf_size, &key) == buf_size)
+    {
+        return key;
+    }
+
+    // A coalesced [[id, value], ...] frame, which never holds 256 sensors
+    if (buf_size < 2 || (buf[0] & 0xe0) != 0x80 || (buf[0] & 0x1f) > 24)
+    {
+        return 0;
+    }
+
+    const uint32_t count = (buf[0] & 0x1f) < 24 ? buf[0] & 0x1f : buf[1];
+    size_t offset = (buf[0] & 0x1f) < 24 ? 1 : 2;
+
+    key = 0;
+    for (uint32_t idx = 0; idx < count; ++idx)
+    {
+        const size_t size = gble_sensor_frame_key(&buf[offset], buf_size - offset, &key);
+        if (size == 0)
+        {
+            return 0;
+        }
+
+        offset += size;
+    }
+
+    return offset == buf_size ? key : 0;
 }
 
 bool gble_set_sensor_value(gble_server* server, gble_sensor_id id, int32_t value)
 {
     if (id >= server->sensors_count)
     {
-        ESP_LOGE(TAG, "Invalid sensor ID %lu", id);
+        ESP_LOGE(TAG, "Invalid sensor ID %" PRIu32, id);
         return false;
     }
 
     server->sensors[id].last_value = value;
 
-    if (server->sensor_cb)
+    if (!server->sensor_cb)
     {
-        uint8_t tmp_buf[512];
+        return true;
+    }
 
-        CborEncoder root_encoder;
+    gble_sensor_feature* sensor = &server->sensors[id];
 
-        cbor_encoder_init(&root_encoder, tmp_buf, sizeof(tmp_buf), 0);
+    if (server->coalesce_window_us == 0)
+    {
+        gble_patch_sensor_frame(sensor, value);
 
-        CborEncoder array_encoder;
+        const gble_sensor_priority priority = sensor->urgent ? GBLE_SENSOR_PRIORITY_URGENT
+                                                             : GBLE_SENSOR_PRIORITY_NORMAL;
 
-        CBOR_CHECKED_RET_FALSE(cbor_encoder_create_array(&root_encoder, &array_encoder, 2));
+        server->sensor_cb(sensor->frame, sensor->frame_size, priority, server->sensor_cb_context);
+        return true;
+    }
 
-        CBOR_CHECKED_RET_FALSE(cbor_encode_uint(&array_encoder, id));
+    xSemaphoreTake(server->coalesce_lock, portMAX_DELAY);
 
-        CBOR_CHECKED_RET_FALSE(cbor_encode_int(&array_encoder, value));
+    ++server->coalesce_stats.updates;
 
-        CBOR_CHECKED_RET_FALSE(cbor_encoder_close_container(&root_encoder, &array_encoder));
+    if (sensor->pending)
+    {
+        ++server->coalesce_stats.replaced;
+    }
+    else
+    {
+        sensor->pending = true;
+        ++server->coalesce_pending_count;
+    }
 
-        const size_t buf_size = cbor_encoder_get_buffer_size(&root_encoder, tmp_buf);
+    gble_patch_sensor_frame(sensor, value);
 
-        server->sensor_cb(tmp_buf, buf_size, server->sensor_cb_context);
+    if (sensor->urgent)
+    {
+        ++server->coalesce_stats.urgent_flushes;
+        gble_send_pending_sensor_values(server);
     }
+    else if (!server->coalesce_armed)
+    {
+        // Not pushed back by later updates, so the window bounds the latency
+        esp_timer_start_once(server->coalesce_timer, server->coalesce_window_us);
+        server->coalesce_armed = true;
+    }
+
+    xSemaphoreGive(server->coalesce_lock);
 
     return true;
 }
 
 // Wrapper functions to work with other APIs
-void gble_handle_actuators_changed_ctx(uint8_t* buf, size_t buf_size, void* context)
+void gble_handle_actuators_changed_ctx(uint16_t conn_handle, uint8_t* buf, size_t buf_size, void* context)
+{
+    gble_handle_client_actuators_changed((gble_server*)context, conn_handle, buf, buf_size);
+}
+
+void gble_handle_actuators_changed_reader_ctx(uint16_t conn_handle, const struct CborParserOperations* ops,
+                                              void* token, void* context)
+{
+    gble_handle_client_actuators_changed_reader((gble_server*)context, conn_handle, ops, token);
+}
+
+void gble_client_disconnected_ctx(uint16_t conn_handle, void* context)
+{
+    gble_client_disconnected((gble_server*)context, conn_handle);
+}
+
+uint64_t gble_get_sensor_frame_key_ctx(const uint8_t* buf, size_t buf_size, void* context)
 {
-    gble_handle_actuators_changed((gble_server*)context, buf, buf_size);
+    return gble_get_sensor_frame_key(buf, buf_size);
 }
 
-uint8_t* gble_get_descriptor_ctx(size_t* buf_size, void* context)
+const uint8_t* gble_get_descriptor_ctx(size_t* buf_size, void* context)
 {
     return gble_get_descriptor((gble_server*)context, buf_size);
 }
@@ -19,18 +19,51 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
 
+#include "sdkconfig.h"
 #include "cbor.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 #define COUNT_OF(x) ((sizeof(x)/sizeof(0[x])) / ((size_t)(!(sizeof(x) % sizeof(0[x])))))
 #define BOOL_STR(b) (b) ? "true" : "false"
 
 #define GBLE_VERSION 1
 
+// Longest descriptor a client can read from the firmware characteristic
+#define GBLE_MAX_DESCRIPTOR_SIZE 512
+
+// Most [id, value] pairs accepted in one batched actuator message
+#define GBLE_MAX_ACTUATOR_BATCH 16
+
+// Most command frame handlers a server can register
+#define GBLE_MAX_COMMAND_HANDLERS 16
+
+// Largest encoded [id, value] sensor message: array header, uint32 id, int32 value
+#define GBLE_SENSOR_FRAME_MAX (1 + 5 + 5)
+
+// Largest coalesced [[id, value], ...] sensor notification
+#define GBLE_SENSOR_COALESCED_FRAME_MAX 256
+
+// Coalesced notification size without a frame size callback: the default
+// ATT MTU of 23 less the notification header
+#define GBLE_SENSOR_COALESCED_FRAME_DEFAULT 20
+
 typedef uint32_t gble_actuator_id;
 
+// Who a message came from: the BLE connection handle of the central, or
+// GBLE_CLIENT_LOCAL for the device itself
+typedef uint16_t gble_client_id;
+#define GBLE_CLIENT_LOCAL 0xffff
+
 #define GBLE_ACTUATOR_TYPE_VIBRATE   1
 #define GBLE_ACTUATOR_TYPE_ROTATE    2
 #define GBLE_ACTUATOR_TYPE_OSCILLATE 3
@@ -46,6 +79,26 @@ typedef uint8_t gble_actuator_msg;
 
 typedef void gble_actuator_callback_fn(gble_actuator_id actuator_id, uint32_t value, void* context);
 
+// A decoded actuator message: [id, value] for SCALAR,
+// [id, position, duration_ms] for LINEAR and [id, speed, clockwise] for
+// ROTATE. value holds the step, position or speed.
+struct gble_actuator_command {
+    gble_actuator_id id;
+    uint32_t value;
+
+    // LINEAR only: time to reach the position, 0 for as fast as possible
+    uint32_t duration_ms;
+
+    // ROTATE only
+    bool clockwise;
+};
+typedef struct gble_actuator_command gble_actuator_command;
+
+typedef void gble_actuator_command_callback_fn(const gble_actuator_command* command, void* context);
+
+// Called once after all actuator changes of a message have been applied
+typedef void gble_actuators_applied_callback_fn(size_t changed_count, void* context);
+
 struct gble_actuator_feature {
     const char* description;
     gble_actuator_type feature_type;
@@ -54,13 +107,17 @@ struct gble_actuator_feature {
     gble_actuator_msg message_type;
 
     gble_actuator_callback_fn* cb;
+    // Takes precedence over cb and gets the whole command, which LINEAR and
+    // ROTATE actuators need; called with cb_context too
+    gble_actuator_command_callback_fn* command_cb;
     void* cb_context;
 
     // Filled in by gble_init
     gble_actuator_id id;
 
-    // Filled in by gble_set_sensor_value
+    // Filled in by gble_handle_actuators_changed
     uint32_t last_value;
+    bool last_clockwise;
 };
 typedef struct gble_actuator_feature gble_actuator_feature;
 
@@ -83,14 +140,50 @@ struct gble_sensor_feature {
     int32_t value_range_high;
     gble_sensor_msg message_type;
 
+    // Sent ahead of other notifications; with coalescing on, sends this
+    // update at once along with any pending ones instead of waiting out the
+    // window
+    bool urgent;
+
     // Filled in by gble_init
     gble_sensor_id id;
 
     // Filled in by gble_set_sensor_value
     int32_t last_value;
+    // Waiting in the coalescing window
+    bool pending;
+
+    // Pre-encoded [id, value] notification: gble_init writes the array and id
+    // header once, gble_set_sensor_value rewrites only the value after it
+    uint8_t frame[GBLE_SENSOR_FRAME_MAX];
+    uint8_t frame_header_size;
+    uint8_t frame_size;
 };
 typedef struct gble_sensor_feature gble_sensor_feature;
 
+// Command frames are [opcode, args...] written to the actuator
+// characteristic. Opcodes are negative so a frame is never mistaken for an
+// actuator message, which starts with an id. Allocated here so modules do
+// not collide.
+#define GBLE_COMMAND_PATTERN_UPLOAD    -1
+#define GBLE_COMMAND_PATTERN_PLAY      -2
+#define GBLE_COMMAND_PATTERN_STOP      -3
+#define GBLE_COMMAND_PATTERN_SPEED     -4
+#define GBLE_COMMAND_PATTERN_INTENSITY -5
+#define GBLE_COMMAND_PATTERN_SAVE      -6
+#define GBLE_COMMAND_PATTERN_DELETE    -7
+#define GBLE_COMMAND_TIMED             -8
+#define GBLE_COMMAND_ARBITER_PRIORITY  -9
+
+// args is positioned at the first argument, after the opcode
+typedef void gble_command_callback_fn(int32_t opcode, CborValue* args, size_t arg_count, void* context);
+
+struct gble_command_handler {
+    int32_t opcode;
+    gble_command_callback_fn* cb;
+    void* cb_context;
+};
+
 struct gble_descriptor {
     CborEncoder rootEncoder;
     CborEncoder rootArrayEncoder;
@@ -101,11 +194,36 @@ struct gble_descriptor {
 };
 typedef struct gble_descriptor gble_descriptor;
 
-typedef void gble_sensor_callback_fn(uint8_t* buf, size_t buf_size, void* context);
+// Where a sensor notification goes in the outbound queue, most urgent first
+#define GBLE_SENSOR_PRIORITY_URGENT 0
+#define GBLE_SENSOR_PRIORITY_NORMAL 1
+#define GBLE_SENSOR_PRIORITY_BULK   2
+typedef uint8_t gble_sensor_priority;
+
+typedef void gble_sensor_callback_fn(uint8_t* buf, size_t buf_size, gble_sensor_priority priority, void* context);
+
+// Largest notification every subscriber can take right now
+typedef size_t gble_sensor_frame_size_fn(void* context);
+
+struct gble_sensor_coalesce_stats {
+    // gble_set_sensor_value calls while coalescing
+    uint32_t updates;
+    // Updates that replaced a value still waiting in the window
+    uint32_t replaced;
+    // Notifications handed to the sensor callback; updates - frames is what
+    // coalescing saved
+    uint32_t frames;
+    uint32_t urgent_flushes;
+    uint32_t deadline_flushes;
+};
+typedef struct gble_sensor_coalesce_stats gble_sensor_coalesce_stats;
 
 struct gble_server
 {
-    uint8_t descriptor_buffer[512];
+#if CONFIG_GBLE_RUNTIME_DESCRIPTOR
+    uint8_t descriptor_buffer[GBLE_MAX_DESCRIPTOR_SIZE];
+#endif
+    const uint8_t* descriptor;
     size_t descriptor_size;
 
     const char* name;
@@ -118,22 +236,153 @@ struct gble_server
 
     gble_sensor_callback_fn* sensor_cb;
     void* sensor_cb_context;
+
+    // Sensor notification coalescing, see gble_set_sensor_coalescing
+    uint32_t coalesce_window_us;
+    esp_timer_handle_t coalesce_timer;
+    SemaphoreHandle_t coalesce_lock;
+    bool coalesce_armed;
+    size_t coalesce_pending_count;
+    gble_sensor_frame_size_fn* sensor_frame_size_cb;
+    void* sensor_frame_size_cb_context;
+    gble_sensor_coalesce_stats coalesce_stats;
+
+    gble_actuators_applied_callback_fn* actuators_applied_cb;
+    void* actuators_applied_cb_context;
+
+    struct gble_command_handler command_handlers[GBLE_MAX_COMMAND_HANDLERS];
+    size_t command_handler_count;
+
+    // Set by gble_actuator_task_start; actuator callbacks then run on that
+    // task instead of in gble_handle_actuators_changed
+    struct gble_actuator_task* actuator_task;
+
+    // Set by gble_arbiter_start; commands from several clients are then
+    // merged per actuator before they are applied
+    struct gble_arbiter* arbiter;
+
+    // Set by gble_jitter_start and gble_pattern_start, so a client's timed
+    // commands and patterns end when it disconnects
+    struct gble_jitter_buffer* jitter;
+    struct gble_pattern_engine* patterns;
+
+    // Sender of the message being handled, for command handlers
+    gble_client_id command_client;
 };
 typedef struct gble_server gble_server;
 
+#if CONFIG_GBLE_RUNTIME_DESCRIPTOR
 bool gble_init(gble_server* server, const char* name,
                gble_actuator_feature* actuators, size_t actuator_count,
                gble_sensor_feature* sensors, size_t sensors_count);
+#endif
+
+// Like gble_init, but serves a descriptor encoded ahead of time, usually at
+// compile time by gble_descriptor.hpp. The descriptor must describe the
+// given features in order and outlive the server.
+bool gble_init_static(gble_server* server, const char* name,
+                      const uint8_t* descriptor, size_t descriptor_size,
+                      gble_actuator_feature* actuators, size_t actuator_count,
+                      gble_sensor_feature* sensors, size_t sensors_count);
 
 void gble_set_sensor_callback_fn(gble_server* server, gble_sensor_callback_fn* cb, void* cb_context);
 
+// Holds sensor updates for up to window_ms after the first one and sends
+// everything that changed meanwhile as one [[id, value], ...] notification,
+// or [id, value] if only one sensor did. The latest value of each sensor
+// wins. Urgent sensors flush at once. Notifications are split to fit the
+// frame size callback. 0 turns coalescing off, sending what is pending.
+bool gble_set_sensor_coalescing(gble_server* server, uint32_t window_ms);
+
+void gble_set_sensor_frame_size_fn(gble_server* server, gble_sensor_frame_size_fn* cb, void* cb_context);
+
+// Sends the pending sensor updates now
+void gble_flush_sensor_values(gble_server* server);
+
+// Which sensors a notification from the sensor callback carries, one bit
+// per id, so a queue only lets a newer frame replace one of the same
+// sensors. 0 for anything else, such as gble_stream sample blocks, which
+// are never replaced, and for sensors past id 63.
+uint64_t gble_get_sensor_frame_key(const uint8_t* buf, size_t buf_size);
+
+void gble_get_sensor_coalesce_stats(gble_server* server, gble_sensor_coalesce_stats* stats);
+
+void gble_set_actuators_applied_callback_fn(gble_server* server, gble_actuators_applied_callback_fn* cb,
+                                            void* cb_context);
+
+// Routes command frames with this opcode to cb. One handler per opcode.
+bool gble_register_command(gble_server* server, int32_t opcode,
+                           gble_command_callback_fn* cb, void* cb_context);
+
+// Accepts either a single command or a batch [command, ...], where each
+// command has the shape of its actuator's message type (see
+// gble_actuator_command). A batch is validated as a whole before any
+// actuator callback runs. Command frames go to their registered handler.
 void gble_handle_actuators_changed(gble_server* server, uint8_t* buf, size_t buf_size);
 
-uint8_t* gble_get_descriptor(gble_server* server, size_t* descriptor_size);
+// As gble_handle_actuators_changed, for a message read through tinycbor's
+// reader interface, such as a write left in pieces by the BLE stack. Parsing
+// only moves forward, and there is no fast path.
+void gble_handle_actuators_changed_reader(gble_server* server, const struct CborParserOperations* ops, void* token);
+
+// As the two above, for a message sent by `client`. The plain ones are from
+// GBLE_CLIENT_LOCAL.
+void gble_handle_client_actuators_changed(gble_server* server, gble_client_id client,
+                                          uint8_t* buf, size_t buf_size);
+
+void gble_handle_client_actuators_changed_reader(gble_server* server, gble_client_id client,
+                                                 const struct CborParserOperations* ops, void* token);
+
+// Drops what the client asked for: its queued timed commands and its
+// patterns end, and with an arbiter, actuators it was driving go back to
+// what the others ask for.
+void gble_client_disconnected(gble_server* server, gble_client_id client);
+
+// Parses an actuator message, single or batch, that `message` points to,
+// into at most GBLE_MAX_ACTUATOR_BATCH commands. Returns the number of
+// commands, or 0 if the message is invalid. For command handlers that carry
+// actuator messages.
+size_t gble_parse_actuator_message(gble_server* server, CborValue* message,
+                                   gble_actuator_command* commands);
+
+// Writes `value` as the shortest CBOR head of `major_type` (0x00 uint, 0x20
+// negative, 0x40 bytes, 0x80 array), returning the number of bytes used,
+// at most 9. With buf NULL only counts them.
+size_t gble_encode_cbor_head(uint8_t* buf, uint8_t major_type, uint64_t value);
+
+// Applies commands from client as gble_handle_client_actuators_changed
+// does, from any task: merged by the arbiter if there is one, then through
+// the actuator task when one runs, so they are ordered with writes and run
+// where every other callback does, else on the calling task.
+void gble_submit_actuator_commands(gble_server* server, gble_client_id client,
+                                   gble_actuator_command* commands, size_t command_count);
+
+// Runs the callbacks for commands from client that are not writes, such as
+// pattern output, without touching last_value: merged by the arbiter if
+// there is one, then through the actuator task when one runs, else on the
+// calling task. Never call it with a lock a callback may take.
+void gble_output_actuator_commands(gble_server* server, gble_client_id client,
+                                   gble_actuator_command* commands, size_t command_count);
+
+// Runs the actuator's command_cb, or its cb with the command value.
+void gble_dispatch_actuator_command(gble_actuator_feature* actuator, const gble_actuator_command* command);
+
+const uint8_t* gble_get_descriptor(gble_server* server, size_t* descriptor_size);
 
 bool gble_set_sensor_value(gble_server* server, gble_sensor_id id, int32_t value);
 
 // Wrapper functions to work with other APIs
-void gble_handle_actuators_changed_ctx(uint8_t* buf, size_t buf_size, void* context);
+void gble_handle_actuators_changed_ctx(uint16_t conn_handle, uint8_t* buf, size_t buf_size, void* context);
+
+void gble_handle_actuators_changed_reader_ctx(uint16_t conn_handle, const struct CborParserOperations* ops,
+                                              void* token, void* context);
+
+void gble_client_disconnected_ctx(uint16_t conn_handle, void* context);
+
+const uint8_t* gble_get_descriptor_ctx(size_t* buf_size, void* context);
+
+uint64_t gble_get_sensor_frame_key_ctx(const uint8_t* buf, size_t buf_size, void* context);
 
-uint8_t* gble_get_descriptor_ctx(size_t* buf_size, void* context);
+#ifdef __cplusplus
+}
+#endif
@@ -26,9 +26,17 @@
 #include "driver/gpio.h"
 #include "nvs_flash.h"
 
+#include "ble_conn_profile.h"
 #include "ble_func.h"
 #include "gatt_svr.h"
 #include "generic_btle.h"
+#include "gble_actuator_task.h"
+#include "gble_arbiter.h"
+#include "gble_broadcast.h"
+#include "gble_jitter.h"
+#include "gble_pattern.h"
+#include "gble_stream.h"
+#include "gble_time_sync.h"
 
 /* for nvs_storage*/
 #define LOCAL_NAMESPACE "storage"
@@ -81,10 +89,35 @@ gble_sensor_feature sensors[] = {
         .value_range_low = 0,
         .value_range_high = 2,
         .message_type = GBLE_SENSOR_MSG_SUBSCRIBE,
+        .urgent = true,
     },
 };
 
 gble_server gble_server_instance;
+gble_actuator_task gble_actuator_task_instance;
+gble_arbiter gble_arbiter_instance;
+gble_pattern_engine gble_pattern_engine_instance;
+gble_jitter_buffer gble_jitter_buffer_instance;
+gble_time_sync gble_time_sync_instance;
+gble_stream gble_stream_instance;
+#if CONFIG_GBLE_BROADCAST
+gble_broadcast gble_broadcast_instance;
+#endif
+
+// A central leaving takes its subscriptions and its say over the actuators
+void handle_client_disconnected(uint16_t conn_handle, void* context)
+{
+    gatt_svr_client_disconnected_ctx(conn_handle, NULL);
+    gble_client_disconnected(&gble_server_instance, conn_handle);
+}
+
+// Timed commands from the syncing client follow its synced clock instead of
+// guessing the offset
+void handle_time_sync_update(const gble_time_sync_estimate* estimate, void* context)
+{
+    gble_jitter_set_clock_offset(&gble_jitter_buffer_instance, estimate->conn_handle,
+                                 estimate->offset_us, estimate->at_us, estimate->drift_ppb);
+}
 
 void app_main(void)
 {
@@ -105,6 +138,45 @@ void app_main(void)
         esp_restart();
     }
 
+    if (!gble_actuator_task_start(&gble_actuator_task_instance, &gble_server_instance,
+                                  CONFIG_GBLE_ACTUATOR_TASK_PRIORITY))
+    {
+        ESP_LOGE(TAG, "Failed to start actuator task");
+        vTaskDelay(pdMS_TO_TICKS(30000));
+        esp_restart();
+    }
+
+    if (!gble_arbiter_start(&gble_arbiter_instance, &gble_server_instance,
+                            CONFIG_GBLE_ARBITER_POLICY, CONFIG_GBLE_ARBITER_LEASE_MS))
+    {
+        ESP_LOGE(TAG, "Failed to start actuator arbiter");
+        vTaskDelay(pdMS_TO_TICKS(30000));
+        esp_restart();
+    }
+
+    if (!gble_pattern_start(&gble_pattern_engine_instance, &gble_server_instance,
+                            CONFIG_GBLE_PATTERN_TICK_HZ))
+    {
+        ESP_LOGE(TAG, "Failed to start pattern engine");
+        vTaskDelay(pdMS_TO_TICKS(30000));
+        esp_restart();
+    }
+
+    if (!gble_jitter_start(&gble_jitter_buffer_instance, &gble_server_instance,
+                           CONFIG_GBLE_JITTER_TICK_HZ, CONFIG_GBLE_JITTER_DEPTH_MS))
+    {
+        ESP_LOGE(TAG, "Failed to start jitter buffer");
+        vTaskDelay(pdMS_TO_TICKS(30000));
+        esp_restart();
+    }
+
+    if (!gble_stream_start(&gble_stream_instance, &gble_server_instance))
+    {
+        ESP_LOGE(TAG, "Failed to start sensor streaming");
+        vTaskDelay(pdMS_TO_TICKS(30000));
+        esp_restart();
+    }
+
     if (!ble_init(gatt_svr_init))
     {
         ESP_LOGE(TAG, "Failed to initialize ble stack");
@@ -112,13 +184,38 @@ void app_main(void)
         esp_restart();
     }
 
-    ble_func_register_disconnect_cb(gatt_svr_client_disconnected_ctx, NULL);
+    gble_time_sync_init(&gble_time_sync_instance);
+    gble_time_sync_set_update_fn(&gble_time_sync_instance, handle_time_sync_update, NULL);
+
+    ble_func_register_disconnect_cb(handle_client_disconnected, NULL);
     ble_func_register_subscribe_cb(gatt_svr_handle_subscribe_ctx, NULL);
+    ble_func_register_notify_tx_cb(gatt_svr_handle_notify_tx_ctx, NULL);
 
     gatt_svr_register_descriptor_cb(gble_get_descriptor_ctx, &gble_server_instance);
     gatt_svr_register_write_cb(gble_handle_actuators_changed_ctx, &gble_server_instance);
+    gatt_svr_register_write_reader_cb(gble_handle_actuators_changed_reader_ctx, &gble_server_instance);
+    gatt_svr_register_write_activity_cb(ble_conn_profile_note_command_ctx, NULL);
+    gatt_svr_register_time_sync_cb(gble_time_sync_handle_request_ctx, gble_time_sync_get_status_ctx,
+                                   &gble_time_sync_instance);
 
     gble_set_sensor_callback_fn(&gble_server_instance, gatt_svr_set_read_value_ctx, NULL);
+    gatt_svr_register_notify_key_cb(gble_get_sensor_frame_key_ctx, NULL);
+    gble_set_sensor_frame_size_fn(&gble_server_instance, gatt_svr_get_notify_size_max_ctx, NULL);
+    gble_set_sensor_coalescing(&gble_server_instance, CONFIG_GBLE_SENSOR_COALESCE_MS);
+    gble_stream_set_frame_size_fn(&gble_stream_instance, gatt_svr_get_notify_size_max_ctx, NULL);
+
+#if CONFIG_GBLE_BROADCAST
+    // Observers that only watch the sensors need no connection
+    if (!gble_broadcast_start(&gble_broadcast_instance, &gble_server_instance,
+                              CONFIG_GBLE_BROADCAST_INTERVAL_MS, ble_func_get_broadcast_size_max()))
+    {
+        ESP_LOGE(TAG, "Failed to start sensor broadcast");
+        vTaskDelay(pdMS_TO_TICKS(30000));
+        esp_restart();
+    }
+
+    gble_broadcast_set_data_fn(&gble_broadcast_instance, ble_func_set_broadcast_data_ctx, NULL);
+#endif
 
     ESP_LOGI(TAG, "BLE init ok");
 